@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Compare the build variants of the open62541 apps. Every app is built as
+# debug, release, lto and pgo and its training workload ('make train') is
+# run against each build. The rates the workload reports are printed per
+# variant with the change relative to the debug build.
+#
+# The pgo build is trained with the same workload it is measured with, so
+# its gain is an upper bound for other loads. The servers listen on their
+# default port 4840 during the run, which has to be free.
+#
+# Usage: ./compare-builds.sh [-t seconds] [APP...]
+#
+# APP is the name of an app directory, e.g. fillsensor-server, all apps by
+# default.
+
+# treat undefined variables as an error
+set -u
+
+seconds=10
+if [ "${1:-}" = "-t" ]; then
+  seconds="$2"
+  shift 2
+fi
+
+root="$(cd "$(dirname "$0")" && pwd)"
+if [ $# -eq 0 ]; then
+  set -- discovery-server fillsensor-server fleet-host plc-logic-client plc-server valve-server
+fi
+
+variants="debug release lto pgo"
+results="$(mktemp -d)"
+trap 'rm -rf "$results"' EXIT
+
+# run the workload of an app built as variant, keep the reported rates,
+# e.g. '1234 requests/s', and sum rates of the same kind
+measure() {
+  make -C "$1" -s BUILD="$2" TRAIN_SECONDS="$seconds" train 2>/dev/null |
+    grep -o '[0-9][0-9.]* [a-z]*/s' |
+    awk '{ sum[$2] += $1 } END { for(rate in sum) print rate, sum[rate] }' |
+    sort
+}
+
+for app in "$@"; do
+  dir="$root/$app/open62541/latest/app"
+  if [ ! -f "$dir/Makefile" ]; then
+    echo "$app: no Makefile in $dir" >&2
+    continue
+  fi
+
+  for variant in $variants; do
+    if [ "$variant" = pgo ]; then
+      make -C "$dir" -s pgo TRAIN_SECONDS="$seconds" > /dev/null 2>&1
+    else
+      make -C "$dir" -s BUILD="$variant" all bench > /dev/null 2>&1
+    fi
+    if [ $? -ne 0 ]; then
+      echo "$app: $variant build failed" >&2
+      : > "$results/$variant"
+      continue
+    fi
+    measure "$dir" "$variant" > "$results/$variant"
+  done
+
+  echo "$app"
+  for variant in $variants; do
+    awk -v variant="$variant" -v baseline="$results/debug" '
+      BEGIN {
+        while((getline line < baseline) > 0) {
+          split(line, field, " ")
+          debug[field[1]] = field[2]
+        }
+      }
+      {
+        change = debug[$1] > 0 ? sprintf("%+.1f%%", 100 * ($2 / debug[$1] - 1)) : "-"
+        printf "  %-8s %-18s %12.0f %8s\n", variant, $1, $2, change
+      }' "$results/$variant"
+  done
+done
@@ -0,0 +1,168 @@
+#include <argp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <open62541/types.h>
+#include "asynclog.h"
+#include "netfault.h"
+
+
+/*
+ * Signal handling
+ */
+static volatile UA_Boolean running = true;
+
+static void stopHandler(int signum)
+{
+    running = false;
+}
+
+/*
+ * Argparser
+ */
+const char* argp_program_version = "discovery-server 0.1";
+const char* argp_program_bug_address = "las3@oth-regensburg.de";
+static char doc[] = "OPC UA local discovery server -- keeps track of the sensor and valve servers";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"port",    'p', "PORT",    0, "Port to listen on [default: 4840]" },
+    {"cleanup", 't', "SECONDS", 0, "Drop servers that did not renew their registration [default: 180]" },
+    {"net-profile", 'n', "PROFILE", 0, "Impair the client connections, e.g. 'wifi' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'" },
+    {0},
+};
+
+struct arguments
+{
+    UA_UInt16 port;
+    UA_UInt32 cleanup;
+    char *netprofile;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'p':
+        {
+            arguments->port = (UA_UInt16)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 't':
+        {
+            arguments->cleanup = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'n':
+        {
+            arguments->netprofile = arg;
+            break;
+        }
+         default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+/*
+ * Create a server, with its connections impaired if a network profile is
+ * given
+ */
+static UA_Server *newServer(const char *netprofile)
+{
+    if(!netprofile)
+    {
+        return UA_Server_new();
+    }
+
+    NetFaultProfile profile;
+    if(parseNetFaultProfile(netprofile, &profile) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Invalid network profile '%s'", netprofile);
+        return NULL;
+    }
+
+    UA_ServerConfig config;
+    memset(&config, 0, sizeof(UA_ServerConfig));
+    config.eventLoop = newFaultyEventLoop(&profile, asyncLog);
+    if(!config.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ServerConfig_setDefault(&config);
+    return UA_Server_newWithConfig(&config);
+}
+
+
+int main(int argc, char **argv)
+{
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    /*
+     * Default arguments. The servers renew their registration every
+     * 60 seconds, so one missed renewal is tolerated.
+     */
+    struct arguments arguments = {
+        .port = 4840,
+        .cleanup = 180,
+        .netprofile = NULL,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
+    UA_StatusCode retval = 0;
+
+    /*
+     * Create and setup server
+     */
+    UA_Server *server = newServer(arguments.netprofile);
+    if(!server)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to create discovery server");
+        retval = UA_STATUSCODE_BAD;
+        goto cleanup;
+    }
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    retval = UA_ServerConfig_setMinimal(config, arguments.port, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to configure discovery server");
+        goto cleanup_server;
+    }
+
+    config->applicationDescription.applicationType = UA_APPLICATIONTYPE_DISCOVERYSERVER;
+    UA_String_clear(&config->applicationDescription.applicationUri);
+    config->applicationDescription.applicationUri = UA_String_fromChars("urn:sim-images:discovery-server");
+    config->discoveryCleanupTimeout = arguments.cleanup;
+
+    /*
+     * Start event loop unless Ctrl-C has already been received
+     */
+    if(running)
+    {
+        retval = UA_Server_run(server, &running);
+    }
+
+cleanup_server:
+    UA_Server_delete(server);
+
+cleanup:
+    stopAsyncLogger();
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <open62541/types.h>
+#include <stdatomic.h>
+
+/*
+ * Registry of the runtime metrics of a process. Counters and latency
+ * histograms are kept in per-thread shards that are only updated with
+ * relaxed atomic operations, so recording a value never takes a lock. The
+ * shards are summed up when a metric is read, which is safe from any
+ * thread.
+ */
+#define METRICS_MAX 32
+#define METRICS_MAX_THREADS 8
+
+/*
+ * Upper bounds of the latency buckets in microseconds, the last bucket
+ * collects everything above
+ */
+#define METRICS_LATENCY_BOUNDS {10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000}
+#define METRICS_LATENCY_BUCKETS 12
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_LATENCY,
+} MetricType;
+
+/*
+ * Gauges can be sampled from a source that is not thread-safe, e.g. the
+ * statistics of the server. refreshSampledGauges() has to be called from
+ * the thread owning the source and caches the values for readers.
+ */
+typedef UA_Int64 (*MetricSampler)(void *samplerContext);
+
+typedef struct {
+    const char *name;
+    const char *description;
+    MetricType type;
+    size_t slot;                /* first slot in the per-thread shards */
+    _Atomic UA_Int64 gauge;
+    MetricSampler sampler;
+    void *samplerContext;
+} Metric;
+
+extern const UA_UInt64 metricsLatencyBounds[METRICS_LATENCY_BUCKETS - 1];
+
+/*
+ * Register a metric, before any other thread reads the registry. Returns
+ * NULL if METRICS_MAX is exceeded, updates of a NULL metric are ignored.
+ */
+Metric *registerMetric(const char *name, const char *description, MetricType type);
+
+Metric *registerSampledGauge(const char *name, const char *description,
+                             MetricSampler sampler, void *samplerContext);
+
+void addCounter(Metric *metric, UA_UInt64 value);
+
+void setGauge(Metric *metric, UA_Int64 value);
+
+void addGauge(Metric *metric, UA_Int64 value);
+
+/*
+ * Record a latency in microseconds
+ */
+void recordLatency(Metric *metric, UA_Int64 value);
+
+/*
+ * Record the time since start, taken with UA_DateTime_nowMonotonic
+ */
+void recordLatencySince(Metric *metric, UA_DateTime start);
+
+void refreshSampledGauges(void);
+
+/*
+ * Registered metrics and their aggregated values
+ */
+size_t getMetricsSize(void);
+
+Metric *getMetric(size_t index);
+
+UA_UInt64 getCounterValue(const Metric *metric);
+
+UA_Int64 getGaugeValue(const Metric *metric);
+
+void getLatencyValues(const Metric *metric, UA_UInt64 buckets[METRICS_LATENCY_BUCKETS],
+                      UA_UInt64 *count, UA_UInt64 *sum);
+
+#endif
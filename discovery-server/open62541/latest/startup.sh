@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# treat undefined variables as an error
+set -u
+
+# if PORT is set, listen on that port
+port_opt=""
+if [ -n "${PORT:-}" ]; then
+  port_opt="--port=${PORT}"
+fi
+
+# if CLEANUP_TIMEOUT is set, drop servers that did not renew their
+# registration within that many seconds
+cleanup_opt=""
+if [ -n "${CLEANUP_TIMEOUT:-}" ]; then
+  cleanup_opt="--cleanup=${CLEANUP_TIMEOUT}"
+fi
+
+# if NET_PROFILE is set, impair the connections of the clients, e.g. for
+# testing the registration and discovery over a wifi or congested link
+net_profile_opt=""
+if [ -n "${NET_PROFILE:-}" ]; then
+  net_profile_opt="--net-profile=${NET_PROFILE}"
+fi
+
+# if no ENV is set, the binary is started with defaults
+/usr/local/bin/discovery-server $port_opt $cleanup_opt $net_profile_opt
@@ -0,0 +1,398 @@
+/*
+ * Synthetic client load for the open62541 servers of this repository. It
+ * is the training workload of the profile-guided build ('make pgo') and
+ * the workload compare-builds.sh measures the build variants with. Any
+ * combination of
+ *
+ *   - a subscription flood: several subscriptions, each monitoring the
+ *     variable at -s with the fastest sampling the server allows
+ *   - a write load: the variable at -w is written back to back with a
+ *     value that changes on every write
+ *   - a method-call load: the method at -c is called back to back without
+ *     input arguments
+ *   - a discovery load: FindServers requests back to back
+ *
+ * runs on a single session for the given time. Browse paths start at the
+ * Objects folder and use names in namespace 1, e.g. tank1/FillPercentage.
+ *
+ * Usage: loadgen [-u URL] [-t seconds] [-n subscriptions] [-s PATH]
+ *                [-w PATH] [-c PATH] [-f]
+ */
+#include <argp.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/client_subscriptions.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CONNECT_TIMEOUT_MS 10000
+#define CONNECT_RETRY_MS 200
+#define MAX_PATH_ELEMENTS 8
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "loadgen 0.1";
+static char doc[] = "Generates subscription, write, method-call and discovery load on an OPC UA server";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"url",           'u', "URL",     0, "Server URL [default: opc.tcp://127.0.0.1:4840]" },
+    {"time",          't', "SECONDS", 0, "Duration of the load [default: 10]" },
+    {"subscriptions", 'n', "N",       0, "Number of subscriptions of the flood [default: 20]" },
+    {"subscribe",     's', "PATH",    0, "Variable to flood with subscriptions" },
+    {"write",         'w', "PATH",    0, "Variable to write back to back" },
+    {"call",          'c', "PATH",    0, "Method to call back to back, its parent is the object" },
+    {"find-servers",  'f', 0,         0, "Send FindServers requests back to back" },
+    { 0 }
+};
+
+struct arguments
+{
+    char *url;
+    UA_UInt32 time;
+    size_t subscriptions;
+    char *subscribe;
+    char *write;
+    char *call;
+    UA_Boolean findServers;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'u': {
+            arguments->url = arg;
+            break;
+        }
+        case 't': {
+            arguments->time = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'n': {
+            arguments->subscriptions = strtoul(arg, NULL, 10);
+            break;
+        }
+        case 's': {
+            arguments->subscribe = arg;
+            break;
+        }
+        case 'w': {
+            arguments->write = arg;
+            break;
+        }
+        case 'c': {
+            arguments->call = arg;
+            break;
+        }
+        case 'f': {
+            arguments->findServers = true;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+static UA_UInt64 notifications = 0;
+
+static void valueChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
+                         UA_UInt32 monId, void *monContext, UA_DataValue *value)
+{
+    notifications++;
+}
+
+
+/*
+ * Resolve a browse path and the path of its parent, which is the Objects
+ * folder for a single element
+ */
+static UA_StatusCode resolvePath(UA_Client *client, const char *path,
+                                 UA_NodeId *nodeId, UA_NodeId *parentId)
+{
+    char names[256];
+    if(strlen(path) >= sizeof(names))
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+    strcpy(names, path);
+
+    UA_RelativePathElement elements[MAX_PATH_ELEMENTS];
+    size_t elementsSize = 0;
+    for(char *name = strtok(names, "/"); name; name = strtok(NULL, "/"))
+    {
+        if(elementsSize == MAX_PATH_ELEMENTS)
+        {
+            return UA_STATUSCODE_BADBROWSENAMEINVALID;
+        }
+        UA_RelativePathElement *element = &elements[elementsSize++];
+        UA_RelativePathElement_init(element);
+        element->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+        element->includeSubtypes = true;
+        element->targetName = UA_QUALIFIEDNAME(1, name);
+    }
+    if(elementsSize == 0)
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+
+    UA_BrowsePath paths[2];
+    for(size_t i = 0; i < 2; i++)
+    {
+        UA_BrowsePath_init(&paths[i]);
+        paths[i].startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        paths[i].relativePath.elements = elements;
+    }
+    paths[0].relativePath.elementsSize = elementsSize;
+    paths[1].relativePath.elementsSize = elementsSize - 1;
+
+    UA_TranslateBrowsePathsToNodeIdsRequest request;
+    UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
+    request.browsePaths = paths;
+    request.browsePathsSize = elementsSize > 1 ? 2 : 1;
+    UA_TranslateBrowsePathsToNodeIdsResponse response =
+        UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != request.browsePathsSize)
+    {
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < response.resultsSize; i++)
+    {
+        if(response.results[i].statusCode != UA_STATUSCODE_GOOD || response.results[i].targetsSize < 1)
+        {
+            retval = UA_STATUSCODE_BADNOTFOUND;
+        }
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        UA_NodeId_copy(&response.results[0].targets[0].targetId.nodeId, nodeId);
+        if(elementsSize > 1)
+        {
+            UA_NodeId_copy(&response.results[1].targets[0].targetId.nodeId, parentId);
+        }
+        else
+        {
+            *parentId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        }
+    }
+    UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    return retval;
+}
+
+
+static UA_StatusCode startSubscriptionFlood(UA_Client *client, const UA_NodeId *nodeId,
+                                            size_t subscriptions)
+{
+    for(size_t i = 0; i < subscriptions; i++)
+    {
+        UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+        request.requestedPublishingInterval = 0.;
+        UA_CreateSubscriptionResponse response =
+            UA_Client_Subscriptions_create(client, request, NULL, NULL, NULL);
+        if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+        {
+            return response.responseHeader.serviceResult;
+        }
+
+        UA_MonitoredItemCreateRequest monRequest = UA_MonitoredItemCreateRequest_default(*nodeId);
+        monRequest.requestedParameters.samplingInterval = 0.;
+        UA_MonitoredItemCreateResult monResponse = UA_Client_MonitoredItems_createDataChange(
+            client, response.subscriptionId, UA_TIMESTAMPSTORETURN_BOTH,
+            monRequest, NULL, valueChanged, NULL);
+        if(monResponse.statusCode != UA_STATUSCODE_GOOD)
+        {
+            return monResponse.statusCode;
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Change a value of the type the server holds, so every write causes a
+ * data change. Other types are written back unchanged.
+ */
+static void changeValue(UA_Variant *value, UA_UInt64 counter)
+{
+    if(UA_Variant_hasScalarType(value, &UA_TYPES[UA_TYPES_DOUBLE]))
+    {
+        *(UA_Double*)value->data = (UA_Double)(counter % 100);
+    }
+    else if(UA_Variant_hasScalarType(value, &UA_TYPES[UA_TYPES_BOOLEAN]))
+    {
+        *(UA_Boolean*)value->data = (counter & 1) != 0;
+    }
+    else if(UA_Variant_hasScalarType(value, &UA_TYPES[UA_TYPES_INT32]))
+    {
+        *(UA_Int32*)value->data = (UA_Int32)(counter % 100);
+    }
+    else if(UA_Variant_hasScalarType(value, &UA_TYPES[UA_TYPES_UINT32]))
+    {
+        *(UA_UInt32*)value->data = (UA_UInt32)(counter % 100);
+    }
+}
+
+
+static UA_StatusCode connectWithRetry(UA_Client *client, const char *url)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + CONNECT_TIMEOUT_MS * UA_DATETIME_MSEC;
+    UA_StatusCode retval;
+    while((retval = UA_Client_connect(client, url)) != UA_STATUSCODE_GOOD &&
+          UA_DateTime_nowMonotonic() < end)
+    {
+        usleep(CONNECT_RETRY_MS * 1000);
+    }
+    return retval;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .url = "opc.tcp://127.0.0.1:4840",
+        .time = 10,
+        .subscriptions = 20,
+        .subscribe = NULL,
+        .write = NULL,
+        .call = NULL,
+        .findServers = false,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(!arguments.subscribe && !arguments.write && !arguments.call && !arguments.findServers)
+    {
+        fprintf(stderr, "Nothing to do, use -s, -w, -c or -f\n");
+        return EXIT_FAILURE;
+    }
+
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return EXIT_FAILURE;
+    }
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+
+    UA_NodeId subscribeId = UA_NODEID_NULL;
+    UA_NodeId writeId = UA_NODEID_NULL;
+    UA_NodeId methodId = UA_NODEID_NULL;
+    UA_NodeId objectId = UA_NODEID_NULL;
+    UA_NodeId parentId = UA_NODEID_NULL;
+    UA_Variant writeValue;
+    UA_Variant_init(&writeValue);
+
+    UA_StatusCode retval = connectWithRetry(client, arguments.url);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to connect to %s: %s\n", arguments.url, UA_StatusCode_name(retval));
+        goto cleanup;
+    }
+
+    if(arguments.subscribe)
+    {
+        retval = resolvePath(client, arguments.subscribe, &subscribeId, &parentId);
+        UA_NodeId_clear(&parentId);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = startSubscriptionFlood(client, &subscribeId, arguments.subscriptions);
+        }
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Unable to subscribe to %s: %s\n", arguments.subscribe,
+                    UA_StatusCode_name(retval));
+            goto cleanup;
+        }
+    }
+    if(arguments.write)
+    {
+        retval = resolvePath(client, arguments.write, &writeId, &parentId);
+        UA_NodeId_clear(&parentId);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = UA_Client_readValueAttribute(client, writeId, &writeValue);
+        }
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", arguments.write, UA_StatusCode_name(retval));
+            goto cleanup;
+        }
+    }
+    if(arguments.call)
+    {
+        retval = resolvePath(client, arguments.call, &methodId, &objectId);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Unable to find %s: %s\n", arguments.call, UA_StatusCode_name(retval));
+            goto cleanup;
+        }
+    }
+
+    UA_UInt64 requests = 0;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_DateTime end = start + (UA_DateTime)arguments.time * UA_DATETIME_SEC;
+    UA_DateTime now = start;
+    while(retval == UA_STATUSCODE_GOOD && now < end)
+    {
+        if(arguments.write)
+        {
+            changeValue(&writeValue, requests);
+            retval = UA_Client_writeValueAttribute(client, writeId, &writeValue);
+            requests++;
+        }
+        if(retval == UA_STATUSCODE_GOOD && arguments.call)
+        {
+            size_t outputSize = 0;
+            UA_Variant *output = NULL;
+            retval = UA_Client_call(client, objectId, methodId, 0, NULL, &outputSize, &output);
+            UA_Array_delete(output, outputSize, &UA_TYPES[UA_TYPES_VARIANT]);
+            requests++;
+        }
+        if(retval == UA_STATUSCODE_GOOD && arguments.findServers)
+        {
+            size_t serversSize = 0;
+            UA_ApplicationDescription *servers = NULL;
+            retval = UA_Client_findServers(client, arguments.url, 0, NULL, 0, NULL,
+                                           &serversSize, &servers);
+            UA_Array_delete(servers, serversSize, &UA_TYPES[UA_TYPES_APPLICATIONDESCRIPTION]);
+            requests++;
+        }
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = UA_Client_run_iterate(client, arguments.write || arguments.call ||
+                                                   arguments.findServers ? 0 : 10);
+        }
+        now = UA_DateTime_nowMonotonic();
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Load stopped: %s\n", UA_StatusCode_name(retval));
+    }
+
+    UA_Double seconds = (UA_Double)(now - start) / UA_DATETIME_SEC;
+    printf("%llu requests, %llu notifications in %.1f s (%.0f requests/s, %.0f notifications/s)\n",
+           (unsigned long long)requests, (unsigned long long)notifications, seconds,
+           seconds > 0. ? (UA_Double)requests / seconds : 0.,
+           seconds > 0. ? (UA_Double)notifications / seconds : 0.);
+
+cleanup:
+    UA_Variant_clear(&writeValue);
+    UA_NodeId_clear(&subscribeId);
+    UA_NodeId_clear(&writeId);
+    UA_NodeId_clear(&methodId);
+    UA_NodeId_clear(&objectId);
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <open62541/server.h>
+
+/*
+ * Threshold alarm of a fill level, evaluated on the server whenever the
+ * level or the threshold is written. Crossing the threshold emits an event
+ * of ThresholdCrossingEventType from the tank object, which is a notifier
+ * of the Server object. Clients subscribe to the events of either object
+ * instead of polling the values, and can pass a where clause that the
+ * server evaluates, e.g. OfType ThresholdCrossingEventType or a minimum
+ * Severity to receive the rising crossings only.
+ *
+ * The level rises above the threshold once it exceeds it and falls below
+ * once it is less than the threshold minus the hysteresis, so a level
+ * hovering at the threshold emits no event on every sample. The first
+ * level seen sets the state without an event.
+ */
+#define ALARM_SEVERITY_RISING 700
+#define ALARM_SEVERITY_FALLING 300
+
+extern UA_NodeId thresholdCrossingEventTypeIdent;
+
+typedef struct {
+    UA_NodeId sourceIdent;
+    char *sourceName;
+    UA_Double threshold;
+    UA_Double hysteresis;
+    UA_Boolean hasThreshold;
+    UA_Boolean hasLevel;
+    UA_Double level;
+    UA_Boolean above;
+} ThresholdAlarm;
+
+/*
+ * Define ThresholdCrossingEventType with its properties Threshold,
+ * FillPercentage and Rising below BaseEventType, once per server before
+ * the alarms are initialized
+ */
+UA_StatusCode defineThresholdCrossingEventType(UA_Server *server);
+
+/*
+ * Make the source object an event notifier below the Server object. The
+ * alarm stays silent until a threshold is set.
+ */
+UA_StatusCode initThresholdAlarm(UA_Server *server, ThresholdAlarm *alarm,
+                                 const UA_NodeId *sourceIdent, char *sourceName,
+                                 UA_Double hysteresis);
+
+void setAlarmThreshold(UA_Server *server, ThresholdAlarm *alarm, UA_Double threshold);
+
+void setAlarmLevel(UA_Server *server, ThresholdAlarm *alarm, UA_Double level);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <open62541/plugin/log.h>
+
+/*
+ * Logger that takes the write to stdout off the calling thread. A log call
+ * formats the message into a fixed-size record of a lock-free ring buffer,
+ * a background thread adds the timestamp prefix and flushes the records in
+ * batches. When the ring buffer is full, records are dropped and counted
+ * instead of blocking the caller. Messages longer than a record are
+ * truncated.
+ *
+ * Until startAsyncLogger() and after stopAsyncLogger(), messages are
+ * written synchronously through UA_Log_Stdout.
+ */
+#define ASYNCLOG_RECORDS 1024       /* power of two */
+#define ASYNCLOG_MESSAGE_SIZE 224
+
+extern const UA_Logger *asyncLog;
+
+/*
+ * Start the background thread. Call before other threads are started, it
+ * registers the metric of dropped records.
+ */
+UA_StatusCode startAsyncLogger(void);
+
+/*
+ * Write the remaining records and stop the background thread
+ */
+void stopAsyncLogger(void);
+
+#endif
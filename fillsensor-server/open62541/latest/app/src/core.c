@@ -1,10 +1,19 @@
 #include <argp.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
+#include <open62541/server_config_default.h>
 #include <open62541/types.h>
+#include "alarm.h"
+#include "asynclog.h"
+#include "diagnostics.h"
+#include "discovery.h"
+#include "exporter.h"
+#include "netfault.h"
 #include "tank.h"
+#include "tank_state.h"
 #include "utils.h"
 
 
@@ -26,11 +35,24 @@ const char* argp_program_bug_address = "las3@oth-regensburg.de";
 static char doc[] = "OPC UA server -- simulates a sensor for water level measurements";
 static char args_doc[] = "";
 static struct argp_option options[] = {
+    {"metrics",         'm', "[ADDR:]PORT", 0, "Serve Prometheus metrics over HTTP" },
+    {"lds",             'l', "URL",         0, "Register with the local discovery server at URL" },
+    {"application-uri", 'u', "URI",         0, "Application URI [default: urn:sim-images:fillsensor-server:<hostname>]" },
+    {"net-profile",     'n', "PROFILE",     0, "Impair the client connections, e.g. 'wifi' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'" },
+    {"alarm-threshold", 't', "PCT",         0, "Emit an event when the fill percentage crosses PCT [default: no events]" },
+    {"alarm-hysteresis",'H', "PCT",         0, "Fill level below the threshold to end an exceedance [default: 1.0]" },
     {0},
 };
 
 struct arguments
 {
+    char *metrics;
+    char *lds;
+    char *applicationUri;
+    char *netprofile;
+    UA_Boolean alarm;
+    UA_Double alarmThreshold;
+    UA_Double alarmHysteresis;
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -38,6 +60,47 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     struct arguments *arguments = state->input;
     switch(key)
     {
+        case 'm':
+        {
+            arguments->metrics = arg;
+            break;
+        }
+        case 'l':
+        {
+            arguments->lds = arg;
+            break;
+        }
+        case 'u':
+        {
+            arguments->applicationUri = arg;
+            break;
+        }
+        case 'n':
+        {
+            arguments->netprofile = arg;
+            break;
+        }
+        case 't':
+        {
+            char *end;
+            arguments->alarmThreshold = strtod(arg, &end);
+            if(end == arg || *end != '\0')
+            {
+                argp_error(state, "invalid alarm threshold '%s'", arg);
+            }
+            arguments->alarm = true;
+            break;
+        }
+        case 'H':
+        {
+            char *end;
+            arguments->alarmHysteresis = strtod(arg, &end);
+            if(end == arg || *end != '\0' || !(arguments->alarmHysteresis >= 0.))
+            {
+                argp_error(state, "invalid alarm hysteresis '%s'", arg);
+            }
+            break;
+        }
          default: {
             return ARGP_ERR_UNKNOWN;
         }
@@ -48,6 +111,81 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
 
+/*
+ * Tank of the sensor, the node context of its fill percentage. The
+ * sensor knows no valve, and the threshold only if the alarm is enabled.
+ */
+typedef struct {
+    ThresholdAlarm alarm;
+    UA_Boolean alarmEnabled;
+    UA_NodeId stateNodeIdent;
+    TankState state;
+} SensorTank;
+
+
+/*
+ * Called after the fill percentage has been written by the process
+ * simulation, counts the notifications it causes, updates the state of
+ * the tank and evaluates its threshold alarm, if any
+ */
+static void fillPercentageWrittenCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range, const UA_DataValue *data)
+{
+    recordValueChange(nodeId);
+    if(!data->hasValue || !UA_Variant_hasScalarType(&data->value, &UA_TYPES[UA_TYPES_DOUBLE]))
+    {
+        return;
+    }
+
+    SensorTank *tank = (SensorTank*)nodeContext;
+    UA_Double level = *(UA_Double*)data->value.data;
+    tank->state.fillPercentage = level;
+    tank->state.fillPercentageTimestamp = data->hasSourceTimestamp ? data->sourceTimestamp
+                                                                   : UA_DateTime_now();
+    writeTankState(server, &tank->stateNodeIdent, &tank->state);
+    recordValueChange(&tank->stateNodeIdent);
+
+    if(tank->alarmEnabled)
+    {
+        setAlarmLevel(server, &tank->alarm, level);
+    }
+}
+
+
+/*
+ * Create a server, with its connections impaired if a network profile is
+ * given
+ */
+static UA_Server *newServer(const char *netprofile)
+{
+    if(!netprofile)
+    {
+        return UA_Server_new();
+    }
+
+    NetFaultProfile profile;
+    if(parseNetFaultProfile(netprofile, &profile) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Invalid network profile '%s'", netprofile);
+        return NULL;
+    }
+
+    UA_ServerConfig config;
+    memset(&config, 0, sizeof(UA_ServerConfig));
+    config.eventLoop = newFaultyEventLoop(&profile, asyncLog);
+    if(!config.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ServerConfig_setDefault(&config);
+    return UA_Server_newWithConfig(&config);
+}
+
+
 int main(int argc, char **argv)
 {
     signal(SIGINT, stopHandler);
@@ -57,18 +195,30 @@ int main(int argc, char **argv)
      * Default arguments
      */
     struct arguments arguments = {
+        .metrics = NULL,
+        .lds = NULL,
+        .applicationUri = NULL,
+        .netprofile = NULL,
+        .alarm = false,
+        .alarmThreshold = 0.,
+        .alarmHysteresis = 1.0,
     };
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
     UA_StatusCode retval = 0;
 
     /*
      * Create and setup server
      */
-    UA_Server *server = UA_Server_new();
+    UA_Server *server = newServer(arguments.netprofile);
     if(!server)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create sensor server");
         retval = UA_STATUSCODE_BAD;
         goto cleanup;
@@ -79,10 +229,17 @@ int main(int argc, char **argv)
      */
     UA_QualifiedName qn;
     UA_NodeId tank1Ident;
+    retval = defineTankStateDataType(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define tank state data type");
+        goto cleanup_server;
+    }
     retval = defineWaterTankObjectType(server);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to define water tank object type");
         goto cleanup_server;
     }
@@ -90,7 +247,7 @@ int main(int argc, char **argv)
     retval = addWaterTankObjectInstance(server, "tank1", &tank1Ident);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add water tank instance to server");
         goto cleanup_server;
     }
@@ -100,7 +257,7 @@ int main(int argc, char **argv)
     retval = findAttributeNodeId(server, &tank1Ident, &qn, &deviceIdNode);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'DeviceID");
         goto cleanup_server;
     }
@@ -114,7 +271,7 @@ int main(int argc, char **argv)
     retval = findAttributeNodeId(server, &tank1Ident, &qn, &locationNode);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'Location'");
         goto cleanup_server;
     }
@@ -128,7 +285,7 @@ int main(int argc, char **argv)
     retval = findAttributeNodeId(server, &tank1Ident, &qn, &capacityNode);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'Capacity'");
         goto cleanup_server;
     }
@@ -142,7 +299,7 @@ int main(int argc, char **argv)
     retval = findAttributeNodeId(server, &tank1Ident, &qn, &fillPercentageNode);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'FillPercentage'");
         goto cleanup_server;
     }
@@ -151,15 +308,125 @@ int main(int argc, char **argv)
     UA_Variant_setScalar(&fillPercentageValue, &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE]);
     UA_Server_writeValue(server, fillPercentageNode, fillPercentageValue);
 
+    SensorTank tank;
+    memset(&tank, 0, sizeof(SensorTank));
+    qn = UA_QUALIFIEDNAME(1, "State");
+    retval = findAttributeNodeId(server, &tank1Ident, &qn, &tank.stateNodeIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'State'");
+        goto cleanup_server;
+    }
+
+    /*
+     * Crossings of the alarm threshold are emitted as events of the tank
+     */
+    if(arguments.alarm)
+    {
+        retval = defineThresholdCrossingEventType(server);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to define threshold crossing event type");
+            goto cleanup_server;
+        }
+        retval = initThresholdAlarm(server, &tank.alarm, &tank1Ident, "tank1",
+                                    arguments.alarmHysteresis);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            goto cleanup_server;
+        }
+        setAlarmThreshold(server, &tank.alarm, arguments.alarmThreshold);
+        tank.alarmEnabled = true;
+        tank.state.threshold = arguments.alarmThreshold;
+        tank.state.thresholdTimestamp = UA_DateTime_now();
+    }
+    writeTankState(server, &tank.stateNodeIdent, &tank.state);
+    UA_Server_setNodeContext(server, fillPercentageNode, &tank);
+
+    UA_ValueCallback callback = {NULL, fillPercentageWrittenCallback};
+    retval = UA_Server_setVariableNode_valueCallback(server, fillPercentageNode, callback);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add write callback to 'FillPercentage'");
+        goto cleanup_server;
+    }
+
+    /*
+     * The application URI identifies the server at the discovery server
+     */
+    retval = setServerApplication(server, arguments.applicationUri, "fillsensor-server", NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to set the application description");
+        goto cleanup_server;
+    }
+
+    /*
+     * Publish the runtime metrics
+     */
+    retval = addDiagnostics(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add diagnostics to server");
+        goto cleanup_server;
+    }
+
+    /*
+     * The metrics endpoint is optional, the server runs without it
+     */
+    MetricsExporter exporter;
+    UA_Boolean exporting = false;
+    if(arguments.metrics)
+    {
+        exporting = startMetricsExporter(&exporter, arguments.metrics, "fillsensor_server") == UA_STATUSCODE_GOOD;
+    }
+
     /*
      * Start event loop unless Ctrl-C has already been received
      */
-    if(!running) goto cleanup_server;
-    retval = UA_Server_run(server, &running);
+    if(running)
+    {
+        retval = UA_Server_run_startup(server);
+    }
+    if(running && retval == UA_STATUSCODE_GOOD)
+    {
+        /*
+         * Registration with the discovery server is optional, a failed
+         * request is retried by the event loop
+         */
+        DiscoveryRegistration registration;
+        if(arguments.lds)
+        {
+            startDiscoveryRegistration(server, &registration, arguments.lds);
+        }
+
+        while(running)
+        {
+            iterateServerWithMetrics(server);
+        }
+
+        if(arguments.lds)
+        {
+            stopDiscoveryRegistration(server, &registration);
+            flushDiscoveryRequests(server);
+        }
+        retval = UA_Server_run_shutdown(server);
+    }
+
+    if(exporting)
+    {
+        stopMetricsExporter(&exporter);
+    }
 
 cleanup_server:
     UA_Server_delete(server);
 
 cleanup:
+    stopAsyncLogger();
     return retval = UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
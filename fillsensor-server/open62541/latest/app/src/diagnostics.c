@@ -0,0 +1,440 @@
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <stdio.h>
+#include "asynclog.h"
+#include "diagnostics.h"
+
+#define DIAGNOSTICS_MAX_MONITORED_NODES 32
+
+/*
+ * Monitored items per node, maintained by the server callback
+ */
+typedef struct {
+    UA_NodeId nodeId;
+    UA_UInt32 monitoredItems;
+} MonitoredNode;
+
+static MonitoredNode monitoredNodes[DIAGNOSTICS_MAX_MONITORED_NODES];
+static size_t monitoredNodesSize = 0;
+
+static Metric *monitoredItemsMetric = NULL;
+static Metric *notificationsMetric = NULL;
+static Metric *eventLoopMetric = NULL;
+
+static const char *metricTypeNames[] = {"counter", "gauge", "latency"};
+
+
+/*
+ * Notifications are estimated from value changes, as every monitored item
+ * on a changed node queues one notification
+ */
+static MonitoredNode *findMonitoredNode(const UA_NodeId *nodeId)
+{
+    for(size_t i = 0; i < monitoredNodesSize; i++)
+    {
+        if(UA_NodeId_equal(&monitoredNodes[i].nodeId, nodeId))
+        {
+            return &monitoredNodes[i];
+        }
+    }
+    return NULL;
+}
+
+
+void recordValueChange(const UA_NodeId *nodeId)
+{
+    MonitoredNode *node = findMonitoredNode(nodeId);
+    if(node && node->monitoredItems > 0)
+    {
+        addCounter(notificationsMetric, node->monitoredItems);
+    }
+}
+
+
+static void monitoredItemRegisterCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_UInt32 attributeId, UA_Boolean removed)
+{
+    addGauge(monitoredItemsMetric, removed ? -1 : 1);
+    if(attributeId != UA_ATTRIBUTEID_VALUE)
+    {
+        return;
+    }
+
+    MonitoredNode *node = findMonitoredNode(nodeId);
+    if(!node)
+    {
+        if(removed || monitoredNodesSize >= DIAGNOSTICS_MAX_MONITORED_NODES)
+        {
+            return;
+        }
+        node = &monitoredNodes[monitoredNodesSize];
+        if(UA_NodeId_copy(nodeId, &node->nodeId) != UA_STATUSCODE_GOOD)
+        {
+            return;
+        }
+        node->monitoredItems = 0;
+        monitoredNodesSize++;
+    }
+
+    if(removed)
+    {
+        node->monitoredItems -= node->monitoredItems > 0 ? 1 : 0;
+    }
+    else
+    {
+        node->monitoredItems++;
+    }
+}
+
+
+void initInstrumentedMethod(InstrumentedMethod *instrumented, const char *name,
+                            UA_MethodCallback method, void *methodContext)
+{
+    instrumented->method = method;
+    instrumented->methodContext = methodContext;
+    snprintf(instrumented->callsName, sizeof(instrumented->callsName), "%sCalls", name);
+    snprintf(instrumented->errorsName, sizeof(instrumented->errorsName), "%sErrors", name);
+    snprintf(instrumented->latencyName, sizeof(instrumented->latencyName), "%sLatency", name);
+    instrumented->calls = registerMetric(instrumented->callsName, "Number of method calls", METRIC_COUNTER);
+    instrumented->errors = registerMetric(instrumented->errorsName, "Number of failed method calls", METRIC_COUNTER);
+    instrumented->latency = registerMetric(instrumented->latencyName, "Method call latency", METRIC_LATENCY);
+}
+
+
+UA_StatusCode instrumentedMethodCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    InstrumentedMethod *instrumented = (InstrumentedMethod*)methodContext;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_StatusCode retval = instrumented->method(server, sessionId, sessionContext,
+                                                methodId, instrumented->methodContext,
+                                                objectId, objectContext,
+                                                inputSize, input, outputSize, output);
+    recordLatencySince(instrumented->latency, start);
+    addCounter(instrumented->calls, 1);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        addCounter(instrumented->errors, 1);
+    }
+    return retval;
+}
+
+
+/*
+ * Sampled from the server statistics in the event loop, as the server
+ * must not be accessed from other threads
+ */
+static UA_Int64 sampleSessions(void *samplerContext)
+{
+    return UA_Server_getStatistics((UA_Server*)samplerContext).ss.currentSessionCount;
+}
+
+
+static UA_Int64 sampleSecureChannels(void *samplerContext)
+{
+    return UA_Server_getStatistics((UA_Server*)samplerContext).scs.currentChannelCount;
+}
+
+
+/*
+ * Read callbacks of the metric variables
+ */
+static UA_StatusCode readCounter(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    UA_UInt64 result = getCounterValue((const Metric*)nodeContext);
+    UA_StatusCode retval = UA_Variant_setScalarCopy(&value->value, &result, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+static UA_StatusCode readGauge(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    const Metric *metric = (const Metric*)nodeContext;
+    UA_Int64 result = metric->sampler ? metric->sampler(metric->samplerContext) : getGaugeValue(metric);
+    UA_StatusCode retval = UA_Variant_setScalarCopy(&value->value, &result, &UA_TYPES[UA_TYPES_INT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+static UA_StatusCode readLatencyCount(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    UA_UInt64 buckets[METRICS_LATENCY_BUCKETS];
+    UA_UInt64 result, sum;
+    getLatencyValues((const Metric*)nodeContext, buckets, &result, &sum);
+    UA_StatusCode retval = UA_Variant_setScalarCopy(&value->value, &result, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+static UA_StatusCode readLatencySum(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    UA_UInt64 buckets[METRICS_LATENCY_BUCKETS];
+    UA_UInt64 count, result;
+    getLatencyValues((const Metric*)nodeContext, buckets, &count, &result);
+    UA_StatusCode retval = UA_Variant_setScalarCopy(&value->value, &result, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+static UA_StatusCode readLatencyBuckets(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    UA_UInt64 buckets[METRICS_LATENCY_BUCKETS];
+    UA_UInt64 count, sum;
+    getLatencyValues((const Metric*)nodeContext, buckets, &count, &sum);
+    UA_StatusCode retval = UA_Variant_setArrayCopy(&value->value, buckets, METRICS_LATENCY_BUCKETS,
+                                                   &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+/*
+ * Node creation
+ */
+static UA_StatusCode addProperty(UA_Server *server, UA_UInt16 ns, const UA_NodeId *parent,
+                                 char *name, const UA_Variant *value)
+{
+    UA_VariableAttributes pAttr = UA_VariableAttributes_default;
+    pAttr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    pAttr.dataType = value->type->typeId;
+    pAttr.valueRank = UA_Variant_isScalar(value) ? UA_VALUERANK_SCALAR : UA_VALUERANK_ONE_DIMENSION;
+    pAttr.value = *value;
+    UA_StatusCode retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, *parent,
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY),
+                                                     UA_QUALIFIEDNAME(ns, name),
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_PROPERTYTYPE),
+                                                     pAttr, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add property '%s'. Exiting with code %u",
+                    name, retval);
+    }
+    return retval;
+}
+
+
+static UA_StatusCode addMetricVariable(UA_Server *server, UA_UInt16 ns, const UA_NodeId *parent,
+                                       const char *nodeName, char *name, char *description,
+                                       const UA_DataType *type, UA_Int32 valueRank,
+                                       UA_DataSource dataSource, Metric *metric, UA_NodeId *outNodeId)
+{
+    UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+    vAttr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    vAttr.description = UA_LOCALIZEDTEXT("en-US", description);
+    vAttr.dataType = type->typeId;
+    vAttr.valueRank = valueRank;
+    vAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_StatusCode retval = UA_Server_addDataSourceVariableNode(server, UA_NODEID_STRING(ns, (char*)nodeName),
+                                                               *parent,
+                                                               UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                                               UA_QUALIFIEDNAME(ns, name),
+                                                               UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                                               vAttr, dataSource, metric, outNodeId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node '%s'. Exiting with code %u",
+                    nodeName, retval);
+    }
+    return retval;
+}
+
+
+/*
+ * Latency metrics are objects with the sample count, the sum of all
+ * samples and the bucket counts. The bucket bounds are a property.
+ */
+static UA_StatusCode addLatencyObject(UA_Server *server, UA_UInt16 ns, const UA_NodeId *parent,
+                                      Metric *metric, UA_NodeId *outNodeId)
+{
+    char nodeName[128];
+    snprintf(nodeName, sizeof(nodeName), "Diagnostics.%s", metric->name);
+
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName = UA_LOCALIZEDTEXT("en-US", (char*)metric->name);
+    oAttr.description = UA_LOCALIZEDTEXT("en-US", (char*)metric->description);
+    UA_StatusCode retval = UA_Server_addObjectNode(server, UA_NODEID_STRING(ns, nodeName), *parent,
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                                   UA_QUALIFIEDNAME(ns, (char*)metric->name),
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                                   oAttr, NULL, outNodeId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node '%s'. Exiting with code %u",
+                    nodeName, retval);
+        return retval;
+    }
+
+    char childName[160];
+    UA_DataSource countSource = {readLatencyCount, NULL};
+    snprintf(childName, sizeof(childName), "%s.Count", nodeName);
+    retval = addMetricVariable(server, ns, outNodeId, childName, "Count",
+                               "Number of samples", &UA_TYPES[UA_TYPES_UINT64],
+                               UA_VALUERANK_SCALAR, countSource, metric, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_DataSource sumSource = {readLatencySum, NULL};
+    snprintf(childName, sizeof(childName), "%s.Sum", nodeName);
+    retval = addMetricVariable(server, ns, outNodeId, childName, "Sum",
+                               "Sum of all samples in microseconds", &UA_TYPES[UA_TYPES_UINT64],
+                               UA_VALUERANK_SCALAR, sumSource, metric, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_DataSource bucketsSource = {readLatencyBuckets, NULL};
+    snprintf(childName, sizeof(childName), "%s.Buckets", nodeName);
+    retval = addMetricVariable(server, ns, outNodeId, childName, "Buckets",
+                               "Samples per bucket, the last bucket counts the samples above all bounds",
+                               &UA_TYPES[UA_TYPES_UINT64], UA_VALUERANK_ONE_DIMENSION,
+                               bucketsSource, metric, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_Variant bounds;
+    UA_Variant_setArray(&bounds, (void*)metricsLatencyBounds, METRICS_LATENCY_BUCKETS - 1,
+                        &UA_TYPES[UA_TYPES_UINT64]);
+    return addProperty(server, ns, outNodeId, "BucketBounds", &bounds);
+}
+
+
+static UA_StatusCode addMetricNode(UA_Server *server, UA_UInt16 ns, const UA_NodeId *parent,
+                                   Metric *metric)
+{
+    char nodeName[128];
+    snprintf(nodeName, sizeof(nodeName), "Diagnostics.%s", metric->name);
+
+    UA_NodeId metricIdent;
+    UA_StatusCode retval;
+    switch(metric->type)
+    {
+        case METRIC_COUNTER: {
+            UA_DataSource dataSource = {readCounter, NULL};
+            retval = addMetricVariable(server, ns, parent, nodeName, (char*)metric->name,
+                                       (char*)metric->description, &UA_TYPES[UA_TYPES_UINT64],
+                                       UA_VALUERANK_SCALAR, dataSource, metric, &metricIdent);
+            break;
+        }
+        case METRIC_GAUGE: {
+            UA_DataSource dataSource = {readGauge, NULL};
+            retval = addMetricVariable(server, ns, parent, nodeName, (char*)metric->name,
+                                       (char*)metric->description, &UA_TYPES[UA_TYPES_INT64],
+                                       UA_VALUERANK_SCALAR, dataSource, metric, &metricIdent);
+            break;
+        }
+        default: {
+            retval = addLatencyObject(server, ns, parent, metric, &metricIdent);
+            break;
+        }
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_String typeName = UA_STRING((char*)metricTypeNames[metric->type]);
+    UA_Variant typeValue;
+    UA_Variant_setScalar(&typeValue, &typeName, &UA_TYPES[UA_TYPES_STRING]);
+    return addProperty(server, ns, &metricIdent, "MetricType", &typeValue);
+}
+
+
+UA_StatusCode addDiagnostics(UA_Server *server)
+{
+    registerSampledGauge("Sessions", "Number of active sessions", sampleSessions, server);
+    registerSampledGauge("SecureChannels", "Number of open secure channels", sampleSecureChannels, server);
+    monitoredItemsMetric = registerMetric(
+        "MonitoredItems", "Number of monitored items in all subscriptions", METRIC_GAUGE);
+    notificationsMetric = registerMetric(
+        "Notifications", "Data change notifications queued for monitored items", METRIC_COUNTER);
+    eventLoopMetric = registerMetric(
+        "EventLoopIteration", "Duration of an event loop iteration, including the wait for network events",
+        METRIC_LATENCY);
+
+    UA_ServerConfig *cfg = UA_Server_getConfig(server);
+    cfg->monitoredItemRegisterCallback = monitoredItemRegisterCallback;
+
+    UA_UInt16 ns = UA_Server_addNamespace(server, DIAGNOSTICS_NAMESPACE_URI);
+
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName = UA_LOCALIZEDTEXT("en-US", "Diagnostics");
+    oAttr.description = UA_LOCALIZEDTEXT("en-US", "Runtime metrics of the server");
+    UA_NodeId diagnosticsIdent;
+    UA_StatusCode retval = UA_Server_addObjectNode(server, UA_NODEID_STRING(ns, "Diagnostics"),
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                                   UA_QUALIFIEDNAME(ns, "Diagnostics"),
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                                   oAttr, NULL, &diagnosticsIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'Diagnostics'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+
+    for(size_t i = 0; i < getMetricsSize(); i++)
+    {
+        retval = addMetricNode(server, ns, &diagnosticsIdent, getMetric(i));
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            return retval;
+        }
+    }
+    return retval;
+}
+
+
+void iterateServerWithMetrics(UA_Server *server)
+{
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_Server_run_iterate(server, true);
+    recordLatencySince(eventLoopMetric, start);
+    refreshSampledGauges();
+}
@@ -0,0 +1,50 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <open62541/server.h>
+
+/*
+ * Registration with a local discovery server (LDS). The LDS keys its
+ * entries by application URI, so every server of a fleet needs its own.
+ * The registration is renewed periodically, which also registers the
+ * server again after a restart of the LDS. Until the first request has
+ * been sent it is retried at the shorter interval.
+ */
+#define DISCOVERY_URI_PREFIX "urn:sim-images:"
+#define DISCOVERY_RETRY_INTERVAL_MS 1000.0
+#define DISCOVERY_REGISTER_INTERVAL_MS 60000.0
+#define DISCOVERY_DEREGISTER_WAIT_MS 200
+
+typedef struct {
+    const char *url;
+    UA_UInt64 callbackId;
+    UA_Boolean registered;      /* a registration request has been sent */
+} DiscoveryRegistration;
+
+/*
+ * Set the application URI and name the server is registered with. A NULL
+ * URI results in DISCOVERY_URI_PREFIX<kind>:<hostname>, extended by
+ * ':<instance>' if an instance is given.
+ */
+UA_StatusCode setServerApplication(UA_Server *server, const char *applicationUri,
+                                   const char *kind, const char *instance);
+
+/*
+ * Register the server with the LDS at url. Call before or after the
+ * startup, the first request is sent by the event loop.
+ */
+UA_StatusCode startDiscoveryRegistration(UA_Server *server, DiscoveryRegistration *registration,
+                                         const char *url);
+
+/*
+ * Stop renewing and deregister the server. The request is sent by the
+ * event loop, run it with flushDiscoveryRequests before the shutdown.
+ */
+void stopDiscoveryRegistration(UA_Server *server, DiscoveryRegistration *registration);
+
+/*
+ * Run the event loop for DISCOVERY_DEREGISTER_WAIT_MS
+ */
+void flushDiscoveryRequests(UA_Server *server);
+
+#endif
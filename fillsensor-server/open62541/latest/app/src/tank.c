@@ -3,7 +3,9 @@
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
 #include <open62541/types.h>
+#include "asynclog.h"
 #include "tank.h"
+#include "tank_state.h"
 
 
 UA_NodeId waterTankTypeIdent = {1, UA_NODEIDTYPE_NUMERIC, {2000}};
@@ -26,7 +28,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                          eqAttr, NULL, &equipmentTypeIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'EquipmentType'. Exiting with code %u",
                     retval);
         return retval;
@@ -47,7 +49,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                        idAttr, NULL, &deviceIdIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'DeviceID'. Exiting with code %u",
                     retval);
         return retval;
@@ -57,7 +59,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'DeviceID'. Exiting with code %u",
                     retval);
         return retval;
@@ -75,7 +77,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                        locAttr, NULL, &locIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'Location'. Exiting with code %u",
                     retval);
         return retval;
@@ -85,7 +87,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'Location'. Exiting with code %u",
                     retval);
         return retval;
@@ -101,7 +103,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                          wtAttr, NULL, NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'waterTankType'. Exiting with code %u",
                     retval);
         return retval;
@@ -122,7 +124,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                        capacityAttr, NULL, &capacityIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'Capacity'. Exiting with code %u",
                     retval);
         return retval;
@@ -132,7 +134,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'Capacity'. Exiting with code %u",
                     retval);
         return retval;
@@ -151,7 +153,7 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                        fillPercentageAttr, NULL, &fillPercentageIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'FillPercentage'. Exiting with code %u",
                     retval);
         return retval;
@@ -161,11 +163,42 @@ UA_StatusCode defineWaterTankObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'FillPercentage'. Exiting with code %u",
                     retval);
         return retval;
     }
+
+    /*
+     * Snapshot of the values above, defined by defineTankStateDataType
+     */
+    UA_VariableAttributes stateAttr = UA_VariableAttributes_default;
+    stateAttr.displayName = UA_LOCALIZEDTEXT("en-US", "State");
+    stateAttr.dataType = tankStateTypeIdent;
+    stateAttr.valueRank = UA_VALUERANK_SCALAR;
+    UA_NodeId stateIdent;
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, waterTankTypeIdent,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                       UA_QUALIFIEDNAME(1, "State"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       stateAttr, NULL, &stateIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'State'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+    retval = UA_Server_addReference(server, stateIdent,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASMODELLINGRULE),
+                                    UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add reference 'State'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
     return retval;
 }
 
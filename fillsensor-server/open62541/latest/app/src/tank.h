@@ -12,6 +12,7 @@ extern UA_NodeId waterTankTypeIdent;
 /*
  * Define the data type used by water tank objects. Nodes can be instantiated only
  * after defining these types first.
+ * Their State variable needs TankState to be defined before.
  */
 UA_StatusCode defineWaterTankObjectType(UA_Server *server);
 
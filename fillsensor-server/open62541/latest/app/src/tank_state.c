@@ -0,0 +1,127 @@
+#include <stddef.h>
+#include <open62541/nodeids.h>
+#include <open62541/plugin/log.h>
+#include <open62541/server.h>
+#include <open62541/types.h>
+#include "asynclog.h"
+#include "tank_state.h"
+
+
+UA_NodeId tankStateTypeIdent = {1, UA_NODEIDTYPE_NUMERIC, {5200}};
+UA_NodeId tankStateBinaryEncodingIdent = {1, UA_NODEIDTYPE_NUMERIC, {5201}};
+
+/*
+ * Members in the order of the encoding, the padding is the gap to the
+ * end of the previous member in TankState
+ */
+static UA_DataTypeMember tankStateMembers[6] = {
+    {
+        UA_TYPENAME("FillPercentage")
+        .memberType = &UA_TYPES[UA_TYPES_DOUBLE],
+        .padding = 0,
+    },
+    {
+        UA_TYPENAME("FillPercentageTimestamp")
+        .memberType = &UA_TYPES[UA_TYPES_DATETIME],
+        .padding = offsetof(TankState, fillPercentageTimestamp)
+                 - offsetof(TankState, fillPercentage) - sizeof(UA_Double),
+    },
+    {
+        UA_TYPENAME("ValvePosition")
+        .memberType = &UA_TYPES[UA_TYPES_BOOLEAN],
+        .padding = offsetof(TankState, valvePosition)
+                 - offsetof(TankState, fillPercentageTimestamp) - sizeof(UA_DateTime),
+    },
+    {
+        UA_TYPENAME("ValvePositionTimestamp")
+        .memberType = &UA_TYPES[UA_TYPES_DATETIME],
+        .padding = offsetof(TankState, valvePositionTimestamp)
+                 - offsetof(TankState, valvePosition) - sizeof(UA_Boolean),
+    },
+    {
+        UA_TYPENAME("Threshold")
+        .memberType = &UA_TYPES[UA_TYPES_DOUBLE],
+        .padding = offsetof(TankState, threshold)
+                 - offsetof(TankState, valvePositionTimestamp) - sizeof(UA_DateTime),
+    },
+    {
+        UA_TYPENAME("ThresholdTimestamp")
+        .memberType = &UA_TYPES[UA_TYPES_DATETIME],
+        .padding = offsetof(TankState, thresholdTimestamp)
+                 - offsetof(TankState, threshold) - sizeof(UA_Double),
+    },
+};
+
+UA_DataType tankStateType = {
+    UA_TYPENAME("TankState")
+    .typeId = {1, UA_NODEIDTYPE_NUMERIC, {5200}},
+    .binaryEncodingId = {1, UA_NODEIDTYPE_NUMERIC, {5201}},
+    .memSize = sizeof(TankState),
+    .typeKind = UA_DATATYPEKIND_STRUCTURE,
+    .pointerFree = true,
+    .overlayable = false,
+    .membersSize = 6,
+    .members = tankStateMembers,
+};
+
+/*
+ * Put in front of the custom data types of a server, which only refers to it
+ */
+static UA_DataTypeArray tankStateTypes = {
+    .next = NULL,
+    .typesSize = 1,
+    .types = &tankStateType,
+};
+
+
+UA_StatusCode defineTankStateDataType(UA_Server *server)
+{
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    if(config->customDataTypes != &tankStateTypes)
+    {
+        tankStateTypes.next = config->customDataTypes;
+        config->customDataTypes = &tankStateTypes;
+    }
+
+    UA_DataTypeAttributes attr = UA_DataTypeAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "TankState");
+    attr.description = UA_LOCALIZEDTEXT("en-US", "Fill percentage, valve position and threshold of a tank");
+    UA_StatusCode retval = UA_Server_addDataTypeNode(server, tankStateTypeIdent,
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_STRUCTURE),
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                                     UA_QUALIFIEDNAME(1, "TankState"),
+                                                     attr, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'TankState'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+
+    /*
+     * Clients look up the binary encoding of the values to find the type
+     */
+    UA_ObjectAttributes encodingAttr = UA_ObjectAttributes_default;
+    encodingAttr.displayName = UA_LOCALIZEDTEXT("en-US", "Default Binary");
+    retval = UA_Server_addObjectNode(server, tankStateBinaryEncodingIdent, tankStateTypeIdent,
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASENCODING),
+                                     UA_QUALIFIEDNAME(0, "Default Binary"),
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_DATATYPEENCODINGTYPE),
+                                     encodingAttr, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'Default Binary' of 'TankState'. Exiting with code %u",
+                    retval);
+    }
+    return retval;
+}
+
+
+UA_StatusCode writeTankState(UA_Server *server, const UA_NodeId *stateIdent, TankState *state)
+{
+    UA_Variant stateValue;
+    UA_Variant_setScalar(&stateValue, state, &tankStateType);
+    return UA_Server_writeValue(server, *stateIdent, stateValue);
+}
@@ -0,0 +1,47 @@
+#ifndef TANK_STATE_H
+#define TANK_STATE_H
+
+#include <open62541/server.h>
+#include <open62541/types.h>
+
+/*
+ * Snapshot of a tank in one structured value, so a single Read or
+ * monitored item returns values that belong together instead of reading
+ * every variable on its own. Each value carries the time it was taken,
+ * the timestamp of a value the tank does not know is 0.
+ */
+typedef struct {
+    UA_Double fillPercentage;
+    UA_DateTime fillPercentageTimestamp;
+    UA_Boolean valvePosition;
+    UA_DateTime valvePositionTimestamp;
+    UA_Double threshold;
+    UA_DateTime thresholdTimestamp;
+} TankState;
+
+/*
+ * The data type node identifiers are made available here for user convenience.
+ * They are defined in the respective implementation files.
+ */
+extern UA_NodeId tankStateTypeIdent;
+extern UA_NodeId tankStateBinaryEncodingIdent;
+
+/*
+ * Description of TankState for encoding and decoding. Clients decode the
+ * values by adding it to the custom data types of their configuration.
+ */
+extern UA_DataType tankStateType;
+
+/*
+ * Register TankState with the binary encoding of the server and add its
+ * data type and encoding nodes. Variables of TankState can be defined only
+ * after registering the type first.
+ */
+UA_StatusCode defineTankStateDataType(UA_Server *server);
+
+/*
+ * Write a snapshot to a variable of TankState
+ */
+UA_StatusCode writeTankState(UA_Server *server, const UA_NodeId *stateIdent, TankState *state);
+
+#endif
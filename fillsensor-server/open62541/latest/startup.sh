@@ -3,5 +3,40 @@
 # treat undefined variables as an error
 set -u
 
+# if METRICS_ADDRESS is set, serve Prometheus metrics on [ADDR:]PORT
+metrics_opt=""
+if [ -n "${METRICS_ADDRESS:-}" ]; then
+  metrics_opt="--metrics=${METRICS_ADDRESS}"
+fi
+
+# if LDS_URL is set, register with the local discovery server at that URL
+lds_opt=""
+if [ -n "${LDS_URL:-}" ]; then
+  lds_opt="--lds=${LDS_URL}"
+fi
+
+# if APPLICATION_URI is set, it replaces the default application URI
+uri_opt=""
+if [ -n "${APPLICATION_URI:-}" ]; then
+  uri_opt="--application-uri=${APPLICATION_URI}"
+fi
+
+# if NET_PROFILE is set, impair the connections of the clients, e.g. for
+# testing the control loop over a wifi or congested link
+net_profile_opt=""
+if [ -n "${NET_PROFILE:-}" ]; then
+  net_profile_opt="--net-profile=${NET_PROFILE}"
+fi
+
+# if ALARM_THRESHOLD is set, emit an event whenever the fill percentage
+# crosses it, with ALARM_HYSTERESIS overriding the default hysteresis
+alarm_opt=""
+if [ -n "${ALARM_THRESHOLD:-}" ]; then
+  alarm_opt="--alarm-threshold=${ALARM_THRESHOLD}"
+fi
+if [ -n "${ALARM_HYSTERESIS:-}" ]; then
+  alarm_opt="$alarm_opt --alarm-hysteresis=${ALARM_HYSTERESIS}"
+fi
+
 # if no ENV is set, the binary is started with defaults
-/usr/local/bin/fillsensor-server
+/usr/local/bin/fillsensor-server $metrics_opt $lds_opt $uri_opt $net_profile_opt $alarm_opt
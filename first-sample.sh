@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Measure the time to the first stored sample from a cold start of the
+# whole stack. The images of fillsensor-server, valve-server, a plc-server
+# and plc-logic-client are built first. Every run then starts fresh
+# containers of all four at once, on a private network and with an empty
+# database volume, like a restart of the stack. plc-logic-client restarts
+# until the servers accept its connections.
+#
+# The time is taken from starting the first container to the docker log
+# timestamp of the line plc-logic-client writes for its first stored
+# sample. The time that line reports from the start of the process is
+# printed next to it.
+#
+# Usage: ./first-sample.sh [-n runs] [PLC_SERVER_DIR]
+#
+# PLC_SERVER_DIR is the directory of the plc-server image relative to the
+# repository, plc-server/open62541/latest by default, e.g.
+# plc-server/opcua-asyncio/latest for a server that waits for the lock file.
+
+# treat undefined variables as an error
+set -u
+
+runs=5
+if [ "${1:-}" = "-n" ]; then
+  runs="$2"
+  shift 2
+fi
+plcserver="${1:-plc-server/open62541/latest}"
+
+root="$(cd "$(dirname "$0")" && pwd)"
+prefix="first-sample-$$"
+timeout=120
+
+for image in fillsensor-server/open62541/latest valve-server/open62541/latest \
+             "$plcserver" plc-logic-client/open62541/latest; do
+  if ! docker build -q -t "$prefix-${image%%/*}" "$root/$image" > /dev/null; then
+    echo "Unable to build $image" >&2
+    exit 1
+  fi
+done
+
+cleanup() {
+  docker rm -f "$prefix-sensor" "$prefix-valve" "$prefix-server" "$prefix-client" > /dev/null 2>&1
+  docker volume rm "$prefix-db" > /dev/null 2>&1
+}
+trap 'cleanup; docker network rm "$prefix" > /dev/null 2>&1; docker rmi "$prefix-fillsensor-server" "$prefix-valve-server" "$prefix-plc-server" "$prefix-plc-logic-client" > /dev/null 2>&1' EXIT
+docker network create "$prefix" > /dev/null || exit 1
+
+echo "run  stack ms  process ms"
+results=""
+run=1
+while [ "$run" -le "$runs" ]; do
+  cleanup
+  docker volume create "$prefix-db" > /dev/null || exit 1
+
+  start="$(date +%s%3N)"
+  docker run -d --name "$prefix-sensor" --network "$prefix" --network-alias sensor \
+    "$prefix-fillsensor-server" > /dev/null &
+  docker run -d --name "$prefix-valve" --network "$prefix" --network-alias valve \
+    "$prefix-valve-server" > /dev/null &
+  docker run -d --name "$prefix-server" --network "$prefix" \
+    -v "$prefix-db:/database" "$prefix-plc-server" > /dev/null &
+  docker run -d --name "$prefix-client" --network "$prefix" --restart on-failure \
+    -v "$prefix-db:/database" \
+    -e SENSOR_URI=opc.tcp://sensor:4840 -e ACTUATOR_URI=opc.tcp://valve:4840 \
+    "$prefix-plc-logic-client" > /dev/null &
+  wait
+
+  # poll the log, the docker timestamp of the line is the measurement
+  line=""
+  deadline=$(( $(date +%s) + timeout ))
+  while [ -z "$line" ] && [ "$(date +%s)" -lt "$deadline" ]; do
+    sleep 0.1
+    line="$(docker logs -t "$prefix-client" 2>&1 | grep -m 1 'First sample stored')"
+  done
+  if [ -z "$line" ]; then
+    echo "$run: no sample stored within $timeout s" >&2
+    exit 1
+  fi
+
+  end="$(date -d "${line%% *}" +%s%3N)"
+  process="$(echo "$line" | sed 's/.*stored \([0-9.]*\) ms.*/\1/')"
+  printf "%3d  %8d  %10s\n" "$run" $(( end - start )) "$process"
+  results="$results $(( end - start ))"
+  run=$(( run + 1 ))
+done
+
+echo "$results" | tr ' ' '\n' | sed '/^$/d' | sort -n |
+  awk '{ ms[NR] = $1 } END { printf "median %d ms of %d runs\n", ms[int((NR + 1) / 2)], NR }'
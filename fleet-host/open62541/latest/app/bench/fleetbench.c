@@ -0,0 +1,446 @@
+/*
+ * Per-endpoint overhead of the fleet host compared to one process per
+ * server. The same number of endpoints is started twice:
+ *
+ *   - fleet: one fleet-host process serving all endpoints from its
+ *     worker pool
+ *   - separate: one fleet-host process per endpoint with a single worker,
+ *     which has the runtime of a standalone fillsensor-server or
+ *     valve-server
+ *
+ * For both it connects a client to every endpoint and reports the memory
+ * of the server processes (proportional set size, so shared library pages
+ * are not counted once per process) and their CPU time, idle and while
+ * every endpoint is read at a fixed rate.
+ *
+ * Usage: fleetbench [-n endpoints] [-p first port] [-j threads]
+ *                   [-d seconds] [-r reads/s] [FLEET-HOST]
+ */
+#include <argp.h>
+#include <open62541/client.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STARTUP_TIMEOUT_MS 30000
+#define CONFIG_TEMPLATE "/tmp/fleetbench-XXXXXX"
+
+typedef struct {
+    const char *name;
+    size_t processes;
+    UA_Double pssKb;            /* all server processes after connecting */
+    UA_Double idleCpuMs;        /* CPU time per second without requests */
+    UA_Double loadCpuMs;        /* CPU time per second while reading */
+    UA_Double readsPerSecond;
+} ModeResult;
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "fleetbench 0.1";
+static char doc[] = "Compares the per-endpoint overhead of fleet-host with one process per server";
+static char args_doc[] = "[FLEET-HOST]";
+static struct argp_option options[] = {
+    {"endpoints", 'n', "N",       0, "Number of endpoints [default: 100]" },
+    {"port",      'p', "PORT",    0, "Port of the first endpoint [default: 48400]" },
+    {"threads",   'j', "N",       0, "Worker threads of the fleet [default: 4]" },
+    {"duration",  'd', "SECONDS", 0, "Duration of the idle and the load phase [default: 10]" },
+    {"rate",      'r', "N",       0, "Reads per second and endpoint [default: 10]" },
+    { 0 }
+};
+
+struct arguments
+{
+    char *executable;
+    size_t endpoints;
+    UA_UInt16 port;
+    size_t threads;
+    unsigned int duration;
+    size_t rate;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'n': {
+            arguments->endpoints = strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'p': {
+            arguments->port = (UA_UInt16)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'j': {
+            arguments->threads = strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'd': {
+            arguments->duration = (unsigned int)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'r': {
+            arguments->rate = strtoul(arg, NULL, 10);
+            break;
+        }
+        case ARGP_KEY_ARG: {
+            arguments->executable = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+/*
+ * Configuration with the endpoints [first, first + count), alternating
+ * between sensors and valves
+ */
+static UA_StatusCode writeConfig(const struct arguments *arguments, size_t first, size_t count,
+                                 char *path)
+{
+    strcpy(path, CONFIG_TEMPLATE);
+    int fd = mkstemp(path);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if(!fp)
+    {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    for(size_t i = first; i < first + count; i++)
+    {
+        fprintf(fp, i % 2 ? "valve %zu valve%zu V%zu P01B02R44\n" : "fillsensor %zu tank%zu T%zu P01B02R12\n",
+                (size_t)arguments->port + i, i, i);
+    }
+    return fclose(fp) == 0 ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINTERNALERROR;
+}
+
+
+static pid_t startFleetHost(const struct arguments *arguments, const char *config, size_t threads)
+{
+    char threadsArg[32];
+    snprintf(threadsArg, sizeof(threadsArg), "--threads=%zu", threads);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        /*
+         * Keep the output of hundreds of servers off the terminal
+         */
+        if(!freopen("/dev/null", "w", stdout))
+        {
+            _exit(127);
+        }
+        execl(arguments->executable, arguments->executable, "--config", config, threadsArg, (char*)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+
+static void stopFleetHosts(pid_t *pids, size_t pidsSize)
+{
+    for(size_t i = 0; i < pidsSize; i++)
+    {
+        if(pids[i] > 0)
+        {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    for(size_t i = 0; i < pidsSize; i++)
+    {
+        if(pids[i] > 0)
+        {
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+}
+
+
+/*
+ * Proportional set size in kB, falls back to the resident set size on
+ * kernels without smaps_rollup
+ */
+static UA_Double readMemoryKb(pid_t pid)
+{
+    char path[64];
+    char line[256];
+    const char *files[] = {"smaps_rollup", "status"};
+    const char *keys[] = {"Pss:", "VmRSS:"};
+    for(size_t i = 0; i < 2; i++)
+    {
+        snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, files[i]);
+        FILE *fp = fopen(path, "r");
+        if(!fp)
+        {
+            continue;
+        }
+        UA_Double kb = -1.;
+        while(kb < 0. && fgets(line, sizeof(line), fp))
+        {
+            if(strncmp(line, keys[i], strlen(keys[i])) == 0)
+            {
+                kb = strtod(line + strlen(keys[i]), NULL);
+            }
+        }
+        fclose(fp);
+        if(kb >= 0.)
+        {
+            return kb;
+        }
+    }
+    return 0.;
+}
+
+
+/*
+ * User and system time in milliseconds
+ */
+static UA_Double readCpuMs(pid_t pid)
+{
+    char path[64];
+    char buffer[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if(!fp)
+    {
+        return 0.;
+    }
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    fclose(fp);
+    buffer[length] = '\0';
+
+    /*
+     * Fields 14 and 15, counted after the command name in parentheses
+     */
+    char *fields = strrchr(buffer, ')');
+    unsigned long utime = 0, stime = 0;
+    if(!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                         &utime, &stime) != 2)
+    {
+        return 0.;
+    }
+    return (UA_Double)(utime + stime) * 1000. / (UA_Double)sysconf(_SC_CLK_TCK);
+}
+
+
+static UA_Double sumCpuMs(const pid_t *pids, size_t pidsSize)
+{
+    UA_Double sum = 0.;
+    for(size_t i = 0; i < pidsSize; i++)
+    {
+        sum += readCpuMs(pids[i]);
+    }
+    return sum;
+}
+
+
+static UA_Client *connectEndpoint(UA_UInt16 port)
+{
+    char url[64];
+    snprintf(url, sizeof(url), "opc.tcp://localhost:%u", port);
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return NULL;
+    }
+
+    UA_DateTime deadline = UA_DateTime_nowMonotonic() + STARTUP_TIMEOUT_MS * UA_DATETIME_MSEC;
+    struct timespec retry = {0, 50000000};
+    while(UA_Client_connect(client, url) != UA_STATUSCODE_GOOD)
+    {
+        if(UA_DateTime_nowMonotonic() > deadline)
+        {
+            UA_Client_delete(client);
+            return NULL;
+        }
+        nanosleep(&retry, NULL);
+    }
+    return client;
+}
+
+
+/*
+ * Read the server time of every endpoint, rate times per second, for the
+ * given duration. Returns the reads per second actually reached.
+ */
+static UA_Double readEndpoints(UA_Client **clients, size_t clientsSize,
+                               size_t rate, unsigned int duration)
+{
+    UA_NodeId currentTime = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_DateTime end = start + (UA_DateTime)duration * UA_DATETIME_SEC;
+    UA_DateTime period = UA_DATETIME_SEC / (UA_DateTime)rate;
+    size_t reads = 0;
+    for(UA_DateTime next = start; next < end; next += period)
+    {
+        for(size_t i = 0; i < clientsSize; i++)
+        {
+            UA_Variant value;
+            UA_Variant_init(&value);
+            if(UA_Client_readValueAttribute(clients[i], currentTime, &value) == UA_STATUSCODE_GOOD)
+            {
+                reads++;
+            }
+            UA_Variant_clear(&value);
+        }
+
+        UA_DateTime now = UA_DateTime_nowMonotonic();
+        if(next + period > now)
+        {
+            UA_DateTime wait = next + period - now;
+            struct timespec pause = {wait / UA_DATETIME_SEC, (wait % UA_DATETIME_SEC) * 100};
+            nanosleep(&pause, NULL);
+        }
+    }
+    UA_DateTime elapsed = UA_DateTime_nowMonotonic() - start;
+    return (UA_Double)reads * UA_DATETIME_SEC / (UA_Double)elapsed;
+}
+
+
+static UA_StatusCode measureMode(const struct arguments *arguments, UA_Boolean separate,
+                                 ModeResult *result)
+{
+    size_t processes = separate ? arguments->endpoints : 1;
+    size_t perProcess = separate ? 1 : arguments->endpoints;
+    pid_t *pids = calloc(processes, sizeof(pid_t));
+    UA_Client **clients = calloc(arguments->endpoints, sizeof(UA_Client*));
+    char (*configs)[sizeof(CONFIG_TEMPLATE)] = calloc(processes, sizeof(CONFIG_TEMPLATE));
+    UA_StatusCode retval = pids && clients && configs ?
+        UA_STATUSCODE_GOOD : UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < processes; i++)
+    {
+        retval = writeConfig(arguments, i * perProcess, perProcess, configs[i]);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            pids[i] = startFleetHost(arguments, configs[i], separate ? 1 : arguments->threads);
+            retval = pids[i] > 0 ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINTERNALERROR;
+        }
+    }
+
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < arguments->endpoints; i++)
+    {
+        clients[i] = connectEndpoint((UA_UInt16)(arguments->port + i));
+        retval = clients[i] ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADCONNECTIONREJECTED;
+    }
+
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        result->name = separate ? "separate" : "fleet";
+        result->processes = processes;
+        result->pssKb = 0.;
+        for(size_t i = 0; i < processes; i++)
+        {
+            result->pssKb += readMemoryKb(pids[i]);
+        }
+
+        /*
+         * The clients stay connected, but only the servers' timers run
+         */
+        UA_Double cpuStart = sumCpuMs(pids, processes);
+        sleep(arguments->duration);
+        UA_Double cpuIdle = sumCpuMs(pids, processes);
+        result->readsPerSecond = readEndpoints(clients, arguments->endpoints,
+                                               arguments->rate, arguments->duration);
+        UA_Double cpuLoad = sumCpuMs(pids, processes);
+        result->idleCpuMs = (cpuIdle - cpuStart) / arguments->duration;
+        result->loadCpuMs = (cpuLoad - cpuIdle) / arguments->duration;
+    }
+
+    for(size_t i = 0; clients && i < arguments->endpoints; i++)
+    {
+        if(clients[i])
+        {
+            UA_Client_disconnect(clients[i]);
+            UA_Client_delete(clients[i]);
+        }
+    }
+    if(pids)
+    {
+        stopFleetHosts(pids, processes);
+    }
+    for(size_t i = 0; configs && i < processes; i++)
+    {
+        if(configs[i][0])
+        {
+            unlink(configs[i]);
+        }
+    }
+    free(configs);
+    free(clients);
+    free(pids);
+    return retval;
+}
+
+
+static void printResult(const ModeResult *result, size_t endpoints, const ModeResult *baseline)
+{
+    printf("%-10s %9zu %12.0f %12.1f %14.3f %14.3f %10.0f",
+           result->name, result->processes, result->pssKb / 1024.,
+           result->pssKb / (UA_Double)endpoints,
+           result->idleCpuMs / (UA_Double)endpoints,
+           result->loadCpuMs / (UA_Double)endpoints,
+           result->readsPerSecond);
+    if(baseline)
+    {
+        printf("   %5.1fx mem  %5.1fx cpu",
+               baseline->pssKb / result->pssKb,
+               baseline->loadCpuMs / (result->loadCpuMs > 0. ? result->loadCpuMs : 1.));
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .executable = "bin/fleet-host",
+        .endpoints = 100,
+        .port = 48400,
+        .threads = 4,
+        .duration = 10,
+        .rate = 10,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(arguments.endpoints == 0 || arguments.duration == 0 || arguments.rate == 0 ||
+       (size_t)arguments.port + arguments.endpoints > 65536)
+    {
+        fprintf(stderr, "endpoints, duration and rate must be positive and the ports must fit\n");
+        return EXIT_FAILURE;
+    }
+
+    ModeResult separate, fleet;
+    UA_StatusCode retval = measureMode(&arguments, true, &separate);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Separate processes failed: %s\n", UA_StatusCode_name(retval));
+        return EXIT_FAILURE;
+    }
+    retval = measureMode(&arguments, false, &fleet);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Fleet failed: %s\n", UA_StatusCode_name(retval));
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu endpoints, %zu reads/s each, %us per phase\n",
+           arguments.endpoints, arguments.rate, arguments.duration);
+    printf("%-10s %9s %12s %12s %14s %14s %10s\n",
+           "mode", "processes", "PSS MB", "kB/endpoint", "idle ms/s/ep", "load ms/s/ep", "reads/s");
+    printResult(&separate, arguments.endpoints, NULL);
+    printResult(&fleet, arguments.endpoints, &separate);
+    return EXIT_SUCCESS;
+}
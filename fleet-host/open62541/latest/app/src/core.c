@@ -0,0 +1,152 @@
+#include <argp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <open62541/types.h>
+#include "asynclog.h"
+#include "exporter.h"
+#include "fleet.h"
+
+
+/*
+ * Signal handling
+ */
+static volatile UA_Boolean running = true;
+
+static void stopHandler(int signum)
+{
+    running = false;
+}
+
+/*
+ * Argparser
+ */
+const char* argp_program_version = "fleet-host 0.1";
+const char* argp_program_bug_address = "las3@oth-regensburg.de";
+static char doc[] = "OPC UA fleet host -- runs many sensor and valve servers in one process";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"config",  'c', "FILE",        0, "Fleet configuration [default: fleet.conf]" },
+    {"threads", 'j', "N",           0, "Worker threads [default: number of CPUs]" },
+    {"metrics", 'm', "[ADDR:]PORT", 0, "Serve Prometheus metrics over HTTP" },
+    {"lds",     'l', "URL",         0, "Register every server with the local discovery server at URL" },
+    {0},
+};
+
+struct arguments
+{
+    char *config;
+    size_t threads;
+    char *metrics;
+    char *lds;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'c':
+        {
+            arguments->config = arg;
+            break;
+        }
+        case 'j':
+        {
+            arguments->threads = strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'm':
+        {
+            arguments->metrics = arg;
+            break;
+        }
+        case 'l':
+        {
+            arguments->lds = arg;
+            break;
+        }
+         default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+int main(int argc, char **argv)
+{
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    /*
+     * Default arguments
+     */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct arguments arguments = {
+        .config = "fleet.conf",
+        .threads = cpus > 0 ? (size_t)cpus : 1,
+        .metrics = NULL,
+        .lds = NULL,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
+    Fleet fleet;
+    initFleet(&fleet);
+    fleet.discoveryUrl = arguments.lds;
+    UA_StatusCode retval = loadFleetConfig(&fleet, arguments.config);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        goto cleanup;
+    }
+
+    retval = startFleet(&fleet, arguments.threads);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to start the fleet");
+        goto cleanup_fleet;
+    }
+
+    /*
+     * The metrics endpoint is optional, the fleet runs without it
+     */
+    MetricsExporter exporter;
+    UA_Boolean exporting = false;
+    if(arguments.metrics)
+    {
+        exporting = startMetricsExporter(&exporter, arguments.metrics, "fleet_host") == UA_STATUSCODE_GOOD;
+    }
+
+    /*
+     * The servers run on the workers, wait for Ctrl-C here
+     */
+    struct timespec interval = {0, FLEET_MAX_WAIT_MS * 1000000L};
+    while(running)
+    {
+        nanosleep(&interval, NULL);
+    }
+
+    if(exporting)
+    {
+        stopMetricsExporter(&exporter);
+    }
+
+cleanup_fleet:
+    stopFleet(&fleet);
+
+cleanup:
+    clearFleet(&fleet);
+    stopAsyncLogger();
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+}
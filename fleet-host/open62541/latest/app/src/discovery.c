@@ -0,0 +1,133 @@
+#include <open62541/client_config_default.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "discovery.h"
+
+
+UA_StatusCode setServerApplication(UA_Server *server, const char *applicationUri,
+                                   const char *kind, const char *instance)
+{
+    char uri[256];
+    if(!applicationUri)
+    {
+        char hostname[128];
+        if(gethostname(hostname, sizeof(hostname)) != 0)
+        {
+            strcpy(hostname, "localhost");
+        }
+        hostname[sizeof(hostname) - 1] = '\0';
+        int length = snprintf(uri, sizeof(uri), DISCOVERY_URI_PREFIX "%s:%s", kind, hostname);
+        if(instance && length > 0 && (size_t)length < sizeof(uri))
+        {
+            snprintf(uri + length, sizeof(uri) - (size_t)length, ":%s", instance);
+        }
+        applicationUri = uri;
+    }
+
+    UA_ServerConfig *cfg = UA_Server_getConfig(server);
+    UA_String_clear(&cfg->applicationDescription.applicationUri);
+    cfg->applicationDescription.applicationUri = UA_String_fromChars(applicationUri);
+    UA_LocalizedText_clear(&cfg->applicationDescription.applicationName);
+    cfg->applicationDescription.applicationName =
+        UA_LOCALIZEDTEXT_ALLOC("en-US", instance ? instance : kind);
+    if(!cfg->applicationDescription.applicationUri.data ||
+       !cfg->applicationDescription.applicationName.text.data)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * The client config is taken over by the server for the registration
+ * client, so a fresh one is set up for every request
+ */
+static void registerCallback(UA_Server *server, void *data)
+{
+    DiscoveryRegistration *registration = (DiscoveryRegistration*)data;
+    UA_ClientConfig cc;
+    memset(&cc, 0, sizeof(UA_ClientConfig));
+    UA_ClientConfig_setDefault(&cc);
+    UA_StatusCode retval = UA_Server_registerDiscovery(server, &cc, UA_STRING((char*)registration->url),
+                                                       UA_STRING_NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        if(!registration->registered)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to register with discovery server %s: %s, retrying",
+                        registration->url, UA_StatusCode_name(retval));
+        }
+        return;
+    }
+
+    if(!registration->registered)
+    {
+        registration->registered = true;
+        UA_Server_changeRepeatedCallbackInterval(server, registration->callbackId,
+                                                 DISCOVERY_REGISTER_INTERVAL_MS);
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Registered with discovery server %s", registration->url);
+    }
+}
+
+
+UA_StatusCode startDiscoveryRegistration(UA_Server *server, DiscoveryRegistration *registration,
+                                         const char *url)
+{
+    registration->url = url;
+    registration->callbackId = 0;
+    registration->registered = false;
+    UA_StatusCode retval = UA_Server_addRepeatedCallback(server, registerCallback, registration,
+                                                         DISCOVERY_RETRY_INTERVAL_MS,
+                                                         &registration->callbackId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to schedule the discovery registration: %s",
+                    UA_StatusCode_name(retval));
+    }
+    return retval;
+}
+
+
+void stopDiscoveryRegistration(UA_Server *server, DiscoveryRegistration *registration)
+{
+    if(registration->callbackId)
+    {
+        UA_Server_removeRepeatedCallback(server, registration->callbackId);
+        registration->callbackId = 0;
+    }
+    if(!registration->registered)
+    {
+        return;
+    }
+
+    UA_ClientConfig cc;
+    memset(&cc, 0, sizeof(UA_ClientConfig));
+    UA_ClientConfig_setDefault(&cc);
+    UA_StatusCode retval = UA_Server_deregisterDiscovery(server, &cc, UA_STRING((char*)registration->url));
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to deregister from discovery server %s: %s",
+                    registration->url, UA_StatusCode_name(retval));
+    }
+    registration->registered = false;
+}
+
+
+void flushDiscoveryRequests(UA_Server *server)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + DISCOVERY_DEREGISTER_WAIT_MS * UA_DATETIME_MSEC;
+    while(UA_DateTime_nowMonotonic() < end)
+    {
+        UA_Server_run_iterate(server, false);
+        usleep(1000);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <open62541/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Minimal HTTP listener serving the registered metrics in the Prometheus
+ * text exposition format on GET /metrics. It runs in its own thread and
+ * only reads the lock-free metric registry, so a slow or stuck scraper
+ * never blocks the OPC UA event loop. Connections are served one at a
+ * time with short socket timeouts.
+ */
+typedef struct {
+    const char *prefix;
+    int fd;
+    pthread_t thread;
+    atomic_bool stop;
+    char *buffer;
+    size_t bufferSize;
+    size_t bufferUsed;
+} MetricsExporter;
+
+/*
+ * Start listening on [ADDR:]PORT, ADDR defaults to 127.0.0.1 and an IPv6
+ * ADDR is put in brackets, e.g. [::1]:9100. The prefix is put in front of
+ * all metric names, e.g. "plc_server".
+ */
+UA_StatusCode startMetricsExporter(MetricsExporter *exporter, const char *address,
+                                   const char *prefix);
+
+void stopMetricsExporter(MetricsExporter *exporter);
+
+#endif
@@ -0,0 +1,593 @@
+#include <open62541/plugin/eventloop.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asynclog.h"
+#include "fleet.h"
+#include "metrics.h"
+#include "tank.h"
+#include "utils.h"
+#include "valve.h"
+
+#define FLEET_TANK_CAPACITY 1000.
+
+static Metric *serversMetric = NULL;
+static Metric *valueWritesMetric = NULL;
+static Metric *eventLoopMetric = NULL;
+
+static const char *kindNames[] = {"fillsensor", "valve"};
+static const char *applicationKinds[] = {"fillsensor-server", "valve-server"};
+
+
+void initFleet(Fleet *fleet)
+{
+    memset(fleet, 0, sizeof(Fleet));
+    atomic_init(&fleet->stop, false);
+}
+
+
+static FleetServer *findFleetServer(Fleet *fleet, UA_UInt16 port)
+{
+    for(size_t i = 0; i < fleet->serversSize; i++)
+    {
+        if(fleet->servers[i].port == port)
+        {
+            return &fleet->servers[i];
+        }
+    }
+    return NULL;
+}
+
+
+static UA_StatusCode parseFleetLine(const char *line, FleetServer *entry)
+{
+    char kind[16];
+    unsigned int port;
+    memset(entry, 0, sizeof(FleetServer));
+    if(sscanf(line, "%15s %u %31s %31s %31s", kind, &port,
+              entry->name, entry->deviceId, entry->location) != 5 ||
+       port == 0 || port > 65535)
+    {
+        return UA_STATUSCODE_BADSYNTAXERROR;
+    }
+    entry->port = (UA_UInt16)port;
+
+    if(strcmp(kind, kindNames[FLEET_FILLSENSOR]) == 0)
+    {
+        entry->kind = FLEET_FILLSENSOR;
+    }
+    else if(strcmp(kind, kindNames[FLEET_VALVE]) == 0)
+    {
+        entry->kind = FLEET_VALVE;
+    }
+    else
+    {
+        return UA_STATUSCODE_BADSYNTAXERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode loadFleetConfig(Fleet *fleet, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if(!fp)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to open fleet configuration '%s'", path);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    char *line = NULL;
+    size_t lineSize = 0;
+    size_t capacity = fleet->serversSize;
+    for(size_t lineNumber = 1; getline(&line, &lineSize, fp) >= 0; lineNumber++)
+    {
+        const char *start = line + strspn(line, " \t");
+        if(*start == '#' || *start == '\n' || *start == '\0')
+        {
+            continue;
+        }
+
+        FleetServer entry;
+        if(parseFleetLine(start, &entry) != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "%s:%zu: expected '<fillsensor|valve> <port> <name> <device ID> <location>'",
+                           path, lineNumber);
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+            break;
+        }
+        if(findFleetServer(fleet, entry.port))
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "%s:%zu: port %u is already used", path, lineNumber, entry.port);
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+            break;
+        }
+
+        if(fleet->serversSize == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 16;
+            FleetServer *servers = realloc(fleet->servers, capacity * sizeof(FleetServer));
+            if(!servers)
+            {
+                retval = UA_STATUSCODE_BADOUTOFMEMORY;
+                break;
+            }
+            fleet->servers = servers;
+        }
+        fleet->servers[fleet->serversSize++] = entry;
+    }
+    free(line);
+    fclose(fp);
+
+    if(retval == UA_STATUSCODE_GOOD && fleet->serversSize == 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "No servers in fleet configuration '%s'", path);
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    }
+    return retval;
+}
+
+
+/*
+ * Counts the values written by the process simulation and the control
+ * logic over all servers
+ */
+static void valueWrittenCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range, const UA_DataValue *data)
+{
+    addCounter(valueWritesMetric, 1);
+}
+
+
+/*
+ * Counts the written fill percentage and updates the state of the fill
+ * sensor passed as node context
+ */
+static void fillPercentageWrittenCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range, const UA_DataValue *data)
+{
+    addCounter(valueWritesMetric, 1);
+    if(!data->hasValue || !UA_Variant_hasScalarType(&data->value, &UA_TYPES[UA_TYPES_DOUBLE]))
+    {
+        return;
+    }
+
+    FleetServer *entry = (FleetServer*)nodeContext;
+    entry->state.fillPercentage = *(UA_Double*)data->value.data;
+    entry->state.fillPercentageTimestamp = data->hasSourceTimestamp ? data->sourceTimestamp
+                                                                    : UA_DateTime_now();
+    writeTankState(server, &entry->stateNodeIdent, &entry->state);
+}
+
+
+/*
+ * Set the initial value of an attribute of a device instance
+ */
+static UA_StatusCode initAttribute(UA_Server *server, const UA_NodeId *objectIdent, char *name,
+                                   void *value, const UA_DataType *type, UA_NodeId *attributeIdent)
+{
+    UA_QualifiedName qn = UA_QUALIFIEDNAME(1, name);
+    UA_NodeId attributeNode;
+    UA_StatusCode retval = findAttributeNodeId(server, objectIdent, &qn, &attributeNode);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute '%s'", name);
+        return retval;
+    }
+
+    UA_Variant variant;
+    UA_Variant_setScalar(&variant, value, type);
+    retval = UA_Server_writeValue(server, attributeNode, variant);
+    if(attributeIdent)
+    {
+        *attributeIdent = attributeNode;
+    }
+    return retval;
+}
+
+
+/*
+ * Same address space as fillsensor-server
+ */
+static UA_StatusCode addFillSensor(FleetServer *entry)
+{
+    UA_StatusCode retval = defineTankStateDataType(entry->server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define tank state data type");
+        return retval;
+    }
+    retval = defineWaterTankObjectType(entry->server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define water tank object type");
+        return retval;
+    }
+
+    UA_NodeId tankIdent;
+    retval = addWaterTankObjectInstance(entry->server, entry->name, &tankIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add water tank instance to server");
+        return retval;
+    }
+
+    UA_String deviceId = UA_STRING(entry->deviceId);
+    UA_String location = UA_STRING(entry->location);
+    UA_Double capacity = FLEET_TANK_CAPACITY;
+    UA_Double fillPercentage = 0.;
+    UA_NodeId fillPercentageNode;
+    retval = initAttribute(entry->server, &tankIdent, "DeviceID",
+                           &deviceId, &UA_TYPES[UA_TYPES_STRING], NULL);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = initAttribute(entry->server, &tankIdent, "Location",
+                               &location, &UA_TYPES[UA_TYPES_STRING], NULL);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = initAttribute(entry->server, &tankIdent, "Capacity",
+                               &capacity, &UA_TYPES[UA_TYPES_DOUBLE], NULL);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = initAttribute(entry->server, &tankIdent, "FillPercentage",
+                               &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE], &fillPercentageNode);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        memset(&entry->state, 0, sizeof(TankState));
+        retval = initAttribute(entry->server, &tankIdent, "State",
+                               &entry->state, &tankStateType, &entry->stateNodeIdent);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_Server_setNodeContext(entry->server, fillPercentageNode, entry);
+    UA_ValueCallback callback = {NULL, fillPercentageWrittenCallback};
+    return UA_Server_setVariableNode_valueCallback(entry->server, fillPercentageNode, callback);
+}
+
+
+/*
+ * Same address space as valve-server, without the apply latency
+ * instrumentation, which is kept per process
+ */
+static UA_StatusCode addValve(FleetServer *entry)
+{
+    UA_StatusCode retval = defineValveObjectType(entry->server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define valve object type");
+        return retval;
+    }
+
+    UA_NodeId valveIdent;
+    retval = addValveObjectInstance(entry->server, entry->name, &valveIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add valve instance to server");
+        return retval;
+    }
+
+    UA_String deviceId = UA_STRING(entry->deviceId);
+    UA_String location = UA_STRING(entry->location);
+    UA_Boolean open = false;
+    UA_NodeId openNode;
+    retval = initAttribute(entry->server, &valveIdent, "DeviceID",
+                           &deviceId, &UA_TYPES[UA_TYPES_STRING], NULL);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = initAttribute(entry->server, &valveIdent, "Location",
+                               &location, &UA_TYPES[UA_TYPES_STRING], NULL);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = initAttribute(entry->server, &valveIdent, "Open",
+                               &open, &UA_TYPES[UA_TYPES_BOOLEAN], &openNode);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_ValueCallback callback = {NULL, valueWrittenCallback};
+    return UA_Server_setVariableNode_valueCallback(entry->server, openNode, callback);
+}
+
+
+/*
+ * The server gets the event loop of its worker instead of creating its
+ * own. As the event loop is external, the server neither starts nor frees
+ * it.
+ */
+static UA_StatusCode startFleetServer(Fleet *fleet, FleetServer *entry, UA_EventLoop *eventLoop)
+{
+    UA_ServerConfig config;
+    memset(&config, 0, sizeof(UA_ServerConfig));
+    config.eventLoop = eventLoop;
+    config.externalEventLoop = true;
+    UA_StatusCode retval = UA_ServerConfig_setMinimal(&config, entry->port, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_ServerConfig_clear(&config);
+        return retval;
+    }
+
+    entry->server = UA_Server_newWithConfig(&config);
+    if(!entry->server)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    retval = setServerApplication(entry->server, NULL, applicationKinds[entry->kind], entry->deviceId);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = entry->kind == FLEET_FILLSENSOR ? addFillSensor(entry) : addValve(entry);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = UA_Server_run_startup(entry->server);
+        entry->started = retval == UA_STATUSCODE_GOOD;
+    }
+    if(retval == UA_STATUSCODE_GOOD && fleet->discoveryUrl)
+    {
+        startDiscoveryRegistration(entry->server, &entry->registration, fleet->discoveryUrl);
+    }
+    return retval;
+}
+
+
+/*
+ * Event loop with a TCP connection manager, shared by all servers of a
+ * worker
+ */
+static UA_EventLoop *newWorkerEventLoop(void)
+{
+    UA_EventLoop *eventLoop = UA_EventLoop_new_POSIX(UA_Log_Stdout);
+    if(!eventLoop)
+    {
+        return NULL;
+    }
+
+    UA_ConnectionManager *tcp = UA_ConnectionManager_new_POSIX_TCP(UA_STRING("tcp connection manager"));
+    if(!tcp)
+    {
+        eventLoop->free(eventLoop);
+        return NULL;
+    }
+    if(eventLoop->registerEventSource(eventLoop, &tcp->eventSource) != UA_STATUSCODE_GOOD)
+    {
+        tcp->eventSource.free(&tcp->eventSource);
+        eventLoop->free(eventLoop);
+        return NULL;
+    }
+    if(eventLoop->start(eventLoop) != UA_STATUSCODE_GOOD)
+    {
+        eventLoop->free(eventLoop);
+        return NULL;
+    }
+    return eventLoop;
+}
+
+
+static void freeWorkerEventLoop(UA_EventLoop *eventLoop)
+{
+    if(eventLoop->state == UA_EVENTLOOPSTATE_STARTED)
+    {
+        eventLoop->stop(eventLoop);
+    }
+    while(eventLoop->state != UA_EVENTLOOPSTATE_STOPPED &&
+          eventLoop->state != UA_EVENTLOOPSTATE_FRESH)
+    {
+        eventLoop->run(eventLoop, FLEET_MAX_WAIT_MS);
+    }
+    eventLoop->free(eventLoop);
+}
+
+
+/*
+ * Run the event loop for DISCOVERY_DEREGISTER_WAIT_MS, the equivalent of
+ * flushDiscoveryRequests for all servers of a worker
+ */
+static void flushWorkerEventLoop(UA_EventLoop *eventLoop)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + DISCOVERY_DEREGISTER_WAIT_MS * UA_DATETIME_MSEC;
+    while(UA_DateTime_nowMonotonic() < end)
+    {
+        eventLoop->run(eventLoop, 1);
+    }
+}
+
+
+/*
+ * A worker only runs the event loop, the server callbacks are dispatched
+ * from it. The timeout bounds the time until a stop is noticed.
+ */
+static void *runFleetWorker(void *data)
+{
+    FleetWorker *worker = (FleetWorker*)data;
+    while(!atomic_load_explicit(&worker->fleet->stop, memory_order_relaxed))
+    {
+        UA_DateTime start = UA_DateTime_nowMonotonic();
+        worker->eventLoop->run(worker->eventLoop, FLEET_MAX_WAIT_MS);
+        recordLatencySince(eventLoopMetric, start);
+    }
+    return NULL;
+}
+
+
+UA_StatusCode startFleet(Fleet *fleet, size_t workersSize)
+{
+    serversMetric = registerMetric("Servers", "Number of running servers", METRIC_GAUGE);
+    valueWritesMetric = registerMetric(
+        "ValueWrites", "Values written to the fill percentage and valve state of all servers",
+        METRIC_COUNTER);
+    eventLoopMetric = registerMetric(
+        "EventLoopIteration", "Duration of a worker event loop iteration, including the wait for network events",
+        METRIC_LATENCY);
+
+    if(workersSize == 0)
+    {
+        workersSize = 1;
+    }
+    if(workersSize > fleet->serversSize)
+    {
+        workersSize = fleet->serversSize;
+    }
+    fleet->workers = calloc(workersSize, sizeof(FleetWorker));
+    if(!fleet->workers)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    fleet->workersSize = workersSize;
+
+    for(size_t i = 0; i < fleet->workersSize; i++)
+    {
+        fleet->workers[i].fleet = fleet;
+        fleet->workers[i].eventLoop = newWorkerEventLoop();
+        if(!fleet->workers[i].eventLoop)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Unable to create the event loop of worker %zu", i);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+    }
+
+    /*
+     * Servers are dealt to the workers round robin
+     */
+    size_t started = 0;
+    for(size_t i = 0; i < fleet->serversSize; i++)
+    {
+        FleetServer *entry = &fleet->servers[i];
+        UA_StatusCode retval = startFleetServer(fleet, entry, fleet->workers[i % fleet->workersSize].eventLoop);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Unable to start %s '%s' on port %u: %s", kindNames[entry->kind],
+                           entry->name, entry->port, UA_StatusCode_name(retval));
+            continue;
+        }
+        started++;
+    }
+    setGauge(serversMetric, (UA_Int64)started);
+    if(started == 0)
+    {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    for(size_t i = 0; i < fleet->workersSize; i++)
+    {
+        FleetWorker *worker = &fleet->workers[i];
+        if(pthread_create(&worker->thread, NULL, runFleetWorker, worker) != 0)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Unable to start worker %zu", i);
+            return UA_STATUSCODE_BADINTERNALERROR;
+        }
+        worker->running = true;
+    }
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Started %zu of %zu servers on %zu workers",
+                started, fleet->serversSize, fleet->workersSize);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void stopFleet(Fleet *fleet)
+{
+    atomic_store(&fleet->stop, true);
+    for(size_t i = 0; i < fleet->workersSize; i++)
+    {
+        if(fleet->workers[i].running)
+        {
+            pthread_join(fleet->workers[i].thread, NULL);
+            fleet->workers[i].running = false;
+        }
+    }
+
+    /*
+     * With the workers gone the event loops are driven from here. The
+     * deregistration requests of all servers of a worker go out in one
+     * run of its event loop.
+     */
+    if(fleet->discoveryUrl)
+    {
+        for(size_t i = 0; i < fleet->serversSize; i++)
+        {
+            FleetServer *entry = &fleet->servers[i];
+            if(entry->started)
+            {
+                stopDiscoveryRegistration(entry->server, &entry->registration);
+            }
+        }
+        for(size_t i = 0; i < fleet->workersSize && i < fleet->serversSize; i++)
+        {
+            if(fleet->workers[i].eventLoop)
+            {
+                flushWorkerEventLoop(fleet->workers[i].eventLoop);
+            }
+        }
+    }
+
+    /*
+     * The shutdown runs the loop until the server's connections are closed
+     */
+    for(size_t i = 0; i < fleet->serversSize; i++)
+    {
+        FleetServer *entry = &fleet->servers[i];
+        if(entry->started)
+        {
+            UA_Server_run_shutdown(entry->server);
+            entry->started = false;
+        }
+        if(entry->server)
+        {
+            UA_Server_delete(entry->server);
+            entry->server = NULL;
+        }
+    }
+
+    for(size_t i = 0; i < fleet->workersSize; i++)
+    {
+        if(fleet->workers[i].eventLoop)
+        {
+            freeWorkerEventLoop(fleet->workers[i].eventLoop);
+        }
+    }
+    free(fleet->workers);
+    fleet->workers = NULL;
+    fleet->workersSize = 0;
+    setGauge(serversMetric, 0);
+}
+
+
+void clearFleet(Fleet *fleet)
+{
+    free(fleet->servers);
+    initFleet(fleet);
+}
@@ -0,0 +1,93 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <open62541/server.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "discovery.h"
+#include "tank_state.h"
+
+/*
+ * Fleet of independent servers in one process. Every server keeps its own
+ * address space and listens on its own port, so each endpoint is addressed
+ * exactly like a standalone fillsensor-server or valve-server. Instead of a
+ * runtime per server, the servers are spread over a fixed pool of worker
+ * threads. Each worker owns one event loop that all of its servers share,
+ * so a worker waits on the sockets and timers of its servers in a single
+ * poll call.
+ *
+ * A server is only touched by the worker owning its event loop once the
+ * fleet is started.
+ *
+ * With a discovery URL every server registers with the LDS on its own,
+ * under an application URI that ends in its device ID.
+ */
+#define FLEET_NAME_SIZE 32
+#define FLEET_MAX_WAIT_MS 50
+
+typedef enum {
+    FLEET_FILLSENSOR = 0,
+    FLEET_VALVE,
+} FleetServerKind;
+
+/*
+ * One line of the configuration file
+ *
+ *   <fillsensor|valve> <port> <instance name> <device ID> <location>
+ *
+ * e.g. 'fillsensor 4840 tank1 T1 P01B02R12'. Empty lines and lines
+ * starting with '#' are skipped.
+ */
+typedef struct {
+    FleetServerKind kind;
+    UA_UInt16 port;
+    char name[FLEET_NAME_SIZE];
+    char deviceId[FLEET_NAME_SIZE];
+    char location[FLEET_NAME_SIZE];
+    UA_Server *server;
+    UA_Boolean started;
+    DiscoveryRegistration registration;
+    UA_NodeId stateNodeIdent;   /* of fill sensors only */
+    TankState state;
+} FleetServer;
+
+struct Fleet;
+
+typedef struct {
+    struct Fleet *fleet;
+    UA_EventLoop *eventLoop;
+    pthread_t thread;
+    UA_Boolean running;
+} FleetWorker;
+
+typedef struct Fleet {
+    FleetServer *servers;
+    size_t serversSize;
+    FleetWorker *workers;
+    size_t workersSize;
+    atomic_bool stop;
+    const char *discoveryUrl;   /* NULL if the servers do not register */
+} Fleet;
+
+void initFleet(Fleet *fleet);
+
+/*
+ * Read the servers from the configuration file, ports must be unique
+ */
+UA_StatusCode loadFleetConfig(Fleet *fleet, const char *path);
+
+/*
+ * Create and start all servers on the given number of workers. A server
+ * that fails to start is logged and skipped, it fails only if no server
+ * could be started.
+ */
+UA_StatusCode startFleet(Fleet *fleet, size_t workersSize);
+
+/*
+ * Stop the workers, deregister, shut down and delete all servers
+ */
+void stopFleet(Fleet *fleet);
+
+void clearFleet(Fleet *fleet);
+
+#endif
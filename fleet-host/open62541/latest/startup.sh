@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# treat undefined variables as an error
+set -u
+
+# servers of the fleet, see /etc/fleet-host/fleet.conf for the format
+config="${FLEET_CONFIG:-/etc/fleet-host/fleet.conf}"
+
+# if FLEET_THREADS is set, run the servers on that many worker threads
+threads_opt=""
+if [ -n "${FLEET_THREADS:-}" ]; then
+  threads_opt="--threads=${FLEET_THREADS}"
+fi
+
+# if METRICS_ADDRESS is set, serve Prometheus metrics on [ADDR:]PORT
+metrics_opt=""
+if [ -n "${METRICS_ADDRESS:-}" ]; then
+  metrics_opt="--metrics=${METRICS_ADDRESS}"
+fi
+
+# if LDS_URL is set, every server registers with the local discovery server
+lds_opt=""
+if [ -n "${LDS_URL:-}" ]; then
+  lds_opt="--lds=${LDS_URL}"
+fi
+
+/usr/local/bin/fleet-host --config="$config" $threads_opt $metrics_opt $lds_opt
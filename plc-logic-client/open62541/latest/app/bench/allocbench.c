@@ -0,0 +1,197 @@
+/*
+ * Allocation counting harness for the control loop. It feeds simulated
+ * fill percentage notifications through the same path as the live client
+ * (decision, valve write, database inserts, latency trace) and counts the
+ * heap allocations made while doing so. The valve write goes to a stub, as
+ * the request is encoded and sent by the open62541 client.
+ *
+ * The harness fails if a single allocation happens after the warm-up.
+ *
+ * Usage: allocbench [notifications] [database]
+ */
+#include <malloc.h>
+#include <open62541/types.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "control.h"
+#include "database.h"
+#include "sqlitemem.h"
+#include "trace.h"
+
+#define WARMUP_NOTIFICATIONS 100000
+
+
+/*
+ * Count allocations by wrapping the glibc allocator
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static size_t allocations = 0;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    allocations++;
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+
+static UA_UInt64 valveWrites = 0;
+
+static UA_StatusCode writeValveStub(void *writerContext, UA_Boolean valveOpen, UA_DateTime decisionTime)
+{
+    valveWrites++;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static const char *createTables =
+    "CREATE TABLE IF NOT EXISTS waterlevel ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    level REAL NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS valveposition ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    position INTEGER NOT NULL);"
+    "PRAGMA synchronous=OFF;";
+
+
+/*
+ * Feed notifications with a triangle wave between 0% and 100%, which makes
+ * the valve move twice per period
+ */
+static void runNotifications(ControlLoop *loop, UA_UInt64 count, UA_UInt64 *sample)
+{
+    UA_DataValue value;
+    UA_DataValue_init(&value);
+    UA_Double fillPercentage = 0.;
+    UA_Variant_setScalar(&value.value, &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE]);
+    value.hasValue = true;
+    value.hasSourceTimestamp = true;
+
+    for(UA_UInt64 i = 0; i < count; i++, (*sample)++)
+    {
+        UA_UInt64 phase = *sample % 200;
+        fillPercentage = (UA_Double)(phase < 100 ? phase : 200 - phase);
+        value.sourceTimestamp = UA_DateTime_now();
+        processSample(loop, &value);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    UA_UInt64 notifications = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    char tmpname[] = "/tmp/allocbench-XXXXXX";
+    const char *dbname = argc > 2 ? argv[2] : NULL;
+    int retval = EXIT_FAILURE;
+
+    if(!dbname)
+    {
+        int fd = mkstemp(tmpname);
+        if(fd < 0)
+        {
+            perror("mkstemp");
+            return EXIT_FAILURE;
+        }
+        close(fd);
+        dbname = tmpname;
+    }
+
+    initSqliteMemory();
+
+    sqlite3 *db;
+    if(sqlite3_open(dbname, &db) != SQLITE_OK ||
+       sqlite3_exec(db, createTables, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "Unable to set up database %s: %s\n", dbname, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    ProcessDatabase database;
+    if(prepareProcessDatabase(&database, db) != UA_STATUSCODE_GOOD)
+    {
+        goto cleanup;
+    }
+
+    TraceHistograms traces;
+    initTraceHistograms(&traces);
+    ControlLoop loop;
+    initControlLoop(&loop, &database, &traces, writeValveStub, NULL);
+
+    /*
+     * The warm-up fills the page cache and the memory pool of SQLite and
+     * the stdio buffers
+     */
+    UA_UInt64 sample = 0;
+    runNotifications(&loop, WARMUP_NOTIFICATIONS, &sample);
+
+    size_t before = allocations;
+    UA_UInt64 writesBefore = valveWrites;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    runNotifications(&loop, notifications, &sample);
+    UA_DateTime end = UA_DateTime_nowMonotonic();
+    size_t counted = allocations - before;
+
+    UA_Double seconds = (UA_Double)(end - start) / UA_DATETIME_SEC;
+    printf("%llu notifications, %llu valve writes in %.3f s (%.0f notifications/s)\n",
+           (unsigned long long)notifications,
+           (unsigned long long)(valveWrites - writesBefore),
+           seconds, seconds > 0. ? (UA_Double)notifications / seconds : 0.);
+    printf("%zu heap allocations after warm-up (%.3f per notification)\n",
+           counted, notifications ? (UA_Double)counted / (UA_Double)notifications : 0.);
+    printTraceHistograms(&traces, stdout);
+    retval = counted == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    finalizeProcessDatabase(&database);
+
+cleanup:
+    sqlite3_close(db);
+    if(dbname == tmpname)
+    {
+        unlink(tmpname);
+    }
+    return retval;
+}
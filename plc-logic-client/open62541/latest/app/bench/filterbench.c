@@ -0,0 +1,489 @@
+/*
+ * Benchmark of the storage filter of storefilter.h on a day of fill level
+ * samples. The day is read from the waterlevel table of a recorded
+ * database, or simulated: the tank fills and drains between the
+ * thresholds of the two-point control with sensor noise, sampled at the
+ * interval given.
+ *
+ * Per filter the benchmark reports the writes (rows stored), the bytes of
+ * the SQLite table and of the time-series store, also in relation to the
+ * first filter, and the largest error of reconstructing every sample from
+ * the ones stored, holding them for the deadband and interpolating
+ * linearly for the swinging door. The benchmark fails if the error
+ * exceeds the deviation of the filter.
+ *
+ * Usage: filterbench [-r database] [-i interval] [-d dir] [SPEC...]
+ */
+#include <argp.h>
+#include <dirent.h>
+#include <math.h>
+#include <open62541/types.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "storefilter.h"
+#include "tsstore.h"
+
+#define DAY_SECONDS 86400
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "filterbench 0.1";
+static char doc[] = "Measures the writes and bytes saved by storage filters on a day of fill level samples";
+static char args_doc[] = "[SPEC...]";
+static struct argp_option options[] = {
+    {"recorded", 'r', "PATH", 0, "Read the last day of the waterlevel table of this database instead of simulating one" },
+    {"interval", 'i', "MS",   0, "Sampling interval of the simulated day [default: 100]" },
+    {"dir",      'd', "DIR",  0, "Directory for the database and the store [default: a new one in /tmp]" },
+    { 0 }
+};
+
+#define MAX_SPECS 16
+
+struct arguments
+{
+    char *recorded;
+    UA_UInt32 interval;
+    char *dir;
+    char *specs[MAX_SPECS];
+    size_t specsSize;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'r': {
+            arguments->recorded = arg;
+            break;
+        }
+        case 'i': {
+            arguments->interval = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'd': {
+            arguments->dir = arg;
+            break;
+        }
+        case ARGP_KEY_ARG: {
+            if(arguments->specsSize == MAX_SPECS)
+            {
+                argp_error(state, "At most %d filters", MAX_SPECS);
+            }
+            arguments->specs[arguments->specsSize++] = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static char *defaultSpecs[] = {
+    "all", "change", "deadband=0.1", "deadband=0.5", "deadband=1%",
+    "swing=0.1", "swing=0.5", "swing=0.5,heartbeat=60",
+};
+
+
+typedef struct {
+    StoredSample *samples;
+    size_t size;
+} Day;
+
+static UA_Int64 unixSeconds(UA_DateTime time)
+{
+    return (time - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC;
+}
+
+
+/*
+ * The tank fills by 0.02% per second and drains by 0.03% per second while
+ * the valve is open, the sensor reads to 0.01% with +-0.05% of noise
+ */
+static int simulateDay(Day *day, UA_UInt32 interval, UA_DateTime start)
+{
+    day->size = (size_t)DAY_SECONDS * 1000 / interval;
+    day->samples = (StoredSample*)malloc(day->size * sizeof(StoredSample));
+    if(!day->samples)
+    {
+        return EXIT_FAILURE;
+    }
+
+    unsigned int seed = 1;
+    UA_Double level = 50.;
+    UA_Boolean valveOpen = false;
+    UA_Double seconds = (UA_Double)interval / 1000.;
+    for(size_t i = 0; i < day->size; i++)
+    {
+        level += (valveOpen ? -.03 : .02) * seconds;
+        if(level > 75.)
+        {
+            valveOpen = true;
+        }
+        else if(level < 25.)
+        {
+            valveOpen = false;
+        }
+        UA_Double noise = (UA_Double)(rand_r(&seed) % 11 - 5) / 100.;
+        day->samples[i].time = start + (UA_DateTime)i * interval * UA_DATETIME_MSEC;
+        day->samples[i].value = round((level + noise) * 100.) / 100.;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/*
+ * The table keeps whole seconds, the samples of a second are spread
+ * evenly over it
+ */
+static int readRecordedDay(Day *day, const char *dbname)
+{
+    int retval = EXIT_FAILURE;
+    sqlite3_stmt *select = NULL;
+    sqlite3 *db;
+    if(   sqlite3_open_v2(dbname, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "SELECT CAST(strftime('%s', timestamp) AS INTEGER), level FROM waterlevel "
+                             "WHERE timestamp >= (SELECT datetime(max(timestamp), '-1 day') "
+                             "FROM waterlevel) ORDER BY id", -1, &select, NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "Unable to read database %s: %s\n", dbname, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    size_t capacity = 0;
+    day->samples = NULL;
+    day->size = 0;
+    while(sqlite3_step(select) == SQLITE_ROW)
+    {
+        if(day->size == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 65536;
+            StoredSample *samples = (StoredSample*)realloc(day->samples, capacity * sizeof(StoredSample));
+            if(!samples)
+            {
+                goto cleanup;
+            }
+            day->samples = samples;
+        }
+        day->samples[day->size].time =
+            sqlite3_column_int64(select, 0) * UA_DATETIME_SEC + UA_DATETIME_UNIX_EPOCH;
+        day->samples[day->size].value = sqlite3_column_double(select, 1);
+        day->size++;
+    }
+
+    for(size_t first = 0; first < day->size;)
+    {
+        size_t last = first;
+        while(last < day->size && day->samples[last].time == day->samples[first].time)
+        {
+            last++;
+        }
+        for(size_t i = first; i < last; i++)
+        {
+            day->samples[i].time += (UA_DateTime)(i - first) * UA_DATETIME_SEC / (UA_DateTime)(last - first);
+        }
+        first = last;
+    }
+    retval = day->size > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    if(day->size == 0)
+    {
+        fprintf(stderr, "No samples in %s\n", dbname);
+    }
+
+cleanup:
+    sqlite3_finalize(select);
+    sqlite3_close(db);
+    return retval;
+}
+
+
+/*
+ * Largest difference of a sample to the reconstruction from the stored
+ * samples, in relation to the deviation the filter allows at that sample
+ */
+typedef struct {
+    UA_Double error;
+    UA_Double excess;
+} Reconstruction;
+
+static UA_Double allowedDeviation(const StoreFilterConfig *config, UA_Double stored)
+{
+    return config->relative ? config->deviation / 100. * fabs(stored) : config->deviation;
+}
+
+static void checkReconstruction(const Day *day, const StoredSample *stored, size_t storedSize,
+                                const StoreFilterConfig *config, Reconstruction *result)
+{
+    result->error = 0.;
+    result->excess = 0.;
+    size_t next = 0;
+    for(size_t i = 0; i < day->size; i++)
+    {
+        const StoredSample *sample = &day->samples[i];
+        while(next < storedSize && stored[next].time <= sample->time)
+        {
+            next++;
+        }
+        const StoredSample *before = &stored[next - 1];
+        UA_Double value = before->value;
+        if(config->mode == STORE_FILTER_SWINGING_DOOR && next < storedSize)
+        {
+            const StoredSample *after = &stored[next];
+            value += (after->value - before->value)
+                   * (UA_Double)(sample->time - before->time)
+                   / (UA_Double)(after->time - before->time);
+        }
+        UA_Double error = fabs(value - sample->value);
+        result->error = fmax(result->error, error);
+        /*
+         * Rounding of the interpolation is tolerated
+         */
+        UA_Double excess = error - allowedDeviation(config, before->value) - 1e-9;
+        result->excess = fmax(result->excess, excess);
+    }
+}
+
+
+static const char *createWaterlevel =
+    "CREATE TABLE IF NOT EXISTS waterlevel ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    level REAL NOT NULL);"
+    "PRAGMA synchronous=OFF;";
+
+/*
+ * One transaction per sample like the live client
+ */
+static int storeSqlite(const char *dbname, const StoredSample *stored, size_t storedSize,
+                       UA_UInt64 *bytes)
+{
+    int retval = EXIT_FAILURE;
+    sqlite3_stmt *insert = NULL;
+    sqlite3_stmt *size = NULL;
+    sqlite3 *db;
+    if(   sqlite3_open(dbname, &db) != SQLITE_OK
+       || sqlite3_exec(db, createWaterlevel, NULL, NULL, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "INSERT INTO waterlevel (timestamp, level) "
+                             "VALUES (datetime(?, 'unixepoch'), ?)", -1, &insert, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "SELECT page_count * page_size FROM pragma_page_count(), "
+                             "pragma_page_size()", -1, &size, NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "Unable to set up database %s: %s\n", dbname, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < storedSize; i++)
+    {
+        sqlite3_bind_int64(insert, 1, unixSeconds(stored[i].time));
+        sqlite3_bind_double(insert, 2, stored[i].value);
+        if(sqlite3_step(insert) != SQLITE_DONE)
+        {
+            fprintf(stderr, "Insert failed: %s\n", sqlite3_errmsg(db));
+            goto cleanup;
+        }
+        sqlite3_reset(insert);
+    }
+
+    if(sqlite3_step(size) != SQLITE_ROW)
+    {
+        fprintf(stderr, "Unable to get the database size: %s\n", sqlite3_errmsg(db));
+        goto cleanup;
+    }
+    *bytes = (UA_UInt64)sqlite3_column_int64(size, 0);
+    retval = EXIT_SUCCESS;
+
+cleanup:
+    sqlite3_finalize(insert);
+    sqlite3_finalize(size);
+    sqlite3_close(db);
+    return retval;
+}
+
+
+static int storeTimeSeries(const char *dir, const StoredSample *stored, size_t storedSize,
+                           UA_UInt64 *bytes)
+{
+    TimeSeries series;
+    if(openTimeSeries(&series, dir, "waterlevel", true) != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to open time series in %s\n", dir);
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < storedSize; i++)
+    {
+        if(appendTimeSeries(&series, stored[i].time, stored[i].value) != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Append failed\n");
+            closeTimeSeries(&series);
+            return EXIT_FAILURE;
+        }
+    }
+    *bytes = timeSeriesBytesUsed(&series);
+    closeTimeSeries(&series);
+    return EXIT_SUCCESS;
+}
+
+
+static void removeStore(const char *dir)
+{
+    DIR *entries = opendir(dir);
+    if(!entries)
+    {
+        return;
+    }
+    struct dirent *entry;
+    char path[4096];
+    while((entry = readdir(entries)) != NULL)
+    {
+        if(entry->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(entries);
+    rmdir(dir);
+}
+
+
+static int benchFilter(const Day *day, const char *spec, const char *dir,
+                       StoredSample *stored, UA_UInt64 baseline[2])
+{
+    StoreFilterConfig config;
+    if(parseStoreFilter(spec, &config) != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Invalid filter '%s'\n", spec);
+        return EXIT_FAILURE;
+    }
+
+    StoreFilter filter;
+    initStoreFilter(&filter, &config);
+    size_t storedSize = 0;
+    for(size_t i = 0; i < day->size; i++)
+    {
+        storedSize += filterSample(&filter, day->samples[i].time, day->samples[i].value,
+                                   &stored[storedSize]);
+    }
+    storedSize += flushStoreFilter(&filter, &stored[storedSize]);
+
+    Reconstruction reconstruction;
+    checkReconstruction(day, stored, storedSize, &config, &reconstruction);
+
+    char dbname[4096];
+    char storedir[4096];
+    snprintf(dbname, sizeof(dbname), "%s/filtered.sqlite3", dir);
+    snprintf(storedir, sizeof(storedir), "%s/filtered", dir);
+    UA_UInt64 bytes[2] = {0, 0};
+    int retval = storeSqlite(dbname, stored, storedSize, &bytes[0]);
+    if(retval == EXIT_SUCCESS)
+    {
+        retval = storeTimeSeries(storedir, stored, storedSize, &bytes[1]);
+    }
+    unlink(dbname);
+    removeStore(storedir);
+    if(retval != EXIT_SUCCESS)
+    {
+        return retval;
+    }
+
+    if(baseline[0] == 0)
+    {
+        baseline[0] = bytes[0];
+        baseline[1] = bytes[1];
+    }
+    printf("%-24s %10zu %7.2f%% %12llu %7.2f%% %12llu %7.2f%% %10.3f\n",
+           spec, storedSize, 100. * (UA_Double)storedSize / (UA_Double)day->size,
+           (unsigned long long)bytes[0], 100. * (UA_Double)bytes[0] / (UA_Double)baseline[0],
+           (unsigned long long)bytes[1], 100. * (UA_Double)bytes[1] / (UA_Double)baseline[1],
+           reconstruction.error);
+    if(reconstruction.excess > 0.)
+    {
+        fprintf(stderr, "Reconstruction exceeds the deviation of '%s' by %g\n",
+                spec, reconstruction.excess);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .recorded = NULL,
+        .interval = 100,
+        .dir = NULL,
+        .specsSize = 0,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    char **specs = arguments.specs;
+    size_t specsSize = arguments.specsSize;
+    if(specsSize == 0)
+    {
+        specs = defaultSpecs;
+        specsSize = sizeof(defaultSpecs) / sizeof(defaultSpecs[0]);
+    }
+    if(arguments.interval == 0)
+    {
+        fprintf(stderr, "The interval has to be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    Day day;
+    int retval;
+    if(arguments.recorded)
+    {
+        retval = readRecordedDay(&day, arguments.recorded);
+    }
+    else
+    {
+        retval = simulateDay(&day, arguments.interval,
+                             UA_DateTime_now() / UA_DATETIME_SEC * UA_DATETIME_SEC);
+    }
+    if(retval != EXIT_SUCCESS)
+    {
+        return retval;
+    }
+
+    /*
+     * A filter stores at most every sample once
+     */
+    StoredSample *stored = (StoredSample*)malloc(day.size * sizeof(StoredSample));
+    char tmpdir[] = "/tmp/filterbench-XXXXXX";
+    const char *dir = arguments.dir;
+    if(!dir)
+    {
+        dir = mkdtemp(tmpdir);
+    }
+    if(!stored || !dir)
+    {
+        fprintf(stderr, "Unable to set up the benchmark\n");
+        free(day.samples);
+        free(stored);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu samples of %s\n", day.size, arguments.recorded ? arguments.recorded : "a simulated day");
+    printf("%-24s %10s %8s %12s %8s %12s %8s %10s\n", "filter", "writes", "",
+           "sqlite bytes", "", "store bytes", "", "max error");
+    UA_UInt64 baseline[2] = {0, 0};
+    for(size_t i = 0; i < specsSize && retval == EXIT_SUCCESS; i++)
+    {
+        retval = benchFilter(&day, specs[i], dir, stored, baseline);
+    }
+
+    if(dir == tmpdir)
+    {
+        rmdir(tmpdir);
+    }
+    free(day.samples);
+    free(stored);
+    return retval;
+}
@@ -0,0 +1,551 @@
+/*
+ * Scenario runner for the control loop under network impairments. A sensor
+ * and a valve server run in-process on loopback, the sensor publishes a
+ * triangle wave of fill percentages at a fixed period. For every network
+ * profile, the sensor and actuator clients are connected through the fault
+ * injection layer of netfault.h and drive the same control loop as the live
+ * client (decision, valve write, database inserts, latency trace).
+ *
+ * The monitored item has a queue size of one, so samples the impaired link
+ * cannot deliver in time are overwritten on the server and show up as gaps
+ * in the source timestamps. Per profile the runner reports the samples
+ * processed, the samples missed and percentiles of the latency from the
+ * sensor to the decision input, of the valve write and of the whole loop.
+ *
+ * By default the subscription publishes every sampling interval. With -D
+ * it is created with the same defaults as by plc-logic-client instead, and
+ * the run fails if samples are counted as missed on the unimpaired link.
+ *
+ * Usage: netbench [-D] [-d seconds] [-i interval] [-p port] [PROFILE...]
+ *
+ * PROFILE is a built-in profile or a specification as accepted by
+ * --net-profile of plc-logic-client, all built-in profiles by default.
+ */
+#include <argp.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/client_subscriptions.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <open62541/types.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "control.h"
+#include "database.h"
+#include "netfault.h"
+#include "reconnect.h"
+#include "sqlitemem.h"
+#include "trace.h"
+
+#define WARMUP_MS 2000
+#define CONNECT_TIMEOUT_MS 10000
+#define FILLPERCENTAGE_NODEID 1001
+#define VALVE_OPEN_NODEID 1002
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "netbench 0.1";
+static char doc[] = "Runs the control loop against in-process servers over impaired connections";
+static char args_doc[] = "[PROFILE...]";
+static struct argp_option options[] = {
+    {"duration", 'd', "SECONDS", 0, "Measured run time per profile [default: 30]" },
+    {"interval", 'i', "MS",      0, "Sampling interval of the sensor [default: 100]" },
+    {"port",     'p', "PORT",    0, "Port of the sensor server, the valve server uses the next one [default: 4850]" },
+    {"client-defaults", 'D', 0,  0, "Subscribe with the defaults of plc-logic-client and check that no samples are missed without impairment" },
+    { 0 }
+};
+
+struct arguments
+{
+    UA_UInt32 duration;
+    UA_Double interval;
+    UA_UInt16 port;
+    UA_Boolean clientDefaults;
+    char **profiles;
+    size_t profilesSize;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'd': {
+            arguments->duration = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'i': {
+            arguments->interval = strtod(arg, NULL);
+            break;
+        }
+        case 'p': {
+            arguments->port = (UA_UInt16)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'D': {
+            arguments->clientDefaults = true;
+            break;
+        }
+        case ARGP_KEY_ARGS: {
+            arguments->profiles = state->argv + state->next;
+            arguments->profilesSize = (size_t)(state->argc - state->next);
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+/*
+ * In-process servers, each running its own event loop on a thread
+ */
+typedef struct {
+    UA_Server *server;
+    pthread_t thread;
+    UA_UInt64 sample;
+} BenchServer;
+
+static volatile UA_Boolean serversRunning = true;
+
+
+static void *runBenchServer(void *data)
+{
+    BenchServer *bs = (BenchServer*)data;
+    UA_Server_run(bs->server, &serversRunning);
+    return NULL;
+}
+
+
+static UA_StatusCode addBenchVariable(UA_Server *server, UA_UInt32 id, char *name,
+                                      void *value, const UA_DataType *type)
+{
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setScalar(&attr.value, value, type);
+    attr.dataType = type->typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    return UA_Server_addVariableNode(server, UA_NODEID_NUMERIC(1, id),
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                     UA_QUALIFIEDNAME(1, name),
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                     attr, NULL, NULL);
+}
+
+
+/*
+ * Triangle wave between 0% and 100%, which makes the valve move twice per
+ * 200 samples
+ */
+static void writeFillPercentage(UA_Server *server, void *data)
+{
+    BenchServer *bs = (BenchServer*)data;
+    UA_UInt64 phase = bs->sample++ % 200;
+    UA_Double fillPercentage = (UA_Double)(phase < 100 ? phase : 200 - phase);
+
+    UA_DataValue value;
+    UA_DataValue_init(&value);
+    UA_Variant_setScalar(&value.value, &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE]);
+    value.hasValue = true;
+    value.sourceTimestamp = UA_DateTime_now();
+    value.hasSourceTimestamp = true;
+    UA_Server_writeDataValue(server, UA_NODEID_NUMERIC(1, FILLPERCENTAGE_NODEID), value);
+}
+
+
+static UA_StatusCode startBenchServer(BenchServer *bs, UA_UInt16 port, UA_Double interval,
+                                      UA_Boolean sensor)
+{
+    memset(bs, 0, sizeof(BenchServer));
+    bs->server = UA_Server_new();
+    if(!bs->server)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    /*
+     * Sampling is allowed down to the interval of the sensor
+     */
+    UA_ServerConfig *config = UA_Server_getConfig(bs->server);
+    UA_StatusCode retval = UA_ServerConfig_setMinimal(config, port, NULL);
+    config->samplingIntervalLimits.min = interval;
+    config->publishingIntervalLimits.min = interval;
+
+    UA_Double fillPercentage = 0.;
+    UA_Boolean open = false;
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = sensor ?
+            addBenchVariable(bs->server, FILLPERCENTAGE_NODEID, "FillPercentage",
+                             &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE]) :
+            addBenchVariable(bs->server, VALVE_OPEN_NODEID, "Open",
+                             &open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    }
+    if(retval == UA_STATUSCODE_GOOD && sensor)
+    {
+        retval = UA_Server_addRepeatedCallback(bs->server, writeFillPercentage, bs,
+                                               interval, NULL);
+    }
+    if(retval != UA_STATUSCODE_GOOD || pthread_create(&bs->thread, NULL, runBenchServer, bs) != 0)
+    {
+        UA_Server_delete(bs->server);
+        bs->server = NULL;
+        return retval != UA_STATUSCODE_GOOD ? retval : UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static void stopBenchServer(BenchServer *bs)
+{
+    if(!bs->server)
+    {
+        return;
+    }
+    pthread_join(bs->thread, NULL);
+    UA_Server_delete(bs->server);
+    bs->server = NULL;
+}
+
+
+/*
+ * Clients of one scenario, both connected through the impaired link
+ */
+typedef struct {
+    UA_Client *sclient;
+    UA_Client *aclient;
+    ControlLoop loop;
+} Scenario;
+
+
+static UA_StatusCode writeValveOpen(void *writerContext, UA_Boolean valveOpen,
+                                    UA_DateTime decisionTime)
+{
+    Scenario *scenario = (Scenario*)writerContext;
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &valveOpen, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    return UA_Client_writeValueAttribute(scenario->aclient,
+                                         UA_NODEID_NUMERIC(1, VALVE_OPEN_NODEID), &value);
+}
+
+
+static void fillPercentageChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
+                                  UA_UInt32 monId, void *monContext, UA_DataValue *value)
+{
+    Scenario *scenario = (Scenario*)monContext;
+    processSample(&scenario->loop, value);
+}
+
+
+static UA_Client *newFaultyClient(const NetFaultProfile *profile)
+{
+    UA_ClientConfig cc;
+    memset(&cc, 0, sizeof(UA_ClientConfig));
+    cc.eventLoop = newFaultyEventLoop(profile, UA_Log_Stdout);
+    if(!cc.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ClientConfig_setDefault(&cc);
+    return UA_Client_newWithConfig(&cc);
+}
+
+
+/*
+ * The loop expects the samples at the interval derived from the revised
+ * parameters, as in plc-logic-client
+ */
+static UA_StatusCode subscribeFillPercentage(Scenario *scenario, UA_Double interval,
+                                             UA_Boolean clientDefaults)
+{
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    if(!clientDefaults)
+    {
+        request.requestedPublishingInterval = interval;
+    }
+    UA_CreateSubscriptionResponse response =
+        UA_Client_Subscriptions_create(scenario->sclient, request, NULL, NULL, NULL);
+    if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+    {
+        return response.responseHeader.serviceResult;
+    }
+
+    UA_MonitoredItemCreateRequest monRequest =
+        UA_MonitoredItemCreateRequest_default(UA_NODEID_NUMERIC(1, FILLPERCENTAGE_NODEID));
+    if(!clientDefaults)
+    {
+        monRequest.requestedParameters.samplingInterval = interval;
+        monRequest.requestedParameters.queueSize = 1;
+        monRequest.requestedParameters.discardOldest = true;
+    }
+    UA_MonitoredItemCreateResult monResponse = UA_Client_MonitoredItems_createDataChange(
+        scenario->sclient, response.subscriptionId, UA_TIMESTAMPSTORETURN_BOTH,
+        monRequest, scenario, fillPercentageChanged, NULL);
+    if(monResponse.statusCode == UA_STATUSCODE_GOOD)
+    {
+        setDeliveryInterval(&scenario->loop, monResponse.revisedSamplingInterval,
+                            response.revisedPublishingInterval, monResponse.revisedQueueSize);
+    }
+    return monResponse.statusCode;
+}
+
+
+static void runScenarioFor(Scenario *scenario, UA_UInt32 ms)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + (UA_DateTime)ms * UA_DATETIME_MSEC;
+    while(UA_DateTime_nowMonotonic() < end)
+    {
+        UA_Client_run_iterate(scenario->sclient, 10);
+        UA_Client_run_iterate(scenario->aclient, 0);
+    }
+}
+
+
+static void printResultHeader(void)
+{
+    printf("%-24s %8s %8s %8s %10s %10s %10s %10s %10s\n",
+           "profile", "samples", "missed", "missed%",
+           "arrive p50", "arrive p99", "write p50", "write p99", "loop p99");
+}
+
+
+/*
+ * Connect, warm up and measure a single profile. The histogram values are
+ * microseconds and printed as milliseconds.
+ */
+static UA_StatusCode runScenario(Scenario *scenario, const NetFaultProfile *profile,
+                                 const char *urls[], const struct arguments *arguments)
+{
+    scenario->sclient = newFaultyClient(profile);
+    scenario->aclient = newFaultyClient(profile);
+    if(!scenario->sclient || !scenario->aclient)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    UA_Client *clients[] = {scenario->sclient, scenario->aclient};
+    const char *names[] = {"sensor", "actuator"};
+    UA_StatusCode retval = connectClients(clients, urls, names, 2, CONNECT_TIMEOUT_MS);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = subscribeFillPercentage(scenario, arguments->interval, arguments->clientDefaults);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    /*
+     * The gap to the last sample of the previous profile is not a miss
+     */
+    ControlLoop *loop = &scenario->loop;
+    loop->lastSourceTime = 0;
+    runScenarioFor(scenario, WARMUP_MS);
+
+    TraceHistograms *traces = loop->traces;
+    for(size_t i = 0; i < TRACE_INTERVALS; i++)
+    {
+        initHistogram(&traces->intervals[i]);
+    }
+    UA_UInt64 samples = getCounterValue(loop->samples);
+    UA_UInt64 missed = getCounterValue(loop->missedSamples);
+    UA_UInt64 writeErrors = getCounterValue(loop->valveWriteErrors);
+    runScenarioFor(scenario, arguments->duration * 1000);
+    samples = getCounterValue(loop->samples) - samples;
+    missed = getCounterValue(loop->missedSamples) - missed;
+    writeErrors = getCounterValue(loop->valveWriteErrors) - writeErrors;
+
+    printf("%-24s %8llu %8llu %7.2f%% %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           profile->name, (unsigned long long)samples, (unsigned long long)missed,
+           samples + missed > 0 ? 100. * (UA_Double)missed / (UA_Double)(samples + missed) : 0.,
+           getHistogramPercentile(&traces->intervals[TRACE_SENSOR_TO_ARRIVAL], 50.) / 1000.,
+           getHistogramPercentile(&traces->intervals[TRACE_SENSOR_TO_ARRIVAL], 99.) / 1000.,
+           getHistogramPercentile(&traces->intervals[TRACE_DECISION_TO_WRITTEN], 50.) / 1000.,
+           getHistogramPercentile(&traces->intervals[TRACE_DECISION_TO_WRITTEN], 99.) / 1000.,
+           getHistogramPercentile(&traces->intervals[TRACE_SENSOR_TO_COMMITTED], 99.) / 1000.);
+    if(writeErrors > 0)
+    {
+        printf("%-24s %llu valve writes failed\n", "", (unsigned long long)writeErrors);
+    }
+    fflush(stdout);
+
+    /*
+     * Without impairment the loop sees every sample the subscription
+     * delivers, so a miss means the expected interval does not match it
+     */
+    UA_Boolean unimpaired = profile->latency == 0. && profile->jitter == 0. &&
+                            profile->bandwidth == 0 && profile->stallInterval == 0;
+    if(arguments->clientDefaults && unimpaired && missed > samples / 100)
+    {
+        printf("%-24s samples missed without impairment\n", "");
+        return UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static void clearScenario(Scenario *scenario)
+{
+    if(scenario->sclient)
+    {
+        UA_Client_disconnect(scenario->sclient);
+        UA_Client_delete(scenario->sclient);
+        scenario->sclient = NULL;
+    }
+    if(scenario->aclient)
+    {
+        UA_Client_disconnect(scenario->aclient);
+        UA_Client_delete(scenario->aclient);
+        scenario->aclient = NULL;
+    }
+}
+
+
+static const char *createTables =
+    "CREATE TABLE IF NOT EXISTS waterlevel ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    level REAL NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS valveposition ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    position INTEGER NOT NULL);"
+    "PRAGMA synchronous=OFF;";
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .duration = 30,
+        .interval = 100.,
+        .port = 4850,
+        .clientDefaults = false,
+        .profiles = NULL,
+        .profilesSize = 0,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(arguments.interval <= 0.)
+    {
+        fprintf(stderr, "Invalid sampling interval\n");
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Profiles are parsed up front, so a typo does not abort a long run
+     */
+    size_t profilesSize = arguments.profilesSize ? arguments.profilesSize : netFaultProfilesSize;
+    NetFaultProfile *profiles = (NetFaultProfile*)calloc(profilesSize, sizeof(NetFaultProfile));
+    if(!profiles)
+    {
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < profilesSize; i++)
+    {
+        if(!arguments.profilesSize)
+        {
+            profiles[i] = netFaultProfiles[i];
+        }
+        else if(parseNetFaultProfile(arguments.profiles[i], &profiles[i]) != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Invalid network profile '%s'\n", arguments.profiles[i]);
+            free(profiles);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int retval = EXIT_FAILURE;
+    char tmpname[] = "/tmp/netbench-XXXXXX";
+    int fd = mkstemp(tmpname);
+    if(fd < 0)
+    {
+        perror("mkstemp");
+        free(profiles);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    initSqliteMemory();
+
+    sqlite3 *db;
+    ProcessDatabase database;
+    if(sqlite3_open(tmpname, &db) != SQLITE_OK ||
+       sqlite3_exec(db, createTables, NULL, NULL, NULL) != SQLITE_OK ||
+       prepareProcessDatabase(&database, db) != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to set up database %s: %s\n", tmpname, sqlite3_errmsg(db));
+        goto cleanup_db;
+    }
+
+    BenchServer sensor;
+    BenchServer valve;
+    if(startBenchServer(&sensor, arguments.port, arguments.interval, true) != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to start the sensor server on port %u\n", arguments.port);
+        goto cleanup_database;
+    }
+    if(startBenchServer(&valve, (UA_UInt16)(arguments.port + 1), arguments.interval, false) !=
+       UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to start the valve server on port %u\n", arguments.port + 1);
+        serversRunning = false;
+        stopBenchServer(&sensor);
+        goto cleanup_database;
+    }
+
+    char surl[64];
+    char aurl[64];
+    snprintf(surl, sizeof(surl), "opc.tcp://127.0.0.1:%u", arguments.port);
+    snprintf(aurl, sizeof(aurl), "opc.tcp://127.0.0.1:%u", arguments.port + 1);
+    const char *urls[] = {surl, aurl};
+
+    /*
+     * The loop and its histograms are shared by all profiles, as the
+     * metrics they register cannot be removed again
+     */
+    TraceHistograms traces;
+    initTraceHistograms(&traces);
+    Scenario scenario;
+    memset(&scenario, 0, sizeof(Scenario));
+    initControlLoop(&scenario.loop, &database, &traces, writeValveOpen, &scenario);
+
+    printf("%u s per profile, sampling every %.1f ms, latencies in ms\n",
+           arguments.duration, arguments.interval);
+    printResultHeader();
+    retval = EXIT_SUCCESS;
+    for(size_t i = 0; i < profilesSize; i++)
+    {
+        UA_StatusCode status = runScenario(&scenario, &profiles[i], urls, &arguments);
+        if(status != UA_STATUSCODE_GOOD)
+        {
+            printf("%-24s failed: %s\n", profiles[i].name, UA_StatusCode_name(status));
+            retval = EXIT_FAILURE;
+        }
+        clearScenario(&scenario);
+    }
+
+    serversRunning = false;
+    stopBenchServer(&sensor);
+    stopBenchServer(&valve);
+
+cleanup_database:
+    finalizeProcessDatabase(&database);
+
+cleanup_db:
+    sqlite3_close(db);
+    unlink(tmpname);
+    free(profiles);
+    return retval;
+}
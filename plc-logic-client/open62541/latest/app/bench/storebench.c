@@ -0,0 +1,403 @@
+/*
+ * Storage benchmark of the samples: the waterlevel table of SQLite against
+ * the time-series store of tsstore.h. Both get the same simulated samples
+ * with explicit timestamps at the sampling interval plus a few ms of
+ * jitter, SQLite with one transaction per sample like the live client and
+ * synchronous=OFF, as the store does not sync either. Two data sets are
+ * measured: whole percent steps of a triangle wave (as in allocbench) and
+ * a slower triangle with sensor noise at a resolution of 0.01%.
+ *
+ * Per data set and storage the benchmark reports the bytes per sample, the
+ * ingest rate and the time to read the samples of the last hour. The
+ * whole store is read back and compared with the input, the benchmark
+ * fails on any difference.
+ *
+ * Usage: storebench [-n samples] [-i interval] [-d dir]
+ */
+#include <argp.h>
+#include <dirent.h>
+#include <open62541/types.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tsstore.h"
+
+#define SCAN_SECONDS 3600
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "storebench 0.1";
+static char doc[] = "Compares the SQLite schema with the time-series store for the waterlevel samples";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"samples",  'n', "COUNT", 0, "Samples per data set [default: 200000]" },
+    {"interval", 'i', "MS",    0, "Sampling interval [default: 100]" },
+    {"dir",      'd', "DIR",   0, "Directory for the database and the store [default: a new one in /tmp]" },
+    { 0 }
+};
+
+struct arguments
+{
+    UA_UInt64 samples;
+    UA_UInt32 interval;
+    char *dir;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'n': {
+            arguments->samples = strtoull(arg, NULL, 10);
+            break;
+        }
+        case 'i': {
+            arguments->interval = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'd': {
+            arguments->dir = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+/*
+ * Reproducible sequence of samples
+ */
+typedef struct {
+    UA_Boolean noisy;
+    UA_UInt32 interval;
+    unsigned int seed;
+    UA_UInt64 index;
+    UA_DateTime time;
+} SampleGenerator;
+
+static void initSampleGenerator(SampleGenerator *generator, UA_Boolean noisy,
+                                UA_UInt32 interval, UA_DateTime start)
+{
+    generator->noisy = noisy;
+    generator->interval = interval;
+    generator->seed = 1;
+    generator->index = 0;
+    generator->time = start;
+}
+
+static void nextSample(SampleGenerator *generator, UA_DateTime *time, UA_Double *value)
+{
+    int jitter = rand_r(&generator->seed) % 5 - 2;
+    generator->time += ((UA_DateTime)generator->interval + jitter) * UA_DATETIME_MSEC;
+    *time = generator->time;
+
+    if(!generator->noisy)
+    {
+        UA_UInt64 phase = generator->index % 200;
+        *value = (UA_Double)(phase < 100 ? phase : 200 - phase);
+    }
+    else
+    {
+        /*
+         * Hundredths of a percent, rising by 0.1% per sample
+         */
+        UA_UInt64 phase = generator->index % 2000;
+        int level = (int)(phase < 1000 ? phase : 2000 - phase) * 10;
+        level += rand_r(&generator->seed) % 21 - 10;
+        *value = (UA_Double)(level < 0 ? 0 : level) / 100.;
+    }
+    generator->index++;
+}
+
+
+static UA_Double secondsSince(UA_DateTime start)
+{
+    return (UA_Double)(UA_DateTime_nowMonotonic() - start) / UA_DATETIME_SEC;
+}
+
+static UA_Int64 unixSeconds(UA_DateTime time)
+{
+    return (time - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC;
+}
+
+
+typedef struct {
+    UA_UInt64 samples;
+    UA_UInt64 bytes;
+    UA_Double ingestSeconds;
+    UA_UInt64 scanned;
+    UA_Double scanSeconds;
+} StorageResult;
+
+static void printResult(const char *dataset, const char *storage, const StorageResult *result)
+{
+    printf("%-8s %-11s %10llu %14.2f %12.0f %10llu %10.2f\n",
+           dataset, storage, (unsigned long long)result->samples,
+           (UA_Double)result->bytes / (UA_Double)result->samples,
+           result->ingestSeconds > 0. ? (UA_Double)result->samples / result->ingestSeconds : 0.,
+           (unsigned long long)result->scanned, result->scanSeconds * 1000.);
+}
+
+
+static const char *createWaterlevel =
+    "CREATE TABLE IF NOT EXISTS waterlevel ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    level REAL NOT NULL);"
+    "PRAGMA synchronous=OFF;";
+
+/*
+ * The timestamp is given explicitly, in the format CURRENT_TIMESTAMP has
+ */
+static int benchSqlite(const char *dbname, UA_Boolean noisy, const struct arguments *arguments,
+                       UA_DateTime start, StorageResult *result)
+{
+    int retval = EXIT_FAILURE;
+    sqlite3_stmt *insert = NULL;
+    sqlite3_stmt *scan = NULL;
+    sqlite3_stmt *size = NULL;
+    sqlite3 *db;
+    if(   sqlite3_open(dbname, &db) != SQLITE_OK
+       || sqlite3_exec(db, createWaterlevel, NULL, NULL, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "INSERT INTO waterlevel (timestamp, level) "
+                             "VALUES (datetime(?, 'unixepoch'), ?)", -1, &insert, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "SELECT level FROM waterlevel WHERE timestamp "
+                             "BETWEEN datetime(?, 'unixepoch') AND datetime(?, 'unixepoch')",
+                             -1, &scan, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, "SELECT page_count * page_size FROM pragma_page_count(), "
+                             "pragma_page_size()", -1, &size, NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "Unable to set up database %s: %s\n", dbname, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    SampleGenerator generator;
+    initSampleGenerator(&generator, noisy, arguments->interval, start);
+    UA_DateTime time = start;
+    UA_Double value;
+    UA_DateTime begin = UA_DateTime_nowMonotonic();
+    for(UA_UInt64 i = 0; i < arguments->samples; i++)
+    {
+        nextSample(&generator, &time, &value);
+        sqlite3_bind_int64(insert, 1, unixSeconds(time));
+        sqlite3_bind_double(insert, 2, value);
+        if(sqlite3_step(insert) != SQLITE_DONE)
+        {
+            fprintf(stderr, "Insert failed: %s\n", sqlite3_errmsg(db));
+            goto cleanup;
+        }
+        sqlite3_reset(insert);
+    }
+    result->ingestSeconds = secondsSince(begin);
+    result->samples = arguments->samples;
+
+    sqlite3_bind_int64(scan, 1, unixSeconds(time) - SCAN_SECONDS);
+    sqlite3_bind_int64(scan, 2, unixSeconds(time));
+    begin = UA_DateTime_nowMonotonic();
+    result->scanned = 0;
+    while(sqlite3_step(scan) == SQLITE_ROW)
+    {
+        result->scanned++;
+    }
+    result->scanSeconds = secondsSince(begin);
+
+    if(sqlite3_step(size) != SQLITE_ROW)
+    {
+        fprintf(stderr, "Unable to get the database size: %s\n", sqlite3_errmsg(db));
+        goto cleanup;
+    }
+    result->bytes = (UA_UInt64)sqlite3_column_int64(size, 0);
+    retval = EXIT_SUCCESS;
+
+cleanup:
+    sqlite3_finalize(insert);
+    sqlite3_finalize(scan);
+    sqlite3_finalize(size);
+    sqlite3_close(db);
+    return retval;
+}
+
+
+/*
+ * Compares the samples read back with the generated ones
+ */
+typedef struct {
+    SampleGenerator generator;
+    UA_UInt64 visited;
+    UA_UInt64 differences;
+} Verification;
+
+static void verifySample(void *context, UA_DateTime time, UA_Double value)
+{
+    Verification *verification = (Verification*)context;
+    UA_DateTime expectedTime;
+    UA_Double expectedValue;
+    nextSample(&verification->generator, &expectedTime, &expectedValue);
+    if(time != expectedTime || value != expectedValue)
+    {
+        verification->differences++;
+    }
+    verification->visited++;
+}
+
+static void countSample(void *context, UA_DateTime time, UA_Double value)
+{
+    (*(UA_UInt64*)context)++;
+}
+
+
+static int benchTimeSeries(const char *dir, UA_Boolean noisy, const struct arguments *arguments,
+                           UA_DateTime start, StorageResult *result)
+{
+    TimeSeries series;
+    if(openTimeSeries(&series, dir, "waterlevel", true) != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to open time series in %s\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    SampleGenerator generator;
+    initSampleGenerator(&generator, noisy, arguments->interval, start);
+    UA_DateTime time = start;
+    UA_Double value;
+    UA_DateTime begin = UA_DateTime_nowMonotonic();
+    for(UA_UInt64 i = 0; i < arguments->samples; i++)
+    {
+        nextSample(&generator, &time, &value);
+        if(appendTimeSeries(&series, time, value) != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Append failed\n");
+            closeTimeSeries(&series);
+            return EXIT_FAILURE;
+        }
+    }
+    result->ingestSeconds = secondsSince(begin);
+    result->samples = arguments->samples;
+
+    /*
+     * The same window as the SQL query, which compares whole seconds
+     */
+    UA_DateTime scanEnd = (unixSeconds(time) + 1) * UA_DATETIME_SEC + UA_DATETIME_UNIX_EPOCH - 1;
+    UA_DateTime scanBegin = (unixSeconds(time) - SCAN_SECONDS) * UA_DATETIME_SEC + UA_DATETIME_UNIX_EPOCH;
+    result->scanned = 0;
+    begin = UA_DateTime_nowMonotonic();
+    scanTimeSeries(&series, scanBegin, scanEnd, countSample, &result->scanned);
+    result->scanSeconds = secondsSince(begin);
+    result->bytes = timeSeriesBytesUsed(&series);
+
+    Verification verification;
+    memset(&verification, 0, sizeof(Verification));
+    initSampleGenerator(&verification.generator, noisy, arguments->interval, start);
+    scanTimeSeries(&series, start, time, verifySample, &verification);
+    closeTimeSeries(&series);
+    if(verification.visited != arguments->samples || verification.differences > 0)
+    {
+        fprintf(stderr, "Read back %llu of %llu samples with %llu differences\n",
+                (unsigned long long)verification.visited,
+                (unsigned long long)arguments->samples,
+                (unsigned long long)verification.differences);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static void removeStore(const char *dir)
+{
+    DIR *entries = opendir(dir);
+    if(!entries)
+    {
+        return;
+    }
+    struct dirent *entry;
+    char path[4096];
+    while((entry = readdir(entries)) != NULL)
+    {
+        if(entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        int length = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if(length > 0 && (size_t)length < sizeof(path))
+        {
+            unlink(path);
+        }
+    }
+    closedir(entries);
+    rmdir(dir);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .samples = 200000,
+        .interval = 100,
+        .dir = NULL,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    char tmpdir[] = "/tmp/storebench-XXXXXX";
+    const char *dir = arguments.dir;
+    if(!dir)
+    {
+        dir = mkdtemp(tmpdir);
+        if(!dir)
+        {
+            perror("mkdtemp");
+            return EXIT_FAILURE;
+        }
+    }
+    if(arguments.samples == 0 || arguments.interval == 0)
+    {
+        fprintf(stderr, "Samples and interval have to be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %-11s %10s %14s %12s %10s %10s\n", "data", "storage", "samples",
+           "bytes/sample", "samples/s", "last hour", "scan ms");
+
+    int retval = EXIT_SUCCESS;
+    const char *datasets[] = {"steps", "noisy"};
+    /*
+     * The store keeps milliseconds, the generated timestamps are whole ones
+     */
+    UA_DateTime start = UA_DateTime_now() / UA_DATETIME_SEC * UA_DATETIME_SEC;
+    for(size_t i = 0; i < 2 && retval == EXIT_SUCCESS; i++)
+    {
+        char dbname[4096];
+        char storedir[4096];
+        snprintf(dbname, sizeof(dbname), "%s/%s.sqlite3", dir, datasets[i]);
+        snprintf(storedir, sizeof(storedir), "%s/%s", dir, datasets[i]);
+
+        StorageResult result;
+        retval = benchSqlite(dbname, i == 1, &arguments, start, &result);
+        if(retval == EXIT_SUCCESS)
+        {
+            printResult(datasets[i], "sqlite", &result);
+            retval = benchTimeSeries(storedir, i == 1, &arguments, start, &result);
+        }
+        if(retval == EXIT_SUCCESS)
+        {
+            printResult(datasets[i], "timeseries", &result);
+        }
+        unlink(dbname);
+        removeStore(storedir);
+    }
+
+    if(dir == tmpdir)
+    {
+        rmdir(tmpdir);
+    }
+    return retval;
+}
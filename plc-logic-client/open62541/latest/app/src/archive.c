@@ -0,0 +1,608 @@
+#include <open62541/plugin/log_stdout.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "archive.h"
+#include "asynclog.h"
+#include "schema.h"
+
+#define ARCHIVE_DAY_SECONDS 86400
+
+/*
+ * Rows deleted per transaction once a chunk is written, small enough for
+ * the live client to get the write lock in between
+ */
+#define ARCHIVE_DELETE_BATCH 1000
+
+/*
+ * How long to wait for the write lock held by the live client
+ */
+#define ARCHIVE_BUSY_TIMEOUT_MS 5000
+
+typedef struct {
+    const char *table;
+    const char *column;
+    UA_Byte type;
+} ArchiveTable;
+
+static const ArchiveTable archiveTables[] = {
+    {"waterlevel", "level", ARCHIVE_TYPE_DOUBLE},
+    {"valveposition", "position", ARCHIVE_TYPE_INT64},
+    {"triggerthreshold", "threshold", ARCHIVE_TYPE_INT64},
+};
+
+
+/*
+ * Growing buffer of encoded bytes, further writes are dropped after an
+ * allocation failed
+ */
+typedef struct {
+    UA_Byte *data;
+    size_t length;
+    size_t capacity;
+    UA_Boolean failed;
+} ChunkBuffer;
+
+static void putBytes(ChunkBuffer *buffer, const void *bytes, size_t size)
+{
+    if(buffer->failed)
+    {
+        return;
+    }
+    if(buffer->length + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while(capacity < buffer->length + size)
+        {
+            capacity *= 2;
+        }
+        UA_Byte *data = (UA_Byte*)realloc(buffer->data, capacity);
+        if(!data)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, bytes, size);
+    buffer->length += size;
+}
+
+static void putUInt(ChunkBuffer *buffer, uint64_t value, size_t size)
+{
+    UA_Byte bytes[8];
+    for(size_t i = 0; i < size; i++)
+    {
+        bytes[i] = (UA_Byte)(value >> (8 * i));
+    }
+    putBytes(buffer, bytes, size);
+}
+
+static void putVarint(ChunkBuffer *buffer, uint64_t value)
+{
+    UA_Byte bytes[10];
+    size_t size = 0;
+    do
+    {
+        bytes[size] = (UA_Byte)(value & 0x7f);
+        value >>= 7;
+        if(value)
+        {
+            bytes[size] |= 0x80;
+        }
+        size++;
+    } while(value);
+    putBytes(buffer, bytes, size);
+}
+
+static void putString(ChunkBuffer *buffer, const char *string)
+{
+    size_t length = strlen(string);
+    putUInt(buffer, length, 2);
+    putBytes(buffer, string, length);
+}
+
+
+/*
+ * A column of a chunk with its statistics and the encoding state
+ */
+typedef struct {
+    const char *name;
+    UA_Byte type;
+    UA_Byte encoding;
+    int64_t minInt;
+    int64_t maxInt;
+    double minDouble;
+    double maxDouble;
+    uint64_t previous;
+    ChunkBuffer data;
+} ChunkColumn;
+
+typedef struct {
+    const ArchiveTable *table;
+    int64_t day;                /* Unix seconds of the start of the day */
+    int64_t firstId;
+    int64_t lastId;
+    uint64_t rows;
+    ChunkColumn columns[3];
+} Chunk;
+
+static void initColumn(ChunkColumn *column, const char *name, UA_Byte type)
+{
+    memset(column, 0, sizeof(ChunkColumn));
+    column->name = name;
+    column->type = type;
+    column->encoding = type == ARCHIVE_TYPE_DOUBLE ? ARCHIVE_ENCODING_XOR : ARCHIVE_ENCODING_DELTA;
+}
+
+static void appendInt(ChunkColumn *column, int64_t value, UA_Boolean first)
+{
+    if(first || value < column->minInt)
+    {
+        column->minInt = value;
+    }
+    if(first || value > column->maxInt)
+    {
+        column->maxInt = value;
+    }
+    uint64_t delta = (uint64_t)value - column->previous;
+    putVarint(&column->data, (delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+    column->previous = (uint64_t)value;
+}
+
+static void appendDouble(ChunkColumn *column, double value, UA_Boolean first)
+{
+    if(first || value < column->minDouble)
+    {
+        column->minDouble = value;
+    }
+    if(first || value > column->maxDouble)
+    {
+        column->maxDouble = value;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t xor = bits ^ column->previous;
+    column->previous = bits;
+
+    UA_Byte leading = xor ? (UA_Byte)(__builtin_clzll(xor) / 8) : 8;
+    UA_Byte trailing = xor ? (UA_Byte)(__builtin_ctzll(xor) / 8) : 0;
+    UA_Byte control = (UA_Byte)(leading << 4 | trailing);
+    putBytes(&column->data, &control, 1);
+    putUInt(&column->data, xor >> (8 * trailing), (size_t)(8 - leading - trailing));
+}
+
+static void initChunk(Chunk *chunk, const ArchiveTable *table)
+{
+    memset(chunk, 0, sizeof(Chunk));
+    chunk->table = table;
+    initColumn(&chunk->columns[0], "id", ARCHIVE_TYPE_INT64);
+    initColumn(&chunk->columns[1], "timestamp", ARCHIVE_TYPE_INT64);
+    initColumn(&chunk->columns[2], table->column, table->type);
+}
+
+static void clearChunk(Chunk *chunk)
+{
+    for(size_t i = 0; i < 3; i++)
+    {
+        free(chunk->columns[i].data.data);
+    }
+    initChunk(chunk, chunk->table);
+}
+
+static void appendRow(Chunk *chunk, sqlite3_stmt *row)
+{
+    UA_Boolean first = chunk->rows == 0;
+    appendInt(&chunk->columns[0], sqlite3_column_int64(row, 0), first);
+    appendInt(&chunk->columns[1], sqlite3_column_int64(row, 1), first);
+    if(chunk->table->type == ARCHIVE_TYPE_DOUBLE)
+    {
+        appendDouble(&chunk->columns[2], sqlite3_column_double(row, 2), first);
+    }
+    else
+    {
+        appendInt(&chunk->columns[2], sqlite3_column_int64(row, 2), first);
+    }
+    chunk->rows++;
+}
+
+
+static UA_StatusCode writeAll(int fd, const UA_Byte *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return UA_STATUSCODE_BADINTERNALERROR;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Write the chunk to a temporary file and rename it once synced, so a
+ * chunk file is always complete. Returns the bytes written.
+ */
+static UA_StatusCode writeChunk(const char *dir, Chunk *chunk, UA_UInt64 *bytes)
+{
+    ChunkBuffer header;
+    memset(&header, 0, sizeof(ChunkBuffer));
+    putBytes(&header, ARCHIVE_MAGIC, 8);
+    putString(&header, chunk->table->table);
+    putUInt(&header, chunk->rows, 8);
+    putUInt(&header, 3, 2);
+    for(size_t i = 0; i < 3; i++)
+    {
+        ChunkColumn *column = &chunk->columns[i];
+        putString(&header, column->name);
+        putBytes(&header, &column->type, 1);
+        putBytes(&header, &column->encoding, 1);
+        if(column->type == ARCHIVE_TYPE_DOUBLE)
+        {
+            uint64_t min, max;
+            memcpy(&min, &column->minDouble, sizeof(min));
+            memcpy(&max, &column->maxDouble, sizeof(max));
+            putUInt(&header, min, 8);
+            putUInt(&header, max, 8);
+        }
+        else
+        {
+            putUInt(&header, (uint64_t)column->minInt, 8);
+            putUInt(&header, (uint64_t)column->maxInt, 8);
+        }
+        putUInt(&header, column->data.length, 8);
+        if(column->data.failed)
+        {
+            header.failed = true;
+        }
+    }
+    if(header.failed)
+    {
+        free(header.data);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    char date[16];
+    time_t day = (time_t)chunk->day;
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y-%m-%d", gmtime_r(&day, &tm));
+    char path[4096];
+    char tmppath[sizeof(path) + 4];
+    snprintf(path, sizeof(path), "%s/%s-%s-%lld.chunk",
+             dir, chunk->table->table, date, (long long)chunk->firstId);
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+    UA_StatusCode retval = UA_STATUSCODE_BADINTERNALERROR;
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create chunk %s", tmppath);
+        free(header.data);
+        return retval;
+    }
+    UA_Boolean complete = writeAll(fd, header.data, header.length) == UA_STATUSCODE_GOOD;
+    *bytes = header.length;
+    for(size_t i = 0; i < 3 && complete; i++)
+    {
+        complete = writeAll(fd, chunk->columns[i].data.data, chunk->columns[i].data.length) == UA_STATUSCODE_GOOD;
+        *bytes += chunk->columns[i].data.length;
+    }
+    complete = complete && fsync(fd) == 0;
+    complete = close(fd) == 0 && complete;
+    free(header.data);
+    if(!complete || rename(tmppath, path) != 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to write chunk %s", path);
+        unlink(tmppath);
+        return retval;
+    }
+
+    /*
+     * The rename has to be on disk before the rows are deleted
+     */
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirfd >= 0)
+    {
+        if(fsync(dirfd) == 0)
+        {
+            retval = UA_STATUSCODE_GOOD;
+        }
+        close(dirfd);
+    }
+    return retval;
+}
+
+
+static UA_StatusCode deleteRows(sqlite3 *db, sqlite3_stmt *stmt, int64_t firstId, int64_t lastId)
+{
+    for(int64_t from = firstId; from <= lastId; from += ARCHIVE_DELETE_BATCH)
+    {
+        int64_t to = from + ARCHIVE_DELETE_BATCH - 1;
+        sqlite3_bind_int64(stmt, 1, from);
+        sqlite3_bind_int64(stmt, 2, to < lastId ? to : lastId);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if(rc != SQLITE_DONE)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Failed to delete archived rows with error: %s",
+                           sqlite3_errmsg(db));
+            return UA_STATUSCODE_BADINTERNALERROR;
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Last id of a table that is in a chunk on disk, 0 if none is
+ */
+static UA_StatusCode readArchivedId(sqlite3 *db, const ArchiveTable *table, int64_t *lastId)
+{
+    sqlite3_stmt *stmt = NULL;
+    UA_StatusCode retval = UA_STATUSCODE_BADINTERNALERROR;
+    *lastId = 0;
+    if(sqlite3_prepare_v2(db, "SELECT lastid FROM archivestate WHERE tablename = ?;",
+                          -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table->table, -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        if(rc == SQLITE_ROW)
+        {
+            *lastId = sqlite3_column_int64(stmt, 0);
+        }
+        if(rc == SQLITE_ROW || rc == SQLITE_DONE)
+        {
+            retval = UA_STATUSCODE_GOOD;
+        }
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to read the archive state of %s with error: %s",
+                       table->table, sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return retval;
+}
+
+
+static UA_StatusCode recordArchivedId(sqlite3 *db, const ArchiveTable *table, int64_t lastId)
+{
+    sqlite3_stmt *stmt = NULL;
+    UA_StatusCode retval = UA_STATUSCODE_BADINTERNALERROR;
+    if(sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO archivestate (tablename, lastid) VALUES (?, ?);",
+                          -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, table->table, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, lastId);
+        if(sqlite3_step(stmt) == SQLITE_DONE)
+        {
+            retval = UA_STATUSCODE_GOOD;
+        }
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to record the archive state of %s with error: %s",
+                       table->table, sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return retval;
+}
+
+
+/*
+ * Stream the rows of tank system 1 before the cutoff in id order, one
+ * chunk per day. Each
+ * chunk is read with a fresh range query after the id of the previous
+ * one, so no cursor is open while its rows are deleted.
+ *
+ * The last archived id is recorded after a chunk is on disk and before
+ * its rows are deleted. Rows up to it that an interrupted run left in the
+ * database are already in a chunk, so they are deleted without being
+ * written again.
+ */
+static UA_StatusCode archiveTable(sqlite3 *db, const char *dir, const ArchiveTable *table,
+                                  int64_t cutoff)
+{
+    int64_t lastId = 0;
+    UA_StatusCode retval = readArchivedId(db, table, &lastId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    char sqlSelect[256];
+    char sqlDelete[128];
+    snprintf(sqlSelect, sizeof(sqlSelect),
+             "SELECT id, CAST(strftime('%%s', timestamp) AS INTEGER), %s "
+             "FROM %s WHERE tank_system = 1 AND id > ? ORDER BY id;",
+             table->column, table->table);
+    snprintf(sqlDelete, sizeof(sqlDelete),
+             "DELETE FROM %s WHERE tank_system = 1 AND id >= ? AND id <= ?;", table->table);
+    sqlite3_stmt *stmtSelect = NULL;
+    sqlite3_stmt *stmtDelete = NULL;
+    if(   sqlite3_prepare_v2(db, sqlSelect, -1, &stmtSelect, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, sqlDelete, -1, &stmtDelete, NULL) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to prepare SQL statement with error: %s",
+                       sqlite3_errmsg(db));
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+        goto cleanup;
+    }
+
+    /*
+     * The first row left in the table starts the batches of the rows an
+     * interrupted run did not delete
+     */
+    sqlite3_bind_int64(stmtSelect, 1, 0);
+    if(sqlite3_step(stmtSelect) == SQLITE_ROW && sqlite3_column_int64(stmtSelect, 0) <= lastId)
+    {
+        int64_t firstId = sqlite3_column_int64(stmtSelect, 0);
+        sqlite3_reset(stmtSelect);
+        retval = deleteRows(db, stmtDelete, firstId, lastId);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            goto cleanup;
+        }
+    }
+    sqlite3_reset(stmtSelect);
+
+    Chunk chunk;
+    initChunk(&chunk, table);
+    UA_UInt64 rows = 0;
+    UA_UInt64 bytes = 0;
+    size_t chunks = 0;
+    UA_Boolean more = true;
+    while(more && retval == UA_STATUSCODE_GOOD)
+    {
+        sqlite3_bind_int64(stmtSelect, 1, lastId);
+        int rc;
+        while((rc = sqlite3_step(stmtSelect)) == SQLITE_ROW)
+        {
+            int64_t timestamp = sqlite3_column_int64(stmtSelect, 1);
+            if(timestamp >= cutoff)
+            {
+                break;
+            }
+            int64_t day = timestamp - timestamp % ARCHIVE_DAY_SECONDS;
+            if(chunk.rows == 0)
+            {
+                chunk.day = day;
+                chunk.firstId = sqlite3_column_int64(stmtSelect, 0);
+            }
+            else if(day != chunk.day)
+            {
+                break;
+            }
+            appendRow(&chunk, stmtSelect);
+            chunk.lastId = sqlite3_column_int64(stmtSelect, 0);
+        }
+        more = rc == SQLITE_ROW && chunk.rows > 0;
+        if(rc != SQLITE_ROW && rc != SQLITE_DONE)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Failed to read %s with error: %s",
+                           table->table, sqlite3_errmsg(db));
+            retval = UA_STATUSCODE_BADINTERNALERROR;
+        }
+        sqlite3_reset(stmtSelect);
+        if(chunk.rows == 0 || retval != UA_STATUSCODE_GOOD)
+        {
+            break;
+        }
+
+        UA_UInt64 chunkBytes = 0;
+        retval = writeChunk(dir, &chunk, &chunkBytes);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = recordArchivedId(db, table, chunk.lastId);
+        }
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = deleteRows(db, stmtDelete, chunk.firstId, chunk.lastId);
+        }
+        rows += chunk.rows;
+        bytes += chunkBytes;
+        chunks++;
+        lastId = chunk.lastId;
+        clearChunk(&chunk);
+    }
+    clearChunk(&chunk);
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Archived %llu rows of %s in %zu chunks with %llu bytes",
+                (unsigned long long)rows, table->table, chunks, (unsigned long long)bytes);
+
+cleanup:
+    sqlite3_finalize(stmtSelect);
+    sqlite3_finalize(stmtDelete);
+    return retval;
+}
+
+
+UA_StatusCode runArchive(const char *dbname, const char *dir, UA_UInt32 retentionHours)
+{
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create archive directory %s", dir);
+        return UA_STATUSCODE_BAD;
+    }
+
+    sqlite3 *db;
+    if(sqlite3_open_v2(dbname, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to open database %s for archiving", dbname);
+        sqlite3_close(db);
+        return UA_STATUSCODE_BAD;
+    }
+
+    /*
+     * The rows are selected by tank system, which a database of an older
+     * version does not have yet. The schema leaves the database without a
+     * busy timeout, so it is set afterwards.
+     */
+    if(initProcessSchema(db) != UA_STATUSCODE_GOOD)
+    {
+        sqlite3_close(db);
+        return UA_STATUSCODE_BAD;
+    }
+    sqlite3_busy_timeout(db, ARCHIVE_BUSY_TIMEOUT_MS);
+    if(sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS archivestate ("
+                        "tablename TEXT PRIMARY KEY, "
+                        "lastid INTEGER NOT NULL);", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create the archive state with error: %s",
+                       sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return UA_STATUSCODE_BAD;
+    }
+
+    /*
+     * Only whole days are archived, the last one ending at least the
+     * retention before now
+     */
+    int64_t now = (UA_DateTime_now() - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC;
+    int64_t cutoff = now - (int64_t)retentionHours * 3600;
+    cutoff -= cutoff % ARCHIVE_DAY_SECONDS;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    for(size_t i = 0; i < sizeof(archiveTables) / sizeof(archiveTables[0]); i++)
+    {
+        retval = archiveTable(db, dir, &archiveTables[i], cutoff);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            break;
+        }
+    }
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Archiving took %.1f s",
+                (UA_Double)(UA_DateTime_nowMonotonic() - start) / UA_DATETIME_SEC);
+
+    sqlite3_close(db);
+    return retval;
+}
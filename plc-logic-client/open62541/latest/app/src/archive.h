@@ -0,0 +1,55 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <open62541/types.h>
+
+/*
+ * Archive of the history tables waterlevel, valveposition and
+ * triggerthreshold in columnar chunk files. Only the rows of tank system
+ * 1, the one plc-logic-client controls, are archived. Rows of days that
+ * ended more than the retention ago are streamed in id order into one
+ * chunk per table and day, '<dir>/<table>-<YYYY-MM-DD>-<first id>.chunk'. Once a
+ * chunk is synced to disk, its last id is recorded in the table
+ * archivestate and its rows are deleted in small batches, so the live
+ * client is never blocked for long. A run interrupted before the id is
+ * recorded writes the same chunk again on the next run, one interrupted
+ * later only deletes the rows left up to the recorded id.
+ *
+ * Chunk format, all integers little endian:
+ *
+ *   magic            "PDCHUNK1"
+ *   table name       u16 length, bytes
+ *   rows             u64
+ *   columns          u16
+ *   per column       u16 name length, name bytes, u8 type, u8 encoding,
+ *                    min and max (8 bytes each, as the type), u64 data bytes
+ *   per column       data
+ *
+ * Types are ARCHIVE_TYPE_INT64 and ARCHIVE_TYPE_DOUBLE. The columns are
+ * the id, the timestamp in Unix seconds and the value of the table. The
+ * statistics let readers skip chunks outside a time or value range
+ * without decoding them, see tools/archread.c.
+ */
+#define ARCHIVE_MAGIC "PDCHUNK1"
+
+#define ARCHIVE_TYPE_INT64 1
+#define ARCHIVE_TYPE_DOUBLE 2
+
+/*
+ * Delta encoding: the difference to the previous value (0 for the first)
+ * zigzag encoded as unsigned LEB128 varint. XOR encoding: the bits of the
+ * double XORed with the previous ones (0 for the first), as a control
+ * byte with the number of leading zero bytes in the high and of trailing
+ * zero bytes in the low nibble, followed by the remaining bytes, least
+ * significant first.
+ */
+#define ARCHIVE_ENCODING_DELTA 1
+#define ARCHIVE_ENCODING_XOR 2
+
+/*
+ * Archive the days that ended more than retentionHours ago into dir,
+ * which is created if needed
+ */
+UA_StatusCode runArchive(const char *dbname, const char *dir, UA_UInt32 retentionHours);
+
+#endif
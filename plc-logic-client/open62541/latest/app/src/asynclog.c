@@ -0,0 +1,260 @@
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "asynclog.h"
+#include "metrics.h"
+
+#define ASYNCLOG_MASK (ASYNCLOG_RECORDS - 1)
+#define ASYNCLOG_IDLE_NS 10000000
+#define ASYNCLOG_BATCH_SIZE 65536
+#define ASYNCLOG_PREFIX_SIZE 64
+
+/*
+ * Slot of the ring buffer. The sequence tells producers and the consumer
+ * whose turn it is: it equals the enqueue position when the slot is free
+ * and the position + 1 when the record is ready to be written.
+ */
+typedef struct {
+    _Atomic size_t sequence;
+    UA_DateTime time;
+    UA_LogLevel level;
+    UA_LogCategory category;
+    size_t length;
+    char message[ASYNCLOG_MESSAGE_SIZE];
+} __attribute__((aligned(64))) LogRecord;
+
+static LogRecord records[ASYNCLOG_RECORDS];
+static _Atomic size_t enqueuePos = 0;
+static size_t dequeuePos = 0;
+
+static atomic_bool accepting = false;
+static atomic_bool stopping = false;
+static pthread_t thread;
+
+static _Atomic UA_UInt64 dropped = 0;
+static Metric *droppedMetric = NULL;
+
+/*
+ * Output buffer of the background thread, flushed once per batch
+ */
+static char batch[ASYNCLOG_BATCH_SIZE];
+static size_t batchUsed = 0;
+
+static const char *levelNames[] = {"trace", "debug", "info", "warn", "error", "fatal"};
+static const char *categoryNames[] = {"network", "channel", "session", "server", "client",
+                                      "userland", "securitypolicy", "eventloop", "pubsub",
+                                      "discovery"};
+
+
+static void logAsync(void *context, UA_LogLevel level, UA_LogCategory category,
+                     const char *msg, va_list args);
+
+static const UA_Logger asyncLogger = {logAsync, NULL, NULL};
+const UA_Logger *asyncLog = &asyncLogger;
+
+
+/*
+ * Claim a free slot, or NULL if the ring buffer is full
+ */
+static LogRecord *claimRecord(size_t *position)
+{
+    size_t pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+    for(;;)
+    {
+        LogRecord *record = &records[pos & ASYNCLOG_MASK];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&enqueuePos, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+            {
+                *position = pos;
+                return record;
+            }
+        }
+        else if(diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+
+static void logAsync(void *context, UA_LogLevel level, UA_LogCategory category,
+                     const char *msg, va_list args)
+{
+    if(!atomic_load_explicit(&accepting, memory_order_relaxed))
+    {
+        UA_Log_Stdout->log(UA_Log_Stdout->context, level, category, msg, args);
+        return;
+    }
+
+    size_t position;
+    LogRecord *record = claimRecord(&position);
+    if(!record)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        addCounter(droppedMetric, 1);
+        return;
+    }
+
+    record->time = UA_DateTime_now();
+    record->level = level;
+    record->category = category;
+    int length = vsnprintf(record->message, sizeof(record->message), msg, args);
+    if(length < 0)
+    {
+        length = 0;
+    }
+    record->length = (size_t)length < sizeof(record->message) ?
+        (size_t)length : sizeof(record->message) - 1;
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+
+static void flushBatch(void)
+{
+    if(batchUsed > 0)
+    {
+        fwrite(batch, 1, batchUsed, stdout);
+        fflush(stdout);
+        batchUsed = 0;
+    }
+}
+
+
+/*
+ * Same line format as UA_Log_Stdout
+ */
+static void appendLine(UA_DateTime time, UA_LogLevel level, UA_LogCategory category,
+                       const char *message, size_t length)
+{
+    if(batchUsed + ASYNCLOG_PREFIX_SIZE + length + 1 > sizeof(batch))
+    {
+        flushBatch();
+    }
+
+    UA_Int64 offset = UA_DateTime_localTimeUtcOffset();
+    UA_DateTimeStruct dts = UA_DateTime_toStruct(time + offset);
+    size_t levelIndex = (size_t)(level / 100 - 1);
+    int prefix = snprintf(batch + batchUsed, ASYNCLOG_PREFIX_SIZE,
+                          "[%04u-%02u-%02u %02u:%02u:%02u.%03u (UTC%+05d)] %s/%s\t",
+                          dts.year, dts.month, dts.day, dts.hour, dts.min, dts.sec, dts.milliSec,
+                          (int)(offset / UA_DATETIME_SEC / 36),
+                          levelIndex < 6 ? levelNames[levelIndex] : "log",
+                          (size_t)category < 10 ? categoryNames[category] : "unknown");
+    if(prefix < 0)
+    {
+        prefix = 0;
+    }
+    if(prefix >= ASYNCLOG_PREFIX_SIZE)
+    {
+        prefix = ASYNCLOG_PREFIX_SIZE - 1;
+    }
+    batchUsed += (size_t)prefix;
+    memcpy(batch + batchUsed, message, length);
+    batchUsed += length;
+    batch[batchUsed++] = '\n';
+}
+
+
+/*
+ * Write all ready records, returns the number of records written
+ */
+static size_t drainRecords(void)
+{
+    size_t written = 0;
+    for(;;)
+    {
+        LogRecord *record = &records[dequeuePos & ASYNCLOG_MASK];
+        if(atomic_load_explicit(&record->sequence, memory_order_acquire) != dequeuePos + 1)
+        {
+            break;
+        }
+        appendLine(record->time, record->level, record->category, record->message, record->length);
+        atomic_store_explicit(&record->sequence, dequeuePos + ASYNCLOG_RECORDS, memory_order_release);
+        dequeuePos++;
+        written++;
+    }
+    return written;
+}
+
+
+static void reportDropped(UA_UInt64 *reported)
+{
+    UA_UInt64 total = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if(total != *reported)
+    {
+        char message[64];
+        int length = snprintf(message, sizeof(message), "%llu log records dropped",
+                              (unsigned long long)(total - *reported));
+        appendLine(UA_DateTime_now(), UA_LOGLEVEL_WARNING, UA_LOGCATEGORY_USERLAND,
+                   message, (size_t)length);
+        *reported = total;
+    }
+}
+
+
+static void *runAsyncLogger(void *data)
+{
+    UA_UInt64 reported = 0;
+    struct timespec idle = {0, ASYNCLOG_IDLE_NS};
+    for(;;)
+    {
+        UA_Boolean stop = atomic_load(&stopping);
+        size_t written = drainRecords();
+        reportDropped(&reported);
+        flushBatch();
+        if(stop && written == 0)
+        {
+            break;
+        }
+        if(written == 0)
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+
+UA_StatusCode startAsyncLogger(void)
+{
+    for(size_t i = 0; i < ASYNCLOG_RECORDS; i++)
+    {
+        atomic_init(&records[i].sequence, i);
+    }
+    droppedMetric = registerMetric("LogRecordsDropped",
+                                   "Number of log records dropped as the log buffer was full",
+                                   METRIC_COUNTER);
+
+    atomic_store(&stopping, false);
+    if(pthread_create(&thread, NULL, runAsyncLogger, NULL) != 0)
+    {
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                       "Unable to start the log thread, logging synchronously");
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    atomic_store(&accepting, true);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void stopAsyncLogger(void)
+{
+    if(!atomic_exchange(&accepting, false))
+    {
+        return;
+    }
+    atomic_store(&stopping, true);
+    pthread_join(thread, NULL);
+}
@@ -0,0 +1,145 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <string.h>
+#include "asynclog.h"
+#include "control.h"
+
+
+void initControlLoop(ControlLoop *loop, ProcessDatabase *database, TraceHistograms *traces,
+                     ValveWriter writeValve, void *writerContext)
+{
+    memset(loop, 0, sizeof(ControlLoop));
+    initValveLogic(&loop->logic, LOGIC_UPPER_THRESHOLD, LOGIC_LOWER_THRESHOLD);
+    loop->database = database;
+    loop->traces = traces;
+    loop->writeValve = writeValve;
+    loop->writerContext = writerContext;
+    loop->samples = registerMetric("Samples", "Number of fill percentage samples processed", METRIC_COUNTER);
+    loop->missedSamples = registerMetric("MissedSamples", "Estimated number of samples lost before arrival", METRIC_COUNTER);
+    loop->valveWrites = registerMetric("ValveWrites", "Number of valve positions written", METRIC_COUNTER);
+    loop->valveWriteErrors = registerMetric("ValveWriteErrors", "Number of failed valve writes", METRIC_COUNTER);
+}
+
+
+static UA_StatusCode writeValve(ControlLoop *loop, UA_DateTime decisionTime)
+{
+    UA_StatusCode retval = loop->writeValve(loop->writerContext, loop->logic.valveOpen, decisionTime);
+    addCounter(retval == UA_STATUSCODE_GOOD ? loop->valveWrites : loop->valveWriteErrors, 1);
+    return retval;
+}
+
+
+void setDeliveryInterval(ControlLoop *loop, UA_Double samplingInterval,
+                         UA_Double publishingInterval, UA_UInt32 queueSize)
+{
+    /*
+     * The queue keeps the latest samples taken during a publishing
+     * interval, so with a queue size of 1 the source timestamps are a
+     * publishing interval apart even if no sample is lost
+     */
+    UA_Double interval = publishingInterval / (queueSize > 0 ? queueSize : 1);
+    loop->deliveryInterval = interval > samplingInterval ? interval : samplingInterval;
+}
+
+
+/*
+ * A gap of more than one and a half delivery intervals between source
+ * timestamps means samples were lost, either during an outage of the
+ * sensor or because the network held them back until the queue of the
+ * monitored item overflowed
+ */
+static void checkOutage(ControlLoop *loop, UA_DateTime sourceTime)
+{
+    if(loop->lastSourceTime != 0 && loop->deliveryInterval > 0.)
+    {
+        UA_Double gap = (UA_Double)(sourceTime - loop->lastSourceTime) / UA_DATETIME_MSEC;
+        UA_Double lost = gap / loop->deliveryInterval - 1.;
+        if(lost > .5)
+        {
+            addCounter(loop->missedSamples, (UA_UInt64)(lost + .5));
+        }
+        if(loop->outagePending)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "First sample after outage: %.1f ms gap in source timestamps, "
+                        "about %.0f samples lost",
+                        gap, lost > 0. ? lost : 0.);
+        }
+    }
+    loop->outagePending = false;
+    loop->lastSourceTime = sourceTime;
+}
+
+
+void processSample(ControlLoop *loop, const UA_DataValue *value)
+{
+    SampleTrace trace = {0};
+    trace.arrival = UA_DateTime_now();
+    if(!UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_DOUBLE]))
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Received data with wrong datatype");
+        return;
+    }
+
+    addCounter(loop->samples, 1);
+    UA_Double fillPercentage = *(UA_Double *)value->value.data;
+    if(value->hasSourceTimestamp)
+    {
+        checkOutage(loop, value->sourceTimestamp);
+        trace.source = value->sourceTimestamp;
+    }
+
+    /*
+     * Logic for setting valve open/closed. It runs before the database
+     * is touched to keep the inserts off the actuation path.
+     */
+    UA_Boolean valveChanged = evaluateValveLogic(&loop->logic, fillPercentage);
+    trace.decision = UA_DateTime_now();
+
+    UA_Boolean valveWritten = false;
+    if(valveChanged)
+    {
+        valveWritten = writeValve(loop, trace.decision) == UA_STATUSCODE_GOOD;
+        loop->valvePending = !valveWritten;
+        if(valveWritten)
+        {
+            trace.written = UA_DateTime_now();
+        }
+    }
+
+    /*
+     * Write the new fill percentage value and the valve position to database
+     */
+    insertWaterlevel(loop->database, fillPercentage);
+    if(valveWritten)
+    {
+        insertValvePosition(loop->database, loop->logic.valveOpen);
+    }
+    trace.committed = UA_DateTime_now();
+    recordSampleTrace(loop->traces, &trace);
+
+    if(loop->started != 0)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "First sample stored %.1f ms after start",
+                    (UA_Double)(UA_DateTime_nowMonotonic() - loop->started) / UA_DATETIME_MSEC);
+        loop->started = 0;
+    }
+}
+
+
+UA_StatusCode resyncValve(ControlLoop *loop)
+{
+    if(!loop->valvePending)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+    UA_StatusCode retval = writeValve(loop, UA_DateTime_now());
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        loop->valvePending = false;
+        insertValvePosition(loop->database, loop->logic.valveOpen);
+    }
+    return retval;
+}
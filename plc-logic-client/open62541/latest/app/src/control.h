@@ -0,0 +1,72 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <open62541/types.h>
+#include "database.h"
+#include "logic.h"
+#include "metrics.h"
+#include "trace.h"
+
+/*
+ * Write a new valve position to the actuator. The decision time is passed
+ * along to be sent as source timestamp.
+ */
+typedef UA_StatusCode (*ValveWriter)(void *writerContext, UA_Boolean valveOpen,
+                                     UA_DateTime decisionTime);
+
+/*
+ * State of the path from a sensor sample to the valve decision, the write
+ * to the actuator and the inserts into the database. Everything a sample
+ * needs is held here, so processing a sample does not allocate.
+ */
+typedef struct {
+    ValveLogic logic;
+    ProcessDatabase *database;
+    TraceHistograms *traces;
+    ValveWriter writeValve;
+    void *writerContext;
+    /*
+     * Set while the last decision has not reached the actuator
+     */
+    UA_Boolean valvePending;
+    /*
+     * Used to estimate the samples lost on the way from the sensor, from
+     * gaps in the source timestamps beyond the interval the subscription
+     * delivers samples at
+     */
+    UA_Double deliveryInterval;
+    UA_DateTime lastSourceTime;
+    UA_Boolean outagePending;
+    /*
+     * Monotonic start time of the process, to report the time until the
+     * first sample is stored, 0 once reported
+     */
+    UA_DateTime started;
+    Metric *samples;
+    Metric *missedSamples;
+    Metric *valveWrites;
+    Metric *valveWriteErrors;
+} ControlLoop;
+
+void initControlLoop(ControlLoop *loop, ProcessDatabase *database, TraceHistograms *traces,
+                     ValveWriter writeValve, void *writerContext);
+
+/*
+ * Set the interval the subscription delivers samples at on a healthy link
+ * from its revised parameters
+ */
+void setDeliveryInterval(ControlLoop *loop, UA_Double samplingInterval,
+                         UA_Double publishingInterval, UA_UInt32 queueSize);
+
+/*
+ * Process a fill percentage sample received from the sensor
+ */
+void processSample(ControlLoop *loop, const UA_DataValue *value);
+
+/*
+ * Send the current valve position again if a decision did not reach the
+ * actuator, e.g. after it was reconnected, and persist it once written
+ */
+UA_StatusCode resyncValve(ControlLoop *loop);
+
+#endif
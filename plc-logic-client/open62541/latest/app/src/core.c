@@ -8,7 +8,24 @@
 #include <open62541/types.h>
 #include <signal.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive.h"
+#include "asynclog.h"
+#include "control.h"
+#include "database.h"
+#include "endpoints.h"
+#include "exporter.h"
+#include "netfault.h"
+#include "nodecache.h"
+#include "reconnect.h"
+#include "replay.h"
+#include "schema.h"
+#include "sqlitemem.h"
+#include "storefilter.h"
+#include "trace.h"
 #include "utils.h"
 
 
@@ -22,6 +39,17 @@ static void stopHandler(int signum)
     running = false;
 }
 
+/*
+ * SIGUSR1 requests a dump of the latency histograms, which is done from the
+ * event loop and not from the handler
+ */
+static volatile sig_atomic_t dumpRequested = 0;
+
+static void dumpHandler(int signum)
+{
+    dumpRequested = 1;
+}
+
 /*
  * Argparser
  */
@@ -30,9 +58,21 @@ const char* argp_program_bug_address = "las3@oth-regensburg.de";
 static char doc[] = "PLC Logic Module -- Simulates process control unit";
 static char args_doc[] = "";
 static struct argp_option options[] = {
-    {"sensor-uri",   's', "URL",  0, "Sensor URI <opc.tcp://hostname:port>" },
-    {"actuator-uri", 'a', "URL",  0, "Acutator URI <opc.tcp://hostname:port>" },
+    {"sensor-uri",   's', "URL",  0, "Sensor URI <opc.tcp://hostname:port>, overrides discovery" },
+    {"actuator-uri", 'a', "URL",  0, "Acutator URI <opc.tcp://hostname:port>, overrides discovery" },
+    {"lds",          'l', "URL",  0, "Find the sensor and actuator at the local discovery server at URL" },
+    {"sensor-app",   'S', "URI",  0, "Application URI (prefix) of the sensor [default: urn:sim-images:fillsensor-server]" },
+    {"actuator-app", 'A', "URI",  0, "Application URI (prefix) of the actuator [default: urn:sim-images:valve-server]" },
+    {"endpoint-cache", 'e', "PATH", 0, "Cache file for endpoints resolved at the discovery server" },
     {"database",     'd', "PATH", 0, "Path to the SQLite database" },
+    {"timeseries",   'T', "DIR",  0, "Store the samples in compressed time-series segments in DIR instead of the database" },
+    {"store-filter", 'F', "SPEC", 0, "Store only the fill level samples needed to reconstruct the history, e.g. 'deadband=0.5' or 'swing=0.2,heartbeat=60'" },
+    {"nodeid-cache", 'c', "PATH", 0, "Cache file for resolved node IDs" },
+    {"replay",       'r', "FILE", 0, "Replay the database offline, write decisions to FILE ('-' for stdout)" },
+    {"archive",      'X', "DIR",  0, "Archive the history of closed days offline into chunk files in DIR" },
+    {"retention",    'R', "HOURS", 0, "Keep at least HOURS of history in the database when archiving [default: 24]" },
+    {"metrics",      'm', "[ADDR:]PORT", 0, "Serve Prometheus metrics over HTTP" },
+    {"net-profile",  'n', "PROFILE", 0, "Impair the connections to the servers, e.g. 'wifi' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'" },
     {0},
 };
 
@@ -40,7 +80,19 @@ struct arguments
 {
     char *suri;
     char *auri;
+    char *lds;
+    char *sensorApp;
+    char *actuatorApp;
+    char *endpointcachename;
     char *dbname;
+    char *timeseriesdir;
+    char *storefilter;
+    char *cachename;
+    char *replayname;
+    char *archivedir;
+    UA_UInt32 retention;
+    char *metrics;
+    char *netprofile;
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -56,10 +108,64 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
             arguments->auri = arg;
             break;
         }
+        case 'l': {
+            arguments->lds = arg;
+            break;
+        }
+        case 'S': {
+            arguments->sensorApp = arg;
+            break;
+        }
+        case 'A': {
+            arguments->actuatorApp = arg;
+            break;
+        }
+        case 'e': {
+            arguments->endpointcachename = arg;
+            break;
+        }
         case 'd': {
             arguments->dbname = arg;
             break;
         }
+        case 'T': {
+            arguments->timeseriesdir = arg;
+            break;
+        }
+        case 'F': {
+            arguments->storefilter = arg;
+            break;
+        }
+        case 'c': {
+            arguments->cachename = arg;
+            break;
+        }
+        case 'r': {
+            arguments->replayname = arg;
+            break;
+        }
+        case 'X': {
+            arguments->archivedir = arg;
+            break;
+        }
+        case 'R': {
+            char *end;
+            unsigned long hours = strtoul(arg, &end, 10);
+            if(end == arg || *end != '\0' || hours > UINT32_MAX / 3600)
+            {
+                argp_error(state, "invalid retention '%s'", arg);
+            }
+            arguments->retention = (UA_UInt32)hours;
+            break;
+        }
+        case 'm': {
+            arguments->metrics = arg;
+            break;
+        }
+        case 'n': {
+            arguments->netprofile = arg;
+            break;
+        }
         default: {
             return ARGP_ERR_UNKNOWN;
         }
@@ -69,15 +175,112 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
+/*
+ * Browse paths of the nodes used on the sensor and actuator servers
+ */
+static char *sensorPath[] = {"tank1", "FillPercentage"};
+static char *actuatorPath[] = {"valve1", "Open"};
+static UA_UInt32 pathReferences[] = {UA_NS0ID_ORGANIZES, UA_NS0ID_HASCOMPONENT};
+
 /*
  * Structure needed to pass objects to callbacks
  */
 typedef struct {
-    sqlite3 *db;
     UA_Client *aclient;
     UA_NodeId openNodeId;
+    UA_NodeId fillPctNodeId;
+    NodeCache *cache;
+    const char *suri;
+    const char *auri;
+    ReconnectState *actuator;
+    ControlLoop loop;
+    /*
+     * Kept to detect whether the subscription survived a reconnect
+     */
+    UA_UInt32 subscriptionId;
 } CallbackContext;
 
+/*
+ * Write the valve state to the actuator. The decision time is sent as
+ * source timestamp, which lets valve-server measure the time until the new
+ * state is applied. A failed write caused by a lost session starts the
+ * reconnect of the actuator client. Nothing is written while the actuator
+ * is disconnected.
+ */
+static UA_StatusCode writeValveOpen(void *writerContext, UA_Boolean valveOpen, UA_DateTime decisionTime)
+{
+    CallbackContext *context = (CallbackContext *)writerContext;
+    if(!context->actuator->connected)
+    {
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+
+    UA_WriteValue writeValue;
+    UA_WriteValue_init(&writeValue);
+    writeValue.nodeId = context->openNodeId;
+    writeValue.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_Variant_setScalar(&writeValue.value.value, &valveOpen, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeValue.value.hasValue = true;
+    writeValue.value.sourceTimestamp = decisionTime;
+    writeValue.value.hasSourceTimestamp = true;
+
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = &writeValue;
+    request.nodesToWriteSize = 1;
+
+    UA_WriteResponse response = UA_Client_Service_write(context->aclient, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = response.resultsSize == 1 ? response.results[0] : UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    UA_WriteResponse_clear(&response);
+
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to write valveOpen to server: %s",
+                       UA_StatusCode_name(retval));
+        if(!isSessionActivated(context->aclient))
+        {
+            markDisconnected(context->actuator);
+        }
+    }
+    return retval;
+}
+
+/*
+ * Browse for 'Open' again after the actuator was reconnected, as the
+ * server may have been restarted with other node IDs. The previous node
+ * ID is kept if browsing fails.
+ */
+static UA_StatusCode refreshOpenNodeId(CallbackContext *context)
+{
+    if(context->cache)
+    {
+        invalidateNodeCache(context->cache, context->auri);
+    }
+    char **paths[] = {actuatorPath};
+    UA_NodeId openNodeId;
+    UA_StatusCode retval = resolveBrowsePaths(
+        context->aclient, context->cache, context->auri, paths, 1, pathReferences, 2,
+        &openNodeId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to retrieve node ID");
+        return retval;
+    }
+    UA_NodeId_clear(&context->openNodeId);
+    context->openNodeId = openNodeId;
+    if(context->cache)
+    {
+        saveNodeCache(context->cache);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
 /*
  * Callback when receiving a value change from the sensor
  */
@@ -85,169 +288,299 @@ static void valueChangedCallback(UA_Client *client, UA_UInt32 subId, void *subCo
                                 UA_UInt32 monId, void *monContext, UA_DataValue *value)
 {
     CallbackContext *context = (CallbackContext *)monContext;
-    if(UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_DOUBLE]))
-    {
-        /*
-         * Write the new fill percentage value to database
-         */
-        UA_Double fillPercentage = *(UA_Double *)value->value.data;
-        const char *sql = "INSERT INTO waterlevel (level) VALUES (?)";
-        sqlite3_stmt *stmt;
-        if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    processSample(&context->loop, value);
+}
+
+
+/*
+ * Callback when the client removes the subscription, e.g. because the
+ * server was restarted and the session could not be reactivated
+ */
+static void subscriptionDeletedCallback(UA_Client *client, UA_UInt32 subId, void *subContext)
+{
+    CallbackContext *context = (CallbackContext *)subContext;
+    if(context->subscriptionId == subId)
+    {
+        context->subscriptionId = 0;
+    }
+}
+
+
+/*
+ * Set up the subscription and the monitored item on the sensor server with
+ * the cached node ID. The browse path is only translated again if the
+ * server does not know the cached node ID anymore.
+ */
+static UA_StatusCode createFillPctSubscription(UA_Client *sclient, CallbackContext *context)
+{
+    UA_CreateSubscriptionRequest subRequest = UA_CreateSubscriptionRequest_default();
+    UA_CreateSubscriptionResponse subResponse =
+        UA_Client_Subscriptions_create(sclient, subRequest, context, NULL,
+                                       subscriptionDeletedCallback);
+    if(subResponse.responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to create subscription");
+        return subResponse.responseHeader.serviceResult;
+    }
+    context->subscriptionId = subResponse.subscriptionId;
+
+    UA_MonitoredItemCreateResult monResponse;
+    for(int attempt = 0; attempt < 2; attempt++)
+    {
+        UA_MonitoredItemCreateRequest monRequest =
+            UA_MonitoredItemCreateRequest_default(context->fillPctNodeId);
+        monResponse = UA_Client_MonitoredItems_createDataChange(
+            sclient,
+            context->subscriptionId,
+            UA_TIMESTAMPSTORETURN_BOTH,
+            monRequest,
+            context,
+            valueChangedCallback,
+            NULL);
+        if(monResponse.statusCode != UA_STATUSCODE_BADNODEIDUNKNOWN || attempt > 0)
         {
-            sqlite3_bind_double(stmt, 1, fillPercentage);
-            if(sqlite3_step(stmt) != SQLITE_DONE)
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                               "Could not write waterlevel to database with error: %s",
-                               sqlite3_errmsg(context->db));
-            }
-            sqlite3_finalize(stmt);
+            break;
         }
-        else
+
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Cached node ID of 'FillPercentage' is unknown, browsing again");
+        if(context->cache)
         {
-            UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                           "Failed to prepare SQL statement with error: %s",
-                           sqlite3_errmsg(context->db));
+            invalidateNodeCache(context->cache, context->suri);
         }
-
-        /*
-         * Logic for setting valve open/closed
-         */
-        double upperThreshold = 75.; // percent
-        double lowerThreshold = 25.; // percent
-        static UA_Boolean valveOpen = false;
-
-        if((!valveOpen) && (fillPercentage > upperThreshold))
+        char **paths[] = {sensorPath};
+        UA_NodeId_clear(&context->fillPctNodeId);
+        UA_StatusCode retval = resolveBrowsePaths(
+            sclient, context->cache, context->suri, paths, 1, pathReferences, 2,
+            &context->fillPctNodeId);
+        if(retval != UA_STATUSCODE_GOOD)
         {
-            valveOpen = true;
-            UA_Variant *valveOpenValue = UA_Variant_new();
-            if(UA_Variant_setScalarCopy(valveOpenValue, &valveOpen, &UA_TYPES[UA_TYPES_BOOLEAN]) != UA_STATUSCODE_GOOD)
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                               "Unable to set valveOpen to %d",
-                               valveOpen);
-                return;
-            }
-            if(UA_Client_writeValueAttribute(context->aclient, context->openNodeId, valveOpenValue) != UA_STATUSCODE_GOOD)
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                "Unable to write valveOpen to server");
-                return;
-            }
-            UA_Variant_delete(valveOpenValue);
-
-            const char* sql = "INSERT INTO valveposition (position) VALUES (?)";
-            if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) == SQLITE_OK)
-            {
-                sqlite3_bind_int(stmt, 1, (int)valveOpen);
-                if(sqlite3_step(stmt) != SQLITE_DONE)
-                {
-                    UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                                   "Could not write valveposition to database with error: %s",
-                                   sqlite3_errmsg(context->db));
-                }
-                sqlite3_finalize(stmt);
-            }
-            else
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                               "Failed to prepare SQL statement with error: %s",
-                               sqlite3_errmsg(context->db));
-            }
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to retrieve node ID");
+            return retval;
         }
-        else if(valveOpen && (fillPercentage < lowerThreshold))
+        if(context->cache)
         {
-            valveOpen = false;
-            UA_Variant *valveOpenValue = UA_Variant_new();
-            if(UA_Variant_setScalarCopy(valveOpenValue, &valveOpen, &UA_TYPES[UA_TYPES_BOOLEAN]) != UA_STATUSCODE_GOOD)
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                               "Unable to set valveOpen to %d",
-                               valveOpen);
-                return;
-            }
-            UA_Client_writeValueAttribute(context->aclient, context->openNodeId, valveOpenValue);
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                "Unable to write valveOpen to server");
-                return;
-            }
-            UA_Variant_delete(valveOpenValue);
-
-            const char* sql = "INSERT INTO valveposition (position) VALUES (?)";
-            if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) == SQLITE_OK)
-            {
-                sqlite3_bind_int(stmt, 1, (int)valveOpen);
-                if(sqlite3_step(stmt) != SQLITE_DONE)
-                {
-                    UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                                   "Could not write valveposition to database with error: %s",
-                                   sqlite3_errmsg(context->db));
-                }
-                sqlite3_finalize(stmt);
-            }
-            else
-            {
-                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                               "Failed to prepare SQL statement with error: %s",
-                               sqlite3_errmsg(context->db));
-            }
+            saveNodeCache(context->cache);
         }
     }
-    else
+
+    if(monResponse.statusCode != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Received data with wrong datatype");
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable add monitored item to subscription");
+        return monResponse.statusCode;
     }
+    setDeliveryInterval(&context->loop, monResponse.revisedSamplingInterval,
+                        subResponse.revisedPublishingInterval, monResponse.revisedQueueSize);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Create a client, with its connections impaired if a network profile is
+ * given
+ */
+static UA_Client *newClient(const NetFaultProfile *netProfile)
+{
+    if(!netProfile)
+    {
+        return UA_Client_new();
+    }
+
+    UA_ClientConfig cc;
+    memset(&cc, 0, sizeof(UA_ClientConfig));
+    cc.eventLoop = newFaultyEventLoop(netProfile, asyncLog);
+    if(!cc.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ClientConfig_setDefault(&cc);
+    return UA_Client_newWithConfig(&cc);
 }
 
 
 int main(int argc, char **argv)
 {
+    UA_DateTime started = UA_DateTime_nowMonotonic();
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
+    signal(SIGUSR1, dumpHandler);
 
     /*
      * Default arguments
      */
     struct arguments arguments = {
-        .suri = "opc.tcp://127.0.0.1:4840",
-        .auri = "opc.tcp://127.0.0.1:4840",
+        .suri = NULL,
+        .auri = NULL,
+        .lds = NULL,
+        .sensorApp = "urn:sim-images:fillsensor-server",
+        .actuatorApp = "urn:sim-images:valve-server",
+        .endpointcachename = NULL,
         .dbname = "/db.sqlite3",
+        .timeseriesdir = NULL,
+        .storefilter = NULL,
+        .cachename = NULL,
+        .replayname = NULL,
+        .archivedir = NULL,
+        .retention = 24,
+        .metrics = NULL,
+        .netprofile = NULL,
     };
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
     UA_StatusCode retval = 0;
 
     /*
-     * Open the database
+     * Route the allocations of SQLite to a pool, so storing samples does
+     * not allocate on the heap once the pool has grown
+     */
+    initSqliteMemory();
+
+    /*
+     * Offline replay and archiving run without any server connection
+     */
+    if(arguments.replayname)
+    {
+        retval = runReplay(arguments.dbname, arguments.replayname);
+        return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(arguments.archivedir)
+    {
+        retval = runArchive(arguments.dbname, arguments.archivedir, arguments.retention);
+        return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
+    /*
+     * URIs given on the command line take precedence over the discovery
+     * server. The resolved URLs stay in the endpoints, so the node ID cache
+     * and the reconnect bookkeeping can point to them.
+     */
+    const char *suri = arguments.suri;
+    const char *auri = arguments.auri;
+    EndpointCache endpointCacheStorage;
+    EndpointCache *endpointCache = NULL;
+    DiscoveredEndpoint sensorEndpoint;
+    DiscoveredEndpoint actuatorEndpoint;
+    if(arguments.lds)
+    {
+        if(arguments.endpointcachename)
+        {
+            loadEndpointCache(&endpointCacheStorage, arguments.endpointcachename);
+            endpointCache = &endpointCacheStorage;
+        }
+        initDiscoveredEndpoint(&sensorEndpoint, arguments.lds, endpointCache, arguments.sensorApp);
+        initDiscoveredEndpoint(&actuatorEndpoint, arguments.lds, endpointCache, arguments.actuatorApp);
+
+        DiscoveredEndpoint *endpoints[2];
+        size_t endpointsSize = 0;
+        if(!suri)
+        {
+            endpoints[endpointsSize++] = &sensorEndpoint;
+            suri = sensorEndpoint.url;
+        }
+        if(!auri)
+        {
+            endpoints[endpointsSize++] = &actuatorEndpoint;
+            auri = actuatorEndpoint.url;
+        }
+        retval = resolveDiscoveredEndpoints(endpoints, endpointsSize, true);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to resolve the servers at the discovery server");
+            goto cleanup;
+        }
+    }
+    if(!suri)
+    {
+        suri = "opc.tcp://127.0.0.1:4840";
+    }
+    if(!auri)
+    {
+        auri = "opc.tcp://127.0.0.1:4840";
+    }
+
+    /*
+     * Network impairments for testing, see netfault.h
+     */
+    NetFaultProfile netProfileStorage;
+    NetFaultProfile *netProfile = NULL;
+    if(arguments.netprofile)
+    {
+        retval = parseNetFaultProfile(arguments.netprofile, &netProfileStorage);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Invalid network profile '%s'", arguments.netprofile);
+            goto cleanup;
+        }
+        netProfile = &netProfileStorage;
+    }
+
+    /*
+     * Storage filter of the fill level samples, see storefilter.h
+     */
+    StoreFilterConfig storeFilter = {0};
+    if(arguments.storefilter)
+    {
+        retval = parseStoreFilter(arguments.storefilter, &storeFilter);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Invalid storage filter '%s'", arguments.storefilter);
+            goto cleanup;
+        }
+    }
+
+    /*
+     * Open the database, which holds the rollups with the time-series
+     * store as well
      */
     sqlite3 *db;
     if(sqlite3_open(arguments.dbname, &db))
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to open database");
         retval = UA_STATUSCODE_BAD;
         goto cleanup;
     }
 
+    /*
+     * Create or migrate the tables and let the servers waiting for the
+     * database know
+     */
+    retval = initProcessSchema(db);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to initialize the database");
+        goto cleanup_db;
+    }
+    signalDatabaseReady(arguments.dbname);
+
     /*
      * Create and setup clients
      */
-    UA_Client *sclient = UA_Client_new();
+    UA_Client *sclient = newClient(netProfile);
     if(!sclient)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create sensor client");
         retval = UA_STATUSCODE_BAD;
         goto cleanup_db;
     }
 
-    UA_Client *aclient = UA_Client_new();
+    UA_Client *aclient = newClient(netProfile);
     if(!aclient)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create actuator client");
         retval = UA_STATUSCODE_BAD;
         goto cleanup_sclient;
@@ -257,7 +590,7 @@ int main(int argc, char **argv)
     retval = UA_ClientConfig_setDefault(scfg);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create sensor config");
         goto cleanup_aclient;
     }
@@ -270,7 +603,7 @@ int main(int argc, char **argv)
     retval = UA_ClientConfig_setDefault(acfg);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create actuator config");
         goto cleanup_aclient;
     }
@@ -280,103 +613,196 @@ int main(int argc, char **argv)
         "http://opcfoundation.org/UA/SecurityPolicy#None");
 
     /*
-     * Sensor client connect
+     * Connect sensor and actuator client in parallel, so the startup does
+     * not add up the handshakes
      */
-    retval = UA_Client_connect(sclient, arguments.suri);
+    UA_Client *clients[] = {sclient, aclient};
+    const char *urls[] = {suri, auri};
+    const char *names[] = {"sensor", "actuator"};
+    retval = connectClients(clients, urls, names, 2, RECONNECT_CONNECT_TIMEOUT_MS);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to connect to sensor");
         goto cleanup_aclient;
     }
-
     /*
-     * Actuator client connect
+     * Request the node IDs of the open attribute from the valve and of the
+     * fillPercentage attribute from the sensor, preferably from the cache
      */
-    retval = UA_Client_connect(aclient, arguments.auri);
-    if(retval != UA_STATUSCODE_GOOD)
+    NodeCache cacheStorage;
+    NodeCache *cache = NULL;
+    if(arguments.cachename)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to connect to actuator");
-        goto cleanup_sclient_disconnect;
+        loadNodeCache(&cacheStorage, arguments.cachename);
+        cache = &cacheStorage;
     }
-    /*
-     * Request the node ID of the open attribute from the valve
-     */
+
     UA_NodeId openNodeId;
-    char *a_path[] = {"valve1", "Open"};
-    UA_UInt32 ids[] = {UA_NS0ID_ORGANIZES, UA_NS0ID_HASCOMPONENT};
-    retval = translateBrowsePathToNodeIdRequest(aclient, &openNodeId, a_path, ids, 2);
+    char **a_paths[] = {actuatorPath};
+    retval = resolveBrowsePaths(aclient, cache, auri, a_paths, 1, pathReferences, 2, &openNodeId);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to retrieve node ID");
-        goto cleanup_aclient_disconnect;
+        goto cleanup_cache;
     }
-    /*
-     * Request the node ID of the fillPercentage attribute from sensor
-     */
+
     UA_NodeId fillPctNodeId;
-    char *s_path[] = {"tank1", "FillPercentage"};
-    retval = translateBrowsePathToNodeIdRequest(sclient, &fillPctNodeId, s_path, ids, 2);
+    char **s_paths[] = {sensorPath};
+    retval = resolveBrowsePaths(sclient, cache, suri, s_paths, 1, pathReferences, 2, &fillPctNodeId);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to retrieve node ID");
-        goto cleanup_aclient_disconnect;
+        goto cleanup_cache;
+    }
+
+    if(cache)
+    {
+        saveNodeCache(cache);
     }
 
     /*
      * Set up the subscription on the sensor server
      */
+    ReconnectState sensor;
+    initReconnectState(&sensor, "sensor", sclient, suri);
+    ReconnectState actuator;
+    initReconnectState(&actuator, "actuator", aclient, auri);
+    if(arguments.lds && !arguments.suri)
+    {
+        setReconnectResolver(&sensor, refreshDiscoveredEndpoint, &sensorEndpoint);
+    }
+    if(arguments.lds && !arguments.auri)
+    {
+        setReconnectResolver(&actuator, refreshDiscoveredEndpoint, &actuatorEndpoint);
+    }
+
+    TraceHistograms traces;
+    initTraceHistograms(&traces);
+
+    ProcessDatabase database;
+    if(arguments.timeseriesdir)
+    {
+        retval = openProcessTimeSeries(&database, db, arguments.timeseriesdir);
+    }
+    else
+    {
+        retval = prepareProcessDatabase(&database, db);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to prepare the storage of samples");
+        goto cleanup_cache;
+    }
+    setStoreFilter(&database, &storeFilter);
+
     CallbackContext context = {
-        .db = db,
         .aclient = aclient,
         .openNodeId = openNodeId,
+        .fillPctNodeId = fillPctNodeId,
+        .cache = cache,
+        .suri = suri,
+        .auri = auri,
+        .actuator = &actuator,
     };
+    initControlLoop(&context.loop, &database, &traces, writeValveOpen, &context);
+    context.loop.started = started;
 
-    UA_CreateSubscriptionRequest subRequest = UA_CreateSubscriptionRequest_default();
-    UA_CreateSubscriptionResponse subResponse =
-        UA_Client_Subscriptions_create(sclient, subRequest, NULL, NULL, NULL);
-    if(subResponse.responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+    retval = createFillPctSubscription(sclient, &context);
+    if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to create subscription");
-        goto cleanup_aclient_disconnect;
+        goto cleanup_database;
     }
 
     /*
-     * Set up the monitored item on the sensor server
+     * Run the eventloop unless Ctrl-C has already been received. Lost
+     * connections are re-established in-process with exponential backoff
+     * and the cached node IDs, without browsing or reopening the database.
      */
-    UA_MonitoredItemCreateRequest monRequest =
-        UA_MonitoredItemCreateRequest_default(fillPctNodeId);
-    UA_MonitoredItemCreateResult monResponse =
-        UA_Client_MonitoredItems_createDataChange(
-            sclient,
-            subResponse.subscriptionId,
-            UA_TIMESTAMPSTORETURN_BOTH,
-            monRequest,
-            &context,
-            valueChangedCallback,
-            NULL);
-    if(monResponse.statusCode != UA_STATUSCODE_GOOD)
-    {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable add monitored item to subscription");
-        goto cleanup_aclient_disconnect;
-    }
+    if(!running) goto cleanup_database;
 
     /*
-     * Run the eventloop unless Ctrl-C has already been received
+     * The metrics endpoint is optional. All metrics are registered by now,
+     * the exporter thread only reads them.
      */
-    if(!running) goto cleanup_aclient_disconnect;
-    while(running && UA_Client_run_iterate(sclient, 1000) == UA_STATUSCODE_GOOD);
+    Metric *sensorConnected = registerMetric("SensorConnected", "1 if connected to the sensor server", METRIC_GAUGE);
+    Metric *actuatorConnected = registerMetric("ActuatorConnected", "1 if connected to the actuator server", METRIC_GAUGE);
+    MetricsExporter exporter;
+    UA_Boolean exporting = false;
+    if(arguments.metrics)
+    {
+        exporting = startMetricsExporter(&exporter, arguments.metrics, "plc_logic_client") == UA_STATUSCODE_GOOD;
+    }
+
+    while(running)
+    {
+        setGauge(sensorConnected, sensor.connected);
+        setGauge(actuatorConnected, actuator.connected);
+
+        if(dumpRequested)
+        {
+            dumpRequested = 0;
+            printTraceHistograms(&traces, stdout);
+        }
+
+        if(!actuator.connected && tryReconnect(&actuator) == UA_STATUSCODE_GOOD)
+        {
+            refreshOpenNodeId(&context);
+            /*
+             * A decision taken during the outage has not reached the valve
+             */
+            resyncValve(&context.loop);
+        }
+
+        if(!sensor.connected)
+        {
+            if(tryReconnect(&sensor) != UA_STATUSCODE_GOOD)
+            {
+                waitForNextAttempt(&sensor, 100);
+                continue;
+            }
 
+            /*
+             * A reactivated session keeps its subscription and the server
+             * republishes what is still queued. Otherwise the subscription
+             * was deleted by the client and is created anew.
+             */
+            if(context.subscriptionId == 0 &&
+               createFillPctSubscription(sclient, &context) != UA_STATUSCODE_GOOD)
+            {
+                UA_Client_disconnect(sclient);
+                markDisconnected(&sensor);
+                context.loop.outagePending = true;
+                continue;
+            }
+        }
+
+        if(UA_Client_run_iterate(sclient, 1000) != UA_STATUSCODE_GOOD ||
+           !isSessionActivated(sclient))
+        {
+            markDisconnected(&sensor);
+            context.loop.outagePending = true;
+        }
+    }
+    printTraceHistograms(&traces, stdout);
+
+    if(exporting)
+    {
+        stopMetricsExporter(&exporter);
+    }
+
+cleanup_database:
+    finalizeProcessDatabase(&database);
+
+cleanup_cache:
+    if(cache)
+    {
+        clearNodeCache(cache);
+    }
 
-cleanup_aclient_disconnect:
     UA_Client_disconnect(aclient);
 
-cleanup_sclient_disconnect:
     UA_Client_disconnect(sclient);
 
 cleanup_aclient:
@@ -389,5 +815,10 @@ cleanup_db:
     sqlite3_close(db);
 
 cleanup:
+    if(endpointCache)
+    {
+        clearEndpointCache(endpointCache);
+    }
+    stopAsyncLogger();
     return retval = UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
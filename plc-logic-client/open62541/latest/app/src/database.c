@@ -0,0 +1,171 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <string.h>
+#include "asynclog.h"
+#include "database.h"
+
+
+static sqlite3_stmt *prepareStatement(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt = NULL;
+    if(sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to prepare SQL statement with error: %s",
+                       sqlite3_errmsg(db));
+        return NULL;
+    }
+    return stmt;
+}
+
+
+/*
+ * Execute a prepared insert and reset it for the next execution
+ */
+static void executeStatement(sqlite3 *db, sqlite3_stmt *stmt, const char *table)
+{
+    if(sqlite3_step(stmt) != SQLITE_DONE)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Could not write %s to database with error: %s",
+                       table, sqlite3_errmsg(db));
+    }
+    sqlite3_reset(stmt);
+}
+
+
+UA_StatusCode prepareProcessDatabase(ProcessDatabase *database, sqlite3 *db)
+{
+    memset(database, 0, sizeof(ProcessDatabase));
+    database->db = db;
+    database->insertWaterlevel = prepareStatement(
+        db, "INSERT INTO waterlevel (timestamp, level) VALUES (datetime(?, 'unixepoch'), ?)");
+    database->insertValvePosition = prepareStatement(
+        db, "INSERT INTO valveposition (position) VALUES (?)");
+    if(   !database->insertWaterlevel || !database->insertValvePosition
+       || prepareRollups(&database->rollups, db) != UA_STATUSCODE_GOOD)
+    {
+        finalizeProcessDatabase(database);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode openProcessTimeSeries(ProcessDatabase *database, sqlite3 *db, const char *dir)
+{
+    memset(database, 0, sizeof(ProcessDatabase));
+    database->db = db;
+    database->timeSeries = true;
+    UA_StatusCode retval = prepareRollups(&database->rollups, db);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    retval = openTimeSeries(&database->waterlevel, dir, "waterlevel", true);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = openTimeSeries(&database->valvePosition, dir, "valveposition", true);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        finalizeProcessDatabase(database);
+    }
+    return retval;
+}
+
+
+void setStoreFilter(ProcessDatabase *database, const StoreFilterConfig *config)
+{
+    initStoreFilter(&database->filter, config);
+}
+
+
+static void appendSample(TimeSeries *series, UA_DateTime time, UA_Double value)
+{
+    if(appendTimeSeries(series, time, value) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Could not write %s to time series", series->name);
+    }
+}
+
+
+/*
+ * The timestamp has the format of the default of the table, the current
+ * time, but a sample held back by the filter is stored with its own
+ */
+static void storeWaterlevel(ProcessDatabase *database, const StoredSample *sample)
+{
+    if(database->timeSeries)
+    {
+        appendSample(&database->waterlevel, sample->time, sample->value);
+        return;
+    }
+    sqlite3_bind_int64(database->insertWaterlevel, 1,
+                       (sample->time - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC);
+    sqlite3_bind_double(database->insertWaterlevel, 2, sample->value);
+    executeStatement(database->db, database->insertWaterlevel, "waterlevel");
+}
+
+
+void finalizeProcessDatabase(ProcessDatabase *database)
+{
+    StoredSample held;
+    if(   (database->insertWaterlevel || database->timeSeries)
+       && flushStoreFilter(&database->filter, &held) > 0)
+    {
+        storeWaterlevel(database, &held);
+    }
+    if(database->filter.config.mode != STORE_FILTER_NONE)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Stored %llu of %llu fill level samples",
+                    (unsigned long long)database->filter.written,
+                    (unsigned long long)database->filter.received);
+    }
+
+    finalizeRollups(&database->rollups);
+    if(database->timeSeries)
+    {
+        closeTimeSeries(&database->waterlevel);
+        closeTimeSeries(&database->valvePosition);
+        return;
+    }
+
+    sqlite3_finalize(database->insertWaterlevel);
+    sqlite3_finalize(database->insertValvePosition);
+    database->insertWaterlevel = NULL;
+    database->insertValvePosition = NULL;
+}
+
+
+/*
+ * The samples are taken at the current time, like the default timestamp
+ * of the tables
+ */
+void insertWaterlevel(ProcessDatabase *database, UA_Double level)
+{
+    UA_DateTime now = UA_DateTime_now();
+    addLevelToRollups(&database->rollups, now, level);
+    StoredSample stored[2];
+    size_t count = filterSample(&database->filter, now, level, stored);
+    for(size_t i = 0; i < count; i++)
+    {
+        storeWaterlevel(database, &stored[i]);
+    }
+}
+
+
+void insertValvePosition(ProcessDatabase *database, UA_Boolean position)
+{
+    UA_DateTime now = UA_DateTime_now();
+    addValveToRollups(&database->rollups, now, position);
+    if(database->timeSeries)
+    {
+        appendSample(&database->valvePosition, now, position ? 1. : 0.);
+        return;
+    }
+    sqlite3_bind_int(database->insertValvePosition, 1, (int)position);
+    executeStatement(database->db, database->insertValvePosition, "valveposition");
+}
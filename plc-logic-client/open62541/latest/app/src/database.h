@@ -0,0 +1,55 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <open62541/types.h>
+#include <sqlite3.h>
+#include "rollup.h"
+#include "storefilter.h"
+#include "tsstore.h"
+
+/*
+ * Insert statements of the control loop. They are prepared once and reset
+ * after every execution, so persisting a sample does not compile SQL or
+ * allocate memory on the heap.
+ *
+ * Alternatively the samples are appended to the time series 'waterlevel'
+ * and 'valveposition' of a time-series store, see tsstore.h. Either way
+ * the rollups of the samples are kept in the database, see rollup.h.
+ *
+ * The fill level samples pass the storage filter on the way, see
+ * storefilter.h. The rollups get all of them.
+ */
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *insertWaterlevel;
+    sqlite3_stmt *insertValvePosition;
+    UA_Boolean timeSeries;
+    TimeSeries waterlevel;
+    TimeSeries valvePosition;
+    Rollups rollups;
+    StoreFilter filter;
+} ProcessDatabase;
+
+UA_StatusCode prepareProcessDatabase(ProcessDatabase *database, sqlite3 *db);
+
+/*
+ * Store the samples in the time-series store in dir instead of the tables
+ */
+UA_StatusCode openProcessTimeSeries(ProcessDatabase *database, sqlite3 *db, const char *dir);
+
+/*
+ * Filter the fill level samples before they are stored, all are stored
+ * by default
+ */
+void setStoreFilter(ProcessDatabase *database, const StoreFilterConfig *config);
+
+/*
+ * Store the sample held back by the filter and finalize the statements
+ */
+void finalizeProcessDatabase(ProcessDatabase *database);
+
+void insertWaterlevel(ProcessDatabase *database, UA_Double level);
+
+void insertValvePosition(ProcessDatabase *database, UA_Boolean position);
+
+#endif
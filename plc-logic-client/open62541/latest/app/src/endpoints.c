@@ -0,0 +1,372 @@
+#include <open62541/client_config_default.h>
+#include <open62541/plugin/log_stdout.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asynclog.h"
+#include "endpoints.h"
+
+
+static void clearEndpointCacheEntry(EndpointCacheEntry *entry)
+{
+    free(entry->query);
+    free(entry->applicationUri);
+    free(entry->url);
+}
+
+
+static EndpointCacheEntry *findEndpointCacheEntry(EndpointCache *cache, const char *query)
+{
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        if(strcmp(cache->entries[i].query, query) == 0)
+        {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Add or replace the entry of a query, the strings are copied
+ */
+static UA_StatusCode setEndpointCacheEntry(EndpointCache *cache, const char *query,
+                                           const char *applicationUri, const char *url)
+{
+    EndpointCacheEntry *entry = findEndpointCacheEntry(cache, query);
+    if(   entry
+       && strcmp(entry->applicationUri, applicationUri) == 0
+       && strcmp(entry->url, url) == 0)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    EndpointCacheEntry update = {strdup(query), strdup(applicationUri), strdup(url)};
+    if(!update.query || !update.applicationUri || !update.url)
+    {
+        clearEndpointCacheEntry(&update);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    if(!entry)
+    {
+        EndpointCacheEntry *entries = (EndpointCacheEntry*)realloc(
+            cache->entries, (cache->entriesSize + 1) * sizeof(EndpointCacheEntry));
+        if(!entries)
+        {
+            clearEndpointCacheEntry(&update);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+        cache->entries = entries;
+        entry = &cache->entries[cache->entriesSize++];
+    }
+    else
+    {
+        clearEndpointCacheEntry(entry);
+    }
+    *entry = update;
+    cache->modified = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode loadEndpointCache(EndpointCache *cache, const char *filename)
+{
+    cache->filename = filename;
+    cache->entriesSize = 0;
+    cache->entries = NULL;
+    cache->modified = false;
+
+    FILE *fp = fopen(filename, "r");
+    if(!fp)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t read;
+    while((read = getline(&line, &lineSize, fp)) > 0)
+    {
+        if(line[read - 1] == '\n')
+        {
+            line[read - 1] = '\0';
+        }
+
+        /*
+         * Split into query, application URI and endpoint URL
+         */
+        char *fields[3] = {line, NULL, NULL};
+        for(int f = 1; f < 3 && fields[f - 1]; f++)
+        {
+            fields[f] = strchr(fields[f - 1], '\t');
+            if(fields[f])
+            {
+                *fields[f]++ = '\0';
+            }
+        }
+        if(!fields[2] || *fields[2] == '\0')
+        {
+            continue;
+        }
+        setEndpointCacheEntry(cache, fields[0], fields[1], fields[2]);
+    }
+    free(line);
+    fclose(fp);
+    cache->modified = false;
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Loaded %lu cached endpoints from %s",
+                (unsigned long)cache->entriesSize, filename);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode saveEndpointCache(EndpointCache *cache)
+{
+    if(!cache->modified)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /*
+     * Write a temporary file first so that a crash never leaves a
+     * truncated cache behind
+     */
+    size_t tmpnameSize = strlen(cache->filename) + 5;
+    char *tmpname = (char*)malloc(tmpnameSize);
+    if(!tmpname)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    snprintf(tmpname, tmpnameSize, "%s.tmp", cache->filename);
+
+    FILE *fp = fopen(tmpname, "w");
+    if(!fp)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to write endpoint cache %s", tmpname);
+        free(tmpname);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        EndpointCacheEntry *entry = &cache->entries[i];
+        fprintf(fp, "%s\t%s\t%s\n", entry->query, entry->applicationUri, entry->url);
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(fclose(fp) != 0 || rename(tmpname, cache->filename) != 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to replace endpoint cache %s", cache->filename);
+        remove(tmpname);
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+    }
+    else
+    {
+        cache->modified = false;
+    }
+    free(tmpname);
+    return retval;
+}
+
+
+void clearEndpointCache(EndpointCache *cache)
+{
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        clearEndpointCacheEntry(&cache->entries[i]);
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->entriesSize = 0;
+}
+
+
+void initDiscoveredEndpoint(DiscoveredEndpoint *endpoint, const char *ldsUrl,
+                            EndpointCache *cache, const char *query)
+{
+    endpoint->ldsUrl = ldsUrl;
+    endpoint->cache = cache;
+    endpoint->query = query;
+    endpoint->url[0] = '\0';
+}
+
+
+static UA_Boolean matchesQuery(const UA_String *applicationUri, const char *query)
+{
+    size_t length = strlen(query);
+    return applicationUri->length >= length
+        && memcmp(applicationUri->data, query, length) == 0
+        && (applicationUri->length == length || applicationUri->data[length] == ':');
+}
+
+
+static int compareStrings(const UA_String *a, const UA_String *b)
+{
+    size_t length = a->length < b->length ? a->length : b->length;
+    int order = memcmp(a->data, b->data, length);
+    if(order != 0 || a->length == b->length)
+    {
+        return order;
+    }
+    return a->length < b->length ? -1 : 1;
+}
+
+
+/*
+ * Pick the registered server for the query of an endpoint and take over
+ * its first discovery URL
+ */
+static UA_Boolean selectRegisteredServer(DiscoveredEndpoint *endpoint,
+                                         const UA_ApplicationDescription *servers, size_t serversSize)
+{
+    const UA_ApplicationDescription *selected = NULL;
+    size_t matches = 0;
+    for(size_t i = 0; i < serversSize; i++)
+    {
+        const UA_ApplicationDescription *server = &servers[i];
+        if(server->discoveryUrlsSize == 0 || server->discoveryUrls[0].length >= ENDPOINT_URL_SIZE ||
+           !matchesQuery(&server->applicationUri, endpoint->query))
+        {
+            continue;
+        }
+        matches++;
+        if(!selected || compareStrings(&server->applicationUri, &selected->applicationUri) < 0)
+        {
+            selected = server;
+        }
+    }
+    if(!selected)
+    {
+        return false;
+    }
+
+    const UA_String *url = &selected->discoveryUrls[0];
+    char applicationUri[ENDPOINT_URL_SIZE];
+    snprintf(applicationUri, sizeof(applicationUri), "%.*s",
+             (int)selected->applicationUri.length, (char*)selected->applicationUri.data);
+    if(matches > 1)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "%lu servers match '%s', using %s",
+                    (unsigned long)matches, endpoint->query, applicationUri);
+    }
+    if(strlen(endpoint->url) != url->length || memcmp(endpoint->url, url->data, url->length) != 0)
+    {
+        memcpy(endpoint->url, url->data, url->length);
+        endpoint->url[url->length] = '\0';
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Resolved '%s' to %s at %s", endpoint->query, applicationUri, endpoint->url);
+    }
+    if(endpoint->cache)
+    {
+        setEndpointCacheEntry(endpoint->cache, endpoint->query, applicationUri, endpoint->url);
+    }
+    return true;
+}
+
+
+static UA_Boolean lookupEndpointCache(DiscoveredEndpoint *endpoint)
+{
+    EndpointCacheEntry *entry = endpoint->cache ? findEndpointCacheEntry(endpoint->cache, endpoint->query) : NULL;
+    if(!entry || strlen(entry->url) >= ENDPOINT_URL_SIZE)
+    {
+        return false;
+    }
+    strcpy(endpoint->url, entry->url);
+    return true;
+}
+
+
+/*
+ * Ask the LDS for all registered servers with a short lived client
+ */
+static UA_StatusCode findRegisteredServers(const char *ldsUrl, UA_ApplicationDescription **servers,
+                                           size_t *serversSize)
+{
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    UA_StatusCode retval = UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = UA_Client_findServers(client, ldsUrl, 0, NULL, 0, NULL, serversSize, servers);
+    }
+    UA_Client_delete(client);
+    return retval;
+}
+
+
+UA_StatusCode resolveDiscoveredEndpoints(DiscoveredEndpoint *endpoints[], size_t endpointsSize,
+                                         UA_Boolean useCache)
+{
+    if(endpointsSize == 0)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    size_t resolved = 0;
+    if(useCache)
+    {
+        while(resolved < endpointsSize && lookupEndpointCache(endpoints[resolved]))
+        {
+            resolved++;
+        }
+        if(resolved == endpointsSize)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Resolved %lu endpoints from cache", (unsigned long)endpointsSize);
+            return UA_STATUSCODE_GOOD;
+        }
+    }
+
+    UA_ApplicationDescription *servers = NULL;
+    size_t serversSize = 0;
+    UA_StatusCode retval = findRegisteredServers(endpoints[0]->ldsUrl, &servers, &serversSize);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to query discovery server %s: %s",
+                       endpoints[0]->ldsUrl, UA_StatusCode_name(retval));
+    }
+
+    retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < endpointsSize; i++)
+    {
+        DiscoveredEndpoint *endpoint = endpoints[i];
+        if(selectRegisteredServer(endpoint, servers, serversSize))
+        {
+            continue;
+        }
+        if(lookupEndpointCache(endpoint))
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "No server for '%s' at the discovery server, using cached %s",
+                        endpoint->query, endpoint->url);
+            continue;
+        }
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "No server for '%s' at the discovery server", endpoint->query);
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    }
+    UA_Array_delete(servers, serversSize, &UA_TYPES[UA_TYPES_APPLICATIONDESCRIPTION]);
+
+    if(endpoints[0]->cache)
+    {
+        saveEndpointCache(endpoints[0]->cache);
+    }
+    return retval;
+}
+
+
+UA_StatusCode refreshDiscoveredEndpoint(void *endpoint)
+{
+    DiscoveredEndpoint *endpoints[] = {(DiscoveredEndpoint*)endpoint};
+    return resolveDiscoveredEndpoints(endpoints, 1, false);
+}
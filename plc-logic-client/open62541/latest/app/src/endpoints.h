@@ -0,0 +1,76 @@
+#ifndef ENDPOINTS_H
+#define ENDPOINTS_H
+
+#include <open62541/client.h>
+
+#define ENDPOINT_URL_SIZE 256
+
+/*
+ * Endpoint URL last resolved for an application URI query
+ */
+typedef struct {
+    char *query;
+    char *applicationUri;
+    char *url;
+} EndpointCacheEntry;
+
+/*
+ * Small on-disk cache of endpoints resolved at the local discovery server
+ * (LDS). The file holds one entry per line with tab separated query,
+ * application URI and endpoint URL. With a complete cache the client
+ * starts without waiting for the LDS.
+ */
+typedef struct {
+    const char *filename;
+    size_t entriesSize;
+    EndpointCacheEntry *entries;
+    UA_Boolean modified;
+} EndpointCache;
+
+/*
+ * Load the cache file. A missing file results in an empty cache.
+ */
+UA_StatusCode loadEndpointCache(EndpointCache *cache, const char *filename);
+
+/*
+ * Write the cache file if entries were changed since loading
+ */
+UA_StatusCode saveEndpointCache(EndpointCache *cache);
+
+void clearEndpointCache(EndpointCache *cache);
+
+/*
+ * A server found by its application URI. The query matches an application
+ * URI that equals it or that continues with ':', e.g.
+ * 'urn:sim-images:fillsensor-server' matches the servers on every host.
+ * Of several matches the lexicographically smallest URI is taken, so the
+ * choice is stable across restarts. url stays valid for the lifetime of
+ * the endpoint and is updated in place.
+ */
+typedef struct {
+    const char *ldsUrl;
+    EndpointCache *cache;       /* may be NULL */
+    const char *query;
+    char url[ENDPOINT_URL_SIZE];
+} DiscoveredEndpoint;
+
+void initDiscoveredEndpoint(DiscoveredEndpoint *endpoint, const char *ldsUrl,
+                            EndpointCache *cache, const char *query);
+
+/*
+ * Resolve endpointsSize endpoints sharing the LDS and cache of the first
+ * one. With useCache, the LDS is only asked if an endpoint is not cached.
+ * All other endpoints are resolved with a single FindServers request, the
+ * cache serves those the LDS does not know. An endpoint that cannot be
+ * resolved keeps its URL and fails the call with UA_STATUSCODE_BADNOTFOUND.
+ */
+UA_StatusCode resolveDiscoveredEndpoints(DiscoveredEndpoint *endpoints[], size_t endpointsSize,
+                                         UA_Boolean useCache);
+
+/*
+ * Resolve a single DiscoveredEndpoint at the LDS, for use as a reconnect
+ * resolver
+ */
+UA_StatusCode refreshDiscoveredEndpoint(void *endpoint);
+
+#endif
@@ -0,0 +1,356 @@
+#include <ctype.h>
+#include <netdb.h>
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "exporter.h"
+#include "metrics.h"
+
+#define EXPORTER_POLL_MS 250
+#define EXPORTER_TIMEOUT_S 1
+#define EXPORTER_REQUEST_SIZE 2048
+#define EXPORTER_NAME_SIZE 128
+
+
+/*
+ * Append formatted text to the response buffer, which grows as needed
+ */
+static void appendText(MetricsExporter *exporter, const char *format, ...)
+{
+    for(;;)
+    {
+        size_t available = exporter->bufferSize - exporter->bufferUsed;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(exporter->buffer + exporter->bufferUsed, available, format, args);
+        va_end(args);
+        if(written < 0)
+        {
+            return;
+        }
+        if((size_t)written < available)
+        {
+            exporter->bufferUsed += (size_t)written;
+            return;
+        }
+
+        size_t size = exporter->bufferSize * 2;
+        while(size - exporter->bufferUsed <= (size_t)written)
+        {
+            size *= 2;
+        }
+        char *buffer = realloc(exporter->buffer, size);
+        if(!buffer)
+        {
+            return;
+        }
+        exporter->buffer = buffer;
+        exporter->bufferSize = size;
+    }
+}
+
+
+/*
+ * Convert a metric name like 'EventLoopIteration' to the Prometheus
+ * convention 'prefix_event_loop_iteration'
+ */
+static void formatMetricName(char *out, size_t size, const char *prefix, const char *name)
+{
+    size_t used = (size_t)snprintf(out, size, "%s_", prefix);
+    size_t length = strlen(name);
+    for(size_t i = 0; i < length && used + 2 < size; i++)
+    {
+        char c = name[i];
+        if(i > 0 && isupper((unsigned char)c) &&
+           (islower((unsigned char)name[i - 1]) || isdigit((unsigned char)name[i - 1]) ||
+            (i + 1 < length && islower((unsigned char)name[i + 1]))))
+        {
+            out[used++] = '_';
+        }
+        out[used++] = (char)tolower((unsigned char)c);
+    }
+    out[used] = '\0';
+}
+
+
+static void appendMetric(MetricsExporter *exporter, const Metric *metric)
+{
+    char name[EXPORTER_NAME_SIZE];
+    formatMetricName(name, sizeof(name), exporter->prefix, metric->name);
+
+    switch(metric->type)
+    {
+        case METRIC_COUNTER: {
+            appendText(exporter, "# HELP %s_total %s\n# TYPE %s_total counter\n%s_total %llu\n",
+                       name, metric->description, name, name,
+                       (unsigned long long)getCounterValue(metric));
+            break;
+        }
+        case METRIC_GAUGE: {
+            appendText(exporter, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+                       name, metric->description, name, name,
+                       (long long)getGaugeValue(metric));
+            break;
+        }
+        default: {
+            /*
+             * Prometheus expects cumulative buckets and seconds
+             */
+            UA_UInt64 buckets[METRICS_LATENCY_BUCKETS];
+            UA_UInt64 count, sum;
+            getLatencyValues(metric, buckets, &count, &sum);
+            appendText(exporter, "# HELP %s_seconds %s\n# TYPE %s_seconds histogram\n",
+                       name, metric->description, name);
+            UA_UInt64 cumulative = 0;
+            for(size_t i = 0; i < METRICS_LATENCY_BUCKETS - 1; i++)
+            {
+                cumulative += buckets[i];
+                appendText(exporter, "%s_seconds_bucket{le=\"%g\"} %llu\n",
+                           name, (UA_Double)metricsLatencyBounds[i] / 1e6,
+                           (unsigned long long)cumulative);
+            }
+            appendText(exporter, "%s_seconds_bucket{le=\"+Inf\"} %llu\n"
+                       "%s_seconds_sum %.6f\n%s_seconds_count %llu\n",
+                       name, (unsigned long long)count,
+                       name, (UA_Double)sum / 1e6,
+                       name, (unsigned long long)count);
+            break;
+        }
+    }
+}
+
+
+static void sendAll(int fd, const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if(sent <= 0)
+        {
+            return;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+}
+
+
+static void sendResponse(int fd, const char *status, const char *contentType,
+                         const char *body, size_t length)
+{
+    char header[256];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                                "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                status, contentType, length);
+    sendAll(fd, header, (size_t)headerLength);
+    sendAll(fd, body, length);
+}
+
+
+static void serveConnection(MetricsExporter *exporter, int fd)
+{
+    struct timeval timeout = {EXPORTER_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    /*
+     * Only the request line is of interest, the rest of the request
+     * header is read to not reset the connection before the response
+     */
+    char request[EXPORTER_REQUEST_SIZE];
+    size_t received = 0;
+    while(received < sizeof(request) - 1)
+    {
+        ssize_t n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+        if(n <= 0)
+        {
+            break;
+        }
+        received += (size_t)n;
+        request[received] = '\0';
+        if(strstr(request, "\r\n\r\n"))
+        {
+            break;
+        }
+    }
+    request[received] = '\0';
+
+    if(strncmp(request, "GET ", 4) != 0)
+    {
+        const char *body = "Method Not Allowed\n";
+        sendResponse(fd, "405 Method Not Allowed", "text/plain", body, strlen(body));
+        return;
+    }
+    if(strncmp(request + 4, "/metrics ", 9) != 0 && strncmp(request + 4, "/metrics?", 9) != 0)
+    {
+        const char *body = "Not Found, metrics are served on /metrics\n";
+        sendResponse(fd, "404 Not Found", "text/plain", body, strlen(body));
+        return;
+    }
+
+    exporter->bufferUsed = 0;
+    exporter->buffer[0] = '\0';
+    for(size_t i = 0; i < getMetricsSize(); i++)
+    {
+        appendMetric(exporter, getMetric(i));
+    }
+    sendResponse(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                 exporter->buffer, exporter->bufferUsed);
+}
+
+
+static void *runExporter(void *data)
+{
+    MetricsExporter *exporter = (MetricsExporter*)data;
+    struct pollfd pfd = {exporter->fd, POLLIN, 0};
+    while(!atomic_load(&exporter->stop))
+    {
+        if(poll(&pfd, 1, EXPORTER_POLL_MS) <= 0 || !(pfd.revents & POLLIN))
+        {
+            continue;
+        }
+        int fd = accept(exporter->fd, NULL, NULL);
+        if(fd < 0)
+        {
+            continue;
+        }
+        serveConnection(exporter, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+
+/*
+ * Split [ADDR:]PORT into host and port. An IPv6 address is given in
+ * brackets, e.g. [::1]:9100, which are not part of the host.
+ */
+static UA_Boolean parseAddress(const char *address, char *host, size_t hostSize,
+                               const char **port)
+{
+    if(address[0] == '[')
+    {
+        const char *end = strchr(address, ']');
+        if(!end || end[1] != ':' || (size_t)(end - address - 1) >= hostSize)
+        {
+            return false;
+        }
+        memcpy(host, address + 1, (size_t)(end - address - 1));
+        host[end - address - 1] = '\0';
+        *port = end + 2;
+        return true;
+    }
+
+    const char *separator = strrchr(address, ':');
+    if(!separator)
+    {
+        snprintf(host, hostSize, "127.0.0.1");
+        *port = address;
+        return true;
+    }
+
+    size_t length = (size_t)(separator - address);
+    if(length >= hostSize)
+    {
+        return false;
+    }
+    memcpy(host, address, length);
+    host[length] = '\0';
+    *port = separator + 1;
+    return true;
+}
+
+
+static int openListener(const char *host, const char *port)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *result;
+    if(getaddrinfo(host, port, &hints, &result) != 0)
+    {
+        return -1;
+    }
+
+    int fd = -1;
+    for(struct addrinfo *ai = result; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0)
+        {
+            continue;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 8) == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+
+UA_StatusCode startMetricsExporter(MetricsExporter *exporter, const char *address,
+                                   const char *prefix)
+{
+    memset(exporter, 0, sizeof(MetricsExporter));
+    exporter->prefix = prefix;
+    atomic_init(&exporter->stop, false);
+
+    char host[256];
+    const char *port;
+    exporter->fd = -1;
+    if(parseAddress(address, host, sizeof(host), &port))
+    {
+        exporter->fd = openListener(host, port);
+    }
+    if(exporter->fd < 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to listen for metrics requests on %s", address);
+        return UA_STATUSCODE_BADCOMMUNICATIONERROR;
+    }
+
+    exporter->bufferSize = 16384;
+    exporter->buffer = malloc(exporter->bufferSize);
+    if(!exporter->buffer)
+    {
+        close(exporter->fd);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    if(pthread_create(&exporter->thread, NULL, runExporter, exporter) != 0)
+    {
+        free(exporter->buffer);
+        close(exporter->fd);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Serving metrics on http://%s:%s/metrics", host, port);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void stopMetricsExporter(MetricsExporter *exporter)
+{
+    atomic_store(&exporter->stop, true);
+    pthread_join(exporter->thread, NULL);
+    close(exporter->fd);
+    free(exporter->buffer);
+}
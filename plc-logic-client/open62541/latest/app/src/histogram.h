@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <open62541/types.h>
+#include <stdio.h>
+
+/*
+ * Log-linear latency histogram in the style of HdrHistogram. Every power of
+ * two is split into HISTOGRAM_SUB_BUCKETS linear buckets, which bounds the
+ * relative error of a recorded value to about 6%. Values are microseconds
+ * and the covered range reaches beyond a day. The storage is a fixed array,
+ * so recording never allocates.
+ */
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_OCTAVES 34
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_OCTAVES + 1))
+
+typedef struct {
+    UA_UInt64 count;
+    UA_UInt64 sum;
+    UA_UInt64 max;
+    UA_UInt64 buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+void initHistogram(Histogram *histogram);
+
+/*
+ * Record a value in microseconds, negative values count as zero
+ */
+void recordHistogramValue(Histogram *histogram, UA_Int64 value);
+
+/*
+ * Upper bound of the bucket holding the given percentile (0..100)
+ */
+UA_UInt64 getHistogramPercentile(const Histogram *histogram, UA_Double percentile);
+
+/*
+ * Print count, mean and selected percentiles in a single line
+ */
+void printHistogram(const Histogram *histogram, const char *name, FILE *fp);
+
+#endif
@@ -0,0 +1,25 @@
+#include "logic.h"
+
+
+void initValveLogic(ValveLogic *logic, UA_Double upperThreshold, UA_Double lowerThreshold)
+{
+    logic->upperThreshold = upperThreshold;
+    logic->lowerThreshold = lowerThreshold;
+    logic->valveOpen = false;
+}
+
+
+UA_Boolean evaluateValveLogic(ValveLogic *logic, UA_Double fillPercentage)
+{
+    if((!logic->valveOpen) && (fillPercentage > logic->upperThreshold))
+    {
+        logic->valveOpen = true;
+        return true;
+    }
+    if(logic->valveOpen && (fillPercentage < logic->lowerThreshold))
+    {
+        logic->valveOpen = false;
+        return true;
+    }
+    return false;
+}
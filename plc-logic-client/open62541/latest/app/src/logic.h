@@ -0,0 +1,31 @@
+#ifndef LOGIC_H
+#define LOGIC_H
+
+#include <open62541/types.h>
+
+/*
+ * Default thresholds of the two-point valve control in percent
+ */
+#define LOGIC_UPPER_THRESHOLD 75.
+#define LOGIC_LOWER_THRESHOLD 25.
+
+/*
+ * State of the two-point control that opens the valve above the upper and
+ * closes it below the lower threshold. It is shared by the live control
+ * loop and the offline replay so both take the same decisions.
+ */
+typedef struct {
+    UA_Double upperThreshold;
+    UA_Double lowerThreshold;
+    UA_Boolean valveOpen;
+} ValveLogic;
+
+void initValveLogic(ValveLogic *logic, UA_Double upperThreshold, UA_Double lowerThreshold);
+
+/*
+ * Evaluate a new fill percentage. Returns true if the valve has to move,
+ * the new position is then found in logic->valveOpen.
+ */
+UA_Boolean evaluateValveLogic(ValveLogic *logic, UA_Double fillPercentage);
+
+#endif
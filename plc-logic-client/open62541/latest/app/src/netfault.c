@@ -0,0 +1,741 @@
+#include <open62541/plugin/log_stdout.h>
+#include <stdlib.h>
+#include <string.h>
+#include "netfault.h"
+
+
+const NetFaultProfile netFaultProfiles[] = {
+    /* name        latency jitter bandwidth stall interval/duration */
+    {"none",       0.,     0.,    0,        0,     0},
+    {"lan",        0.5,    0.2,   0,        0,     0},
+    {"wifi",       4.,     8.,    20000,    0,     0},
+    {"congested",  25.,    40.,   1000,     0,     0},
+    {"stalling",   2.,     1.,    0,        5000,  800},
+    {"cellular",   60.,    30.,   2000,     15000, 400},
+};
+const size_t netFaultProfilesSize = sizeof(netFaultProfiles) / sizeof(netFaultProfiles[0]);
+
+
+static const NetFaultProfile *findNetFaultProfile(const char *name)
+{
+    for(size_t i = 0; i < netFaultProfilesSize; i++)
+    {
+        if(strcmp(netFaultProfiles[i].name, name) == 0)
+        {
+            return &netFaultProfiles[i];
+        }
+    }
+    return NULL;
+}
+
+
+UA_StatusCode parseNetFaultProfile(const char *spec, NetFaultProfile *profile)
+{
+    char *copy = strdup(spec);
+    if(!copy)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    *profile = netFaultProfiles[0];
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    char *saveptr = NULL;
+    for(char *token = strtok_r(copy, ",", &saveptr);
+        token && retval == UA_STATUSCODE_GOOD;
+        token = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(token, '=');
+        if(!value)
+        {
+            const NetFaultProfile *named = findNetFaultProfile(token);
+            if(!named)
+            {
+                retval = UA_STATUSCODE_BADNOTFOUND;
+                break;
+            }
+            *profile = *named;
+            continue;
+        }
+
+        *value++ = '\0';
+        char *end = value;
+        if(strcmp(token, "latency") == 0)
+        {
+            profile->latency = strtod(value, &end);
+        }
+        else if(strcmp(token, "jitter") == 0)
+        {
+            profile->jitter = strtod(value, &end);
+        }
+        else if(strcmp(token, "bandwidth") == 0)
+        {
+            profile->bandwidth = (UA_UInt32)strtoul(value, &end, 10);
+        }
+        else if(strcmp(token, "stall") == 0)
+        {
+            profile->stallInterval = (UA_UInt32)strtoul(value, &end, 10);
+            profile->stallDuration = 0;
+            if(*end == '/')
+            {
+                profile->stallDuration = (UA_UInt32)strtoul(end + 1, &end, 10);
+            }
+        }
+        else
+        {
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+        }
+        if(end == value || *end != '\0' || *value == '-')
+        {
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+        }
+    }
+    free(copy);
+
+    /*
+     * A network that stalls all the time never delivers anything
+     */
+    if(profile->stallInterval > 0 && profile->stallDuration >= profile->stallInterval)
+    {
+        retval = UA_STATUSCODE_BADSYNTAXERROR;
+    }
+    profile->name = spec;
+    return retval;
+}
+
+
+/*
+ * The wrapped connection manager passes a context to the callbacks of a
+ * connection that is first the one given when opening it and then the
+ * FaultyConnection set by the first callback. Both start with the kind to
+ * tell them apart.
+ */
+typedef enum {
+    FAULTY_OPEN = 0,
+    FAULTY_CONNECTION,
+} FaultyContextKind;
+
+/*
+ * Context of an openConnection call. Listen sockets hand it on to the
+ * connections they accept, so it is kept until the connection manager is
+ * freed. For outgoing connections it is consumed by the first callback.
+ */
+typedef struct FaultyOpen {
+    FaultyContextKind kind;
+    struct FaultyOpen *next;
+    void *application;
+    void *context;
+    UA_ConnectionManager_connectionCallback callback;
+    UA_Boolean listen;
+} FaultyOpen;
+
+typedef struct FaultyMessage {
+    struct FaultyMessage *next;
+    UA_DateTime delivery;       /* monotonic */
+    UA_ByteString data;
+} FaultyMessage;
+
+typedef enum {
+    FAULTY_INBOUND = 0,
+    FAULTY_OUTBOUND,
+} FaultyDirection;
+
+struct FaultyConnection;
+
+/*
+ * Messages held back in one direction of a connection. The delivery times
+ * never decrease, so the queue is delivered from the head with a single
+ * timer.
+ */
+typedef struct {
+    struct FaultyConnection *connection;
+    FaultyDirection direction;
+    FaultyMessage *head;
+    FaultyMessage *tail;
+    UA_UInt64 timerId;          /* 0 while no delivery is scheduled */
+    UA_DateTime idle;           /* end of the transmission of the last message */
+    UA_DateTime lastDelivery;
+} FaultyQueue;
+
+typedef struct FaultyConnection {
+    FaultyContextKind kind;
+    struct FaultyConnection *next;
+    uintptr_t id;
+    void *application;
+    void *context;
+    UA_ConnectionManager_connectionCallback callback;
+    FaultyQueue queues[2];
+    UA_Boolean closeRequested;  /* close once the outbound queue is empty */
+    UA_Boolean delivering;
+    UA_Boolean closed;          /* free once the delivery in progress returns */
+} FaultyConnection;
+
+typedef struct {
+    UA_ConnectionManager cm;
+    UA_ConnectionManager *inner;
+    NetFaultProfile profile;
+    UA_DateTime stallBase;
+    unsigned int seed;
+    FaultyOpen *opens;
+    FaultyConnection *connections;
+} FaultyConnectionManager;
+
+
+static UA_DateTime faultyNow(FaultyConnectionManager *fcm)
+{
+    UA_EventLoop *el = fcm->cm.eventSource.eventLoop;
+    return el->dateTime_nowMonotonic(el);
+}
+
+
+/*
+ * Delivery time of a message entering the queue now. The message is sent
+ * once the link finished the previous one, then travels with latency and
+ * jitter. A delivery that falls into a stall waits for its end.
+ */
+static UA_DateTime scheduleMessage(FaultyConnectionManager *fcm, FaultyQueue *queue,
+                                   size_t length, UA_DateTime now)
+{
+    const NetFaultProfile *profile = &fcm->profile;
+    UA_DateTime sent = queue->idle > now ? queue->idle : now;
+    if(profile->bandwidth > 0)
+    {
+        sent += (UA_DateTime)(length * 8 * (UA_DATETIME_SEC / 1000) / profile->bandwidth);
+    }
+    queue->idle = sent;
+
+    UA_Double delay = profile->latency;
+    if(profile->jitter > 0.)
+    {
+        delay += profile->jitter * (UA_Double)rand_r(&fcm->seed) / (UA_Double)RAND_MAX;
+    }
+    UA_DateTime delivery = sent + (UA_DateTime)(delay * UA_DATETIME_MSEC);
+
+    if(profile->stallInterval > 0)
+    {
+        UA_DateTime offset = (delivery - fcm->stallBase) % ((UA_DateTime)profile->stallInterval * UA_DATETIME_MSEC);
+        UA_DateTime stall = (UA_DateTime)profile->stallDuration * UA_DATETIME_MSEC;
+        if(offset >= 0 && offset < stall)
+        {
+            delivery += stall - offset;
+        }
+    }
+
+    if(delivery < queue->lastDelivery)
+    {
+        delivery = queue->lastDelivery;
+    }
+    queue->lastDelivery = delivery;
+    return delivery;
+}
+
+
+static void appendMessage(FaultyQueue *queue, FaultyMessage *message)
+{
+    message->next = NULL;
+    if(queue->tail)
+    {
+        queue->tail->next = message;
+    }
+    else
+    {
+        queue->head = message;
+    }
+    queue->tail = message;
+}
+
+
+static FaultyMessage *popMessage(FaultyQueue *queue)
+{
+    FaultyMessage *message = queue->head;
+    queue->head = message->next;
+    if(!queue->head)
+    {
+        queue->tail = NULL;
+    }
+    return message;
+}
+
+
+static void deliverMessage(FaultyConnectionManager *fcm, FaultyConnection *conn,
+                           FaultyDirection direction, FaultyMessage *message)
+{
+    if(direction == FAULTY_OUTBOUND)
+    {
+        fcm->inner->sendWithConnection(fcm->inner, conn->id, &UA_KEYVALUEMAP_NULL, &message->data);
+    }
+    else
+    {
+        conn->callback(&fcm->cm, conn->id, conn->application, &conn->context,
+                       UA_CONNECTIONSTATE_ESTABLISHED, &UA_KEYVALUEMAP_NULL, message->data);
+        UA_ByteString_clear(&message->data);
+    }
+    free(message);
+}
+
+
+static void cancelDelivery(FaultyConnectionManager *fcm, FaultyQueue *queue)
+{
+    if(queue->timerId != 0)
+    {
+        UA_EventLoop *el = fcm->cm.eventSource.eventLoop;
+        el->removeCyclicCallback(el, queue->timerId);
+        queue->timerId = 0;
+    }
+}
+
+
+/*
+ * Drop the messages of a queue. Outbound messages are network buffers of
+ * the wrapped connection manager.
+ */
+static void dropMessages(FaultyConnectionManager *fcm, FaultyQueue *queue)
+{
+    cancelDelivery(fcm, queue);
+    while(queue->head)
+    {
+        FaultyMessage *message = popMessage(queue);
+        if(queue->direction == FAULTY_OUTBOUND)
+        {
+            fcm->inner->freeNetworkBuffer(fcm->inner, queue->connection->id, &message->data);
+        }
+        else
+        {
+            UA_ByteString_clear(&message->data);
+        }
+        free(message);
+    }
+}
+
+
+static void deliverMessages(void *application, void *data);
+
+static void scheduleDelivery(FaultyConnectionManager *fcm, FaultyQueue *queue)
+{
+    if(queue->timerId != 0 || !queue->head)
+    {
+        return;
+    }
+
+    UA_EventLoop *el = fcm->cm.eventSource.eventLoop;
+    UA_StatusCode retval = el->addTimedCallback(el, deliverMessages, fcm, queue,
+                                                queue->head->delivery, &queue->timerId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(el->logger, UA_LOGCATEGORY_NETWORK,
+                       "Unable to schedule delayed messages: %s", UA_StatusCode_name(retval));
+        queue->timerId = 0;
+    }
+}
+
+
+/*
+ * Timer callback delivering the messages that are due
+ */
+static void deliverMessages(void *application, void *data)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)application;
+    FaultyQueue *queue = (FaultyQueue*)data;
+    FaultyConnection *conn = queue->connection;
+    queue->timerId = 0;
+
+    UA_DateTime now = faultyNow(fcm);
+    conn->delivering = true;
+    while(queue->head && queue->head->delivery <= now && !conn->closed)
+    {
+        deliverMessage(fcm, conn, queue->direction, popMessage(queue));
+    }
+    conn->delivering = false;
+
+    if(conn->closed)
+    {
+        dropMessages(fcm, &conn->queues[FAULTY_INBOUND]);
+        dropMessages(fcm, &conn->queues[FAULTY_OUTBOUND]);
+        free(conn);
+        return;
+    }
+    if(queue->head)
+    {
+        scheduleDelivery(fcm, queue);
+    }
+    else if(queue->direction == FAULTY_OUTBOUND && conn->closeRequested)
+    {
+        fcm->inner->closeConnection(fcm->inner, conn->id);
+    }
+}
+
+
+static FaultyConnection *findFaultyConnection(FaultyConnectionManager *fcm, uintptr_t connectionId)
+{
+    for(FaultyConnection *conn = fcm->connections; conn; conn = conn->next)
+    {
+        if(conn->id == connectionId)
+        {
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+
+static UA_Boolean removeFaultyOpen(FaultyConnectionManager *fcm, FaultyOpen *open)
+{
+    for(FaultyOpen **prev = &fcm->opens; *prev; prev = &(*prev)->next)
+    {
+        if(*prev == open)
+        {
+            *prev = open->next;
+            free(open);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Track a connection seen for the first time. It inherits the callback and
+ * context of the openConnection call or of the listen socket.
+ */
+static FaultyConnection *newFaultyConnection(FaultyConnectionManager *fcm, uintptr_t connectionId,
+                                             void *origin)
+{
+    FaultyConnection *conn = (FaultyConnection*)calloc(1, sizeof(FaultyConnection));
+    if(!conn)
+    {
+        return NULL;
+    }
+    conn->kind = FAULTY_CONNECTION;
+    conn->id = connectionId;
+    for(int d = 0; d < 2; d++)
+    {
+        conn->queues[d].connection = conn;
+        conn->queues[d].direction = (FaultyDirection)d;
+    }
+
+    if(((FaultyOpen*)origin)->kind == FAULTY_OPEN)
+    {
+        FaultyOpen *open = (FaultyOpen*)origin;
+        conn->application = open->application;
+        conn->context = open->context;
+        conn->callback = open->callback;
+        if(!open->listen)
+        {
+            removeFaultyOpen(fcm, open);
+        }
+    }
+    else
+    {
+        FaultyConnection *listener = (FaultyConnection*)origin;
+        conn->application = listener->application;
+        conn->context = listener->context;
+        conn->callback = listener->callback;
+    }
+
+    conn->next = fcm->connections;
+    fcm->connections = conn;
+    return conn;
+}
+
+
+static void closeFaultyConnection(FaultyConnectionManager *fcm, FaultyConnection *conn,
+                                  const UA_KeyValueMap *params, UA_ByteString msg)
+{
+    /*
+     * Messages that already arrived are handed over before the close,
+     * messages still on the way out are lost with the connection
+     */
+    FaultyQueue *inbound = &conn->queues[FAULTY_INBOUND];
+    cancelDelivery(fcm, inbound);
+    UA_Boolean delivering = conn->delivering;
+    conn->delivering = true;
+    while(inbound->head)
+    {
+        deliverMessage(fcm, conn, FAULTY_INBOUND, popMessage(inbound));
+    }
+    conn->delivering = delivering;
+    dropMessages(fcm, &conn->queues[FAULTY_OUTBOUND]);
+
+    conn->callback(&fcm->cm, conn->id, conn->application, &conn->context,
+                   UA_CONNECTIONSTATE_CLOSING, params, msg);
+
+    for(FaultyConnection **prev = &fcm->connections; *prev; prev = &(*prev)->next)
+    {
+        if(*prev == conn)
+        {
+            *prev = conn->next;
+            break;
+        }
+    }
+    if(conn->delivering)
+    {
+        conn->closed = true;
+        return;
+    }
+    free(conn);
+}
+
+
+/*
+ * Callback of the wrapped connection manager
+ */
+static void faultyConnectionCallback(UA_ConnectionManager *cm, uintptr_t connectionId,
+                                     void *application, void **connectionContext,
+                                     UA_ConnectionState state, const UA_KeyValueMap *params,
+                                     UA_ByteString msg)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)application;
+    FaultyConnection *conn = (FaultyConnection*)*connectionContext;
+    if(conn->kind != FAULTY_CONNECTION || conn->id != connectionId)
+    {
+        conn = newFaultyConnection(fcm, connectionId, *connectionContext);
+        if(!conn)
+        {
+            if(state != UA_CONNECTIONSTATE_CLOSING)
+            {
+                fcm->inner->closeConnection(fcm->inner, connectionId);
+            }
+            return;
+        }
+        *connectionContext = conn;
+    }
+
+    if(state == UA_CONNECTIONSTATE_CLOSING)
+    {
+        closeFaultyConnection(fcm, conn, params, msg);
+        return;
+    }
+
+    /*
+     * State changes without payload are passed on right away
+     */
+    FaultyQueue *queue = &conn->queues[FAULTY_INBOUND];
+    UA_DateTime now = faultyNow(fcm);
+    UA_DateTime delivery = msg.length > 0 ? scheduleMessage(fcm, queue, msg.length, now) : now;
+    if(msg.length == 0 || (!queue->head && delivery <= now))
+    {
+        conn->callback(&fcm->cm, connectionId, conn->application, &conn->context,
+                       state, params, msg);
+        return;
+    }
+
+    /*
+     * The payload belongs to the wrapped connection manager and is only
+     * valid during the callback
+     */
+    FaultyMessage *message = (FaultyMessage*)malloc(sizeof(FaultyMessage));
+    if(!message || UA_ByteString_copy(&msg, &message->data) != UA_STATUSCODE_GOOD)
+    {
+        free(message);
+        conn->callback(&fcm->cm, connectionId, conn->application, &conn->context,
+                       state, params, msg);
+        return;
+    }
+    message->delivery = delivery;
+    appendMessage(queue, message);
+    scheduleDelivery(fcm, queue);
+}
+
+
+static UA_StatusCode faultyOpenConnection(UA_ConnectionManager *cm, const UA_KeyValueMap *params,
+                                          void *application, void *context,
+                                          UA_ConnectionManager_connectionCallback connectionCallback)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)cm;
+    FaultyOpen *open = (FaultyOpen*)calloc(1, sizeof(FaultyOpen));
+    if(!open)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    open->kind = FAULTY_OPEN;
+    open->application = application;
+    open->context = context;
+    open->callback = connectionCallback;
+    const UA_Boolean *listen = (const UA_Boolean*)UA_KeyValueMap_getScalar(
+        params, UA_QUALIFIEDNAME(0, "listen"), &UA_TYPES[UA_TYPES_BOOLEAN]);
+    open->listen = listen && *listen;
+    open->next = fcm->opens;
+    fcm->opens = open;
+
+    UA_StatusCode retval = fcm->inner->openConnection(fcm->inner, params, fcm, open,
+                                                      faultyConnectionCallback);
+    const UA_Boolean *validate = (const UA_Boolean*)UA_KeyValueMap_getScalar(
+        params, UA_QUALIFIEDNAME(0, "validate"), &UA_TYPES[UA_TYPES_BOOLEAN]);
+    if(retval != UA_STATUSCODE_GOOD || (validate && *validate))
+    {
+        removeFaultyOpen(fcm, open);
+    }
+    return retval;
+}
+
+
+static UA_StatusCode faultySendWithConnection(UA_ConnectionManager *cm, uintptr_t connectionId,
+                                              const UA_KeyValueMap *params, UA_ByteString *buf)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)cm;
+    FaultyConnection *conn = findFaultyConnection(fcm, connectionId);
+    if(!conn)
+    {
+        return fcm->inner->sendWithConnection(fcm->inner, connectionId, params, buf);
+    }
+    if(conn->closeRequested)
+    {
+        fcm->inner->freeNetworkBuffer(fcm->inner, connectionId, buf);
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+
+    FaultyQueue *queue = &conn->queues[FAULTY_OUTBOUND];
+    UA_DateTime now = faultyNow(fcm);
+    UA_DateTime delivery = scheduleMessage(fcm, queue, buf->length, now);
+    if(!queue->head && delivery <= now)
+    {
+        return fcm->inner->sendWithConnection(fcm->inner, connectionId, params, buf);
+    }
+
+    FaultyMessage *message = (FaultyMessage*)malloc(sizeof(FaultyMessage));
+    if(!message)
+    {
+        fcm->inner->freeNetworkBuffer(fcm->inner, connectionId, buf);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    message->data = *buf;
+    message->delivery = delivery;
+    UA_ByteString_init(buf);
+    appendMessage(queue, message);
+    scheduleDelivery(fcm, queue);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static UA_StatusCode faultyCloseConnection(UA_ConnectionManager *cm, uintptr_t connectionId)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)cm;
+    FaultyConnection *conn = findFaultyConnection(fcm, connectionId);
+    if(conn && conn->queues[FAULTY_OUTBOUND].head)
+    {
+        conn->closeRequested = true;
+        return UA_STATUSCODE_GOOD;
+    }
+    return fcm->inner->closeConnection(fcm->inner, connectionId);
+}
+
+
+static UA_StatusCode faultyAllocNetworkBuffer(UA_ConnectionManager *cm, uintptr_t connectionId,
+                                              UA_ByteString *buf, size_t bufSize)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)cm;
+    return fcm->inner->allocNetworkBuffer(fcm->inner, connectionId, buf, bufSize);
+}
+
+
+static void faultyFreeNetworkBuffer(UA_ConnectionManager *cm, uintptr_t connectionId,
+                                    UA_ByteString *buf)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)cm;
+    fcm->inner->freeNetworkBuffer(fcm->inner, connectionId, buf);
+}
+
+
+static UA_StatusCode faultyStart(UA_EventSource *es)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)es;
+    if(!es->eventLoop)
+    {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    fcm->stallBase = faultyNow(fcm);
+    es->state = UA_EVENTSOURCESTATE_STARTED;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * The sockets are closed by the wrapped connection manager, whose close
+ * callbacks are still passed on after the stop
+ */
+static void faultyStop(UA_EventSource *es)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)es;
+    for(FaultyConnection *conn = fcm->connections; conn; conn = conn->next)
+    {
+        dropMessages(fcm, &conn->queues[FAULTY_INBOUND]);
+        dropMessages(fcm, &conn->queues[FAULTY_OUTBOUND]);
+    }
+    es->state = UA_EVENTSOURCESTATE_STOPPED;
+}
+
+
+static UA_StatusCode faultyFree(UA_EventSource *es)
+{
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)es;
+    while(fcm->opens)
+    {
+        removeFaultyOpen(fcm, fcm->opens);
+    }
+    while(fcm->connections)
+    {
+        FaultyConnection *conn = fcm->connections;
+        fcm->connections = conn->next;
+        free(conn);
+    }
+    UA_String_clear(&es->name);
+    free(fcm);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_EventLoop *newFaultyEventLoop(const NetFaultProfile *profile, const UA_Logger *logger)
+{
+    UA_EventLoop *el = UA_EventLoop_new_POSIX(logger);
+    if(!el)
+    {
+        return NULL;
+    }
+
+    UA_ConnectionManager *inner = UA_ConnectionManager_new_POSIX_TCP(UA_STRING("tcp connection manager"));
+    if(!inner)
+    {
+        el->free(el);
+        return NULL;
+    }
+    inner->protocol = UA_STRING(NETFAULT_INNER_PROTOCOL);
+    if(el->registerEventSource(el, &inner->eventSource) != UA_STATUSCODE_GOOD)
+    {
+        inner->eventSource.free(&inner->eventSource);
+        el->free(el);
+        return NULL;
+    }
+
+    FaultyConnectionManager *fcm = (FaultyConnectionManager*)calloc(1, sizeof(FaultyConnectionManager));
+    if(!fcm)
+    {
+        el->free(el);
+        return NULL;
+    }
+    fcm->cm.eventSource.eventSourceType = UA_EVENTSOURCETYPE_CONNECTIONMANAGER;
+    fcm->cm.eventSource.name = UA_STRING_ALLOC("faulty tcp connection manager");
+    fcm->cm.eventSource.start = faultyStart;
+    fcm->cm.eventSource.stop = faultyStop;
+    fcm->cm.eventSource.free = faultyFree;
+    fcm->cm.protocol = UA_STRING("tcp");
+    fcm->cm.openConnection = faultyOpenConnection;
+    fcm->cm.sendWithConnection = faultySendWithConnection;
+    fcm->cm.closeConnection = faultyCloseConnection;
+    fcm->cm.allocNetworkBuffer = faultyAllocNetworkBuffer;
+    fcm->cm.freeNetworkBuffer = faultyFreeNetworkBuffer;
+    fcm->inner = inner;
+    fcm->profile = *profile;
+    fcm->seed = 1;
+    if(el->registerEventSource(el, &fcm->cm.eventSource) != UA_STATUSCODE_GOOD)
+    {
+        faultyFree(&fcm->cm.eventSource);
+        el->free(el);
+        return NULL;
+    }
+
+    UA_LOG_INFO(logger, UA_LOGCATEGORY_NETWORK,
+                "Network profile '%s': latency %.1f ms, jitter %.1f ms, bandwidth %u kbit/s, "
+                "stall %u ms every %u ms",
+                profile->name, profile->latency, profile->jitter, profile->bandwidth,
+                profile->stallDuration, profile->stallInterval);
+    return el;
+}
@@ -0,0 +1,401 @@
+#include <open62541/plugin/log_stdout.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asynclog.h"
+#include "nodecache.h"
+#include "utils.h"
+
+
+static void clearNodeCacheEntry(NodeCacheEntry *entry)
+{
+    free(entry->serverUri);
+    free(entry->namespaceUri);
+    free(entry->path);
+    UA_NodeId_clear(&entry->nodeId);
+}
+
+
+static NodeCacheEntry *findNodeCacheEntry(NodeCache *cache, const char *serverUri,
+                                          const char *namespaceUri, const char *path)
+{
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        NodeCacheEntry *entry = &cache->entries[i];
+        if(   strcmp(entry->path, path) == 0
+           && strcmp(entry->serverUri, serverUri) == 0
+           && strcmp(entry->namespaceUri, namespaceUri) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Takes ownership of the strings on success
+ */
+static UA_StatusCode appendNodeCacheEntry(NodeCache *cache, char *serverUri,
+                                          char *namespaceUri, char *path,
+                                          const UA_NodeId *nodeId)
+{
+    NodeCacheEntry *entries = (NodeCacheEntry*)realloc(
+        cache->entries, (cache->entriesSize + 1) * sizeof(NodeCacheEntry));
+    if(!entries)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    cache->entries = entries;
+
+    NodeCacheEntry *entry = &cache->entries[cache->entriesSize];
+    UA_StatusCode retval = UA_NodeId_copy(nodeId, &entry->nodeId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    entry->serverUri = serverUri;
+    entry->namespaceUri = namespaceUri;
+    entry->path = path;
+    cache->entriesSize++;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode loadNodeCache(NodeCache *cache, const char *filename)
+{
+    cache->filename = filename;
+    cache->entriesSize = 0;
+    cache->entries = NULL;
+    cache->modified = false;
+
+    FILE *fp = fopen(filename, "r");
+    if(!fp)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t read;
+    while((read = getline(&line, &lineSize, fp)) > 0)
+    {
+        if(line[read - 1] == '\n')
+        {
+            line[read - 1] = '\0';
+        }
+
+        /*
+         * Split into server URI, namespace URI, path and node ID
+         */
+        char *fields[4] = {line, NULL, NULL, NULL};
+        for(int f = 1; f < 4 && fields[f - 1]; f++)
+        {
+            fields[f] = strchr(fields[f - 1], '\t');
+            if(fields[f])
+            {
+                *fields[f]++ = '\0';
+            }
+        }
+        if(!fields[3])
+        {
+            continue;
+        }
+
+        UA_NodeId nodeId;
+        if(UA_NodeId_parse(&nodeId, UA_STRING(fields[3])) != UA_STATUSCODE_GOOD)
+        {
+            continue;
+        }
+
+        char *serverUri = strdup(fields[0]);
+        char *namespaceUri = strdup(fields[1]);
+        char *path = strdup(fields[2]);
+        if(   !serverUri || !namespaceUri || !path
+           || appendNodeCacheEntry(cache, serverUri, namespaceUri, path, &nodeId) != UA_STATUSCODE_GOOD)
+        {
+            free(serverUri);
+            free(namespaceUri);
+            free(path);
+        }
+        UA_NodeId_clear(&nodeId);
+    }
+    free(line);
+    fclose(fp);
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Loaded %lu cached node IDs from %s",
+                (unsigned long)cache->entriesSize, filename);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode saveNodeCache(NodeCache *cache)
+{
+    if(!cache->modified)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /*
+     * Write a temporary file first so that a crash never leaves a
+     * truncated cache behind
+     */
+    size_t tmpnameSize = strlen(cache->filename) + 5;
+    char *tmpname = (char*)malloc(tmpnameSize);
+    if(!tmpname)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    snprintf(tmpname, tmpnameSize, "%s.tmp", cache->filename);
+
+    FILE *fp = fopen(tmpname, "w");
+    if(!fp)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to write node ID cache %s", tmpname);
+        free(tmpname);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        NodeCacheEntry *entry = &cache->entries[i];
+        UA_String nodeId = UA_STRING_NULL;
+        if(UA_NodeId_print(&entry->nodeId, &nodeId) != UA_STATUSCODE_GOOD)
+        {
+            continue;
+        }
+        fprintf(fp, "%s\t%s\t%s\t%.*s\n",
+                entry->serverUri, entry->namespaceUri, entry->path,
+                (int)nodeId.length, (char*)nodeId.data);
+        UA_String_clear(&nodeId);
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(fclose(fp) != 0 || rename(tmpname, cache->filename) != 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to replace node ID cache %s", cache->filename);
+        remove(tmpname);
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+    }
+    else
+    {
+        cache->modified = false;
+    }
+    free(tmpname);
+    return retval;
+}
+
+
+void clearNodeCache(NodeCache *cache)
+{
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        clearNodeCacheEntry(&cache->entries[i]);
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->entriesSize = 0;
+}
+
+
+void invalidateNodeCache(NodeCache *cache, const char *serverUri)
+{
+    size_t kept = 0;
+    for(size_t i = 0; i < cache->entriesSize; i++)
+    {
+        if(strcmp(cache->entries[i].serverUri, serverUri) == 0)
+        {
+            clearNodeCacheEntry(&cache->entries[i]);
+            cache->modified = true;
+            continue;
+        }
+        cache->entries[kept++] = cache->entries[i];
+    }
+    cache->entriesSize = kept;
+}
+
+
+/*
+ * Read the URI of namespace 1, which holds the application nodes
+ */
+static UA_StatusCode readNamespaceUri(UA_Client *client, char **namespaceUri)
+{
+    UA_Variant namespaces;
+    UA_Variant_init(&namespaces);
+    UA_StatusCode retval = UA_Client_readValueAttribute(
+        client, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY), &namespaces);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    if(   !UA_Variant_hasArrayType(&namespaces, &UA_TYPES[UA_TYPES_STRING])
+       || namespaces.arrayLength < 2)
+    {
+        UA_Variant_clear(&namespaces);
+        return UA_STATUSCODE_BADTYPEMISMATCH;
+    }
+
+    const UA_String *uri = &((UA_String*)namespaces.data)[1];
+    *namespaceUri = strndup((const char*)uri->data, uri->length);
+    UA_Variant_clear(&namespaces);
+    return *namespaceUri ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADOUTOFMEMORY;
+}
+
+
+/*
+ * Join the browse names of a path with '/' to form the cache key
+ */
+static char *joinPath(char* path[], int len)
+{
+    size_t size = 1;
+    for(int i = 0; i < len; i++)
+    {
+        size += strlen(path[i]) + 1;
+    }
+
+    char *joined = (char*)malloc(size);
+    if(!joined)
+    {
+        return NULL;
+    }
+
+    char *pos = joined;
+    for(int i = 0; i < len; i++)
+    {
+        pos += sprintf(pos, i ? "/%s" : "%s", path[i]);
+    }
+    *pos = '\0';
+    return joined;
+}
+
+
+UA_StatusCode resolveBrowsePaths(
+    UA_Client *client,
+    NodeCache *cache,
+    const char *serverUri,
+    char** paths[],
+    size_t pathsSize,
+    UA_UInt32 id[],
+    int len,
+    UA_NodeId *nodeIds)
+{
+    if(!cache)
+    {
+        return translateBrowsePathsToNodeIdsRequest(client, nodeIds, paths, pathsSize, id, len);
+    }
+
+    char *namespaceUri = NULL;
+    UA_StatusCode retval = readNamespaceUri(client, &namespaceUri);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to read namespace of %s, bypassing node ID cache: %s",
+                       serverUri, UA_StatusCode_name(retval));
+        return translateBrowsePathsToNodeIdsRequest(client, nodeIds, paths, pathsSize, id, len);
+    }
+
+    char **keys = (char**)calloc(pathsSize, sizeof(char*));
+    char ***missingPaths = (char***)calloc(pathsSize, sizeof(char**));
+    size_t *missingIndex = (size_t*)calloc(pathsSize, sizeof(size_t));
+    UA_NodeId *missingNodeIds = (UA_NodeId*)calloc(pathsSize, sizeof(UA_NodeId));
+    if(!keys || !missingPaths || !missingIndex || !missingNodeIds)
+    {
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        goto cleanup;
+    }
+
+    /*
+     * Serve what is cached and collect the remaining paths
+     */
+    size_t missingSize = 0;
+    size_t resolved = 0;
+    for(; resolved < pathsSize; resolved++)
+    {
+        keys[resolved] = joinPath(paths[resolved], len);
+        if(!keys[resolved])
+        {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            goto cleanup_resolved;
+        }
+
+        NodeCacheEntry *entry = findNodeCacheEntry(cache, serverUri, namespaceUri, keys[resolved]);
+        if(entry)
+        {
+            retval = UA_NodeId_copy(&entry->nodeId, &nodeIds[resolved]);
+            if(retval != UA_STATUSCODE_GOOD)
+            {
+                goto cleanup_resolved;
+            }
+            continue;
+        }
+
+        UA_NodeId_init(&nodeIds[resolved]);
+        missingPaths[missingSize] = paths[resolved];
+        missingIndex[missingSize] = resolved;
+        missingSize++;
+    }
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Resolving %lu browse paths on %s, %lu from cache",
+                (unsigned long)pathsSize, serverUri,
+                (unsigned long)(pathsSize - missingSize));
+    if(missingSize == 0)
+    {
+        goto cleanup;
+    }
+
+    /*
+     * Translate all cache misses with one service call
+     */
+    retval = translateBrowsePathsToNodeIdsRequest(client, missingNodeIds, missingPaths,
+                                                  missingSize, id, len);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        goto cleanup_resolved;
+    }
+
+    for(size_t m = 0; m < missingSize; m++)
+    {
+        size_t p = missingIndex[m];
+        nodeIds[p] = missingNodeIds[m];
+
+        char *entryServerUri = strdup(serverUri);
+        char *entryNamespaceUri = strdup(namespaceUri);
+        if(   !entryServerUri || !entryNamespaceUri
+           || appendNodeCacheEntry(cache, entryServerUri, entryNamespaceUri,
+                                   keys[p], &nodeIds[p]) != UA_STATUSCODE_GOOD)
+        {
+            free(entryServerUri);
+            free(entryNamespaceUri);
+            continue;
+        }
+        keys[p] = NULL; /* now owned by the cache */
+        cache->modified = true;
+    }
+    goto cleanup;
+
+cleanup_resolved:
+    for(size_t p = 0; p < resolved; p++)
+    {
+        UA_NodeId_clear(&nodeIds[p]);
+    }
+
+cleanup:
+    if(keys)
+    {
+        for(size_t p = 0; p < pathsSize; p++)
+        {
+            free(keys[p]);
+        }
+    }
+    free(keys);
+    free(missingPaths);
+    free(missingIndex);
+    free(missingNodeIds);
+    free(namespaceUri);
+    return retval;
+}
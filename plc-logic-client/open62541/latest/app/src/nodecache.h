@@ -0,0 +1,61 @@
+#ifndef NODECACHE_H
+#define NODECACHE_H
+
+#include <open62541/client.h>
+
+/*
+ * A resolved browse path. Entries are keyed by the server URI and the URI
+ * of namespace 1 on that server, so a server that changed its namespace is
+ * never served stale node IDs.
+ */
+typedef struct {
+    char *serverUri;
+    char *namespaceUri;
+    char *path;             /* browse names joined by '/' */
+    UA_NodeId nodeId;
+} NodeCacheEntry;
+
+/*
+ * Small on-disk cache of resolved node IDs. The file holds one entry per
+ * line with tab separated server URI, namespace URI, path and node ID.
+ */
+typedef struct {
+    const char *filename;
+    size_t entriesSize;
+    NodeCacheEntry *entries;
+    UA_Boolean modified;
+} NodeCache;
+
+/*
+ * Load the cache file. A missing file results in an empty cache.
+ */
+UA_StatusCode loadNodeCache(NodeCache *cache, const char *filename);
+
+/*
+ * Write the cache file if entries were added or dropped since loading
+ */
+UA_StatusCode saveNodeCache(NodeCache *cache);
+
+void clearNodeCache(NodeCache *cache);
+
+/*
+ * Drop all entries of a server, e.g. after it reported an unknown node ID
+ */
+void invalidateNodeCache(NodeCache *cache, const char *serverUri);
+
+/*
+ * Resolve pathsSize browse paths of len elements each. Cached node IDs are
+ * used where possible and all remaining paths are translated with a single
+ * service call and added to the cache. The cache may be NULL.
+ */
+UA_StatusCode resolveBrowsePaths(
+    UA_Client *client,
+    NodeCache *cache,
+    const char *serverUri,
+    char** paths[],
+    size_t pathsSize,
+    UA_UInt32 id[],
+    int len,
+    UA_NodeId *nodeIds);
+
+#endif
@@ -0,0 +1,185 @@
+#include <open62541/plugin/log_stdout.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "reconnect.h"
+
+
+void initReconnectState(ReconnectState *state, const char *name,
+                        UA_Client *client, const char *uri)
+{
+    state->name = name;
+    state->uri = uri;
+    state->client = client;
+    state->connected = true;
+    state->backoff = RECONNECT_BACKOFF_MIN_MS;
+    state->attempts = 0;
+    state->outages = 0;
+    state->outageStart = 0;
+    state->nextAttempt = 0;
+    state->resolve = NULL;
+    state->resolveContext = NULL;
+}
+
+
+void setReconnectResolver(ReconnectState *state, ReconnectResolver resolve, void *context)
+{
+    state->resolve = resolve;
+    state->resolveContext = context;
+}
+
+
+UA_StatusCode connectClients(UA_Client *clients[], const char *urls[], const char *names[],
+                             size_t clientsSize, UA_UInt32 timeout)
+{
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < clientsSize && retval == UA_STATUSCODE_GOOD; i++)
+    {
+        retval = UA_Client_connectAsync(clients[i], urls[i]);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to connect to %s at %s: %s",
+                        names[i], urls[i], UA_StatusCode_name(retval));
+        }
+    }
+
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_DateTime deadline = start + (UA_DateTime)timeout * UA_DATETIME_MSEC;
+    size_t activated = 0;
+    while(retval == UA_STATUSCODE_GOOD && activated < clientsSize)
+    {
+        if(UA_DateTime_nowMonotonic() > deadline)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Timeout while connecting to the servers");
+            retval = UA_STATUSCODE_BADTIMEOUT;
+            break;
+        }
+
+        activated = 0;
+        for(size_t i = 0; i < clientsSize && retval == UA_STATUSCODE_GOOD; i++)
+        {
+            if(isSessionActivated(clients[i]))
+            {
+                activated++;
+                continue;
+            }
+
+            UA_Client_run_iterate(clients[i], 1);
+            UA_SecureChannelState channelState;
+            UA_SessionState sessionState;
+            UA_Client_getState(clients[i], &channelState, &sessionState, &retval);
+            if(retval != UA_STATUSCODE_GOOD)
+            {
+                UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                            "Unable to connect to %s at %s: %s",
+                            names[i], urls[i], UA_StatusCode_name(retval));
+            }
+        }
+    }
+
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        for(size_t i = 0; i < clientsSize; i++)
+        {
+            UA_Client_disconnect(clients[i]);
+        }
+        return retval;
+    }
+
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Connected to %lu servers in %.1f ms", (unsigned long)clientsSize,
+                (UA_Double)(UA_DateTime_nowMonotonic() - start) / UA_DATETIME_MSEC);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_Boolean isSessionActivated(UA_Client *client)
+{
+    UA_SecureChannelState channelState;
+    UA_SessionState sessionState;
+    UA_StatusCode connectStatus;
+    UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
+    return sessionState == UA_SESSIONSTATE_ACTIVATED;
+}
+
+
+void markDisconnected(ReconnectState *state)
+{
+    if(!state->connected)
+    {
+        return;
+    }
+
+    state->connected = false;
+    state->outages++;
+    state->attempts = 0;
+    state->backoff = RECONNECT_BACKOFF_MIN_MS;
+    state->outageStart = UA_DateTime_nowMonotonic();
+    state->nextAttempt = state->outageStart;
+
+    UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                   "Lost connection to %s (outage %u)",
+                   state->name, state->outages);
+}
+
+
+UA_StatusCode tryReconnect(ReconnectState *state)
+{
+    if(state->connected)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    if(now < state->nextAttempt)
+    {
+        return UA_STATUSCODE_GOODCALLAGAIN;
+    }
+
+    state->attempts++;
+    UA_StatusCode retval = UA_Client_connect(state->client, state->uri);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Reconnect attempt %u to %s failed: %s, retrying in %u ms",
+                    state->attempts, state->name, UA_StatusCode_name(retval),
+                    state->backoff);
+        state->nextAttempt = UA_DateTime_nowMonotonic() + state->backoff * UA_DATETIME_MSEC;
+        state->backoff *= 2;
+        if(state->backoff > RECONNECT_BACKOFF_MAX_MS)
+        {
+            state->backoff = RECONNECT_BACKOFF_MAX_MS;
+        }
+        if(state->resolve && state->attempts % RECONNECT_RESOLVE_ATTEMPTS == 0)
+        {
+            state->resolve(state->resolveContext);
+        }
+        return retval;
+    }
+
+    state->connected = true;
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Reconnected to %s after %.1f ms and %u attempts",
+                state->name,
+                (UA_Double)(UA_DateTime_nowMonotonic() - state->outageStart) / UA_DATETIME_MSEC,
+                state->attempts);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void waitForNextAttempt(const ReconnectState *state, UA_UInt32 maxWait)
+{
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    if(state->connected || now >= state->nextAttempt)
+    {
+        return;
+    }
+
+    UA_DateTime wait = (state->nextAttempt - now) / UA_DATETIME_USEC;
+    if(wait > (UA_DateTime)maxWait * 1000)
+    {
+        wait = (UA_DateTime)maxWait * 1000;
+    }
+    usleep((useconds_t)wait);
+}
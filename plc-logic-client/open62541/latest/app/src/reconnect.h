@@ -0,0 +1,91 @@
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <open62541/client.h>
+
+/*
+ * Bounds of the exponential backoff between two connection attempts
+ */
+#define RECONNECT_BACKOFF_MIN_MS 100
+#define RECONNECT_BACKOFF_MAX_MS 10000
+
+/*
+ * Failed attempts after which the endpoint URL is resolved again, and the
+ * time allowed for the initial connection of all clients
+ */
+#define RECONNECT_RESOLVE_ATTEMPTS 3
+#define RECONNECT_CONNECT_TIMEOUT_MS 5000
+
+/*
+ * Updates the URL the state points to in place, e.g. from a discovery
+ * server
+ */
+typedef UA_StatusCode (*ReconnectResolver)(void *context);
+
+/*
+ * Bookkeeping for a client connection that is re-established in-process
+ * instead of restarting the container. The client object and therefore
+ * its configuration and cached node IDs survive the outage.
+ */
+typedef struct {
+    const char *name;           /* only used for log messages */
+    const char *uri;
+    UA_Client *client;
+    UA_Boolean connected;
+    UA_UInt32 backoff;          /* delay before the next attempt in ms */
+    UA_UInt32 attempts;         /* attempts during the current outage */
+    UA_UInt32 outages;          /* outages since startup */
+    UA_DateTime outageStart;    /* monotonic */
+    UA_DateTime nextAttempt;    /* monotonic */
+    ReconnectResolver resolve;  /* may be NULL */
+    void *resolveContext;
+} ReconnectState;
+
+/*
+ * Initialize the bookkeeping for an already connected client
+ */
+void initReconnectState(ReconnectState *state, const char *name,
+                        UA_Client *client, const char *uri);
+
+/*
+ * Resolve the URL again after every RECONNECT_RESOLVE_ATTEMPTS failed
+ * attempts, for servers that moved to another address
+ */
+void setReconnectResolver(ReconnectState *state, ReconnectResolver resolve, void *context);
+
+/*
+ * Connect several clients in parallel. The connections are opened
+ * asynchronously and the event loops of all clients are driven until every
+ * session is activated, one fails or the timeout expires. On failure all
+ * clients are disconnected again.
+ */
+UA_StatusCode connectClients(UA_Client *clients[], const char *urls[], const char *names[],
+                             size_t clientsSize, UA_UInt32 timeout);
+
+/*
+ * Check the session state of the client, e.g. after a failed service call
+ */
+UA_Boolean isSessionActivated(UA_Client *client);
+
+/*
+ * Record the start of an outage. Calling this while already disconnected
+ * has no effect.
+ */
+void markDisconnected(ReconnectState *state);
+
+/*
+ * Attempt to re-establish the connection once the backoff delay expired.
+ * The session is not closed beforehand, so the server may reactivate it
+ * and keep its subscriptions. Returns UA_STATUSCODE_GOOD once connected,
+ * UA_STATUSCODE_GOODCALLAGAIN while waiting for the next attempt and the
+ * error of the failed attempt otherwise.
+ */
+UA_StatusCode tryReconnect(ReconnectState *state);
+
+/*
+ * Sleep until the next attempt is due, but at most maxWait ms so that
+ * signals are still handled in time
+ */
+void waitForNextAttempt(const ReconnectState *state, UA_UInt32 maxWait);
+
+#endif
@@ -0,0 +1,184 @@
+#include <open62541/plugin/log_stdout.h>
+#include <sqlite3.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asynclog.h"
+#include "logic.h"
+#include "replay.h"
+
+/*
+ * Logged timestamps have a resolution of one second and are taken after
+ * the decision, so they may lag the waterlevel row slightly
+ */
+#define REPLAY_TIME_TOLERANCE 1
+#define REPLAY_MAX_REPORTED_DIFFERENCES 10
+
+#define REPLAY_OUTPUT_BUFFER (1 << 20)
+
+
+static void logStderr(void *context, UA_LogLevel level, UA_LogCategory category,
+                      const char *msg, va_list args)
+{
+    static const char *levelNames[] = {"trace", "debug", "info", "warn", "error", "fatal"};
+    size_t levelIndex = (size_t)(level / 100 - 1);
+    fprintf(stderr, "%s/replay\t", levelIndex < 6 ? levelNames[levelIndex] : "log");
+    vfprintf(stderr, msg, args);
+    fputc('\n', stderr);
+}
+
+/*
+ * Used instead of the process logger while the CSV goes to stdout, so the
+ * log lines do not end up between the decisions
+ */
+static const UA_Logger stderrLogger = {logStderr, NULL, NULL};
+
+
+UA_StatusCode runReplay(const char *dbname, const char *outputname)
+{
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    const UA_Logger *logger = strcmp(outputname, "-") == 0 ? &stderrLogger : asyncLog;
+
+    sqlite3 *db;
+    if(sqlite3_open_v2(dbname, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                    "Unable to open database %s for replay", dbname);
+        sqlite3_close(db);
+        return UA_STATUSCODE_BAD;
+    }
+
+    const char *sqlLevel =
+        "SELECT id, timestamp, CAST(strftime('%s', timestamp) AS INTEGER), level "
+        "FROM waterlevel ORDER BY id;";
+    const char *sqlPosition =
+        "SELECT CAST(strftime('%s', timestamp) AS INTEGER), position "
+        "FROM valveposition ORDER BY id;";
+    sqlite3_stmt *stmtLevel = NULL;
+    sqlite3_stmt *stmtPosition = NULL;
+    if(   sqlite3_prepare_v2(db, sqlLevel, -1, &stmtLevel, NULL) != SQLITE_OK
+       || sqlite3_prepare_v2(db, sqlPosition, -1, &stmtPosition, NULL) != SQLITE_OK)
+    {
+        UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                    "Failed to prepare SQL statement with error: %s",
+                    sqlite3_errmsg(db));
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+        goto cleanup;
+    }
+
+    FILE *output = stdout;
+    if(strcmp(outputname, "-") != 0)
+    {
+        output = fopen(outputname, "w");
+        if(!output)
+        {
+            UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                        "Unable to open replay output %s", outputname);
+            retval = UA_STATUSCODE_BADINTERNALERROR;
+            goto cleanup;
+        }
+    }
+    setvbuf(output, NULL, _IOFBF, REPLAY_OUTPUT_BUFFER);
+    fprintf(output, "waterlevel_id,timestamp,position\n");
+
+    ValveLogic logic;
+    initValveLogic(&logic, LOGIC_UPPER_THRESHOLD, LOGIC_LOWER_THRESHOLD);
+
+    UA_UInt64 rows = 0;
+    UA_UInt64 decisions = 0;
+    UA_UInt64 differences = 0;
+    UA_UInt64 logged = 0;
+    UA_Boolean loggedExhausted = false;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+
+    int rc;
+    while((rc = sqlite3_step(stmtLevel)) == SQLITE_ROW)
+    {
+        rows++;
+        if(!evaluateValveLogic(&logic, sqlite3_column_double(stmtLevel, 3)))
+        {
+            continue;
+        }
+        decisions++;
+
+        sqlite3_int64 id = sqlite3_column_int64(stmtLevel, 0);
+        const unsigned char *timestamp = sqlite3_column_text(stmtLevel, 1);
+        sqlite3_int64 time = sqlite3_column_int64(stmtLevel, 2);
+        fprintf(output, "%lld,%s,%d\n", (long long)id,
+                timestamp ? (const char*)timestamp : "", (int)logic.valveOpen);
+
+        /*
+         * Compare with the decision logged at the same position in the history
+         */
+        if(!loggedExhausted && sqlite3_step(stmtPosition) == SQLITE_ROW)
+        {
+            logged++;
+            sqlite3_int64 loggedTime = sqlite3_column_int64(stmtPosition, 0);
+            int loggedPosition = sqlite3_column_int(stmtPosition, 1);
+            sqlite3_int64 skew = loggedTime - time;
+            if(   loggedPosition != (int)logic.valveOpen
+               || skew > REPLAY_TIME_TOLERANCE || skew < -REPLAY_TIME_TOLERANCE)
+            {
+                if(differences < REPLAY_MAX_REPORTED_DIFFERENCES)
+                {
+                    UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                                "Decision %llu at waterlevel id %lld differs: "
+                                "replayed position %d, logged position %d %+lld s later",
+                                (unsigned long long)decisions, (long long)id,
+                                (int)logic.valveOpen, loggedPosition, (long long)skew);
+                }
+                differences++;
+            }
+        }
+        else if(!loggedExhausted)
+        {
+            loggedExhausted = true;
+        }
+    }
+
+    UA_Double elapsed = (UA_Double)(UA_DateTime_nowMonotonic() - start) / UA_DATETIME_SEC;
+    if(rc != SQLITE_DONE)
+    {
+        UA_LOG_WARNING(logger, UA_LOGCATEGORY_USERLAND,
+                       "Replay stopped early with error: %s", sqlite3_errmsg(db));
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    /*
+     * Logged decisions without a replayed counterpart are differences as well
+     */
+    UA_UInt64 missing = decisions - logged;
+    UA_UInt64 extra = 0;
+    while(!loggedExhausted && sqlite3_step(stmtPosition) == SQLITE_ROW)
+    {
+        extra++;
+    }
+    differences += missing + extra;
+
+    if(output != stdout)
+    {
+        fclose(output);
+    }
+    else
+    {
+        fflush(output);
+    }
+
+    UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                "Replayed %llu samples in %.3f s (%.0f samples/s), %llu valve decisions",
+                (unsigned long long)rows, elapsed,
+                elapsed > 0. ? (UA_Double)rows / elapsed : 0.,
+                (unsigned long long)decisions);
+    UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                "%llu differences to the logged history: %llu replayed decisions "
+                "not logged, %llu logged decisions not replayed",
+                (unsigned long long)differences, (unsigned long long)missing,
+                (unsigned long long)extra);
+
+cleanup:
+    sqlite3_finalize(stmtLevel);
+    sqlite3_finalize(stmtPosition);
+    sqlite3_close(db);
+    return retval;
+}
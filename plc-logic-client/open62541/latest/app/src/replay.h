@@ -0,0 +1,17 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <open62541/types.h>
+
+/*
+ * Feed the recorded waterlevel history of a database through the control
+ * logic without connecting to any server. The rows are streamed with a
+ * single cursor and the resulting valve decisions are written as CSV
+ * (waterlevel id, timestamp, position) to outputname, '-' for stdout.
+ * The decisions are compared in order with the logged valveposition rows
+ * and the throughput and all differences are reported, on stderr when
+ * the CSV goes to stdout.
+ */
+UA_StatusCode runReplay(const char *dbname, const char *outputname);
+
+#endif
@@ -0,0 +1,202 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <string.h>
+#include "asynclog.h"
+#include "rollup.h"
+
+/*
+ * Bucket is the start in Unix seconds. Minimum and maximum are NULL for a
+ * bucket only covered by a sample held from the previous one.
+ */
+#define ROLLUP_TABLE(name) \
+    "CREATE TABLE IF NOT EXISTS " name " (" \
+    "    bucket INTEGER PRIMARY KEY," \
+    "    samples INTEGER NOT NULL," \
+    "    min REAL," \
+    "    max REAL," \
+    "    sum REAL NOT NULL," \
+    "    weighted REAL NOT NULL," \
+    "    covered REAL NOT NULL," \
+    "    valve_open REAL NOT NULL);"
+
+#define ROLLUP_UPSERT(name) \
+    "INSERT INTO " name " (bucket, samples, min, max, sum, weighted, covered, valve_open) " \
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?) " \
+    "ON CONFLICT(bucket) DO UPDATE SET " \
+    "    samples = samples + excluded.samples," \
+    "    min = coalesce(min(min, excluded.min), min, excluded.min)," \
+    "    max = coalesce(max(max, excluded.max), max, excluded.max)," \
+    "    sum = sum + excluded.sum," \
+    "    weighted = weighted + excluded.weighted," \
+    "    covered = covered + excluded.covered," \
+    "    valve_open = valve_open + excluded.valve_open"
+
+
+static UA_DateTime bucketStart(UA_DateTime time, UA_DateTime width)
+{
+    return time - (time - UA_DATETIME_UNIX_EPOCH) % width;
+}
+
+
+static void writeBucket(Rollups *rollups, sqlite3_stmt *stmt, UA_DateTime start)
+{
+    RollupBucket *bucket = &rollups->bucket;
+    sqlite3_bind_int64(stmt, 1, (start - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)bucket->samples);
+    if(bucket->samples > 0)
+    {
+        sqlite3_bind_double(stmt, 3, bucket->min);
+        sqlite3_bind_double(stmt, 4, bucket->max);
+    }
+    else
+    {
+        sqlite3_bind_null(stmt, 3);
+        sqlite3_bind_null(stmt, 4);
+    }
+    sqlite3_bind_double(stmt, 5, bucket->sum);
+    sqlite3_bind_double(stmt, 6, bucket->weighted);
+    sqlite3_bind_double(stmt, 7, bucket->covered);
+    sqlite3_bind_double(stmt, 8, bucket->valveOpen);
+    if(sqlite3_step(stmt) != SQLITE_DONE)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Could not write rollup to database with error: %s",
+                       sqlite3_errmsg(rollups->db));
+    }
+    sqlite3_reset(stmt);
+}
+
+
+/*
+ * Merge the current minute into its rows of both tables
+ */
+static void flushBucket(Rollups *rollups)
+{
+    RollupBucket *bucket = &rollups->bucket;
+    if(bucket->start != 0 && (bucket->samples > 0 || bucket->covered > 0.))
+    {
+        writeBucket(rollups, rollups->upsertMinute, bucket->start);
+        writeBucket(rollups, rollups->upsertHour, bucketStart(bucket->start, ROLLUP_HOUR));
+    }
+    memset(bucket, 0, sizeof(RollupBucket));
+}
+
+
+/*
+ * Make the bucket of time the current one
+ */
+static void enterBucket(Rollups *rollups, UA_DateTime time)
+{
+    UA_DateTime start = bucketStart(time, ROLLUP_MINUTE);
+    if(rollups->bucket.start != start)
+    {
+        flushBucket(rollups);
+        rollups->bucket.start = start;
+    }
+}
+
+
+/*
+ * Account the time since the last sample to the level and valve position
+ * held since, split at the minute boundaries
+ */
+static void holdUntil(Rollups *rollups, UA_DateTime time)
+{
+    if(!rollups->hasLevel || time <= rollups->lastTime)
+    {
+        return;
+    }
+    if(time - rollups->lastTime > ROLLUP_MAX_HOLD)
+    {
+        rollups->lastTime = time;
+        return;
+    }
+
+    UA_DateTime from = rollups->lastTime;
+    while(from < time)
+    {
+        enterBucket(rollups, from);
+        RollupBucket *bucket = &rollups->bucket;
+        UA_DateTime end = bucket->start + ROLLUP_MINUTE;
+        if(end > time)
+        {
+            end = time;
+        }
+        UA_Double seconds = (UA_Double)(end - from) / UA_DATETIME_SEC;
+        bucket->weighted += rollups->lastLevel * seconds;
+        bucket->covered += seconds;
+        if(rollups->valveOpen)
+        {
+            bucket->valveOpen += seconds;
+        }
+        from = end;
+    }
+    rollups->lastTime = time;
+}
+
+
+UA_StatusCode prepareRollups(Rollups *rollups, sqlite3 *db)
+{
+    memset(rollups, 0, sizeof(Rollups));
+    rollups->db = db;
+    if(   sqlite3_exec(db, ROLLUP_TABLE("rollup_minute") ROLLUP_TABLE("rollup_hour"),
+                       NULL, NULL, NULL) != SQLITE_OK
+       || sqlite3_prepare_v3(db, ROLLUP_UPSERT("rollup_minute"), -1, SQLITE_PREPARE_PERSISTENT,
+                             &rollups->upsertMinute, NULL) != SQLITE_OK
+       || sqlite3_prepare_v3(db, ROLLUP_UPSERT("rollup_hour"), -1, SQLITE_PREPARE_PERSISTENT,
+                             &rollups->upsertHour, NULL) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to prepare rollup tables with error: %s",
+                       sqlite3_errmsg(db));
+        sqlite3_finalize(rollups->upsertMinute);
+        sqlite3_finalize(rollups->upsertHour);
+        rollups->upsertMinute = NULL;
+        rollups->upsertHour = NULL;
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void finalizeRollups(Rollups *rollups)
+{
+    if(rollups->upsertMinute && rollups->upsertHour)
+    {
+        flushBucket(rollups);
+    }
+    sqlite3_finalize(rollups->upsertMinute);
+    sqlite3_finalize(rollups->upsertHour);
+    rollups->upsertMinute = NULL;
+    rollups->upsertHour = NULL;
+}
+
+
+void addLevelToRollups(Rollups *rollups, UA_DateTime time, UA_Double level)
+{
+    holdUntil(rollups, time);
+    enterBucket(rollups, time);
+
+    RollupBucket *bucket = &rollups->bucket;
+    if(bucket->samples == 0 || level < bucket->min)
+    {
+        bucket->min = level;
+    }
+    if(bucket->samples == 0 || level > bucket->max)
+    {
+        bucket->max = level;
+    }
+    bucket->sum += level;
+    bucket->samples++;
+
+    rollups->hasLevel = true;
+    rollups->lastTime = time;
+    rollups->lastLevel = level;
+}
+
+
+void addValveToRollups(Rollups *rollups, UA_DateTime time, UA_Boolean valveOpen)
+{
+    holdUntil(rollups, time);
+    rollups->valveOpen = valveOpen;
+}
@@ -0,0 +1,65 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <open62541/types.h>
+#include <sqlite3.h>
+
+#define ROLLUP_MINUTE (60 * UA_DATETIME_SEC)
+#define ROLLUP_HOUR (3600 * UA_DATETIME_SEC)
+
+/*
+ * The level and valve position are held between samples for the time
+ * weighting, but not across gaps longer than this, e.g. an outage of the
+ * sensor
+ */
+#define ROLLUP_MAX_HOLD (5 * UA_DATETIME_SEC)
+
+/*
+ * Aggregates of the current minute. The time-weighted values integrate
+ * the level and the open valve over the time covered by samples.
+ */
+typedef struct {
+    UA_DateTime start;          /* 0 if no bucket is open */
+    UA_UInt64 samples;
+    UA_Double min;
+    UA_Double max;
+    UA_Double sum;
+    UA_Double weighted;         /* percent seconds */
+    UA_Double covered;          /* seconds */
+    UA_Double valveOpen;        /* seconds */
+} RollupBucket;
+
+/*
+ * Aggregates of the fill level and the valve position, maintained while
+ * the samples are stored. Only the current minute is kept in memory. A
+ * completed minute is written to the tables rollup_minute and rollup_hour
+ * and merged with an existing row of the same bucket, so the hour is
+ * complete up to the last minute and a restart continues a bucket.
+ * Queries for aggregates read one row per bucket instead of the samples.
+ */
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *upsertMinute;
+    sqlite3_stmt *upsertHour;
+    RollupBucket bucket;
+    UA_Boolean hasLevel;
+    UA_DateTime lastTime;
+    UA_Double lastLevel;
+    UA_Boolean valveOpen;
+} Rollups;
+
+/*
+ * Create the rollup tables if needed and prepare the statements
+ */
+UA_StatusCode prepareRollups(Rollups *rollups, sqlite3 *db);
+
+/*
+ * Write the current minute and finalize the statements
+ */
+void finalizeRollups(Rollups *rollups);
+
+void addLevelToRollups(Rollups *rollups, UA_DateTime time, UA_Double level);
+
+void addValveToRollups(Rollups *rollups, UA_DateTime time, UA_Boolean valveOpen);
+
+#endif
@@ -0,0 +1,217 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asynclog.h"
+#include "sqlitemem.h"
+
+/*
+ * Size classes are the powers of two from 16 bytes to 64 KiB and the
+ * midpoints between them, which keeps the waste of the 4 KiB pages of the
+ * page cache low. Larger blocks are passed to malloc directly.
+ */
+#define SQLITEMEM_MIN_SHIFT 4
+#define SQLITEMEM_MAX_SHIFT 16
+#define SQLITEMEM_CLASSES (2 * (SQLITEMEM_MAX_SHIFT - SQLITEMEM_MIN_SHIFT) + 1)
+#define SQLITEMEM_LARGE SQLITEMEM_CLASSES
+#define SQLITEMEM_CHUNK_SIZE (256 * 1024)
+
+/*
+ * Every block starts with a header. Header and class sizes are multiples
+ * of 8 bytes, which is the alignment SQLite requires.
+ */
+typedef struct {
+    size_t sizeClass;
+    size_t size;
+} BlockHeader;
+
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+typedef struct Chunk {
+    struct Chunk *next;
+    size_t used;
+} Chunk;
+
+static size_t classSizes[SQLITEMEM_CLASSES];
+static FreeBlock *freeLists[SQLITEMEM_CLASSES];
+static Chunk *chunks = NULL;
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static size_t getSizeClass(size_t size)
+{
+    for(size_t i = 0; i < SQLITEMEM_CLASSES; i++)
+    {
+        if(size <= classSizes[i])
+        {
+            return i;
+        }
+    }
+    return SQLITEMEM_LARGE;
+}
+
+
+/*
+ * Take a new block of a size class from the current chunk
+ */
+static void *carveBlock(size_t sizeClass)
+{
+    size_t blockSize = sizeof(BlockHeader) + classSizes[sizeClass];
+    if(!chunks || chunks->used + blockSize > SQLITEMEM_CHUNK_SIZE)
+    {
+        Chunk *chunk = malloc(SQLITEMEM_CHUNK_SIZE);
+        if(!chunk)
+        {
+            return NULL;
+        }
+        chunk->next = chunks;
+        chunk->used = sizeof(Chunk);
+        chunks = chunk;
+    }
+    void *block = (char *)chunks + chunks->used;
+    chunks->used += blockSize;
+    return block;
+}
+
+
+static void *poolMalloc(int size)
+{
+    if(size <= 0)
+    {
+        return NULL;
+    }
+
+    size_t sizeClass = getSizeClass((size_t)size);
+    BlockHeader *header;
+    if(sizeClass == SQLITEMEM_LARGE)
+    {
+        header = malloc(sizeof(BlockHeader) + (size_t)size);
+    }
+    else
+    {
+        pthread_mutex_lock(&poolMutex);
+        header = (BlockHeader *)freeLists[sizeClass];
+        if(header)
+        {
+            freeLists[sizeClass] = freeLists[sizeClass]->next;
+        }
+        else
+        {
+            header = carveBlock(sizeClass);
+        }
+        pthread_mutex_unlock(&poolMutex);
+    }
+    if(!header)
+    {
+        return NULL;
+    }
+
+    header->sizeClass = sizeClass;
+    header->size = sizeClass == SQLITEMEM_LARGE ? (size_t)size : classSizes[sizeClass];
+    return header + 1;
+}
+
+
+static void poolFree(void *ptr)
+{
+    if(!ptr)
+    {
+        return;
+    }
+
+    BlockHeader *header = (BlockHeader *)ptr - 1;
+    size_t sizeClass = header->sizeClass;
+    if(sizeClass == SQLITEMEM_LARGE)
+    {
+        free(header);
+        return;
+    }
+
+    pthread_mutex_lock(&poolMutex);
+    FreeBlock *block = (FreeBlock *)header;
+    block->next = freeLists[sizeClass];
+    freeLists[sizeClass] = block;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+
+static int poolSize(void *ptr)
+{
+    return ptr ? (int)((BlockHeader *)ptr - 1)->size : 0;
+}
+
+
+static void *poolRealloc(void *ptr, int size)
+{
+    if(poolSize(ptr) >= size)
+    {
+        return ptr;
+    }
+
+    void *block = poolMalloc(size);
+    if(block && ptr)
+    {
+        memcpy(block, ptr, (size_t)poolSize(ptr));
+        poolFree(ptr);
+    }
+    return block;
+}
+
+
+static int poolRoundup(int size)
+{
+    size_t sizeClass = getSizeClass((size_t)size);
+    return sizeClass == SQLITEMEM_LARGE ? (size + 7) & ~7 : (int)classSizes[sizeClass];
+}
+
+
+static int poolInit(void *appData)
+{
+    return SQLITE_OK;
+}
+
+
+static void poolShutdown(void *appData)
+{
+    while(chunks)
+    {
+        Chunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    memset(freeLists, 0, sizeof(freeLists));
+}
+
+
+static const sqlite3_mem_methods poolMethods = {
+    poolMalloc,
+    poolFree,
+    poolRealloc,
+    poolSize,
+    poolRoundup,
+    poolInit,
+    poolShutdown,
+    NULL,
+};
+
+
+UA_StatusCode initSqliteMemory(void)
+{
+    for(size_t i = 0; i < SQLITEMEM_CLASSES; i++)
+    {
+        size_t shift = SQLITEMEM_MIN_SHIFT + i / 2;
+        classSizes[i] = i % 2 == 0 ? (size_t)1 << shift : (size_t)3 << (shift - 1);
+    }
+
+    if(sqlite3_config(SQLITE_CONFIG_MALLOC, &poolMethods) != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to install the SQLite memory pool");
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
@@ -0,0 +1,19 @@
+#ifndef SQLITEMEM_H
+#define SQLITEMEM_H
+
+#include <open62541/types.h>
+
+/*
+ * SQLite allocates its cursors, record buffers and journal bitmaps on
+ * every executed statement. The distribution packages are built without
+ * lookaside memory and without the memsys5 heap, so these allocations go
+ * to malloc. This installs a pool allocator with size classes and free
+ * lists instead. Memory is taken from the system in chunks while the pool
+ * grows and reused afterwards, so a steady stream of statements no longer
+ * reaches malloc.
+ *
+ * Must be called before SQLite is used for the first time.
+ */
+UA_StatusCode initSqliteMemory(void);
+
+#endif
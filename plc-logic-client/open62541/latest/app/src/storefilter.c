@@ -0,0 +1,208 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storefilter.h"
+
+
+UA_StatusCode parseStoreFilter(const char *spec, StoreFilterConfig *config)
+{
+    char *copy = strdup(spec);
+    if(!copy)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    memset(config, 0, sizeof(StoreFilterConfig));
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    char *saveptr = NULL;
+    for(char *token = strtok_r(copy, ",", &saveptr);
+        token && retval == UA_STATUSCODE_GOOD;
+        token = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(token, '=');
+        if(!value)
+        {
+            if(strcmp(token, "all") == 0)
+            {
+                config->mode = STORE_FILTER_NONE;
+            }
+            else if(strcmp(token, "change") == 0)
+            {
+                config->mode = STORE_FILTER_DEADBAND;
+                config->deviation = 0.;
+                config->relative = false;
+            }
+            else
+            {
+                retval = UA_STATUSCODE_BADSYNTAXERROR;
+            }
+            continue;
+        }
+
+        *value++ = '\0';
+        char *end = value;
+        if(strcmp(token, "deadband") == 0 || strcmp(token, "swing") == 0)
+        {
+            config->mode = token[0] == 'd' ? STORE_FILTER_DEADBAND : STORE_FILTER_SWINGING_DOOR;
+            config->deviation = strtod(value, &end);
+            config->relative = *end == '%';
+            if(config->relative)
+            {
+                end++;
+            }
+        }
+        else if(strcmp(token, "heartbeat") == 0)
+        {
+            config->heartbeat = (UA_DateTime)(strtod(value, &end) * UA_DATETIME_SEC);
+        }
+        else
+        {
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+        }
+        if(end == value || *end != '\0' || *value == '-')
+        {
+            retval = UA_STATUSCODE_BADSYNTAXERROR;
+        }
+    }
+    free(copy);
+
+    /*
+     * A filter with a heartbeat only would store every sample anyway
+     */
+    if(config->mode == STORE_FILTER_NONE && config->heartbeat != 0)
+    {
+        retval = UA_STATUSCODE_BADSYNTAXERROR;
+    }
+    return retval;
+}
+
+
+void initStoreFilter(StoreFilter *filter, const StoreFilterConfig *config)
+{
+    memset(filter, 0, sizeof(StoreFilter));
+    if(config)
+    {
+        filter->config = *config;
+    }
+}
+
+
+static UA_Double deviationOf(const StoreFilter *filter)
+{
+    if(filter->config.relative)
+    {
+        return filter->config.deviation / 100. * fabs(filter->stored.value);
+    }
+    return filter->config.deviation;
+}
+
+
+static size_t storeSample(StoreFilter *filter, UA_DateTime time, UA_Double value,
+                          StoredSample *out)
+{
+    filter->stored.time = time;
+    filter->stored.value = value;
+    filter->hasStored = true;
+    filter->hasHeld = false;
+    filter->written++;
+    *out = filter->stored;
+    return 1;
+}
+
+
+/*
+ * Narrow the door by a sample. The lines from the last stored sample
+ * within half the deviation of it have slopes between low and high. The
+ * door closes if no line stays within half the deviation of all samples
+ * since, the line to the held sample then stays within the full
+ * deviation of them.
+ */
+static UA_Boolean narrowDoor(StoreFilter *filter, UA_DateTime time, UA_Double value)
+{
+    UA_Double seconds = (UA_Double)(time - filter->stored.time) / UA_DATETIME_SEC;
+    if(seconds <= 0.)
+    {
+        return false;
+    }
+    UA_Double halfDeviation = deviationOf(filter) / 2.;
+    UA_Double low = (value - filter->stored.value - halfDeviation) / seconds;
+    UA_Double high = (value - filter->stored.value + halfDeviation) / seconds;
+    if(filter->hasHeld)
+    {
+        low = fmax(low, filter->slopeLow);
+        high = fmin(high, filter->slopeHigh);
+        if(low > high)
+        {
+            return false;
+        }
+    }
+    filter->slopeLow = low;
+    filter->slopeHigh = high;
+    filter->held.time = time;
+    filter->held.value = value;
+    filter->hasHeld = true;
+    return true;
+}
+
+
+size_t filterSample(StoreFilter *filter, UA_DateTime time, UA_Double value,
+                    StoredSample out[2])
+{
+    filter->received++;
+    if(filter->config.mode == STORE_FILTER_NONE || !filter->hasStored)
+    {
+        return storeSample(filter, time, value, out);
+    }
+
+    size_t count = 0;
+    if(filter->config.heartbeat != 0 && time - filter->stored.time >= filter->config.heartbeat)
+    {
+        if(filter->hasHeld)
+        {
+            count += storeSample(filter, filter->held.time, filter->held.value, &out[count]);
+        }
+        if(time - filter->stored.time >= filter->config.heartbeat)
+        {
+            return count + storeSample(filter, time, value, &out[count]);
+        }
+    }
+
+    if(filter->config.mode == STORE_FILTER_DEADBAND)
+    {
+        if(fabs(value - filter->stored.value) > deviationOf(filter))
+        {
+            count += storeSample(filter, time, value, &out[count]);
+        }
+        return count;
+    }
+
+    /*
+     * Swinging door, the held sample is stored when the door closes and
+     * the door opens again from there. A sample that does not fit through
+     * the fresh door either is only possible at the same timestamp and is
+     * stored right away.
+     */
+    if(narrowDoor(filter, time, value))
+    {
+        return count;
+    }
+    if(filter->hasHeld)
+    {
+        count += storeSample(filter, filter->held.time, filter->held.value, &out[count]);
+        if(narrowDoor(filter, time, value))
+        {
+            return count;
+        }
+    }
+    return count + storeSample(filter, time, value, &out[count]);
+}
+
+
+size_t flushStoreFilter(StoreFilter *filter, StoredSample *out)
+{
+    if(!filter->hasHeld)
+    {
+        return 0;
+    }
+    return storeSample(filter, filter->held.time, filter->held.value, out);
+}
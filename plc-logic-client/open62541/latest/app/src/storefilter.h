@@ -0,0 +1,86 @@
+#ifndef STOREFILTER_H
+#define STOREFILTER_H
+
+#include <open62541/types.h>
+
+/*
+ * Filter of the fill level samples before they are stored. Every sample is
+ * still processed by the control loop and the rollups, only the history
+ * is thinned out. The history kept can be reconstructed within the
+ * deviation configured:
+ *
+ *   deadband       a sample is stored if it differs by more than the
+ *                  deviation from the last one stored, holding the stored
+ *                  value until the next one reconstructs every sample
+ *                  within the deviation. A deviation of 0 stores changes
+ *                  only.
+ *   swinging door  a sample is stored once the samples since the last one
+ *                  stored cannot be approximated by a straight line
+ *                  anymore. Interpolating linearly between the stored
+ *                  samples reconstructs every sample within the deviation.
+ *
+ * The deviation is either absolute in percent of the fill level or
+ * relative in percent of the last value stored. The heartbeat stores a
+ * sample at least every interval, so a constant level still shows up in
+ * the history. The first sample is always stored.
+ */
+typedef enum {
+    STORE_FILTER_NONE = 0,
+    STORE_FILTER_DEADBAND,
+    STORE_FILTER_SWINGING_DOOR,
+} StoreFilterMode;
+
+typedef struct {
+    StoreFilterMode mode;
+    UA_Double deviation;
+    UA_Boolean relative;
+    UA_DateTime heartbeat;      /* 0 for none */
+} StoreFilterConfig;
+
+typedef struct {
+    UA_DateTime time;
+    UA_Double value;
+} StoredSample;
+
+typedef struct {
+    StoreFilterConfig config;
+    UA_Boolean hasStored;
+    StoredSample stored;        /* last sample stored */
+    /*
+     * Swinging door: the last sample received but not stored yet and the
+     * range of slopes of the lines from the last stored sample that stay
+     * close enough to all samples since
+     */
+    UA_Boolean hasHeld;
+    StoredSample held;
+    UA_Double slopeLow;
+    UA_Double slopeHigh;
+    UA_UInt64 received;
+    UA_UInt64 written;
+} StoreFilter;
+
+/*
+ * Parse a filter specification: 'all', 'change', 'deadband=DEV' or
+ * 'swing=DEV' with DEV in percent of the fill level, or relative to the
+ * last value stored with a '%' suffix, optionally followed by
+ * ',heartbeat=SECONDS', e.g. 'swing=0.5,heartbeat=60'
+ */
+UA_StatusCode parseStoreFilter(const char *spec, StoreFilterConfig *config);
+
+void initStoreFilter(StoreFilter *filter, const StoreFilterConfig *config);
+
+/*
+ * Pass a sample through the filter. The samples to store, at most two and
+ * possibly older ones, are written to 'out' in time order and their number
+ * is returned.
+ */
+size_t filterSample(StoreFilter *filter, UA_DateTime time, UA_Double value,
+                    StoredSample out[2]);
+
+/*
+ * The sample held back by the swinging door, to be stored on shutdown.
+ * Returns 0 if there is none.
+ */
+size_t flushStoreFilter(StoreFilter *filter, StoredSample *out);
+
+#endif
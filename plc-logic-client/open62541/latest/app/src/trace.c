@@ -0,0 +1,69 @@
+#include "trace.h"
+
+
+static const char *intervalNames[TRACE_INTERVALS] = {
+    "sensor->arrival",
+    "arrival->decision",
+    "decision->written",
+    "decision->committed",
+    "sensor->committed",
+};
+
+static const char *metricNames[TRACE_INTERVALS] = {
+    "SensorToArrivalLatency",
+    "ArrivalToDecisionLatency",
+    "DecisionToWrittenLatency",
+    "DecisionToCommittedLatency",
+    "SensorToCommittedLatency",
+};
+
+static const char *metricDescriptions[TRACE_INTERVALS] = {
+    "Time from the source timestamp of a sample to its arrival",
+    "Time from the arrival of a sample to the valve decision",
+    "Time from the valve decision to the acknowledged valve write",
+    "Time from the valve decision to the database inserts",
+    "Time from the source timestamp of a sample to the database inserts",
+};
+
+
+static void recordInterval(TraceHistograms *histograms, TraceInterval interval,
+                           UA_DateTime start, UA_DateTime end)
+{
+    if(start == 0 || end == 0)
+    {
+        return;
+    }
+    UA_Int64 value = (end - start) / UA_DATETIME_USEC;
+    recordHistogramValue(&histograms->intervals[interval], value);
+    recordLatency(histograms->metrics[interval], value);
+}
+
+
+void initTraceHistograms(TraceHistograms *histograms)
+{
+    for(size_t i = 0; i < TRACE_INTERVALS; i++)
+    {
+        initHistogram(&histograms->intervals[i]);
+        histograms->metrics[i] = registerMetric(metricNames[i], metricDescriptions[i], METRIC_LATENCY);
+    }
+}
+
+
+void recordSampleTrace(TraceHistograms *histograms, const SampleTrace *trace)
+{
+    recordInterval(histograms, TRACE_SENSOR_TO_ARRIVAL, trace->source, trace->arrival);
+    recordInterval(histograms, TRACE_ARRIVAL_TO_DECISION, trace->arrival, trace->decision);
+    recordInterval(histograms, TRACE_DECISION_TO_WRITTEN, trace->decision, trace->written);
+    recordInterval(histograms, TRACE_DECISION_TO_COMMITTED, trace->decision, trace->committed);
+    recordInterval(histograms, TRACE_SENSOR_TO_COMMITTED, trace->source, trace->committed);
+}
+
+
+void printTraceHistograms(const TraceHistograms *histograms, FILE *fp)
+{
+    for(size_t i = 0; i < TRACE_INTERVALS; i++)
+    {
+        printHistogram(&histograms->intervals[i], intervalNames[i], fp);
+    }
+    fflush(fp);
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <open62541/types.h>
+#include <stdio.h>
+#include "histogram.h"
+#include "metrics.h"
+
+/*
+ * Timestamps of a single sample on its way through the control loop. All
+ * timestamps are wall clock time, as the source timestamp is taken on the
+ * sensor server. Stages that did not happen for a sample stay zero, e.g.
+ * the valve write when the decision did not change the valve.
+ */
+typedef struct {
+    UA_DateTime source;     /* source timestamp set by the sensor server */
+    UA_DateTime arrival;    /* notification received by the logic client */
+    UA_DateTime decision;   /* control logic evaluated */
+    UA_DateTime written;    /* valve write acknowledged by the valve server */
+    UA_DateTime committed;  /* rows inserted into the database */
+} SampleTrace;
+
+/*
+ * Intervals aggregated from the sample traces. The time from the decision
+ * to applying the new valve state is measured by valve-server itself, as
+ * the write carries the decision time as source timestamp.
+ */
+typedef enum {
+    TRACE_SENSOR_TO_ARRIVAL = 0,
+    TRACE_ARRIVAL_TO_DECISION,
+    TRACE_DECISION_TO_WRITTEN,
+    TRACE_DECISION_TO_COMMITTED,
+    TRACE_SENSOR_TO_COMMITTED,
+    TRACE_INTERVALS
+} TraceInterval;
+
+/*
+ * The intervals are kept twice: in the fine-grained histograms printed to
+ * stdout, and as latency metrics for the metrics endpoint
+ */
+typedef struct {
+    Histogram intervals[TRACE_INTERVALS];
+    Metric *metrics[TRACE_INTERVALS];
+} TraceHistograms;
+
+void initTraceHistograms(TraceHistograms *histograms);
+
+/*
+ * Add the intervals of a finished sample trace to the histograms
+ */
+void recordSampleTrace(TraceHistograms *histograms, const SampleTrace *trace);
+
+void printTraceHistograms(const TraceHistograms *histograms, FILE *fp);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TSSTORE_H
+#define TSSTORE_H
+
+#include <open62541/types.h>
+#include <stdint.h>
+
+/*
+ * Append-only store for a time series of doubles, an alternative to a
+ * SQLite table with one row per sample. Samples are appended to
+ * memory-mapped segment files '<dir>/<name>.<number>.seg' of a fixed size.
+ *
+ * Every segment starts with a header and a sparse time index with one
+ * entry per block of TSSTORE_BLOCK_SAMPLES samples. The entry holds the
+ * first sample of the block uncompressed, the following samples are
+ * packed into a bit stream like in Facebook's Gorilla: timestamps as delta
+ * of delta, values XORed with their predecessor. Timestamps are stored
+ * with a resolution of one millisecond and samples are expected in time
+ * order.
+ *
+ * A single process appends. Other processes can map the same files and
+ * read concurrently, the header is updated under a sequence counter. The
+ * mapped pages survive a crash of the writer, but are not synced to disk
+ * after every sample.
+ */
+#define TSSTORE_BLOCK_SAMPLES 256
+#define TSSTORE_INDEX_ENTRIES 2048
+#define TSSTORE_SEGMENT_SIZE (1 << 20)
+
+/*
+ * Compression state after a sample: the previous timestamp and delta in
+ * milliseconds, the bits of the previous value and the window of
+ * meaningful bits of the last XOR written with its own window
+ */
+typedef struct {
+    int64_t time;
+    int64_t delta;
+    uint64_t value;
+    uint8_t leading;
+    uint8_t trailing;
+} TimeSeriesCodec;
+
+typedef struct {
+    const char *dir;
+    const char *name;
+    UA_Boolean writable;
+    UA_UInt32 segmentNumber;    /* 0 if no segment is mapped */
+    UA_Byte *segment;
+    TimeSeriesCodec codec;      /* state of the last block, writer only */
+} TimeSeries;
+
+/*
+ * Called for every sample of a range scan
+ */
+typedef void (*TimeSeriesVisitor)(void *context, UA_DateTime time, UA_Double value);
+
+/*
+ * Open the series name in dir. A writer creates the directory and the
+ * first segment if needed and continues the newest segment. A reader
+ * succeeds as well if nothing has been written yet.
+ */
+UA_StatusCode openTimeSeries(TimeSeries *series, const char *dir, const char *name,
+                             UA_Boolean writable);
+
+void closeTimeSeries(TimeSeries *series);
+
+/*
+ * Append a sample, starting a new segment when the current one is full.
+ * Does not allocate memory and only enters the kernel to start a segment.
+ */
+UA_StatusCode appendTimeSeries(TimeSeries *series, UA_DateTime time, UA_Double value);
+
+/*
+ * Latest sample from the segment header, UA_STATUSCODE_BADNODATA if the
+ * series is empty
+ */
+UA_StatusCode readLatestTimeSeries(TimeSeries *series, UA_DateTime *time, UA_Double *value);
+
+/*
+ * Visit all samples from 'from' to 'to' inclusively in time order. Segments
+ * outside the range are skipped by their header and the decoding starts at
+ * the last block that begins before 'from'.
+ */
+UA_StatusCode scanTimeSeries(TimeSeries *series, UA_DateTime from, UA_DateTime to,
+                             TimeSeriesVisitor visitor, void *context);
+
+/*
+ * Bytes of the segment files in use by the samples, for comparing the
+ * footprint with other storage
+ */
+UA_UInt64 timeSeriesBytesUsed(TimeSeries *series);
+
+#endif
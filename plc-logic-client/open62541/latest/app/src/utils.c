@@ -7,31 +7,89 @@ UA_StatusCode translateBrowsePathToNodeIdRequest(
     UA_UInt32 id[],
     int len)
 {
-    UA_BrowsePath browsePath;
-    UA_BrowsePath_init(&browsePath);
-    browsePath.startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
-    browsePath.relativePath.elements = (UA_RelativePathElement*)UA_Array_new(len, &UA_TYPES[UA_TYPES_RELATIVEPATHELEMENT]);
-    browsePath.relativePath.elementsSize = len;
+    char **paths[] = {path};
+    return translateBrowsePathsToNodeIdsRequest(client, nodeId, paths, 1, id, len);
+}
+
+
+UA_StatusCode translateBrowsePathsToNodeIdsRequest(
+    UA_Client *client,
+    UA_NodeId *nodeIds,
+    char** paths[],
+    size_t pathsSize,
+    UA_UInt32 id[],
+    int len)
+{
+    UA_BrowsePath *browsePaths =
+        (UA_BrowsePath*)UA_Array_new(pathsSize, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+    if(!browsePaths)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
 
-    for(size_t i = 0; i < len; i++)
+    for(size_t p = 0; p < pathsSize; p++)
     {
-        UA_RelativePathElement *elem = &browsePath.relativePath.elements[i];
-        elem->referenceTypeId = UA_NODEID_NUMERIC(0, id[i]);
-        elem->targetName = UA_QUALIFIEDNAME_ALLOC(1, path[i]);
+        UA_BrowsePath *browsePath = &browsePaths[p];
+        browsePath->startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        browsePath->relativePath.elements = (UA_RelativePathElement*)UA_Array_new(len, &UA_TYPES[UA_TYPES_RELATIVEPATHELEMENT]);
+        if(!browsePath->relativePath.elements)
+        {
+            UA_Array_delete(browsePaths, pathsSize, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+        browsePath->relativePath.elementsSize = len;
+
+        for(size_t i = 0; i < len; i++)
+        {
+            UA_RelativePathElement *elem = &browsePath->relativePath.elements[i];
+            elem->referenceTypeId = UA_NODEID_NUMERIC(0, id[i]);
+            elem->targetName = UA_QUALIFIEDNAME_ALLOC(1, paths[p][i]);
+        }
     }
 
     UA_TranslateBrowsePathsToNodeIdsRequest request;
     UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
-    request.browsePaths = &browsePath;
-    request.browsePathsSize = 1;
+    request.browsePaths = browsePaths;
+    request.browsePathsSize = pathsSize;
     UA_TranslateBrowsePathsToNodeIdsResponse response =
         UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
-    if(   response.responseHeader.serviceResult != UA_STATUSCODE_GOOD
-       || response.resultsSize < 1
-       || response.results[0].targetsSize < 1)
+
+    /*
+     * The request owns the path elements and qualified names
+     */
+    UA_Array_delete(browsePaths, pathsSize, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != pathsSize)
+    {
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+
+    size_t copied = 0;
+    for(; retval == UA_STATUSCODE_GOOD && copied < pathsSize; copied++)
     {
-        return response.responseHeader.serviceResult;
+        const UA_BrowsePathResult *result = &response.results[copied];
+        if(result->statusCode != UA_STATUSCODE_GOOD)
+        {
+            retval = result->statusCode;
+            break;
+        }
+        if(result->targetsSize < 1)
+        {
+            retval = UA_STATUSCODE_BADNOTFOUND;
+            break;
+        }
+        retval = UA_NodeId_copy(&result->targets[0].targetId.nodeId, &nodeIds[copied]);
     }
-    *nodeId = response.results[0].targets[0].targetId.nodeId;
-    return UA_STATUSCODE_GOOD;
+
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        for(size_t p = 0; p < copied; p++)
+        {
+            UA_NodeId_clear(&nodeIds[p]);
+        }
+    }
+
+    UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    return retval;
 }
@@ -13,4 +13,18 @@ UA_StatusCode translateBrowsePathToNodeIdRequest(
     UA_UInt32 id[],
     int len);
 
+/*
+ * Send a single request translating pathsSize paths to node IDs. Every path
+ * starts at the objects folder and has len elements that follow the
+ * reference types in id. On success nodeIds holds one copied node ID per
+ * path, on failure nothing needs to be cleaned up.
+ */
+UA_StatusCode translateBrowsePathsToNodeIdsRequest(
+    UA_Client *client,
+    UA_NodeId *nodeIds,
+    char** paths[],
+    size_t pathsSize,
+    UA_UInt32 id[],
+    int len);
+
 #endif
@@ -0,0 +1,457 @@
+/*
+ * Reader of the chunk files written by the archiver, see src/archive.h.
+ * Prints the rows within a time and value range as CSV and skips chunks
+ * whose statistics lie outside of the range without reading their data.
+ * Depends on the C library only, so it can be copied to wherever the
+ * archive ends up.
+ */
+#define _GNU_SOURCE
+#include <argp.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ARCHIVE_MAGIC "PDCHUNK1"
+#define ARCHIVE_TYPE_INT64 1
+#define ARCHIVE_TYPE_DOUBLE 2
+#define ARCHIVE_ENCODING_DELTA 1
+#define ARCHIVE_ENCODING_XOR 2
+
+#define CHUNK_MAX_COLUMNS 16
+
+static char doc[] = "archread -- Print rows of archived chunk files as CSV";
+static char args_doc[] = "CHUNK...";
+static struct argp_option options[] = {
+    {"from",   'f', "TIME",  0, "First timestamp, Unix seconds or 'YYYY-MM-DD[ HH:MM:SS]' in UTC" },
+    {"to",     't', "TIME",  0, "Timestamp to stop before, as --from" },
+    {"min",    'l', "VALUE", 0, "Lowest value" },
+    {"max",    'h', "VALUE", 0, "Highest value" },
+    {"quiet",  'q', 0,       0, "Print the number of chunks read and skipped only" },
+    {0},
+};
+
+struct arguments
+{
+    int64_t from;
+    int64_t to;
+    double min;
+    double max;
+    int quiet;
+    char **files;
+    int count;
+};
+
+static int parseTime(const char *arg, int64_t *time)
+{
+    char *end;
+    long long seconds = strtoll(arg, &end, 10);
+    if(end != arg && *end == '\0')
+    {
+        *time = seconds;
+        return 0;
+    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(arg, "%Y-%m-%d", &tm);
+    if(end && *end == ' ')
+    {
+        end = strptime(end + 1, "%H:%M:%S", &tm);
+    }
+    if(!end || *end != '\0')
+    {
+        return -1;
+    }
+    *time = (int64_t)timegm(&tm);
+    return 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    char *end;
+    switch(key)
+    {
+        case 'f': {
+            if(parseTime(arg, &arguments->from) != 0)
+            {
+                argp_error(state, "invalid time '%s'", arg);
+            }
+            break;
+        }
+        case 't': {
+            if(parseTime(arg, &arguments->to) != 0)
+            {
+                argp_error(state, "invalid time '%s'", arg);
+            }
+            break;
+        }
+        case 'l': {
+            arguments->min = strtod(arg, &end);
+            if(end == arg || *end != '\0')
+            {
+                argp_error(state, "invalid value '%s'", arg);
+            }
+            break;
+        }
+        case 'h': {
+            arguments->max = strtod(arg, &end);
+            if(end == arg || *end != '\0')
+            {
+                argp_error(state, "invalid value '%s'", arg);
+            }
+            break;
+        }
+        case 'q': {
+            arguments->quiet = 1;
+            break;
+        }
+        case ARGP_KEY_ARGS: {
+            arguments->files = state->argv + state->next;
+            arguments->count = state->argc - state->next;
+            break;
+        }
+        case ARGP_KEY_NO_ARGS: {
+            argp_usage(state);
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+typedef struct {
+    char name[64];
+    uint8_t type;
+    uint8_t encoding;
+    uint64_t min;
+    uint64_t max;
+    uint64_t size;
+    uint8_t *data;
+} ChunkColumn;
+
+typedef struct {
+    char table[64];
+    uint64_t rows;
+    uint16_t count;
+    ChunkColumn columns[CHUNK_MAX_COLUMNS];
+} ChunkHeader;
+
+static int readUInt(FILE *file, uint64_t *value, size_t size)
+{
+    uint8_t bytes[8];
+    if(fread(bytes, 1, size, file) != size)
+    {
+        return -1;
+    }
+    *value = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        *value |= (uint64_t)bytes[i] << (8 * i);
+    }
+    return 0;
+}
+
+static int readString(FILE *file, char *string, size_t capacity)
+{
+    uint64_t length;
+    if(readUInt(file, &length, 2) != 0 || length >= capacity
+       || fread(string, 1, length, file) != length)
+    {
+        return -1;
+    }
+    string[length] = '\0';
+    return 0;
+}
+
+static int readHeader(FILE *file, ChunkHeader *header)
+{
+    char magic[8];
+    uint64_t count;
+    if(fread(magic, 1, 8, file) != 8 || memcmp(magic, ARCHIVE_MAGIC, 8) != 0
+       || readString(file, header->table, sizeof(header->table)) != 0
+       || readUInt(file, &header->rows, 8) != 0
+       || readUInt(file, &count, 2) != 0 || count > CHUNK_MAX_COLUMNS)
+    {
+        return -1;
+    }
+    header->count = (uint16_t)count;
+    for(uint16_t i = 0; i < header->count; i++)
+    {
+        ChunkColumn *column = &header->columns[i];
+        uint64_t type, encoding;
+        if(   readString(file, column->name, sizeof(column->name)) != 0
+           || readUInt(file, &type, 1) != 0
+           || readUInt(file, &encoding, 1) != 0
+           || readUInt(file, &column->min, 8) != 0
+           || readUInt(file, &column->max, 8) != 0
+           || readUInt(file, &column->size, 8) != 0)
+        {
+            return -1;
+        }
+        column->type = (uint8_t)type;
+        column->encoding = (uint8_t)encoding;
+        column->data = NULL;
+    }
+    return 0;
+}
+
+static double asDouble(const ChunkColumn *column, uint64_t bits)
+{
+    if(column->type == ARCHIVE_TYPE_DOUBLE)
+    {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    return (double)(int64_t)bits;
+}
+
+static ChunkColumn *findColumn(ChunkHeader *header, const char *name)
+{
+    for(uint16_t i = 0; i < header->count; i++)
+    {
+        if(strcmp(header->columns[i].name, name) == 0)
+        {
+            return &header->columns[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The value column is the one that is neither the id nor the timestamp
+ */
+static ChunkColumn *findValueColumn(ChunkHeader *header)
+{
+    for(uint16_t i = 0; i < header->count; i++)
+    {
+        if(   strcmp(header->columns[i].name, "id") != 0
+           && strcmp(header->columns[i].name, "timestamp") != 0)
+        {
+            return &header->columns[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Decode the next value of a column into its bits, returns -1 on
+ * truncated data
+ */
+typedef struct {
+    const ChunkColumn *column;
+    size_t offset;
+    uint64_t previous;
+} ColumnCursor;
+
+static int nextValue(ColumnCursor *cursor, uint64_t *bits)
+{
+    const ChunkColumn *column = cursor->column;
+    if(column->encoding == ARCHIVE_ENCODING_DELTA)
+    {
+        uint64_t zigzag = 0;
+        for(unsigned shift = 0; ; shift += 7)
+        {
+            if(cursor->offset >= column->size || shift > 63)
+            {
+                return -1;
+            }
+            uint8_t byte = column->data[cursor->offset++];
+            zigzag |= (uint64_t)(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+            {
+                break;
+            }
+        }
+        cursor->previous += (zigzag >> 1) ^ (0 - (zigzag & 1));
+    }
+    else if(column->encoding == ARCHIVE_ENCODING_XOR)
+    {
+        if(cursor->offset >= column->size)
+        {
+            return -1;
+        }
+        uint8_t control = column->data[cursor->offset++];
+        unsigned leading = control >> 4;
+        unsigned trailing = control & 0x0f;
+        if(leading + trailing > 8 || cursor->offset + (8 - leading - trailing) > column->size)
+        {
+            return -1;
+        }
+        uint64_t xor = 0;
+        for(unsigned i = 0; i < 8 - leading - trailing; i++)
+        {
+            xor |= (uint64_t)column->data[cursor->offset++] << (8 * (i + trailing));
+        }
+        cursor->previous ^= xor;
+    }
+    else
+    {
+        return -1;
+    }
+    *bits = cursor->previous;
+    return 0;
+}
+
+
+static int printRows(ChunkHeader *header, ChunkColumn *id, ChunkColumn *timestamp,
+                     ChunkColumn *value, const struct arguments *arguments)
+{
+    ColumnCursor cursors[3] = {{id, 0, 0}, {timestamp, 0, 0}, {value, 0, 0}};
+    for(uint64_t row = 0; row < header->rows; row++)
+    {
+        uint64_t bits[3];
+        for(size_t i = 0; i < 3; i++)
+        {
+            if(nextValue(&cursors[i], &bits[i]) != 0)
+            {
+                return -1;
+            }
+        }
+        int64_t time = (int64_t)bits[1];
+        double number = asDouble(value, bits[2]);
+        if(   time < arguments->from || time >= arguments->to
+           || number < arguments->min || number > arguments->max)
+        {
+            continue;
+        }
+        char date[32];
+        time_t seconds = (time_t)time;
+        struct tm tm;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime_r(&seconds, &tm));
+        if(value->type == ARCHIVE_TYPE_DOUBLE)
+        {
+            printf("%s,%lld,%s,%.17g\n", header->table, (long long)bits[0], date, number);
+        }
+        else
+        {
+            printf("%s,%lld,%s,%lld\n", header->table, (long long)bits[0], date, (long long)bits[2]);
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Returns 1 if the chunk was read, 0 if it was skipped and -1 on error
+ */
+static int readChunk(const char *path, const struct arguments *arguments)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return -1;
+    }
+    int retval = -1;
+    ChunkHeader header;
+    memset(&header, 0, sizeof(header));
+    if(readHeader(file, &header) != 0)
+    {
+        fprintf(stderr, "%s is not a chunk file\n", path);
+        goto cleanup;
+    }
+    ChunkColumn *id = findColumn(&header, "id");
+    ChunkColumn *timestamp = findColumn(&header, "timestamp");
+    ChunkColumn *value = findValueColumn(&header);
+    if(!id || !timestamp || !value)
+    {
+        fprintf(stderr, "%s lacks the id, timestamp or value column\n", path);
+        goto cleanup;
+    }
+
+    /*
+     * Skip the chunk on its statistics alone
+     */
+    if(   (int64_t)timestamp->max < arguments->from || (int64_t)timestamp->min >= arguments->to
+       || asDouble(value, value->max) < arguments->min || asDouble(value, value->min) > arguments->max)
+    {
+        retval = 0;
+        goto cleanup;
+    }
+    retval = 1;
+    if(arguments->quiet)
+    {
+        goto cleanup;
+    }
+
+    for(uint16_t i = 0; i < header.count; i++)
+    {
+        ChunkColumn *column = &header.columns[i];
+        if(column != id && column != timestamp && column != value)
+        {
+            if(fseek(file, (long)column->size, SEEK_CUR) != 0)
+            {
+                retval = -1;
+                break;
+            }
+            continue;
+        }
+        column->data = malloc(column->size ? column->size : 1);
+        if(!column->data || fread(column->data, 1, column->size, file) != column->size)
+        {
+            retval = -1;
+            break;
+        }
+    }
+    if(retval < 0 || printRows(&header, id, timestamp, value, arguments) != 0)
+    {
+        fprintf(stderr, "%s is truncated\n", path);
+        retval = -1;
+    }
+
+cleanup:
+    for(uint16_t i = 0; i < header.count; i++)
+    {
+        free(header.columns[i].data);
+    }
+    fclose(file);
+    return retval;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .from = INT64_MIN,
+        .to = INT64_MAX,
+        .min = -INFINITY,
+        .max = INFINITY,
+        .quiet = 0,
+        .files = NULL,
+        .count = 0,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    int read = 0;
+    int skipped = 0;
+    int failed = 0;
+    for(int i = 0; i < arguments.count; i++)
+    {
+        int retval = readChunk(arguments.files[i], &arguments);
+        if(retval > 0)
+        {
+            read++;
+        }
+        else if(retval == 0)
+        {
+            skipped++;
+        }
+        else
+        {
+            failed++;
+        }
+    }
+    fprintf(stderr, "%d chunks read, %d skipped by statistics, %d failed\n",
+            read, skipped, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
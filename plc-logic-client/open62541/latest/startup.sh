@@ -3,66 +3,76 @@
 # treat undefined variables as an error
 set -u
 
-# if SENSOR_URI is set, then use it instead
+# if SENSOR_URI is set, then use it instead of discovery
 sensor_uri_opt=""
-if [ -n "$SENSOR_URI" ]; then
-  sensor_uri_opt="--sensor-uri="
+if [ -n "${SENSOR_URI:-}" ]; then
+  sensor_uri_opt="--sensor-uri=${SENSOR_URI}"
 fi
 
-# if ACTUATOR_URI is set, then use it instead
+# if ACTUATOR_URI is set, then use it instead of discovery
 act_uri_opt=""
-if [ -n "$ACTUATOR_URI" ]; then
-  act_uri_opt="--actuator-uri="
+if [ -n "${ACTUATOR_URI:-}" ]; then
+  act_uri_opt="--actuator-uri=${ACTUATOR_URI}"
 fi
 
-# create the database if it does not exist yet AND create
-# a lock file to indicate to other containers that the
-# database is ready to use
-DB_NAME="${DB_NAME:-/database/process_database.sqlite3}"
-LOCKFILE="${DB_NAME:-/database/process_database.sqlite3}.lock"
-if [ ! -f "$LOCKFILE" ]; then
-
-# Define the SQL commands for creating the tables
-CREATE_WATERLEVEL_TABLE="
-CREATE TABLE IF NOT EXISTS waterlevel (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
-    level REAL NOT NULL
-);
-"
+# if LDS_URL is set, find the servers not given above at the local
+# discovery server, SENSOR_APP and ACTUATOR_APP select them by their
+# application URI
+lds_opt=""
+if [ -n "${LDS_URL:-}" ]; then
+  lds_opt="--lds=${LDS_URL}"
+fi
+sensor_app_opt=""
+if [ -n "${SENSOR_APP:-}" ]; then
+  sensor_app_opt="--sensor-app=${SENSOR_APP}"
+fi
+act_app_opt=""
+if [ -n "${ACTUATOR_APP:-}" ]; then
+  act_app_opt="--actuator-app=${ACTUATOR_APP}"
+fi
 
-CREATE_VALVEPOSITION_TABLE="
-CREATE TABLE IF NOT EXISTS valveposition (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
-    position INTEGER NOT NULL
-);
-"
+# plc-logic-client creates the database or migrates it on start and then
+# creates ${DB_NAME}.lock for the servers waiting for it
+DB_NAME="${DB_NAME:-/database/process_database.sqlite3}"
 
-CREATE_TRIGGERTHRESHOLD_TABLE="
-CREATE TABLE IF NOT EXISTS triggerthreshold (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
-    threshold INTEGER NOT NULL
-);
-"
+# if METRICS_ADDRESS is set, serve Prometheus metrics on [ADDR:]PORT
+metrics_opt=""
+if [ -n "${METRICS_ADDRESS:-}" ]; then
+  metrics_opt="--metrics=${METRICS_ADDRESS}"
+fi
 
-sqlite3 "$DB_NAME" <<EOF
-$CREATE_WATERLEVEL_TABLE
-$CREATE_VALVEPOSITION_TABLE
-$CREATE_TRIGGERTHRESHOLD_TABLE
-EOF
+# if NET_PROFILE is set, impair the connections to the servers, e.g. for
+# testing the control loop over a wifi or congested link
+net_profile_opt=""
+if [ -n "${NET_PROFILE:-}" ]; then
+  net_profile_opt="--net-profile=${NET_PROFILE}"
+fi
 
-# create the file to indicate to other containers that
-# the database is ready to use
-touch "$LOCKFILE"
+# if TIMESERIES_DIR is set, store the samples in the compressed time-series
+# store in that directory instead of the database
+timeseries_opt=""
+if [ -n "${TIMESERIES_DIR:-}" ]; then
+  timeseries_opt="--timeseries=${TIMESERIES_DIR}"
+fi
 
+# if STORE_FILTER is set, store only the fill level samples needed to
+# reconstruct the history within the given deviation, e.g. 'swing=0.2'
+store_filter_opt=""
+if [ -n "${STORE_FILTER:-}" ]; then
+  store_filter_opt="--store-filter=${STORE_FILTER}"
 fi
 
 # if no ENV is set, the binary is started with defaults
-# the missing space for addresses is on purpose, as the
-# prefix opc.mqtt:// is included in the option variable
 /usr/local/bin/plc-logic-client \
-    "${sensor_uri_opt}${SENSOR_URI}" \
-    "${act_uri_opt}${ACTUATOR_URI}" \
-    --database="${DB_NAME}"
+    $sensor_uri_opt \
+    $act_uri_opt \
+    $lds_opt \
+    $sensor_app_opt \
+    $act_app_opt \
+    --database="${DB_NAME}" \
+    $timeseries_opt \
+    $store_filter_opt \
+    --nodeid-cache="${DB_NAME}.nodeids" \
+    --endpoint-cache="${DB_NAME}.endpoints" \
+    $metrics_opt \
+    $net_profile_opt
@@ -3,12 +3,21 @@
 # treat undefined variables as an error
 set -u
 
-# wait until another process has setup the database
-# including creating the tables
+# wait until plc-logic-client or plc-server has set up the database,
+# woken by inotify when the lock file is created instead of polling. The
+# timeout only matters if the file is created between the check and the
+# start of the watch. The directory is created first, as the watch fails
+# on a missing one, and a watch that fails anyway (exit code 1, 2 is the
+# timeout) falls back to polling every second instead of spinning.
 DB_NAME="${DB_NAME:-/database/process_database.sqlite3}"
-LOCKFILE="${DB_NAME:-/database/process_database.sqlite3}.lock"
+LOCKFILE="${DB_NAME}.lock"
+LOCKDIR="$(dirname "$LOCKFILE")"
+mkdir -p "$LOCKDIR"
 while [ ! -f "$LOCKFILE" ]; do
-  sleep 1
+  inotifywait -qq -t 5 -e create -e moved_to "$LOCKDIR"
+  if [ $? -eq 1 ]; then
+    sleep 1
+  fi
 done
 
 # generate the keys for encryption
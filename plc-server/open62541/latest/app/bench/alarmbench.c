@@ -0,0 +1,484 @@
+/*
+ * Network traffic of an HMI-style client watching the fill level of a
+ * tank against its threshold, in one of three modes:
+ *
+ *   poll       the method at -c is called every interval, e.g.
+ *              tankSystem1/getTankSystemParams of plc-server
+ *   subscribe  the variable at -s is monitored by a subscription publishing
+ *              every interval, e.g. tank1/FillPercentage
+ *   events     the threshold crossings are monitored as events of the
+ *              Server object, filtered on the server to the
+ *              ThresholdCrossingEventType
+ *
+ * The bytes the client sent and received on its connection are read from
+ * the TCP statistics of the socket, so they count the OPC UA messages
+ * without the TCP/IP headers. Run the modes against the same server for
+ * the same time to compare them.
+ *
+ * Usage: alarmbench [-u URL] [-t seconds] [-i ms] -m poll -c PATH
+ *        alarmbench [-u URL] [-t seconds] [-i ms] -m subscribe -s PATH
+ *        alarmbench [-u URL] [-t seconds] -m events
+ */
+#include <argp.h>
+#include <dirent.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/client_subscriptions.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CONNECT_TIMEOUT_MS 10000
+#define CONNECT_RETRY_MS 200
+#define MAX_PATH_ELEMENTS 8
+
+/*
+ * ThresholdCrossingEventType as defined in alarm.c of the servers
+ */
+#define THRESHOLD_EVENT_TYPE_NS 1
+#define THRESHOLD_EVENT_TYPE_ID 5100
+
+typedef enum {
+    MODE_POLL = 0,
+    MODE_SUBSCRIBE,
+    MODE_EVENTS,
+} BenchMode;
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "alarmbench 0.1";
+static char doc[] = "Measures the network traffic of polling, subscribing to and receiving events of a threshold";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"url",       'u', "URL",     0, "Server URL [default: opc.tcp://127.0.0.1:4840]" },
+    {"time",      't', "SECONDS", 0, "Duration of the measurement [default: 60]" },
+    {"interval",  'i', "MS",      0, "Polling or publishing interval [default: 500]" },
+    {"mode",      'm', "MODE",    0, "poll, subscribe or events [default: events]" },
+    {"call",      'c', "PATH",    0, "Method to poll, its parent is the object" },
+    {"subscribe", 's', "PATH",    0, "Variable to subscribe to" },
+    { 0 }
+};
+
+struct arguments
+{
+    char *url;
+    UA_UInt32 time;
+    UA_UInt32 interval;
+    BenchMode mode;
+    char *call;
+    char *subscribe;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'u': {
+            arguments->url = arg;
+            break;
+        }
+        case 't': {
+            arguments->time = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'i': {
+            arguments->interval = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'm': {
+            if(strcmp(arg, "poll") == 0)
+            {
+                arguments->mode = MODE_POLL;
+            }
+            else if(strcmp(arg, "subscribe") == 0)
+            {
+                arguments->mode = MODE_SUBSCRIBE;
+            }
+            else if(strcmp(arg, "events") == 0)
+            {
+                arguments->mode = MODE_EVENTS;
+            }
+            else
+            {
+                argp_error(state, "unknown mode '%s'", arg);
+            }
+            break;
+        }
+        case 'c': {
+            arguments->call = arg;
+            break;
+        }
+        case 's': {
+            arguments->subscribe = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+static UA_UInt64 notifications = 0;
+static UA_UInt64 events = 0;
+
+static void valueChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
+                         UA_UInt32 monId, void *monContext, UA_DataValue *value)
+{
+    notifications++;
+}
+
+static void eventReceived(UA_Client *client, UA_UInt32 subId, void *subContext,
+                          UA_UInt32 monId, void *monContext,
+                          size_t nEventFields, UA_Variant *eventFields)
+{
+    events++;
+    if(nEventFields == 3 && UA_Variant_hasScalarType(&eventFields[1], &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]))
+    {
+        UA_LocalizedText *message = (UA_LocalizedText*)eventFields[1].data;
+        printf("%.*s\n", (int)message->text.length, (char*)message->text.data);
+    }
+}
+
+
+/*
+ * Bytes sent and received on the TCP sockets of the process, which is the
+ * connection of the client only
+ */
+static void readTrafficCounters(UA_UInt64 *sent, UA_UInt64 *received)
+{
+    *sent = 0;
+    *received = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if(!dir)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        int fd = atoi(entry->d_name);
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        if(entry->d_name[0] == '.' || fd == dirfd(dir) ||
+           getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+        {
+            continue;
+        }
+        *sent += info.tcpi_bytes_acked;
+        *received += info.tcpi_bytes_received;
+    }
+    closedir(dir);
+}
+
+
+/*
+ * Resolve a browse path and the path of its parent, which is the Objects
+ * folder for a single element
+ */
+static UA_StatusCode resolvePath(UA_Client *client, const char *path,
+                                 UA_NodeId *nodeId, UA_NodeId *parentId)
+{
+    char names[256];
+    if(strlen(path) >= sizeof(names))
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+    strcpy(names, path);
+
+    UA_RelativePathElement elements[MAX_PATH_ELEMENTS];
+    size_t elementsSize = 0;
+    for(char *name = strtok(names, "/"); name; name = strtok(NULL, "/"))
+    {
+        if(elementsSize == MAX_PATH_ELEMENTS)
+        {
+            return UA_STATUSCODE_BADBROWSENAMEINVALID;
+        }
+        UA_RelativePathElement *element = &elements[elementsSize++];
+        UA_RelativePathElement_init(element);
+        element->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+        element->includeSubtypes = true;
+        element->targetName = UA_QUALIFIEDNAME(1, name);
+    }
+    if(elementsSize == 0)
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+
+    UA_BrowsePath paths[2];
+    for(size_t i = 0; i < 2; i++)
+    {
+        UA_BrowsePath_init(&paths[i]);
+        paths[i].startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        paths[i].relativePath.elements = elements;
+    }
+    paths[0].relativePath.elementsSize = elementsSize;
+    paths[1].relativePath.elementsSize = elementsSize - 1;
+
+    UA_TranslateBrowsePathsToNodeIdsRequest request;
+    UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
+    request.browsePaths = paths;
+    request.browsePathsSize = elementsSize > 1 ? 2 : 1;
+    UA_TranslateBrowsePathsToNodeIdsResponse response =
+        UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != request.browsePathsSize)
+    {
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < response.resultsSize; i++)
+    {
+        if(response.results[i].statusCode != UA_STATUSCODE_GOOD || response.results[i].targetsSize < 1)
+        {
+            retval = UA_STATUSCODE_BADNOTFOUND;
+        }
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        UA_NodeId_copy(&response.results[0].targets[0].targetId.nodeId, nodeId);
+        if(elementsSize > 1)
+        {
+            UA_NodeId_copy(&response.results[1].targets[0].targetId.nodeId, parentId);
+        }
+        else
+        {
+            *parentId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        }
+    }
+    UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    return retval;
+}
+
+
+static UA_StatusCode createSubscription(UA_Client *client, UA_UInt32 interval,
+                                        UA_UInt32 *subscriptionId)
+{
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    request.requestedPublishingInterval = (UA_Double)interval;
+    UA_CreateSubscriptionResponse response =
+        UA_Client_Subscriptions_create(client, request, NULL, NULL, NULL);
+    *subscriptionId = response.subscriptionId;
+    return response.responseHeader.serviceResult;
+}
+
+
+static UA_StatusCode subscribeValue(UA_Client *client, const UA_NodeId *nodeId, UA_UInt32 interval)
+{
+    UA_UInt32 subscriptionId;
+    UA_StatusCode retval = createSubscription(client, interval, &subscriptionId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    UA_MonitoredItemCreateRequest request = UA_MonitoredItemCreateRequest_default(*nodeId);
+    request.requestedParameters.samplingInterval = (UA_Double)interval;
+    UA_MonitoredItemCreateResult result = UA_Client_MonitoredItems_createDataChange(
+        client, subscriptionId, UA_TIMESTAMPSTORETURN_SOURCE, request, NULL, valueChanged, NULL);
+    return result.statusCode;
+}
+
+
+/*
+ * Event monitored item on the Server object, the where clause lets the
+ * server drop all events but the threshold crossings before they are sent
+ */
+static UA_StatusCode subscribeEvents(UA_Client *client, UA_UInt32 interval)
+{
+    UA_UInt32 subscriptionId;
+    UA_StatusCode retval = createSubscription(client, interval, &subscriptionId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    UA_NodeId eventType = UA_NODEID_NUMERIC(THRESHOLD_EVENT_TYPE_NS, THRESHOLD_EVENT_TYPE_ID);
+    UA_QualifiedName fields[3] = {
+        UA_QUALIFIEDNAME(0, "Severity"),
+        UA_QUALIFIEDNAME(0, "Message"),
+        UA_QUALIFIEDNAME(1, "FillPercentage"),
+    };
+    UA_SimpleAttributeOperand select[3];
+    for(size_t i = 0; i < 3; i++)
+    {
+        UA_SimpleAttributeOperand_init(&select[i]);
+        select[i].typeDefinitionId = i < 2 ? UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE) : eventType;
+        select[i].browsePathSize = 1;
+        select[i].browsePath = &fields[i];
+        select[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    UA_LiteralOperand typeOperand;
+    UA_LiteralOperand_init(&typeOperand);
+    UA_Variant_setScalar(&typeOperand.value, &eventType, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_ExtensionObject operand;
+    UA_ExtensionObject_setValue(&operand, &typeOperand, &UA_TYPES[UA_TYPES_LITERALOPERAND]);
+    UA_ContentFilterElement ofType;
+    UA_ContentFilterElement_init(&ofType);
+    ofType.filterOperator = UA_FILTEROPERATOR_OFTYPE;
+    ofType.filterOperandsSize = 1;
+    ofType.filterOperands = &operand;
+
+    UA_EventFilter filter;
+    UA_EventFilter_init(&filter);
+    filter.selectClausesSize = 3;
+    filter.selectClauses = select;
+    filter.whereClause.elementsSize = 1;
+    filter.whereClause.elements = &ofType;
+
+    UA_MonitoredItemCreateRequest request;
+    UA_MonitoredItemCreateRequest_init(&request);
+    request.itemToMonitor.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+    request.itemToMonitor.attributeId = UA_ATTRIBUTEID_EVENTNOTIFIER;
+    request.monitoringMode = UA_MONITORINGMODE_REPORTING;
+    request.requestedParameters.samplingInterval = 0.;
+    request.requestedParameters.queueSize = 16;
+    request.requestedParameters.discardOldest = true;
+    UA_ExtensionObject_setValue(&request.requestedParameters.filter, &filter,
+                                &UA_TYPES[UA_TYPES_EVENTFILTER]);
+
+    UA_MonitoredItemCreateResult result = UA_Client_MonitoredItems_createEvent(
+        client, subscriptionId, UA_TIMESTAMPSTORETURN_BOTH, request, NULL, eventReceived, NULL);
+    retval = result.statusCode;
+    UA_MonitoredItemCreateResult_clear(&result);
+    return retval;
+}
+
+
+static UA_StatusCode connectWithRetry(UA_Client *client, const char *url)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + CONNECT_TIMEOUT_MS * UA_DATETIME_MSEC;
+    UA_StatusCode retval;
+    while((retval = UA_Client_connect(client, url)) != UA_STATUSCODE_GOOD &&
+          UA_DateTime_nowMonotonic() < end)
+    {
+        usleep(CONNECT_RETRY_MS * 1000);
+    }
+    return retval;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .url = "opc.tcp://127.0.0.1:4840",
+        .time = 60,
+        .interval = 500,
+        .mode = MODE_EVENTS,
+        .call = NULL,
+        .subscribe = NULL,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(   (arguments.mode == MODE_POLL && !arguments.call)
+       || (arguments.mode == MODE_SUBSCRIBE && !arguments.subscribe))
+    {
+        fprintf(stderr, "Mode needs a path, use -c for poll or -s for subscribe\n");
+        return EXIT_FAILURE;
+    }
+
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return EXIT_FAILURE;
+    }
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+
+    UA_NodeId nodeId = UA_NODEID_NULL;
+    UA_NodeId objectId = UA_NODEID_NULL;
+
+    UA_StatusCode retval = connectWithRetry(client, arguments.url);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to connect to %s: %s\n", arguments.url, UA_StatusCode_name(retval));
+        goto cleanup;
+    }
+
+    const char *path = arguments.mode == MODE_POLL ? arguments.call : arguments.subscribe;
+    if(arguments.mode != MODE_EVENTS)
+    {
+        retval = resolvePath(client, path, &nodeId, &objectId);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Unable to find %s: %s\n", path, UA_StatusCode_name(retval));
+            goto cleanup;
+        }
+    }
+    if(arguments.mode == MODE_SUBSCRIBE)
+    {
+        retval = subscribeValue(client, &nodeId, arguments.interval);
+    }
+    else if(arguments.mode == MODE_EVENTS)
+    {
+        retval = subscribeEvents(client, arguments.interval);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to subscribe: %s\n", UA_StatusCode_name(retval));
+        goto cleanup;
+    }
+
+    /*
+     * The traffic of connecting and subscribing is not counted
+     */
+    UA_UInt64 sentStart, receivedStart;
+    readTrafficCounters(&sentStart, &receivedStart);
+
+    UA_UInt64 calls = 0;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_DateTime end = start + (UA_DateTime)arguments.time * UA_DATETIME_SEC;
+    UA_DateTime nextCall = start;
+    UA_DateTime now = start;
+    while(retval == UA_STATUSCODE_GOOD && now < end)
+    {
+        if(arguments.mode == MODE_POLL && now >= nextCall)
+        {
+            size_t outputSize = 0;
+            UA_Variant *output = NULL;
+            retval = UA_Client_call(client, objectId, nodeId, 0, NULL, &outputSize, &output);
+            UA_Array_delete(output, outputSize, &UA_TYPES[UA_TYPES_VARIANT]);
+            calls++;
+            nextCall += (UA_DateTime)arguments.interval * UA_DATETIME_MSEC;
+        }
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = UA_Client_run_iterate(client, 10);
+        }
+        now = UA_DateTime_nowMonotonic();
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Measurement stopped: %s\n", UA_StatusCode_name(retval));
+    }
+
+    UA_UInt64 sent, received;
+    readTrafficCounters(&sent, &received);
+    sent -= sentStart;
+    received -= receivedStart;
+    UA_Double seconds = (UA_Double)(now - start) / UA_DATETIME_SEC;
+    printf("%llu calls, %llu notifications, %llu events in %.1f s\n",
+           (unsigned long long)calls, (unsigned long long)notifications,
+           (unsigned long long)events, seconds);
+    printf("%llu bytes sent, %llu bytes received (%.0f bytes/s)\n",
+           (unsigned long long)sent, (unsigned long long)received,
+           seconds > 0. ? (UA_Double)(sent + received) / seconds : 0.);
+
+cleanup:
+    UA_NodeId_clear(&nodeId);
+    UA_NodeId_clear(&objectId);
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+}
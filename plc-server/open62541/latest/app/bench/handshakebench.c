@@ -0,0 +1,366 @@
+/*
+ * Handshake and throughput benchmark for the endpoints of plc-server. For
+ * every security policy and mode offered by the server it measures
+ *
+ *   - opening a SecureChannel (OpenSecureChannel, asymmetric crypto)
+ *   - opening a session on top (CreateSession and ActivateSession)
+ *   - the steady-state rate of getTankSystemParams calls on one session,
+ *     which is what headunit-client does between reconnects
+ *
+ * and reports the call throughput relative to the unencrypted endpoint.
+ * Policies the server does not offer are skipped.
+ *
+ * The client certificate has to be trusted by the server, e.g. by passing
+ * it to plc-server with -t, and its URI has to match --application-uri.
+ *
+ * Usage: handshakebench -c cert.der -k key.der [-n handshakes] [-r calls] [URL]
+ */
+#include <argp.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define POLICY_URI_PREFIX "http://opcfoundation.org/UA/SecurityPolicy#"
+
+typedef struct {
+    const char *name;
+    UA_MessageSecurityMode mode;
+} Endpoint;
+
+static const Endpoint endpoints[] = {
+    {"None", UA_MESSAGESECURITYMODE_NONE},
+    {"Basic128Rsa15", UA_MESSAGESECURITYMODE_SIGN},
+    {"Basic128Rsa15", UA_MESSAGESECURITYMODE_SIGNANDENCRYPT},
+    {"Basic256", UA_MESSAGESECURITYMODE_SIGN},
+    {"Basic256", UA_MESSAGESECURITYMODE_SIGNANDENCRYPT},
+    {"Basic256Sha256", UA_MESSAGESECURITYMODE_SIGN},
+    {"Basic256Sha256", UA_MESSAGESECURITYMODE_SIGNANDENCRYPT},
+    {"Aes128_Sha256_RsaOaep", UA_MESSAGESECURITYMODE_SIGN},
+    {"Aes128_Sha256_RsaOaep", UA_MESSAGESECURITYMODE_SIGNANDENCRYPT},
+    {"Aes256_Sha256_RsaPss", UA_MESSAGESECURITYMODE_SIGN},
+    {"Aes256_Sha256_RsaPss", UA_MESSAGESECURITYMODE_SIGNANDENCRYPT},
+};
+
+typedef struct {
+    UA_Double channelMs;        /* mean time to open a SecureChannel */
+    UA_Double sessionMs;        /* mean time to open a channel and a session */
+    UA_Double callsPerSecond;
+} EndpointResult;
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "handshakebench 0.1";
+static char doc[] = "Measures handshake cost and throughput of the plc-server endpoints";
+static char args_doc[] = "[URL]";
+static struct argp_option options[] = {
+    {"certificate",     'c', "FILE", 0, "Client certificate (DER or PEM)" },
+    {"key",             'k', "FILE", 0, "Client private key (DER or PEM)" },
+    {"application-uri", 'u', "URI",  0, "Application URI in the client certificate" },
+    {"handshakes",      'n', "N",    0, "Handshakes per endpoint [default: 50]" },
+    {"calls",           'r', "N",    0, "Method calls per endpoint [default: 5000]" },
+    { 0 }
+};
+
+struct arguments
+{
+    char *url;
+    char *cert;
+    char *key;
+    char *applicationUri;
+    size_t handshakes;
+    size_t calls;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'c': {
+            arguments->cert = arg;
+            break;
+        }
+        case 'k': {
+            arguments->key = arg;
+            break;
+        }
+        case 'u': {
+            arguments->applicationUri = arg;
+            break;
+        }
+        case 'n': {
+            arguments->handshakes = strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'r': {
+            arguments->calls = strtoul(arg, NULL, 10);
+            break;
+        }
+        case ARGP_KEY_ARG: {
+            arguments->url = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+/*
+ * Mapped for the whole run, every client copies them from the mapping
+ */
+static MappedFile cert;
+static MappedFile key;
+
+
+static UA_Client *newBenchClient(const struct arguments *arguments, const Endpoint *endpoint)
+{
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return NULL;
+    }
+
+    UA_ClientConfig *cc = UA_Client_getConfig(client);
+    UA_StatusCode retval = endpoint->mode == UA_MESSAGESECURITYMODE_NONE ?
+        UA_ClientConfig_setDefault(cc) :
+        UA_ClientConfig_setDefaultEncryption(cc, cert.contents, key.contents, NULL, 0, NULL, 0);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_Client_delete(client);
+        return NULL;
+    }
+
+    char policyUri[128];
+    snprintf(policyUri, sizeof(policyUri), POLICY_URI_PREFIX "%s", endpoint->name);
+    cc->securityMode = endpoint->mode;
+    UA_String_clear(&cc->securityPolicyUri);
+    cc->securityPolicyUri = UA_String_fromChars(policyUri);
+    UA_String_clear(&cc->clientDescription.applicationUri);
+    cc->clientDescription.applicationUri = UA_String_fromChars(arguments->applicationUri);
+    return client;
+}
+
+
+/*
+ * Mean time of a fresh client connecting, either only the SecureChannel
+ * or the SecureChannel and a session
+ */
+static UA_StatusCode measureHandshakes(const struct arguments *arguments, const Endpoint *endpoint,
+                                       UA_Boolean withSession, UA_Double *meanMs)
+{
+    UA_DateTime total = 0;
+    for(size_t i = 0; i < arguments->handshakes; i++)
+    {
+        UA_Client *client = newBenchClient(arguments, endpoint);
+        if(!client)
+        {
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+
+        UA_DateTime start = UA_DateTime_nowMonotonic();
+        UA_StatusCode retval = withSession ?
+            UA_Client_connect(client, arguments->url) :
+            UA_Client_connectSecureChannel(client, arguments->url);
+        total += UA_DateTime_nowMonotonic() - start;
+
+        UA_Client_disconnect(client);
+        UA_Client_delete(client);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            return retval;
+        }
+    }
+    *meanMs = (UA_Double)total / UA_DATETIME_MSEC / (UA_Double)arguments->handshakes;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Node IDs of the tank system object and its getTankSystemParams method
+ */
+static UA_StatusCode resolveMethod(UA_Client *client, UA_NodeId *objectId, UA_NodeId *methodId)
+{
+    UA_RelativePathElement elements[2];
+    for(size_t i = 0; i < 2; i++)
+    {
+        UA_RelativePathElement_init(&elements[i]);
+        elements[i].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+        elements[i].includeSubtypes = true;
+    }
+    elements[0].targetName = UA_QUALIFIEDNAME(1, "tankSystem1");
+    elements[1].targetName = UA_QUALIFIEDNAME(1, "getTankSystemParams");
+
+    UA_BrowsePath paths[2];
+    for(size_t i = 0; i < 2; i++)
+    {
+        UA_BrowsePath_init(&paths[i]);
+        paths[i].startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        paths[i].relativePath.elements = elements;
+        paths[i].relativePath.elementsSize = i + 1;
+    }
+
+    UA_TranslateBrowsePathsToNodeIdsRequest request;
+    UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
+    request.browsePaths = paths;
+    request.browsePathsSize = 2;
+    UA_TranslateBrowsePathsToNodeIdsResponse response =
+        UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != 2)
+    {
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < 2; i++)
+    {
+        if(response.results[i].statusCode != UA_STATUSCODE_GOOD || response.results[i].targetsSize < 1)
+        {
+            retval = UA_STATUSCODE_BADNOTFOUND;
+        }
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        UA_NodeId_copy(&response.results[0].targets[0].targetId.nodeId, objectId);
+        UA_NodeId_copy(&response.results[1].targets[0].targetId.nodeId, methodId);
+    }
+    UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    return retval;
+}
+
+
+static UA_StatusCode measureCalls(const struct arguments *arguments, const Endpoint *endpoint,
+                                  UA_Double *callsPerSecond)
+{
+    UA_Client *client = newBenchClient(arguments, endpoint);
+    if(!client)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    UA_NodeId objectId = UA_NODEID_NULL;
+    UA_NodeId methodId = UA_NODEID_NULL;
+    UA_StatusCode retval = UA_Client_connect(client, arguments->url);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = resolveMethod(client, &objectId, &methodId);
+    }
+
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < arguments->calls; i++)
+    {
+        size_t outputSize = 0;
+        UA_Variant *output = NULL;
+        retval = UA_Client_call(client, objectId, methodId, 0, NULL, &outputSize, &output);
+        UA_Array_delete(output, outputSize, &UA_TYPES[UA_TYPES_VARIANT]);
+    }
+    UA_DateTime elapsed = UA_DateTime_nowMonotonic() - start;
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        *callsPerSecond = (UA_Double)arguments->calls * UA_DATETIME_SEC / (UA_Double)elapsed;
+    }
+
+    UA_NodeId_clear(&objectId);
+    UA_NodeId_clear(&methodId);
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    return retval;
+}
+
+
+static const char *modeName(UA_MessageSecurityMode mode)
+{
+    switch(mode)
+    {
+        case UA_MESSAGESECURITYMODE_NONE: return "None";
+        case UA_MESSAGESECURITYMODE_SIGN: return "Sign";
+        default: return "SignAndEncrypt";
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct arguments arguments = {
+        .url = "opc.tcp://127.0.0.1:4840",
+        .cert = "",
+        .key = "",
+        .applicationUri = "urn:open62541.client.application",
+        .handshakes = 50,
+        .calls = 5000,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(arguments.handshakes == 0 || arguments.calls == 0)
+    {
+        fprintf(stderr, "handshakes and calls must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    UA_Boolean encrypt = mapFile(arguments.cert, &cert) == UA_STATUSCODE_GOOD &&
+                         mapFile(arguments.key, &key) == UA_STATUSCODE_GOOD;
+    if(!encrypt)
+    {
+        fprintf(stderr, "No client certificate and key, only the None endpoint is measured\n");
+    }
+
+    size_t endpointsSize = sizeof(endpoints) / sizeof(endpoints[0]);
+    EndpointResult results[sizeof(endpoints) / sizeof(endpoints[0])];
+    UA_Boolean measured[sizeof(endpoints) / sizeof(endpoints[0])];
+    for(size_t i = 0; i < endpointsSize; i++)
+    {
+        const Endpoint *endpoint = &endpoints[i];
+        measured[i] = false;
+        if(endpoint->mode != UA_MESSAGESECURITYMODE_NONE && !encrypt)
+        {
+            continue;
+        }
+
+        UA_StatusCode retval = measureHandshakes(&arguments, endpoint, false, &results[i].channelMs);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = measureHandshakes(&arguments, endpoint, true, &results[i].sessionMs);
+        }
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = measureCalls(&arguments, endpoint, &results[i].callsPerSecond);
+        }
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "%s/%s skipped: %s\n", endpoint->name, modeName(endpoint->mode),
+                    UA_StatusCode_name(retval));
+            continue;
+        }
+        measured[i] = true;
+    }
+
+    printf("%-22s %-15s %12s %12s %12s %10s\n",
+           "policy", "mode", "channel ms", "session ms", "calls/s", "vs None");
+    for(size_t i = 0; i < endpointsSize; i++)
+    {
+        if(!measured[i])
+        {
+            continue;
+        }
+        printf("%-22s %-15s %12.2f %12.2f %12.0f", endpoints[i].name, modeName(endpoints[i].mode),
+               results[i].channelMs, results[i].sessionMs, results[i].callsPerSecond);
+        if(measured[0])
+        {
+            printf(" %+9.1f%%", 100. * (results[i].callsPerSecond / results[0].callsPerSecond - 1.));
+        }
+        printf("\n");
+    }
+
+    unmapFile(&cert);
+    unmapFile(&key);
+    return measured[0] ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,476 @@
+/*
+ * Round trips and traffic of a client taking snapshots of a tank, the way
+ * clients do it today compared to reading the TankState variable:
+ *
+ *   variables  one Read request per variable FillPercentage, ValvePosition
+ *              and Threshold
+ *   read       one Read request for the three variables
+ *   call       the getTankSystemParams method of the tank
+ *   state      one Read request for the State variable
+ *
+ * Every mode takes the same number of snapshots of the object at -o, e.g.
+ * tankSystem1 of plc-server. Modes that need nodes the object does not
+ * have are skipped, for tank1 of fillsensor-server only state is run.
+ * The encoded size of the responses is calculated from the decoded
+ * messages. The bytes on the connection are read from the TCP statistics
+ * of the socket and include the headers of the secure channel.
+ *
+ * Usage: statebench [-u URL] [-n snapshots] [-o PATH]
+ */
+#include <argp.h>
+#include <dirent.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CONNECT_TIMEOUT_MS 10000
+#define CONNECT_RETRY_MS 200
+#define MAX_PATH_ELEMENTS 8
+#define MAX_PATH_LENGTH 256
+
+typedef enum {
+    MODE_VARIABLES = 0,
+    MODE_READ,
+    MODE_CALL,
+    MODE_STATE,
+    MODES_SIZE,
+} BenchMode;
+
+static const char *modeNames[MODES_SIZE] = {"variables", "read", "call", "state"};
+
+/*
+ * Variables of the snapshot of today's clients, followed by State
+ */
+#define SNAPSHOT_VARIABLES 3
+static const char *variableNames[SNAPSHOT_VARIABLES + 1] = {
+    "FillPercentage", "ValvePosition", "Threshold", "State",
+};
+
+
+/*
+ * Argument parsing
+ */
+const char* argp_program_version = "statebench 0.1";
+static char doc[] = "Compares the round trips and bytes of reading the state of a tank";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"url",       'u', "URL",   0, "Server URL [default: opc.tcp://127.0.0.1:4840]" },
+    {"snapshots", 'n', "COUNT", 0, "Snapshots taken in every mode [default: 1000]" },
+    {"object",    'o', "PATH",  0, "Tank object [default: tankSystem1]" },
+    { 0 }
+};
+
+struct arguments
+{
+    char *url;
+    UA_UInt32 snapshots;
+    char *object;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct arguments *arguments = state->input;
+    switch(key)
+    {
+        case 'u': {
+            arguments->url = arg;
+            break;
+        }
+        case 'n': {
+            arguments->snapshots = (UA_UInt32)strtoul(arg, NULL, 10);
+            break;
+        }
+        case 'o': {
+            arguments->object = arg;
+            break;
+        }
+        default: {
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+/*
+ * Nodes of the tank, NULL if it does not have them
+ */
+typedef struct {
+    UA_NodeId objectId;
+    UA_NodeId variableIds[SNAPSHOT_VARIABLES + 1];
+    UA_NodeId methodId;
+} TankNodes;
+
+/*
+ * Result of a mode over all snapshots
+ */
+typedef struct {
+    UA_UInt64 requests;
+    UA_UInt64 responseBytes;
+    UA_UInt64 sent;
+    UA_UInt64 received;
+    UA_DateTime duration;
+} BenchResult;
+
+
+/*
+ * Bytes sent and received on the TCP sockets of the process, which is the
+ * connection of the client only
+ */
+static void readTrafficCounters(UA_UInt64 *sent, UA_UInt64 *received)
+{
+    *sent = 0;
+    *received = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if(!dir)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        int fd = atoi(entry->d_name);
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        if(entry->d_name[0] == '.' || fd == dirfd(dir) ||
+           getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+        {
+            continue;
+        }
+        *sent += info.tcpi_bytes_acked;
+        *received += info.tcpi_bytes_received;
+    }
+    closedir(dir);
+}
+
+
+/*
+ * Resolve a browse path below the Objects folder
+ */
+static UA_StatusCode resolvePath(UA_Client *client, const char *path, UA_NodeId *nodeId)
+{
+    char names[MAX_PATH_LENGTH];
+    if(strlen(path) >= sizeof(names))
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+    strcpy(names, path);
+
+    UA_RelativePathElement elements[MAX_PATH_ELEMENTS];
+    size_t elementsSize = 0;
+    for(char *name = strtok(names, "/"); name; name = strtok(NULL, "/"))
+    {
+        if(elementsSize == MAX_PATH_ELEMENTS)
+        {
+            return UA_STATUSCODE_BADBROWSENAMEINVALID;
+        }
+        UA_RelativePathElement *element = &elements[elementsSize++];
+        UA_RelativePathElement_init(element);
+        element->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+        element->includeSubtypes = true;
+        element->targetName = UA_QUALIFIEDNAME(1, name);
+    }
+    if(elementsSize == 0)
+    {
+        return UA_STATUSCODE_BADBROWSENAMEINVALID;
+    }
+
+    UA_BrowsePath browsePath;
+    UA_BrowsePath_init(&browsePath);
+    browsePath.startingNode = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    browsePath.relativePath.elements = elements;
+    browsePath.relativePath.elementsSize = elementsSize;
+
+    UA_TranslateBrowsePathsToNodeIdsRequest request;
+    UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
+    request.browsePaths = &browsePath;
+    request.browsePathsSize = 1;
+    UA_TranslateBrowsePathsToNodeIdsResponse response =
+        UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD &&
+       (   response.resultsSize != 1
+        || response.results[0].statusCode != UA_STATUSCODE_GOOD
+        || response.results[0].targetsSize < 1))
+    {
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        UA_NodeId_copy(&response.results[0].targets[0].targetId.nodeId, nodeId);
+    }
+    UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    return retval;
+}
+
+
+/*
+ * Resolve the object and its children, missing children stay NULL
+ */
+static UA_StatusCode resolveTankNodes(UA_Client *client, const char *object, TankNodes *nodes)
+{
+    memset(nodes, 0, sizeof(TankNodes));
+    UA_StatusCode retval = resolvePath(client, object, &nodes->objectId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    char path[MAX_PATH_LENGTH];
+    for(size_t i = 0; i < SNAPSHOT_VARIABLES + 1; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", object, variableNames[i]);
+        resolvePath(client, path, &nodes->variableIds[i]);
+    }
+    snprintf(path, sizeof(path), "%s/getTankSystemParams", object);
+    resolvePath(client, path, &nodes->methodId);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static UA_Boolean hasModeNodes(const TankNodes *nodes, BenchMode mode)
+{
+    switch(mode)
+    {
+        case MODE_VARIABLES:
+        case MODE_READ:
+        {
+            for(size_t i = 0; i < SNAPSHOT_VARIABLES; i++)
+            {
+                if(UA_NodeId_isNull(&nodes->variableIds[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case MODE_CALL:
+        {
+            return !UA_NodeId_isNull(&nodes->methodId);
+        }
+        default:
+        {
+            return !UA_NodeId_isNull(&nodes->variableIds[SNAPSHOT_VARIABLES]);
+        }
+    }
+}
+
+
+/*
+ * One Read request for the values of the nodes, adding the encoded size
+ * of the response
+ */
+static UA_StatusCode readValues(UA_Client *client, const UA_NodeId *nodeIds, size_t nodeIdsSize,
+                                BenchResult *result)
+{
+    UA_ReadValueId items[SNAPSHOT_VARIABLES + 1];
+    for(size_t i = 0; i < nodeIdsSize; i++)
+    {
+        UA_ReadValueId_init(&items[i]);
+        items[i].nodeId = nodeIds[i];
+        items[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_SOURCE;
+    request.nodesToRead = items;
+    request.nodesToReadSize = nodeIdsSize;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < response.resultsSize; i++)
+    {
+        if(response.results[i].hasStatus)
+        {
+            retval = response.results[i].status;
+        }
+    }
+    result->requests++;
+    result->responseBytes += UA_calcSizeBinary(&response, &UA_TYPES[UA_TYPES_READRESPONSE], NULL);
+    UA_ReadResponse_clear(&response);
+    return retval;
+}
+
+
+static UA_StatusCode callMethod(UA_Client *client, const TankNodes *nodes, BenchResult *result)
+{
+    UA_CallMethodRequest item;
+    UA_CallMethodRequest_init(&item);
+    item.objectId = nodes->objectId;
+    item.methodId = nodes->methodId;
+    UA_CallRequest request;
+    UA_CallRequest_init(&request);
+    request.methodsToCall = &item;
+    request.methodsToCallSize = 1;
+
+    UA_CallResponse response = UA_Client_Service_call(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize == 1)
+    {
+        retval = response.results[0].statusCode;
+    }
+    result->requests++;
+    result->responseBytes += UA_calcSizeBinary(&response, &UA_TYPES[UA_TYPES_CALLRESPONSE], NULL);
+    UA_CallResponse_clear(&response);
+    return retval;
+}
+
+
+static UA_StatusCode takeSnapshot(UA_Client *client, const TankNodes *nodes, BenchMode mode,
+                                  BenchResult *result)
+{
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    switch(mode)
+    {
+        case MODE_VARIABLES:
+        {
+            for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < SNAPSHOT_VARIABLES; i++)
+            {
+                retval = readValues(client, &nodes->variableIds[i], 1, result);
+            }
+            break;
+        }
+        case MODE_READ:
+        {
+            retval = readValues(client, nodes->variableIds, SNAPSHOT_VARIABLES, result);
+            break;
+        }
+        case MODE_CALL:
+        {
+            retval = callMethod(client, nodes, result);
+            break;
+        }
+        default:
+        {
+            retval = readValues(client, &nodes->variableIds[SNAPSHOT_VARIABLES], 1, result);
+            break;
+        }
+    }
+    return retval;
+}
+
+
+static UA_StatusCode runMode(UA_Client *client, const TankNodes *nodes, BenchMode mode,
+                             UA_UInt32 snapshots, BenchResult *result)
+{
+    memset(result, 0, sizeof(BenchResult));
+    UA_UInt64 sentStart, receivedStart;
+    readTrafficCounters(&sentStart, &receivedStart);
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    for(UA_UInt32 i = 0; retval == UA_STATUSCODE_GOOD && i < snapshots; i++)
+    {
+        retval = takeSnapshot(client, nodes, mode, result);
+    }
+    result->duration = UA_DateTime_nowMonotonic() - start;
+
+    readTrafficCounters(&result->sent, &result->received);
+    result->sent -= sentStart;
+    result->received -= receivedStart;
+    return retval;
+}
+
+
+static UA_StatusCode connectWithRetry(UA_Client *client, const char *url)
+{
+    UA_DateTime end = UA_DateTime_nowMonotonic() + CONNECT_TIMEOUT_MS * UA_DATETIME_MSEC;
+    UA_StatusCode retval;
+    while((retval = UA_Client_connect(client, url)) != UA_STATUSCODE_GOOD &&
+          UA_DateTime_nowMonotonic() < end)
+    {
+        usleep(CONNECT_RETRY_MS * 1000);
+    }
+    return retval;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct arguments arguments = {
+        .url = "opc.tcp://127.0.0.1:4840",
+        .snapshots = 1000,
+        .object = "tankSystem1",
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if(arguments.snapshots == 0)
+    {
+        fprintf(stderr, "Take at least one snapshot\n");
+        return EXIT_FAILURE;
+    }
+
+    UA_Client *client = UA_Client_new();
+    if(!client)
+    {
+        return EXIT_FAILURE;
+    }
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+
+    TankNodes nodes;
+    memset(&nodes, 0, sizeof(TankNodes));
+
+    UA_StatusCode retval = connectWithRetry(client, arguments.url);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to connect to %s: %s\n", arguments.url, UA_StatusCode_name(retval));
+        goto cleanup;
+    }
+    retval = resolveTankNodes(client, arguments.object, &nodes);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        fprintf(stderr, "Unable to find %s: %s\n", arguments.object, UA_StatusCode_name(retval));
+        goto cleanup;
+    }
+
+    printf("%-10s %9s %14s %14s %14s %11s\n", "mode", "requests", "response B", "sent B",
+           "received B", "latency us");
+    for(int mode = 0; retval == UA_STATUSCODE_GOOD && mode < MODES_SIZE; mode++)
+    {
+        if(!hasModeNodes(&nodes, (BenchMode)mode))
+        {
+            printf("%-10s skipped, %s has no nodes for it\n", modeNames[mode], arguments.object);
+            continue;
+        }
+        BenchResult result;
+        retval = runMode(client, &nodes, (BenchMode)mode, arguments.snapshots, &result);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            fprintf(stderr, "Mode %s stopped: %s\n", modeNames[mode], UA_StatusCode_name(retval));
+            break;
+        }
+
+        /*
+         * All columns are per snapshot
+         */
+        UA_Double snapshots = (UA_Double)arguments.snapshots;
+        printf("%-10s %9.1f %14.1f %14.1f %14.1f %11.1f\n", modeNames[mode],
+               (UA_Double)result.requests / snapshots,
+               (UA_Double)result.responseBytes / snapshots,
+               (UA_Double)result.sent / snapshots,
+               (UA_Double)result.received / snapshots,
+               (UA_Double)result.duration / UA_DATETIME_USEC / snapshots);
+    }
+
+cleanup:
+    UA_NodeId_clear(&nodes.objectId);
+    for(size_t i = 0; i < SNAPSHOT_VARIABLES + 1; i++)
+    {
+        UA_NodeId_clear(&nodes.variableIds[i]);
+    }
+    UA_NodeId_clear(&nodes.methodId);
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+#include <open62541/nodeids.h>
+#include <open62541/plugin/log.h>
+#include <open62541/server.h>
+#include <open62541/types.h>
+#include "alarm.h"
+#include "asynclog.h"
+#include "metrics.h"
+
+
+UA_NodeId thresholdCrossingEventTypeIdent = {1, UA_NODEIDTYPE_NUMERIC, {5100}};
+
+/*
+ * Events of all alarms of the server
+ */
+static Metric *thresholdEvents = NULL;
+
+
+/*
+ * Mandatory property of the event type, instantiated with every event
+ */
+static UA_StatusCode addEventProperty(UA_Server *server, char *name, const UA_DataType *type)
+{
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    attr.dataType = type->typeId;
+    attr.valueRank = UA_VALUERANK_SCALAR;
+    UA_NodeId propertyIdent;
+    UA_StatusCode retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, thresholdCrossingEventTypeIdent,
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY),
+                                                     UA_QUALIFIEDNAME(1, name),
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_PROPERTYTYPE),
+                                                     attr, NULL, &propertyIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node '%s'. Exiting with code %u",
+                    name, retval);
+        return retval;
+    }
+    retval = UA_Server_addReference(server, propertyIdent,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASMODELLINGRULE),
+                                    UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add reference '%s'. Exiting with code %u",
+                    name, retval);
+    }
+    return retval;
+}
+
+
+UA_StatusCode defineThresholdCrossingEventType(UA_Server *server)
+{
+    UA_ObjectTypeAttributes attr = UA_ObjectTypeAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "ThresholdCrossingEventType");
+    attr.description = UA_LOCALIZEDTEXT("en-US", "Fill level crossed the threshold of its tank");
+    UA_StatusCode retval = UA_Server_addObjectTypeNode(server, thresholdCrossingEventTypeIdent,
+                                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE),
+                                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                                       UA_QUALIFIEDNAME(1, "ThresholdCrossingEventType"),
+                                                       attr, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'ThresholdCrossingEventType'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+    thresholdEvents = registerMetric("ThresholdEvents",
+                                     "Threshold crossing events emitted", METRIC_COUNTER);
+
+    retval = addEventProperty(server, "Threshold", &UA_TYPES[UA_TYPES_DOUBLE]);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = addEventProperty(server, "FillPercentage", &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        retval = addEventProperty(server, "Rising", &UA_TYPES[UA_TYPES_BOOLEAN]);
+    }
+    return retval;
+}
+
+
+UA_StatusCode initThresholdAlarm(UA_Server *server, ThresholdAlarm *alarm,
+                                 const UA_NodeId *sourceIdent, char *sourceName,
+                                 UA_Double hysteresis)
+{
+    memset(alarm, 0, sizeof(ThresholdAlarm));
+    alarm->sourceIdent = *sourceIdent;
+    alarm->sourceName = sourceName;
+    alarm->hysteresis = hysteresis;
+
+    /*
+     * Events of the source are also delivered to subscribers of the
+     * Server object
+     */
+    UA_StatusCode retval = UA_Server_writeEventNotifier(server, *sourceIdent,
+                                                        UA_EVENTNOTIFIERTYPE_SUBSCRIBETOEVENTS);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to make '%s' an event notifier", sourceName);
+        return retval;
+    }
+    retval = UA_Server_addReference(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER),
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASNOTIFIER),
+                                    UA_EXPANDEDNODEID_NUMERIC(sourceIdent->namespaceIndex,
+                                                              sourceIdent->identifier.numeric),
+                                    true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add '%s' as notifier of the server", sourceName);
+    }
+    return retval;
+}
+
+
+static void emitThresholdEvent(UA_Server *server, ThresholdAlarm *alarm)
+{
+    UA_NodeId eventIdent;
+    UA_StatusCode retval = UA_Server_createEvent(server, thresholdCrossingEventTypeIdent, &eventIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create threshold event: %s", UA_StatusCode_name(retval));
+        return;
+    }
+
+    char text[128];
+    snprintf(text, sizeof(text), "Fill level %.1f%% %s threshold %.1f%%", alarm->level,
+             alarm->above ? "rose above" : "fell below", alarm->threshold);
+    UA_DateTime time = UA_DateTime_now();
+    UA_UInt16 severity = alarm->above ? ALARM_SEVERITY_RISING : ALARM_SEVERITY_FALLING;
+    UA_LocalizedText message = UA_LOCALIZEDTEXT("en-US", text);
+    UA_String sourceName = UA_STRING(alarm->sourceName);
+
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(0, "Time"),
+                                         &time, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(0, "Severity"),
+                                         &severity, &UA_TYPES[UA_TYPES_UINT16]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(0, "Message"),
+                                         &message, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(0, "SourceName"),
+                                         &sourceName, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(1, "Threshold"),
+                                         &alarm->threshold, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(1, "FillPercentage"),
+                                         &alarm->level, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeObjectProperty_scalar(server, eventIdent, UA_QUALIFIEDNAME(1, "Rising"),
+                                         &alarm->above, &UA_TYPES[UA_TYPES_BOOLEAN]);
+
+    /*
+     * The server sets the SourceNode to the origin and removes the event
+     * node once it is queued for the subscriptions
+     */
+    retval = UA_Server_triggerEvent(server, eventIdent, alarm->sourceIdent, NULL, true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to trigger threshold event: %s", UA_StatusCode_name(retval));
+        return;
+    }
+    addCounter(thresholdEvents, 1);
+}
+
+
+/*
+ * Compare the level with the threshold, emitting an event if it crossed
+ * it since the last evaluation
+ */
+static void evaluateThresholdAlarm(UA_Server *server, ThresholdAlarm *alarm)
+{
+    if(!alarm->hasThreshold || !alarm->hasLevel)
+    {
+        return;
+    }
+    UA_Boolean above = alarm->above
+        ? alarm->level >= alarm->threshold - alarm->hysteresis
+        : alarm->level > alarm->threshold;
+    if(above == alarm->above)
+    {
+        return;
+    }
+    alarm->above = above;
+    emitThresholdEvent(server, alarm);
+}
+
+
+void setAlarmThreshold(UA_Server *server, ThresholdAlarm *alarm, UA_Double threshold)
+{
+    if(!alarm->hasThreshold)
+    {
+        /*
+         * The first threshold only sets the state
+         */
+        alarm->hasThreshold = true;
+        alarm->threshold = threshold;
+        alarm->above = alarm->hasLevel && alarm->level > threshold;
+        return;
+    }
+    alarm->threshold = threshold;
+    evaluateThresholdAlarm(server, alarm);
+}
+
+
+void setAlarmLevel(UA_Server *server, ThresholdAlarm *alarm, UA_Double level)
+{
+    alarm->level = level;
+    if(!alarm->hasLevel)
+    {
+        /*
+         * The first level only sets the state
+         */
+        alarm->hasLevel = true;
+        alarm->above = alarm->hasThreshold && level > alarm->threshold;
+        return;
+    }
+    evaluateThresholdAlarm(server, alarm);
+}
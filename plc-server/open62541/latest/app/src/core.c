@@ -1,24 +1,57 @@
 #include <argp.h>
+#include <math.h>
 #include <open62541/common.h>
 #include <open62541/plugin/log.h>
 #include <open62541/types.h>
 #include <open62541/util.h>
 #include <sqlite3.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <open62541/plugin/create_certificate.h>
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
 #include <open62541/server_config_default.h>
+#include "alarm.h"
+#include "asynclog.h"
+#include "diagnostics.h"
+#include "exporter.h"
+#include "netfault.h"
+#include "schema.h"
+#include "tank_state.h"
 #include "tank_system.h"
+#include "truststore.h"
+#include "tsstore.h"
 #include "utils.h"
 
 
-#define MAX_SIZE_TRUSTLIST 10
-#define MAX_SIZE_ISSUERLIST 10
+#define TRUSTSTORE_CHECK_INTERVAL_MS 1000.0
 
-static size_t trustListSize = 0;
-static size_t issuerListSize = 0;
+/*
+ * Interval of reading the latest values to evaluate the threshold alarm
+ */
+#define ALARM_INTERVAL_MS 500
+#define ALARM_HYSTERESIS 1.0
+
+/*
+ * Limits for clients that reconnect often. A client that reconnects opens
+ * a new session, and the old one is only removed once its timeout has
+ * expired, so the session timeout is capped well below the hour clients
+ * like asyncua request. Long-lived security tokens save the asymmetric
+ * crypto of renewing a SecureChannel.
+ */
+#define MAX_SECURE_CHANNELS 256
+#define MAX_SESSIONS 256
+#define MAX_SESSION_TIMEOUT_MS 120000.0
+#define MAX_SECURITY_TOKEN_LIFETIME_MS 3600000
+
+/*
+ * getAggregates returns the bucket starts and five aggregates per bucket,
+ * for at most a week of minutes
+ */
+#define AGGREGATES_OUTPUTS 6
+#define AGGREGATES_MAX_BUCKETS 10080
 
 /*
  * Signal handling
@@ -41,20 +74,34 @@ static struct argp_option options[] = {
     {"encrypt",     'e', 0,      0, "Enable encryption" },
     {"certificate", 'c', "FILE", 0, "Server certificate" },
     {"key",         'k', "FILE", 0, "Private key" },
-    {"trustlist",   't', "FILE", 0, "Trust list" },
-    {"issuerlist",  'i', "FILE", 0, "Issuer list" },
+    {"trustlist",   't', "FILE", 0, "Trusted certificate" },
+    {"issuerlist",  'i', "FILE", 0, "Issuer certificate" },
+    {"revocationlist", 'r', "FILE", 0, "Certificate revocation list of an issuer" },
+    {"pki",         'p', "DIR",  0, "PKI directory with 'trusted' and 'issuers' certificates and 'crl' revocation lists, reloaded on change" },
     {"database",    'd', "PATH", 0, "Path to the SQLite database" },
+    {"timeseries",  'T', "DIR",  0, "Read the samples from the time-series store in DIR instead of the database" },
+    {"metrics",     'm', "[ADDR:]PORT", 0, "Serve Prometheus metrics over HTTP" },
+    {"alarm-interval",   'a', "MS",  0, "Read the latest values every MS to emit threshold events, 0 on method calls only [default: 500]" },
+    {"alarm-hysteresis", 'H', "PCT", 0, "Fill level below the threshold to end an exceedance [default: 1.0]" },
+    {"tank-systems",     'n', "COUNT", 0, "Number of tank systems, tankSystem1 to tankSystemCOUNT [default: 1]" },
+    {"net-profile",      'N', "PROFILE", 0, "Impair the client connections, e.g. 'wifi' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'" },
     { 0 }
 };
 
 struct arguments
 {
     char *dbname;
+    char *timeseriesdir;
     char *cert;
     char *private;
-    char *trustlist[MAX_SIZE_TRUSTLIST];
-    char *issuerlist[MAX_SIZE_ISSUERLIST];
+    TrustStore *trustStore;
+    char *pki;
     int encrypt;
+    char *metrics;
+    UA_UInt32 alarmInterval;
+    UA_Double alarmHysteresis;
+    UA_UInt32 tankSystems;
+    char *netprofile;
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -68,6 +115,11 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
             arguments->dbname = arg;
             break;
         }
+        case 'T':
+        {
+            arguments->timeseriesdir = arg;
+            break;
+        }
         case 'c':
         {
             arguments->cert = arg;
@@ -83,32 +135,66 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
             arguments->encrypt = 1;
             break;
         }
+        case 'm':
+        {
+            arguments->metrics = arg;
+            break;
+        }
         case 't':
         {
-            if( trustListSize < MAX_SIZE_TRUSTLIST )
-            {
-                arguments->trustlist[trustListSize++] = arg;
-            }
-            else
+            addTrustStoreFile(arguments->trustStore, arg, TRUSTSTORE_TRUSTED);
+            break;
+        }
+        case 'i':
+        {
+            addTrustStoreFile(arguments->trustStore, arg, TRUSTSTORE_ISSUER);
+            break;
+        }
+        case 'r':
+        {
+            addTrustStoreFile(arguments->trustStore, arg, TRUSTSTORE_REVOCATION);
+            break;
+        }
+        case 'p':
+        {
+            arguments->pki = arg;
+            break;
+        }
+        case 'a':
+        {
+            char *end;
+            unsigned long interval = strtoul(arg, &end, 10);
+            if(end == arg || *end != '\0' || *arg == '-' || interval > UINT32_MAX)
             {
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                            "Max number of trustlist entries reached. Ignoring %s",
-                            arg);
+                argp_error(state, "invalid alarm interval '%s'", arg);
             }
+            arguments->alarmInterval = (UA_UInt32)interval;
             break;
         }
-        case 'i':
+        case 'H':
         {
-            if( issuerListSize < MAX_SIZE_ISSUERLIST )
+            char *end;
+            arguments->alarmHysteresis = strtod(arg, &end);
+            if(end == arg || *end != '\0' || !(arguments->alarmHysteresis >= 0.))
             {
-                arguments->issuerlist[issuerListSize++] = arg;
+                argp_error(state, "invalid alarm hysteresis '%s'", arg);
             }
-            else
+            break;
+        }
+        case 'n':
+        {
+            char *end;
+            unsigned long count = strtoul(arg, &end, 10);
+            if(end == arg || *end != '\0' || *arg == '-' || count == 0 || count > UINT32_MAX)
             {
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                            "Max number of issuerlist entries reached. Ignoring %s",
-                            arg);
+                argp_error(state, "invalid number of tank systems '%s'", arg);
             }
+            arguments->tankSystems = (UA_UInt32)count;
+            break;
+        }
+        case 'N':
+        {
+            arguments->netprofile = arg;
             break;
         }
         default:
@@ -121,154 +207,391 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
+
+/*
+ * Create a server, with its connections impaired if a network profile is
+ * given
+ */
+static UA_Server *newServer(const char *netprofile)
+{
+    if(!netprofile)
+    {
+        return UA_Server_new();
+    }
+
+    NetFaultProfile profile;
+    if(parseNetFaultProfile(netprofile, &profile) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Invalid network profile '%s'", netprofile);
+        return NULL;
+    }
+
+    UA_ServerConfig config;
+    memset(&config, 0, sizeof(UA_ServerConfig));
+    config.eventLoop = newFaultyEventLoop(&profile, asyncLog);
+    if(!config.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ServerConfig_setDefault(&config);
+    return UA_Server_newWithConfig(&config);
+}
+
+
+static void trustStoreCallback(UA_Server *server, void *data)
+{
+    processTrustStoreChanges((TrustStore*)data);
+}
+
+
+/*
+ * Has to be applied after the security policies are set up, as setting
+ * them resets the limits to the defaults
+ */
+static void setSessionLimits(UA_ServerConfig *cfg)
+{
+    cfg->maxSecureChannels = MAX_SECURE_CHANNELS;
+    cfg->maxSessions = MAX_SESSIONS;
+    cfg->maxSessionTimeout = MAX_SESSION_TIMEOUT_MS;
+    cfg->maxSecurityTokenLifetime = MAX_SECURITY_TOKEN_LIFETIME_MS;
+}
+
 /*
- * Structure needed to pass objects to callbacks
+ * Latest values of a tank system
  */
 typedef struct {
-    sqlite3 *db;
+    UA_StatusCode status;       /* BADOUTOFRANGE while values are missing */
+    UA_Double fillPct;
+    UA_Boolean valvePos;
+    UA_Int32 threshold;
+    UA_DateTime fillPctTime;
+    UA_DateTime valvePosTime;
+    UA_DateTime thresholdTime;
+} TankValues;
+
+/*
+ * Instance of a tank system, the object context of its node. Its rows in
+ * the database have its key in the column tank_system, so the instances
+ * never update the same rows.
+ */
+typedef struct {
+    UA_UInt32 key;
+    char name[32];
+    UA_NodeId ident;
     UA_NodeId fillPctNodeIdent;
     UA_NodeId valvePosNodeIdent;
     UA_NodeId thresholdNodeIdent;
+    UA_NodeId stateNodeIdent;
+    ThresholdAlarm alarm;
+    UA_StatusCode alarmStatus;  /* of the last periodic refresh */
+} TankSystem;
+
+/*
+ * Structure needed to pass objects to callbacks, shared by the methods of
+ * all tank systems
+ */
+typedef struct {
+    sqlite3 *db;
+    Metric *dbLatency;
+    /*
+     * Set if the samples of tank system 1 are read from the time-series
+     * store, the threshold stays in the database
+     */
+    TimeSeries *waterlevel;
+    TimeSeries *valvePosition;
+    TankSystem *tankSystems;
+    size_t tankSystemsSize;
+    /*
+     * The values of all tank systems are read at once by the first
+     * getTankSystemParams call of a Call request. The further calls of the
+     * request are answered from them, until they are dropped in the next
+     * iteration of the event loop.
+     */
+    TankValues *values;
+    UA_Boolean valuesCached;
 } CallbackContext;
 
 
 /*
- * Callback when getTankSystemParams method is invoked
+ * Time of a column of Unix time in seconds, 0 if it is not known
  */
-static UA_StatusCode getTankSystemParamsCallback(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *methodId, void *methodContext,
-    const UA_NodeId *objectId, void *objectContext,
-    size_t inputSize, const UA_Variant *input,
-    size_t outputSize, UA_Variant *output)
+static UA_DateTime columnTime(sqlite3_stmt *stmt, int column)
 {
-    CallbackContext *context = (CallbackContext*)methodContext;
+    if(sqlite3_column_type(stmt, column) == SQLITE_NULL)
+    {
+        return 0;
+    }
+    return UA_DateTime_fromUnixTime(sqlite3_column_int64(stmt, column));
+}
 
-    /*
-     * Initialize the output array
-     */
-    UA_Variant *nullArray = (UA_Variant*)UA_Array_new(3, &UA_TYPES[UA_TYPES_VARIANT]);
-    for(size_t iter = 0; iter < 3; iter++) UA_Variant_init(&nullArray[iter]);
-    UA_Variant_setArrayCopy(&output[0], nullArray, 3, &UA_TYPES[UA_TYPES_VARIANT]);
-    UA_Array_delete(nullArray, 3, &UA_TYPES[UA_TYPES_VARIANT]);
 
-    if(inputSize != 0)
+/*
+ * Latest fill percentage, valve position and threshold of every tank
+ * system from the state table plc-logic-client maintains along with the
+ * history tables, with a single range lookup on the primary key. The
+ * values of tank system 1 are taken from the time-series store instead,
+ * if it is used, but for its threshold. Missing values are left to the
+ * caller to report. The times have a resolution of one second.
+ */
+static UA_StatusCode readTankStates(CallbackContext *context)
+{
+    for(size_t i = 0; i < context->tankSystemsSize; i++)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                     "Received data with wrong datatype or dimension");
-        return UA_STATUSCODE_BADINVALIDARGUMENT;
+        context->values[i].status = UA_STATUSCODE_BADOUTOFRANGE;
     }
 
-    /*
-     * Prepare statements and execute for FillPercentage
-     */
-    const char *sqlFillPct = "SELECT level FROM waterlevel ORDER BY id DESC LIMIT 1;";
-    sqlite3_stmt *stmtFillPct;
-    if(sqlite3_prepare_v2(context->db, sqlFillPct, -1, &stmtFillPct, NULL) != SQLITE_OK)
+    const char *sql = "SELECT tank_system, level, position, threshold, "
+                      "CAST(strftime('%s', level_timestamp) AS INTEGER), "
+                      "CAST(strftime('%s', position_timestamp) AS INTEGER), "
+                      "CAST(strftime('%s', threshold_timestamp) AS INTEGER) FROM tankstate "
+                      "WHERE tank_system BETWEEN 1 AND ?;";
+    sqlite3_stmt *stmt;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) != SQLITE_OK)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Failed to prepare SQL statement for fill percentage with error: %s",
-                    sqlite3_errmsg(context->db));
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Failed to prepare SQL statement for tank state with error: %s",
+                     sqlite3_errmsg(context->db));
         return UA_STATUSCODE_BADINTERNALERROR;
     }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)context->tankSystemsSize);
 
-    UA_Double fillPct = 0.;
-    if(sqlite3_step(stmtFillPct) == SQLITE_ROW)
+    int rc;
+    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
     {
-        fillPct = sqlite3_column_double(stmtFillPct, 0);
+        TankValues *values = &context->values[sqlite3_column_int64(stmt, 0) - 1];
+        UA_Boolean fromState = values != &context->values[0] || context->waterlevel == NULL;
+        if(   sqlite3_column_type(stmt, 3) == SQLITE_NULL
+           || (fromState && (   sqlite3_column_type(stmt, 1) == SQLITE_NULL
+                             || sqlite3_column_type(stmt, 2) == SQLITE_NULL)))
+        {
+            continue;
+        }
+        if(fromState)
+        {
+            values->fillPct = sqlite3_column_double(stmt, 1);
+            values->valvePos = (sqlite3_column_int(stmt, 2) != 0) ? UA_TRUE : UA_FALSE;
+            values->fillPctTime = columnTime(stmt, 4);
+            values->valvePosTime = columnTime(stmt, 5);
+        }
+        values->threshold = sqlite3_column_int(stmt, 3);
+        values->thresholdTime = columnTime(stmt, 6);
+        values->status = UA_STATUSCODE_GOOD;
     }
-    else
+    recordLatencySince(context->dbLatency, start);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                     "No data found or failed to step fill percentage: %s",
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Failed to step tank state: %s",
                      sqlite3_errmsg(context->db));
-        return UA_STATUSCODE_BADOUTOFRANGE;
-    }
-    sqlite3_finalize(stmtFillPct);
-
-    /*
-     * Prepare statements and execute for ValvePosition
-     */
-    const char *sqlValvePos = "SELECT position FROM valveposition ORDER BY id DESC LIMIT 1;";
-    sqlite3_stmt *stmtValvePos;
-    if(sqlite3_prepare_v2(context->db, sqlValvePos, -1, &stmtValvePos, NULL) != SQLITE_OK)
-    {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Failed to prepare SQL statement for valve position with error: %s",
-                    sqlite3_errmsg(context->db));
         return UA_STATUSCODE_BADINTERNALERROR;
     }
+    return UA_STATUSCODE_GOOD;
+}
+
 
-    UA_Boolean valvePos = UA_FALSE;
-    if(sqlite3_step(stmtValvePos) == SQLITE_ROW)
+/*
+ * Latest fill percentage and valve position of tank system 1 from the
+ * time-series store, read from the segment headers
+ */
+static UA_StatusCode readLatestFromTimeSeries(CallbackContext *context, TankValues *values)
+{
+    UA_Double position = 0.;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    UA_StatusCode retval = readLatestTimeSeries(context->waterlevel, &values->fillPctTime,
+                                                &values->fillPct);
+    if(retval == UA_STATUSCODE_GOOD)
     {
-        valvePos = (sqlite3_column_int(stmtValvePos, 0) != 0) ? UA_TRUE : UA_FALSE;
+        retval = readLatestTimeSeries(context->valvePosition, &values->valvePosTime, &position);
     }
-    else
+    recordLatencySince(context->dbLatency, start);
+    if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                     "No data found or failed to step valve position: %s",
-                     sqlite3_errmsg(context->db));
+        if(retval != UA_STATUSCODE_BADNODATA)
+        {
+            UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                         "Failed to read time series: %s", UA_StatusCode_name(retval));
+        }
         return UA_STATUSCODE_BADOUTOFRANGE;
     }
-    sqlite3_finalize(stmtValvePos);
+    values->valvePos = position != 0.;
+    return UA_STATUSCODE_GOOD;
+}
 
-    /*
-     * Prepare statements and execute for Threshold
-     */
-    const char *sqlThreshold = "SELECT threshold FROM triggerthreshold ORDER BY id DESC LIMIT 1;";
-    sqlite3_stmt *stmtThreshold;
-    if(sqlite3_prepare_v2(context->db, sqlThreshold, -1, &stmtThreshold, NULL) != SQLITE_OK)
+
+/*
+ * Read the latest values of all tank systems
+ */
+static UA_StatusCode readTankValues(CallbackContext *context)
+{
+    UA_StatusCode retval = readTankStates(context);
+    if(retval == UA_STATUSCODE_GOOD && context->waterlevel &&
+       readLatestFromTimeSeries(context, &context->values[0]) != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                     "Failed to prepare SQL statement for threshold with error: %s",
-                     sqlite3_errmsg(context->db));
-        return UA_STATUSCODE_BADINTERNALERROR;
+        context->values[0].status = UA_STATUSCODE_BADOUTOFRANGE;
     }
+    return retval;
+}
 
-    UA_Int32 threshold = 0;
-    if(sqlite3_step(stmtThreshold) == SQLITE_ROW)
+
+static void dropCachedValuesCallback(UA_Server *server, void *data)
+{
+    ((CallbackContext*)data)->valuesCached = false;
+}
+
+
+/*
+ * Values of all tank systems, read once for the operations processed in
+ * the current iteration of the event loop
+ */
+static UA_StatusCode getCachedTankValues(UA_Server *server, CallbackContext *context)
+{
+    if(context->valuesCached)
     {
-        threshold = sqlite3_column_int(stmtThreshold, 0);
+        return UA_STATUSCODE_GOOD;
     }
-    else
+    UA_StatusCode retval = readTankValues(context);
+    if(retval == UA_STATUSCODE_GOOD &&
+       UA_Server_addTimedCallback(server, dropCachedValuesCallback, context,
+                                  UA_DateTime_nowMonotonic(), NULL) == UA_STATUSCODE_GOOD)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                     "No data found or failed to step threshold: %s",
-                     sqlite3_errmsg(context->db));
-        return UA_STATUSCODE_BADOUTOFRANGE;
+        context->valuesCached = true;
     }
-    sqlite3_finalize(stmtThreshold);
+    return retval;
+}
 
-    /*
-     * Write the retrieved values to the server
-     */
+
+/*
+ * Write the values of a tank system to its nodes and evaluate its
+ * threshold alarm with them
+ */
+static void writeTankValues(UA_Server *server, TankSystem *tankSystem, TankValues *values)
+{
     UA_Variant fillPercentageValue;
-    UA_Variant_setScalar(&fillPercentageValue, &fillPct, &UA_TYPES[UA_TYPES_DOUBLE]);
-    UA_Server_writeValue(server, context->fillPctNodeIdent, fillPercentageValue);
+    UA_Variant_setScalar(&fillPercentageValue, &values->fillPct, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, tankSystem->fillPctNodeIdent, fillPercentageValue);
+    recordValueChange(&tankSystem->fillPctNodeIdent);
 
     UA_Variant valvePositionValue;
-    UA_Variant_setScalar(&valvePositionValue, &valvePos, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    UA_Server_writeValue(server, context->valvePosNodeIdent, fillPercentageValue);
+    UA_Variant_setScalar(&valvePositionValue, &values->valvePos, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    UA_Server_writeValue(server, tankSystem->valvePosNodeIdent, valvePositionValue);
+    recordValueChange(&tankSystem->valvePosNodeIdent);
 
     UA_Variant thresholdValue;
-    UA_Variant_setScalar(&thresholdValue, &threshold, &UA_TYPES[UA_TYPES_INT32]);
-    UA_Server_writeValue(server, context->thresholdNodeIdent, thresholdValue);
+    UA_Variant_setScalar(&thresholdValue, &values->threshold, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Server_writeValue(server, tankSystem->thresholdNodeIdent, thresholdValue);
+    recordValueChange(&tankSystem->thresholdNodeIdent);
+
+    TankState state = {
+        .fillPercentage = values->fillPct,
+        .fillPercentageTimestamp = values->fillPctTime,
+        .valvePosition = values->valvePos,
+        .valvePositionTimestamp = values->valvePosTime,
+        .threshold = values->threshold,
+        .thresholdTimestamp = values->thresholdTime,
+    };
+    writeTankState(server, &tankSystem->stateNodeIdent, &state);
+    recordValueChange(&tankSystem->stateNodeIdent);
+
+    setAlarmThreshold(server, &tankSystem->alarm, values->threshold);
+    setAlarmLevel(server, &tankSystem->alarm, values->fillPct);
+}
+
+
+/*
+ * The values are written by plc-logic-client to the database, so they are
+ * read periodically to emit the threshold events without a client calling
+ * getTankSystemParams
+ */
+static void alarmCallback(UA_Server *server, void *data)
+{
+    CallbackContext *context = (CallbackContext*)data;
+    if(readTankValues(context) != UA_STATUSCODE_GOOD)
+    {
+        context->valuesCached = false;
+        return;
+    }
+    for(size_t i = 0; i < context->tankSystemsSize; i++)
+    {
+        TankSystem *tankSystem = &context->tankSystems[i];
+        TankValues *values = &context->values[i];
+        if(values->status == UA_STATUSCODE_GOOD)
+        {
+            writeTankValues(server, tankSystem, values);
+        }
+        else if(tankSystem->alarmStatus == UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "No values of '%s' to evaluate the threshold alarm yet",
+                        tankSystem->name);
+        }
+        tankSystem->alarmStatus = values->status;
+    }
+}
+
+
+/*
+ * Callback when getTankSystemParams method is invoked on a tank system
+ */
+static UA_StatusCode getTankSystemParamsCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    CallbackContext *context = (CallbackContext*)methodContext;
+    TankSystem *tankSystem = (TankSystem*)objectContext;
+
+    /*
+     * Initialize the output array
+     */
+    UA_Variant *nullArray = (UA_Variant*)UA_Array_new(3, &UA_TYPES[UA_TYPES_VARIANT]);
+    for(size_t iter = 0; iter < 3; iter++) UA_Variant_init(&nullArray[iter]);
+    UA_Variant_setArrayCopy(&output[0], nullArray, 3, &UA_TYPES[UA_TYPES_VARIANT]);
+    UA_Array_delete(nullArray, 3, &UA_TYPES[UA_TYPES_VARIANT]);
+
+    if(inputSize != 0 || !tankSystem)
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Received data with wrong datatype or dimension");
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+
+    /*
+     * Latest fill percentage, valve position and threshold, also written
+     * to the server
+     */
+    UA_StatusCode retval = getCachedTankValues(server, context);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    TankValues *values = &context->values[tankSystem->key - 1];
+    if(values->status != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "No data found for '%s'", tankSystem->name);
+        return values->status;
+    }
+    writeTankValues(server, tankSystem, values);
 
     /*
      * Return the retrieved values to client
      */
-    UA_Variant_setScalarCopy(&output[0], &fillPct, &UA_TYPES[UA_TYPES_DOUBLE]);
-    UA_Variant_setScalarCopy(&output[1], &valvePos, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    UA_Variant_setScalarCopy(&output[2], &threshold, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Variant_setScalarCopy(&output[0], &values->fillPct, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Variant_setScalarCopy(&output[1], &values->valvePos, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    UA_Variant_setScalarCopy(&output[2], &values->threshold, &UA_TYPES[UA_TYPES_INT32]);
 
     return UA_STATUSCODE_GOOD;
 }
 
 
 /*
- * Callback when setThreshold method is invoked
+ * Callback when setThreshold method is invoked on a tank system
  */
 static UA_StatusCode setThresholdCallback(
     UA_Server *server,
@@ -282,9 +605,11 @@ static UA_StatusCode setThresholdCallback(
      * Input validation
      */
     CallbackContext *context = (CallbackContext*)methodContext;
-    if(inputSize != 1 || !UA_Variant_hasScalarType(input, &UA_TYPES[UA_TYPES_INT32]))
+    TankSystem *tankSystem = (TankSystem*)objectContext;
+    if(   inputSize != 1 || !UA_Variant_hasScalarType(input, &UA_TYPES[UA_TYPES_INT32])
+       || !tankSystem)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
                      "Received data with wrong datatype or dimension");
         return UA_STATUSCODE_BADINVALIDARGUMENT;
     }
@@ -294,28 +619,32 @@ static UA_StatusCode setThresholdCallback(
     /*
      * Prepare statements and execute for Threshold
      */
-    const char *sql = "INSERT INTO triggerthreshold (threshold) VALUES (?)";
+    const char *sql = "INSERT INTO triggerthreshold (tank_system, threshold) VALUES (?, ?)";
     sqlite3_stmt *stmt;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
     if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) != SQLITE_OK)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Failed to prepare SQL statement with error: %s",
                     sqlite3_errmsg(context->db));
         return UA_STATUSCODE_BADINTERNALERROR;
     }
 
-    if(sqlite3_bind_int(stmt, 1, newThreshold) != SQLITE_OK)
+    if(   sqlite3_bind_int64(stmt, 1, tankSystem->key) != SQLITE_OK
+       || sqlite3_bind_int(stmt, 2, newThreshold) != SQLITE_OK)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
                      "Failed to bind value with error: %s",
                      sqlite3_errmsg(context->db));
         sqlite3_finalize(stmt);
         return UA_STATUSCODE_BADINTERNALERROR;
     }
 
-    if(sqlite3_step(stmt) != SQLITE_DONE)
+    int rc = sqlite3_step(stmt);
+    recordLatencySince(context->dbLatency, start);
+    if(rc != SQLITE_DONE)
     {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
                      "Could not write threshold to database with error: %s",
                      sqlite3_errmsg(context->db));
         sqlite3_finalize(stmt);
@@ -323,223 +652,245 @@ static UA_StatusCode setThresholdCallback(
     }
     sqlite3_finalize(stmt);
 
+    /*
+     * Calls later in the same request read the new threshold
+     */
+    context->valuesCached = false;
+
     /*
      * Write the new value to the server
      */
     UA_Variant newThresholdValue;
     UA_Variant_setScalar(&newThresholdValue, &newThreshold, &UA_TYPES[UA_TYPES_INT32]);
-    UA_Server_writeValue(server, context->thresholdNodeIdent, newThresholdValue);
+    UA_Server_writeValue(server, tankSystem->thresholdNodeIdent, newThresholdValue);
+    recordValueChange(&tankSystem->thresholdNodeIdent);
+    setAlarmThreshold(server, &tankSystem->alarm, newThreshold);
 
     return UA_STATUSCODE_GOOD;
 }
 
 
-int main(int argc, char *argv[])
+/*
+ * Callback when getAggregates method is invoked. The aggregates per minute
+ * or hour are read from the rollups plc-logic-client maintains while
+ * storing the samples, one row per bucket. Buckets without a sample of
+ * their own have no minimum, maximum and average (NaN).
+ */
+static UA_StatusCode getAggregatesCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
 {
-    signal(SIGINT, stopHandler);
-    signal(SIGTERM, stopHandler);
-
     /*
-     * Default arguments
+     * Input validation
      */
-    struct arguments arguments = {
-        .dbname = "/db.sqlite3",
-        .cert = "",
-        .private = "",
-        .trustlist = {""},
-        .issuerlist = {""},
-        .encrypt = false,
-    };
-    argp_parse(&argp, argc, argv, 0, 0, &arguments);
-
+    CallbackContext *context = (CallbackContext*)methodContext;
+    if(   inputSize != 3 || outputSize != AGGREGATES_OUTPUTS
+       || !UA_Variant_hasScalarType(&input[0], &UA_TYPES[UA_TYPES_UINT32])
+       || !UA_Variant_hasScalarType(&input[1], &UA_TYPES[UA_TYPES_DATETIME])
+       || !UA_Variant_hasScalarType(&input[2], &UA_TYPES[UA_TYPES_DATETIME]))
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Received data with wrong datatype or dimension");
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
 
-    UA_StatusCode retval = UA_STATUSCODE_GOOD;
-    UA_ByteString cert = UA_BYTESTRING_NULL;
-    UA_ByteString privateKey = UA_BYTESTRING_NULL;
+    UA_UInt32 resolution = *(UA_UInt32*)input[0].data;
+    UA_DateTime startTime = *(UA_DateTime*)input[1].data;
+    UA_DateTime endTime = *(UA_DateTime*)input[2].data;
+    const char *table = resolution == 60 ? "rollup_minute" : resolution == 3600 ? "rollup_hour" : NULL;
+    if(!table || endTime <= startTime)
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Aggregates need a resolution of 60 or 3600 s and a start before the end");
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+    size_t capacity = (size_t)((endTime - startTime) / (resolution * UA_DATETIME_SEC)) + 2;
+    if(capacity > AGGREGATES_MAX_BUCKETS)
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Aggregates requested for more than %d buckets", AGGREGATES_MAX_BUCKETS);
+        return UA_STATUSCODE_BADTOOMANYOPERATIONS;
+    }
 
     /*
-     * Open the database
+     * Bucket starts and the aggregates of the columns of the query
      */
-    sqlite3 *db;
-    if(sqlite3_open(arguments.dbname, &db))
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_DateTime *buckets = (UA_DateTime*)UA_Array_new(capacity, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Double *aggregates[AGGREGATES_OUTPUTS - 1];
+    for(size_t i = 0; i < AGGREGATES_OUTPUTS - 1; i++)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to open database");
-        retval = UA_STATUSCODE_BAD;
-        goto cleanup;
+        aggregates[i] = (UA_Double*)UA_Array_new(capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+        if(!aggregates[i])
+        {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        }
     }
-    /*
-     * Create and setup server
-     */
-    UA_Server *server = UA_Server_new();
-    if(!server)
+    if(!buckets)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to create plc server");
-        retval = UA_STATUSCODE_BAD;
-        goto cleanup_db;
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
     }
-
-    UA_ServerConfig *cfg = UA_Server_getConfig(server);
-    retval = UA_ServerConfig_setDefault(cfg);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to create server config");
-        goto cleanup_server;
+        goto cleanup;
     }
 
-    /*
-     * Set up config for encryption
-     */
-    if(arguments.encrypt)
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+             "SELECT bucket, min, max, sum / samples, weighted / covered, "
+             "100. * valve_open / covered FROM %s "
+             "WHERE bucket >= ? AND bucket < ? ORDER BY bucket LIMIT ?;", table);
+    sqlite3_stmt *stmt;
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+    if(sqlite3_prepare_v2(context->db, sql, -1, &stmt, NULL) != SQLITE_OK)
     {
-        if( (strlen(arguments.cert) == 0) || (strlen(arguments.private) == 0) )
-        {
-            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                        "Certificate and/or key missing");
-            goto cleanup_server;
-        }
-
-        cert = loadFile(arguments.cert);
-        if(!cert.length)
-        {
-            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                        "Certificate is empty");
-            goto cleanup_server;
-        }
-
-        privateKey = loadFile(arguments.private);
-        if(!privateKey.length)
-        {
-            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                        "Private key is empty");
-            goto cleanup_server;
-        }
-
-        /*
-         * Omitting checks for validity of these list entries for now
-         * due to them not being relevant right now
-         */
-        UA_STACKARRAY(UA_ByteString, trustList, trustListSize);
-        for(size_t idx = 0; idx < trustListSize; idx++)
-        {
-            trustList[idx] = loadFile(arguments.trustlist[idx]);
-        }
-
-        UA_STACKARRAY(UA_ByteString, issuerList, issuerListSize);
-        for(size_t idx = 0; idx < issuerListSize; idx++)
-        {
-            issuerList[idx] = loadFile(arguments.issuerlist[idx]);
-        }
-
-        /*
-         * Check for success happens later after deleting the other variables
-         */
-        retval = UA_ServerConfig_setDefaultWithSecurityPolicies(
-            cfg, 4840, &cert, &privateKey,
-            trustList, trustListSize,
-            issuerList, issuerListSize,
-            NULL, 0);
-
-        UA_ByteString_clear(&cert);
-        UA_ByteString_clear(&privateKey);
-
-        for(size_t idx = 0; idx < trustListSize; idx++)
-        {
-            UA_ByteString_clear(&trustList[idx]);
-        }
-
-        for(size_t idx = 0; idx < issuerListSize; idx++)
-        {
-            UA_ByteString_clear(&issuerList[idx]);
-        }
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Failed to prepare SQL statement for aggregates with error: %s",
+                     sqlite3_errmsg(context->db));
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+        goto cleanup;
+    }
 
-        /*
-         * Check for success now
-         */
-        if(retval != UA_STATUSCODE_GOOD)
+    sqlite3_int64 first = (startTime - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC;
+    sqlite3_bind_int64(stmt, 1, first - first % resolution);
+    sqlite3_bind_int64(stmt, 2, (endTime - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)capacity);
+    size_t rows = 0;
+    int rc;
+    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        buckets[rows] = sqlite3_column_int64(stmt, 0) * UA_DATETIME_SEC + UA_DATETIME_UNIX_EPOCH;
+        for(int i = 0; i < AGGREGATES_OUTPUTS - 1; i++)
         {
-            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                        "Setting encryption configuration failed: %s",
-                        UA_StatusCode_name(retval));
-            goto cleanup_server;
+            aggregates[i][rows] = sqlite3_column_type(stmt, i + 1) == SQLITE_NULL
+                ? NAN : sqlite3_column_double(stmt, i + 1);
         }
+        rows++;
+    }
+    recordLatencySince(context->dbLatency, start);
+    if(rc != SQLITE_DONE)
+    {
+        UA_LOG_ERROR(asyncLog, UA_LOGCATEGORY_USERLAND,
+                     "Failed to read aggregates with error: %s",
+                     sqlite3_errmsg(context->db));
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+    }
+    sqlite3_finalize(stmt);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        goto cleanup;
     }
 
     /*
-     * Prepare the system instance on the server with initial values
+     * The outputs take over the arrays
      */
-    UA_QualifiedName qn;
-    UA_NodeId tankSystem1Ident;
-    retval = defineTankSystemObjectType(server);
-    if(retval != UA_STATUSCODE_GOOD)
+    UA_Variant_setArray(&output[0], buckets, rows, &UA_TYPES[UA_TYPES_DATETIME]);
+    for(size_t i = 0; i < AGGREGATES_OUTPUTS - 1; i++)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to define tank system object type");
-        goto cleanup_server;
+        UA_Variant_setArray(&output[i + 1], aggregates[i], rows, &UA_TYPES[UA_TYPES_DOUBLE]);
     }
+    return UA_STATUSCODE_GOOD;
 
-    retval = addTankSystemObjectInstance(server, "tankSystem1", &tankSystem1Ident);
+cleanup:
+    UA_Array_delete(buckets, capacity, &UA_TYPES[UA_TYPES_DATETIME]);
+    for(size_t i = 0; i < AGGREGATES_OUTPUTS - 1; i++)
+    {
+        UA_Array_delete(aggregates[i], capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+    return retval;
+}
+
+
+/*
+ * Add tank system instance 'key' with initial values and its threshold
+ * alarm. The instance is the object context of its node.
+ */
+static UA_StatusCode addTankSystem(UA_Server *server, TankSystem *tankSystem, UA_UInt32 key,
+                                   UA_Double hysteresis)
+{
+    tankSystem->key = key;
+    tankSystem->alarmStatus = UA_STATUSCODE_GOOD;
+    snprintf(tankSystem->name, sizeof(tankSystem->name), "tankSystem%u", key);
+    UA_StatusCode retval = addTankSystemObjectInstance(server, tankSystem->name, &tankSystem->ident);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add tank system instance to server");
-        goto cleanup_server;
+        return retval;
     }
+    UA_Server_setNodeContext(server, tankSystem->ident, tankSystem);
 
-    qn = UA_QUALIFIEDNAME(1, "FillPercentage");
-    UA_NodeId fillPercentageNode;
-    retval = findAttributeNodeId(server, &tankSystem1Ident, &qn, &fillPercentageNode);
+    UA_QualifiedName qn = UA_QUALIFIEDNAME(1, "FillPercentage");
+    retval = findAttributeNodeId(server, &tankSystem->ident, &qn, &tankSystem->fillPctNodeIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'FillPercentage'");
-        goto cleanup_server;
+        return retval;
     }
     UA_Double fillPercentage = 0.;
     UA_Variant fillPercentageValue;
     UA_Variant_setScalar(&fillPercentageValue, &fillPercentage, &UA_TYPES[UA_TYPES_DOUBLE]);
-    UA_Server_writeValue(server, fillPercentageNode, fillPercentageValue);
+    UA_Server_writeValue(server, tankSystem->fillPctNodeIdent, fillPercentageValue);
 
     qn = UA_QUALIFIEDNAME(1, "ValvePosition");
-    UA_NodeId valvePositionNode;
-    retval = findAttributeNodeId(server, &tankSystem1Ident, &qn, &valvePositionNode);
+    retval = findAttributeNodeId(server, &tankSystem->ident, &qn, &tankSystem->valvePosNodeIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'ValvePosition'");
-        goto cleanup_server;
+        return retval;
     }
     UA_Boolean valvePosition = false;
     UA_Variant valvePositionValue;
     UA_Variant_setScalar(&valvePositionValue, &valvePosition, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    UA_Server_writeValue(server, valvePositionNode, valvePositionValue);
+    UA_Server_writeValue(server, tankSystem->valvePosNodeIdent, valvePositionValue);
 
     qn = UA_QUALIFIEDNAME(1, "Threshold");
-    UA_NodeId thresholdNode;
-    retval = findAttributeNodeId(server, &tankSystem1Ident, &qn, &thresholdNode);
+    retval = findAttributeNodeId(server, &tankSystem->ident, &qn, &tankSystem->thresholdNodeIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to find attribute 'Threshold'");
-        goto cleanup_server;
+        return retval;
     }
     UA_Int32 threshold = 0;
     UA_Variant thresholdValue;
     UA_Variant_setScalar(&thresholdValue, &threshold, &UA_TYPES[UA_TYPES_INT32]);
-    UA_Server_writeValue(server, thresholdNode, thresholdValue);
+    UA_Server_writeValue(server, tankSystem->thresholdNodeIdent, thresholdValue);
+
+    qn = UA_QUALIFIEDNAME(1, "State");
+    retval = findAttributeNodeId(server, &tankSystem->ident, &qn, &tankSystem->stateNodeIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'State'");
+        return retval;
+    }
+    TankState state;
+    memset(&state, 0, sizeof(TankState));
+    writeTankState(server, &tankSystem->stateNodeIdent, &state);
 
     /*
-     * Create methods
+     * Crossings of the threshold are emitted as events of the tank system
      */
-    CallbackContext context = {
-        .db = db,
-        .fillPctNodeIdent = fillPercentageNode,
-        .valvePosNodeIdent = valvePositionNode,
-        .thresholdNodeIdent = thresholdNode,
-    };
+    return initThresholdAlarm(server, &tankSystem->alarm, &tankSystem->ident, tankSystem->name,
+                              hysteresis);
+}
+
 
+/*
+ * Add the methods to a tank system instance, getAggregates only if given
+ */
+static UA_StatusCode addTankSystemMethods(UA_Server *server, const UA_NodeId *tankSystemIdent,
+                                          InstrumentedMethod *getTankSystemParams,
+                                          InstrumentedMethod *setThreshold,
+                                          InstrumentedMethod *getAggregates)
+{
     // getTankSystemParams method
     UA_Argument outputArgument[3];
 
@@ -568,22 +919,22 @@ int main(int argc, char *argv[])
     mAttrGet.userExecutable = true;
 
 
-    retval = UA_Server_addMethodNode(
+    UA_StatusCode retval = UA_Server_addMethodNode(
         server,
         UA_NODEID_NULL,
-        tankSystem1Ident,
+        *tankSystemIdent,
         UA_NS0ID(HASCOMPONENT),
         UA_QUALIFIEDNAME(1, "getTankSystemParams"),
         mAttrGet,
-        &getTankSystemParamsCallback,
+        &instrumentedMethodCallback,
         0, NULL,
         3, outputArgument,
-        &context, NULL);
+        getTankSystemParams, NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add method 'getTankSystemParams'");
-        goto cleanup_server;
+        return retval;
     }
 
     // setThreshold method
@@ -604,33 +955,391 @@ int main(int argc, char *argv[])
     retval = UA_Server_addMethodNode(
         server,
         UA_NODEID_NULL,
-        tankSystem1Ident,
+        *tankSystemIdent,
         UA_NS0ID(HASCOMPONENT),
         UA_QUALIFIEDNAME(1, "setThreshold"),
         mAttrSet,
-        &setThresholdCallback,
+        &instrumentedMethodCallback,
         1, inputArgument,
         0, NULL,
-        &context, NULL);
+        setThreshold, NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add method 'setThreshold'");
+        return retval;
+    }
+
+    // getAggregates method, the rollups are kept for tank system 1 only
+    if(!getAggregates)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_Argument aggregatesInput[3];
+    const char *aggregatesInputNames[] = {"Resolution", "StartTime", "EndTime"};
+    const char *aggregatesInputDescriptions[] = {
+        "Bucket width in seconds, 60 or 3600",
+        "Start of the first bucket returned",
+        "End of the range, exclusive",
+    };
+    UA_UInt32 aggregatesInputTypes[] = {UA_TYPES_UINT32, UA_TYPES_DATETIME, UA_TYPES_DATETIME};
+    for(size_t i = 0; i < 3; i++)
+    {
+        UA_Argument_init(&aggregatesInput[i]);
+        aggregatesInput[i].description = UA_LOCALIZEDTEXT("en-US", (char*)aggregatesInputDescriptions[i]);
+        aggregatesInput[i].name = UA_STRING((char*)aggregatesInputNames[i]);
+        aggregatesInput[i].dataType = UA_TYPES[aggregatesInputTypes[i]].typeId;
+        aggregatesInput[i].valueRank = UA_VALUERANK_SCALAR;
+    }
+
+    UA_Argument aggregatesOutput[AGGREGATES_OUTPUTS];
+    const char *aggregatesOutputNames[] = {
+        "BucketStart", "Minimum", "Maximum", "Average", "TimeAverage", "ValveOpenPercent",
+    };
+    const char *aggregatesOutputDescriptions[] = {
+        "Start of every bucket with data",
+        "Minimum fill percentage",
+        "Maximum fill percentage",
+        "Average of the fill percentage samples",
+        "Time-weighted average of the fill percentage",
+        "Share of the covered time the valve was open in percent",
+    };
+    for(size_t i = 0; i < AGGREGATES_OUTPUTS; i++)
+    {
+        UA_Argument_init(&aggregatesOutput[i]);
+        aggregatesOutput[i].description = UA_LOCALIZEDTEXT("en-US", (char*)aggregatesOutputDescriptions[i]);
+        aggregatesOutput[i].name = UA_STRING((char*)aggregatesOutputNames[i]);
+        aggregatesOutput[i].dataType = UA_TYPES[i == 0 ? UA_TYPES_DATETIME : UA_TYPES_DOUBLE].typeId;
+        aggregatesOutput[i].valueRank = UA_VALUERANK_ONE_DIMENSION;
+    }
+
+    UA_MethodAttributes mAttrAggregates = UA_MethodAttributes_default;
+    mAttrAggregates.description = UA_LOCALIZEDTEXT("en-US", "Get fill level and valve aggregates per minute or hour");
+    mAttrAggregates.displayName = UA_LOCALIZEDTEXT("en-US", "getAggregates");
+    mAttrAggregates.executable = true;
+    mAttrAggregates.userExecutable = true;
+
+    retval = UA_Server_addMethodNode(
+        server,
+        UA_NODEID_NULL,
+        *tankSystemIdent,
+        UA_NS0ID(HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, "getAggregates"),
+        mAttrAggregates,
+        &instrumentedMethodCallback,
+        3, aggregatesInput,
+        AGGREGATES_OUTPUTS, aggregatesOutput,
+        getAggregates, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add method 'getAggregates'");
+    }
+    return retval;
+}
+
+
+int main(int argc, char *argv[])
+{
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    /*
+     * Default arguments
+     */
+    TrustStore trustStore;
+    initTrustStore(&trustStore);
+    struct arguments arguments = {
+        .dbname = "/db.sqlite3",
+        .timeseriesdir = NULL,
+        .cert = "",
+        .private = "",
+        .trustStore = &trustStore,
+        .pki = NULL,
+        .encrypt = false,
+        .metrics = NULL,
+        .alarmInterval = ALARM_INTERVAL_MS,
+        .alarmHysteresis = ALARM_HYSTERESIS,
+        .tankSystems = 1,
+        .netprofile = NULL,
+    };
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    MappedFile cert = {UA_BYTESTRING_NULL, false};
+    MappedFile privateKey = {UA_BYTESTRING_NULL, false};
+    TankSystem *tankSystems = NULL;
+    TankValues *tankValues = NULL;
+
+    /*
+     * Open the database
+     */
+    sqlite3 *db;
+    if(sqlite3_open(arguments.dbname, &db))
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to open database");
+        retval = UA_STATUSCODE_BAD;
+        goto cleanup;
+    }
+
+    /*
+     * The samples may be kept in the time-series store of plc-logic-client
+     * instead, which is read without locking
+     */
+    TimeSeries waterlevelSeries;
+    TimeSeries valvePositionSeries;
+    memset(&waterlevelSeries, 0, sizeof(TimeSeries));
+    memset(&valvePositionSeries, 0, sizeof(TimeSeries));
+    if(arguments.timeseriesdir &&
+       (   openTimeSeries(&waterlevelSeries, arguments.timeseriesdir, "waterlevel", false) != UA_STATUSCODE_GOOD
+        || openTimeSeries(&valvePositionSeries, arguments.timeseriesdir, "valveposition", false) != UA_STATUSCODE_GOOD))
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to open time series in %s", arguments.timeseriesdir);
+        retval = UA_STATUSCODE_BAD;
+        goto cleanup_timeseries;
+    }
+
+    /*
+     * Create or migrate the tables, whichever of plc-server and
+     * plc-logic-client starts first
+     */
+    retval = initProcessSchema(db);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to initialize the database");
+        goto cleanup_timeseries;
+    }
+    signalDatabaseReady(arguments.dbname);
+
+    /*
+     * Create and setup server
+     */
+    UA_Server *server = newServer(arguments.netprofile);
+    if(!server)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to create plc server");
+        retval = UA_STATUSCODE_BAD;
+        goto cleanup_timeseries;
+    }
+
+    UA_ServerConfig *cfg = UA_Server_getConfig(server);
+    retval = UA_ServerConfig_setDefault(cfg);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to create server config");
         goto cleanup_server;
     }
 
+    /*
+     * Set up config for encryption
+     */
+    if(arguments.encrypt)
+    {
+        if( (strlen(arguments.cert) == 0) || (strlen(arguments.private) == 0) )
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Certificate and/or key missing");
+            goto cleanup_server;
+        }
+
+        if(mapFile(arguments.cert, &cert) != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Certificate is empty");
+            goto cleanup_server;
+        }
+
+        if(mapFile(arguments.private, &privateKey) != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Private key is empty");
+            goto cleanup_server;
+        }
+
+        /*
+         * Client certificates are verified against the trust store below.
+         * The security policies copy certificate and key, DER or PEM, so
+         * the mappings are passed as they are and released right after.
+         */
+        retval = UA_ServerConfig_setDefaultWithSecurityPolicies(
+            cfg, 4840, &cert.contents, &privateKey.contents,
+            NULL, 0,
+            NULL, 0,
+            NULL, 0);
+
+        unmapFile(&cert);
+        unmapFile(&privateKey);
+
+        /*
+         * Check for success now
+         */
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Setting encryption configuration failed: %s",
+                        UA_StatusCode_name(retval));
+            goto cleanup_server;
+        }
+
+        /*
+         * Without a PKI directory or certificates on the command line the
+         * default verification stays, which accepts all clients
+         */
+        if(arguments.pki &&
+           watchTrustStoreDirectory(&trustStore, arguments.pki) == UA_STATUSCODE_GOOD)
+        {
+            UA_Server_addRepeatedCallback(server, trustStoreCallback, &trustStore,
+                                          TRUSTSTORE_CHECK_INTERVAL_MS, NULL);
+        }
+        if(arguments.pki || trustStore.entriesSize > 0)
+        {
+            setTrustStoreVerification(&cfg->secureChannelPKI, &trustStore);
+            setTrustStoreVerification(&cfg->sessionPKI, &trustStore);
+        }
+    }
+
+    setSessionLimits(cfg);
+
+    /*
+     * Prepare the system instances on the server with initial values
+     */
+    retval = defineTankStateDataType(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define tank state data type");
+        goto cleanup_server;
+    }
+    retval = defineTankSystemObjectType(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define tank system object type");
+        goto cleanup_server;
+    }
+    retval = defineThresholdCrossingEventType(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to define threshold crossing event type");
+        goto cleanup_server;
+    }
+    tankSystems = (TankSystem*)calloc(arguments.tankSystems, sizeof(TankSystem));
+    tankValues = (TankValues*)calloc(arguments.tankSystems, sizeof(TankValues));
+    if(!tankSystems || !tankValues)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to allocate the tank systems");
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        goto cleanup_server;
+    }
+
+    CallbackContext context = {
+        .db = db,
+        .dbLatency = registerMetric("DatabaseStatementLatency",
+                                    "Latency of preparing and executing a database statement",
+                                    METRIC_LATENCY),
+        .waterlevel = arguments.timeseriesdir ? &waterlevelSeries : NULL,
+        .valvePosition = arguments.timeseriesdir ? &valvePositionSeries : NULL,
+        .tankSystems = tankSystems,
+        .tankSystemsSize = arguments.tankSystems,
+        .values = tankValues,
+        .valuesCached = false,
+    };
+
+    /*
+     * All methods are wrapped to count their calls and call latency, for
+     * all tank systems together
+     */
+    InstrumentedMethod getTankSystemParams;
+    initInstrumentedMethod(&getTankSystemParams, "GetTankSystemParams",
+                           getTankSystemParamsCallback, &context);
+    InstrumentedMethod setThreshold;
+    initInstrumentedMethod(&setThreshold, "SetThreshold", setThresholdCallback, &context);
+    InstrumentedMethod getAggregates;
+    initInstrumentedMethod(&getAggregates, "GetAggregates", getAggregatesCallback, &context);
+
+    for(UA_UInt32 i = 0; i < arguments.tankSystems; i++)
+    {
+        retval = addTankSystem(server, &tankSystems[i], i + 1, arguments.alarmHysteresis);
+        if(retval == UA_STATUSCODE_GOOD)
+        {
+            retval = addTankSystemMethods(server, &tankSystems[i].ident, &getTankSystemParams,
+                                          &setThreshold, i == 0 ? &getAggregates : NULL);
+        }
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            goto cleanup_server;
+        }
+    }
+
+    if(arguments.alarmInterval > 0)
+    {
+        UA_Server_addRepeatedCallback(server, alarmCallback, &context,
+                                      arguments.alarmInterval, NULL);
+    }
+
+    /*
+     * Publish the runtime metrics
+     */
+    retval = addDiagnostics(server);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add diagnostics to server");
+        goto cleanup_server;
+    }
+
+    /*
+     * The metrics endpoint is optional, the server runs without it
+     */
+    MetricsExporter exporter;
+    UA_Boolean exporting = false;
+    if(arguments.metrics)
+    {
+        exporting = startMetricsExporter(&exporter, arguments.metrics, "plc_server") == UA_STATUSCODE_GOOD;
+    }
+
     /*
      * Start event loop unless Ctrl-C has already been received
      */
-    if(!running) goto cleanup_server;
-    retval = UA_Server_run(server, &running);
+    if(running)
+    {
+        retval = runServerWithMetrics(server, &running);
+    }
+
+    if(exporting)
+    {
+        stopMetricsExporter(&exporter);
+    }
 
 cleanup_server:
+    unmapFile(&cert);
+    unmapFile(&privateKey);
     UA_Server_delete(server);
+    free(tankSystems);
+    free(tankValues);
+
+cleanup_timeseries:
+    closeTimeSeries(&waterlevelSeries);
+    closeTimeSeries(&valvePositionSeries);
 
-cleanup_db:
     sqlite3_close(db);
 
 cleanup:
+    clearTrustStore(&trustStore);
+    stopAsyncLogger();
     return retval = UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
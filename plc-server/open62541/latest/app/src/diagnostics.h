@@ -0,0 +1,63 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <open62541/server.h>
+#include "metrics.h"
+
+/*
+ * The registered metrics are published as OPC UA variables below a
+ * 'Diagnostics' object in the namespace DIAGNOSTICS_NAMESPACE_URI. Every
+ * metric carries its description and a 'MetricType' property, so clients
+ * can discover all metrics by browsing. The values are aggregated when
+ * the variables are read.
+ */
+#define DIAGNOSTICS_NAMESPACE_URI "urn:sim-images:diagnostics"
+
+/*
+ * Count a value change of a node. It adds the number of monitored items
+ * on the node to the notification counter.
+ */
+void recordValueChange(const UA_NodeId *nodeId);
+
+/*
+ * Method callback wrapper counting the calls, failed calls and the call
+ * latency of a method. Pass instrumentedMethodCallback with the
+ * InstrumentedMethod as method context to UA_Server_addMethodNode.
+ */
+typedef struct {
+    UA_MethodCallback method;
+    void *methodContext;
+    Metric *calls;
+    Metric *errors;
+    Metric *latency;
+    char callsName[64];
+    char errorsName[64];
+    char latencyName[64];
+} InstrumentedMethod;
+
+void initInstrumentedMethod(InstrumentedMethod *instrumented, const char *name,
+                            UA_MethodCallback method, void *methodContext);
+
+UA_StatusCode instrumentedMethodCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output);
+
+/*
+ * Register the metrics every server has (sessions, secure channels,
+ * monitored items, notifications, event loop iterations) and add the
+ * 'Diagnostics' object with all registered metrics to the server.
+ */
+UA_StatusCode addDiagnostics(UA_Server *server);
+
+/*
+ * Replacement for UA_Server_run that records the time of every event loop
+ * iteration, including the time spent waiting for network events, and
+ * refreshes the sampled gauges for readers in other threads
+ */
+UA_StatusCode runServerWithMetrics(UA_Server *server, volatile UA_Boolean *running);
+
+#endif
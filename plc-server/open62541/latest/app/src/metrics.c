@@ -0,0 +1,199 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include "asynclog.h"
+#include "metrics.h"
+
+#define METRICS_SLOTS (METRICS_MAX * (METRICS_LATENCY_BUCKETS + 2))
+
+/*
+ * Counters of one thread. A latency metric uses one slot per bucket
+ * followed by the sample count and the sum of all samples.
+ */
+typedef struct {
+    _Atomic UA_UInt64 slots[METRICS_SLOTS];
+} __attribute__((aligned(64))) MetricShard;
+
+static Metric metrics[METRICS_MAX];
+static size_t metricsSize = 0;
+static size_t slotsUsed = 0;
+
+static MetricShard shards[METRICS_MAX_THREADS];
+static atomic_size_t shardsUsed = 0;
+static _Thread_local MetricShard *threadShard = NULL;
+
+const UA_UInt64 metricsLatencyBounds[METRICS_LATENCY_BUCKETS - 1] = METRICS_LATENCY_BOUNDS;
+
+
+/*
+ * Each thread gets its own shard on its first update. Threads beyond
+ * METRICS_MAX_THREADS share the last shard, which stays correct as all
+ * updates are atomic.
+ */
+static MetricShard *getThreadShard(void)
+{
+    if(!threadShard)
+    {
+        size_t index = atomic_fetch_add_explicit(&shardsUsed, 1, memory_order_relaxed);
+        threadShard = &shards[index < METRICS_MAX_THREADS ? index : METRICS_MAX_THREADS - 1];
+    }
+    return threadShard;
+}
+
+
+static UA_UInt64 sumSlot(size_t slot)
+{
+    size_t used = atomic_load_explicit(&shardsUsed, memory_order_relaxed);
+    if(used > METRICS_MAX_THREADS)
+    {
+        used = METRICS_MAX_THREADS;
+    }
+
+    UA_UInt64 sum = 0;
+    for(size_t i = 0; i < used; i++)
+    {
+        sum += atomic_load_explicit(&shards[i].slots[slot], memory_order_relaxed);
+    }
+    return sum;
+}
+
+
+static void addSlot(size_t slot, UA_UInt64 value)
+{
+    atomic_fetch_add_explicit(&getThreadShard()->slots[slot], value, memory_order_relaxed);
+}
+
+
+Metric *registerMetric(const char *name, const char *description, MetricType type)
+{
+    size_t slots = type == METRIC_LATENCY ? METRICS_LATENCY_BUCKETS + 2 : 1;
+    if(metricsSize >= METRICS_MAX || slotsUsed + slots > METRICS_SLOTS)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to register metric '%s', too many metrics", name);
+        return NULL;
+    }
+
+    Metric *metric = &metrics[metricsSize++];
+    metric->name = name;
+    metric->description = description;
+    metric->type = type;
+    metric->slot = slotsUsed;
+    atomic_init(&metric->gauge, 0);
+    metric->sampler = NULL;
+    metric->samplerContext = NULL;
+    slotsUsed += slots;
+    return metric;
+}
+
+
+Metric *registerSampledGauge(const char *name, const char *description,
+                             MetricSampler sampler, void *samplerContext)
+{
+    Metric *metric = registerMetric(name, description, METRIC_GAUGE);
+    if(metric)
+    {
+        metric->sampler = sampler;
+        metric->samplerContext = samplerContext;
+    }
+    return metric;
+}
+
+
+void addCounter(Metric *metric, UA_UInt64 value)
+{
+    if(metric)
+    {
+        addSlot(metric->slot, value);
+    }
+}
+
+
+void setGauge(Metric *metric, UA_Int64 value)
+{
+    if(metric)
+    {
+        atomic_store_explicit(&metric->gauge, value, memory_order_relaxed);
+    }
+}
+
+
+void addGauge(Metric *metric, UA_Int64 value)
+{
+    if(metric)
+    {
+        atomic_fetch_add_explicit(&metric->gauge, value, memory_order_relaxed);
+    }
+}
+
+
+void recordLatency(Metric *metric, UA_Int64 value)
+{
+    if(!metric)
+    {
+        return;
+    }
+
+    UA_UInt64 v = value > 0 ? (UA_UInt64)value : 0;
+    size_t bucket = 0;
+    while(bucket < METRICS_LATENCY_BUCKETS - 1 && v > metricsLatencyBounds[bucket])
+    {
+        bucket++;
+    }
+    addSlot(metric->slot + bucket, 1);
+    addSlot(metric->slot + METRICS_LATENCY_BUCKETS, 1);
+    addSlot(metric->slot + METRICS_LATENCY_BUCKETS + 1, v);
+}
+
+
+void recordLatencySince(Metric *metric, UA_DateTime start)
+{
+    recordLatency(metric, (UA_DateTime_nowMonotonic() - start) / UA_DATETIME_USEC);
+}
+
+
+void refreshSampledGauges(void)
+{
+    for(size_t i = 0; i < metricsSize; i++)
+    {
+        if(metrics[i].sampler)
+        {
+            setGauge(&metrics[i], metrics[i].sampler(metrics[i].samplerContext));
+        }
+    }
+}
+
+
+size_t getMetricsSize(void)
+{
+    return metricsSize;
+}
+
+
+Metric *getMetric(size_t index)
+{
+    return index < metricsSize ? &metrics[index] : NULL;
+}
+
+
+UA_UInt64 getCounterValue(const Metric *metric)
+{
+    return sumSlot(metric->slot);
+}
+
+
+UA_Int64 getGaugeValue(const Metric *metric)
+{
+    return atomic_load_explicit(&metric->gauge, memory_order_relaxed);
+}
+
+
+void getLatencyValues(const Metric *metric, UA_UInt64 buckets[METRICS_LATENCY_BUCKETS],
+                      UA_UInt64 *count, UA_UInt64 *sum)
+{
+    for(size_t i = 0; i < METRICS_LATENCY_BUCKETS; i++)
+    {
+        buckets[i] = sumSlot(metric->slot + i);
+    }
+    *count = sumSlot(metric->slot + METRICS_LATENCY_BUCKETS);
+    *sum = sumSlot(metric->slot + METRICS_LATENCY_BUCKETS + 1);
+}
@@ -0,0 +1,49 @@
+#ifndef NETFAULT_H
+#define NETFAULT_H
+
+#include <open62541/plugin/eventloop.h>
+
+/*
+ * Fault injection for the network layer. A connection manager wraps the
+ * TCP connection manager of an event loop and holds back every message
+ * until its simulated delivery time, in both directions. As TCP is a
+ * stream, messages of a connection are never reordered, so jitter and
+ * stalls delay all later messages as well, like a congested link does.
+ *
+ * The wrapper takes over the "tcp" protocol name, so servers and clients
+ * pick it up without further changes. The wrapped connection manager stays
+ * registered with the event loop under NETFAULT_INNER_PROTOCOL and keeps
+ * handling the sockets.
+ */
+#define NETFAULT_INNER_PROTOCOL "tcp-unimpaired"
+
+typedef struct {
+    const char *name;
+    UA_Double latency;          /* ms added to every message */
+    UA_Double jitter;           /* ms, uniformly distributed on top */
+    UA_UInt32 bandwidth;        /* kbit/s per connection and direction, 0 for unlimited */
+    UA_UInt32 stallInterval;    /* ms from the start of one stall to the next, 0 for none */
+    UA_UInt32 stallDuration;    /* ms during which the network delivers nothing */
+} NetFaultProfile;
+
+/*
+ * Built-in profiles, starting with the unimpaired "none"
+ */
+extern const NetFaultProfile netFaultProfiles[];
+extern const size_t netFaultProfilesSize;
+
+/*
+ * Parse a comma separated profile specification. It may start with the
+ * name of a built-in profile and continue with overrides, e.g.
+ * 'congested,latency=50' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'.
+ */
+UA_StatusCode parseNetFaultProfile(const char *spec, NetFaultProfile *profile);
+
+/*
+ * Create a POSIX event loop whose TCP connections are impaired according to
+ * the profile. The event loop is not started and can be handed to a server
+ * or client config, which then takes ownership.
+ */
+UA_EventLoop *newFaultyEventLoop(const NetFaultProfile *profile, const UA_Logger *logger);
+
+#endif
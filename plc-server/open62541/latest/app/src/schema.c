@@ -0,0 +1,178 @@
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/log_stdout.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "schema.h"
+
+/*
+ * How long to wait for another process that is initializing the schema
+ */
+#define SCHEMA_BUSY_TIMEOUT_MS 10000
+
+/*
+ * The rows of the history tables belong to the tank system in their
+ * column tank_system, which is 1 unless the writer sets it
+ */
+static const char *tables =
+    "CREATE TABLE IF NOT EXISTS waterlevel ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    level REAL NOT NULL,"
+    "    tank_system INTEGER NOT NULL DEFAULT 1);"
+    "CREATE TABLE IF NOT EXISTS valveposition ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    position INTEGER NOT NULL,"
+    "    tank_system INTEGER NOT NULL DEFAULT 1);"
+    "CREATE TABLE IF NOT EXISTS triggerthreshold ("
+    "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "    threshold INTEGER NOT NULL,"
+    "    tank_system INTEGER NOT NULL DEFAULT 1);"
+    "CREATE TABLE IF NOT EXISTS tankstate ("
+    "    tank_system INTEGER PRIMARY KEY,"
+    "    level REAL,"
+    "    level_timestamp DATETIME,"
+    "    position INTEGER,"
+    "    position_timestamp DATETIME,"
+    "    threshold INTEGER,"
+    "    threshold_timestamp DATETIME);";
+
+static const char *historyTables[] = {"waterlevel", "valveposition", "triggerthreshold"};
+
+/*
+ * The triggers are replaced, as older versions kept every row in the
+ * state of tank system 1. The state row of tank system 1 is seeded from
+ * the latest history rows when the table is created for an existing
+ * database.
+ */
+static const char *triggers =
+    "DROP TRIGGER IF EXISTS waterlevel_tankstate;"
+    "CREATE TRIGGER waterlevel_tankstate AFTER INSERT ON waterlevel "
+    "BEGIN"
+    "    INSERT INTO tankstate (tank_system, level, level_timestamp)"
+    "    VALUES (NEW.tank_system, NEW.level, NEW.timestamp)"
+    "    ON CONFLICT(tank_system) DO UPDATE SET"
+    "        level = excluded.level,"
+    "        level_timestamp = excluded.level_timestamp;"
+    "END;"
+    "DROP TRIGGER IF EXISTS valveposition_tankstate;"
+    "CREATE TRIGGER valveposition_tankstate AFTER INSERT ON valveposition "
+    "BEGIN"
+    "    INSERT INTO tankstate (tank_system, position, position_timestamp)"
+    "    VALUES (NEW.tank_system, NEW.position, NEW.timestamp)"
+    "    ON CONFLICT(tank_system) DO UPDATE SET"
+    "        position = excluded.position,"
+    "        position_timestamp = excluded.position_timestamp;"
+    "END;"
+    "DROP TRIGGER IF EXISTS triggerthreshold_tankstate;"
+    "CREATE TRIGGER triggerthreshold_tankstate AFTER INSERT ON triggerthreshold "
+    "BEGIN"
+    "    INSERT INTO tankstate (tank_system, threshold, threshold_timestamp)"
+    "    VALUES (NEW.tank_system, NEW.threshold, NEW.timestamp)"
+    "    ON CONFLICT(tank_system) DO UPDATE SET"
+    "        threshold = excluded.threshold,"
+    "        threshold_timestamp = excluded.threshold_timestamp;"
+    "END;"
+    "INSERT OR IGNORE INTO tankstate (tank_system, level, level_timestamp, position,"
+    "                                 position_timestamp, threshold, threshold_timestamp) "
+    "SELECT 1,"
+    "    (SELECT level FROM waterlevel WHERE tank_system = 1 ORDER BY id DESC LIMIT 1),"
+    "    (SELECT timestamp FROM waterlevel WHERE tank_system = 1 ORDER BY id DESC LIMIT 1),"
+    "    (SELECT position FROM valveposition WHERE tank_system = 1 ORDER BY id DESC LIMIT 1),"
+    "    (SELECT timestamp FROM valveposition WHERE tank_system = 1 ORDER BY id DESC LIMIT 1),"
+    "    (SELECT threshold FROM triggerthreshold WHERE tank_system = 1 ORDER BY id DESC LIMIT 1),"
+    "    (SELECT timestamp FROM triggerthreshold WHERE tank_system = 1 ORDER BY id DESC LIMIT 1);";
+
+
+/*
+ * Add the column tank_system to a history table created by an older
+ * version, its rows belong to tank system 1
+ */
+static int addTankSystemColumn(sqlite3 *db, const char *table)
+{
+    char sql[128];
+    snprintf(sql, sizeof(sql),
+             "SELECT 1 FROM pragma_table_info('%s') WHERE name = 'tank_system';", table);
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if(rc != SQLITE_OK)
+    {
+        return rc;
+    }
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE)
+    {
+        return rc == SQLITE_ROW ? SQLITE_OK : rc;
+    }
+    snprintf(sql, sizeof(sql),
+             "ALTER TABLE %s ADD COLUMN tank_system INTEGER NOT NULL DEFAULT 1;", table);
+    return sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+
+UA_StatusCode initProcessSchema(sqlite3 *db)
+{
+    /*
+     * The write lock is taken right away, so a second process blocks at
+     * the start of the transaction and finds the schema complete
+     */
+    sqlite3_busy_timeout(db, SCHEMA_BUSY_TIMEOUT_MS);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+    if(rc == SQLITE_OK)
+    {
+        rc = sqlite3_exec(db, tables, NULL, NULL, NULL);
+    }
+    for(size_t i = 0; rc == SQLITE_OK && i < sizeof(historyTables) / sizeof(historyTables[0]); i++)
+    {
+        rc = addTankSystemColumn(db, historyTables[i]);
+    }
+    if(rc == SQLITE_OK)
+    {
+        rc = sqlite3_exec(db, triggers, NULL, NULL, NULL);
+    }
+    if(rc == SQLITE_OK)
+    {
+        rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    }
+    if(rc != SQLITE_OK)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Failed to create the database schema with error: %s",
+                       sqlite3_errmsg(db));
+        if(!sqlite3_get_autocommit(db))
+        {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        }
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    /*
+     * Statements of the control loop fail instead of blocking it
+     */
+    sqlite3_busy_timeout(db, 0);
+    return retval;
+}
+
+
+UA_StatusCode signalDatabaseReady(const char *dbname)
+{
+    char lockname[4096];
+    if(snprintf(lockname, sizeof(lockname), "%s.lock", dbname) >= (int)sizeof(lockname))
+    {
+        return UA_STATUSCODE_BADOUTOFRANGE;
+    }
+    int fd = open(lockname, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create %s", lockname);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    close(fd);
+    return UA_STATUSCODE_GOOD;
+}
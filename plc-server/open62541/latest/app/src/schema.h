@@ -0,0 +1,26 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <open62541/types.h>
+#include <sqlite3.h>
+
+/*
+ * Schema of the process database shared by plc-logic-client and
+ * plc-server: the history tables waterlevel, valveposition and
+ * triggerthreshold and the table tankstate with the latest values of each
+ * tank system, maintained by triggers on the history tables.
+ *
+ * Either process creates the schema on start, or migrates a database
+ * created by an older version, so neither has to wait for the other. All
+ * statements are idempotent and run in one transaction, which a process
+ * starting at the same time waits for.
+ */
+UA_StatusCode initProcessSchema(sqlite3 *db);
+
+/*
+ * Create the file '<dbname>.lock' that the other implementations of
+ * plc-server wait for before they open the database
+ */
+UA_StatusCode signalDatabaseReady(const char *dbname);
+
+#endif
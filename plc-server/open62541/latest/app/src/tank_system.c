@@ -5,6 +5,8 @@
 #include <open62541/server.h>
 #include <open62541/types.h>
 #include <sqlite3.h>
+#include "asynclog.h"
+#include "tank_state.h"
 #include "tank_system.h"
 
 
@@ -27,7 +29,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                          UA_QUALIFIEDNAME(1, "tankSystemType"), tsAttr, NULL, NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'tankSystemType'. Exiting with code %u",
                     retval);
         return retval;
@@ -48,7 +50,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                        fillPercentageAttr, NULL, &fillPercentageIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'FillPercentage'. Exiting with code %u",
                     retval);
         return retval;
@@ -58,7 +60,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'FillPercentage'. Exiting with code %u,",
                     retval);
         return retval;
@@ -76,7 +78,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                        valvePosAttr, NULL, &valvePosIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'ValvePosition'. Exiting with code %u",
                     retval);
         return retval;
@@ -86,7 +88,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'ValvePosition'. Exiting with code %u",
                     retval);
         return retval;
@@ -105,7 +107,7 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                        thresholdAttr, NULL, &thresholdIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'Threshold'. Exiting with code %u",
                     retval);
         return retval;
@@ -115,11 +117,42 @@ UA_StatusCode defineTankSystemObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'Threshold'. Exiting with code %u",
                     retval);
         return retval;
     }
+
+    /*
+     * Snapshot of the values above, defined by defineTankStateDataType
+     */
+    UA_VariableAttributes stateAttr = UA_VariableAttributes_default;
+    stateAttr.displayName = UA_LOCALIZEDTEXT("en-US", "State");
+    stateAttr.dataType = tankStateTypeIdent;
+    stateAttr.valueRank = UA_VALUERANK_SCALAR;
+    UA_NodeId stateIdent;
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, tankSystemTypeIdent,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                       UA_QUALIFIEDNAME(1, "State"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       stateAttr, NULL, &stateIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'State'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+    retval = UA_Server_addReference(server, stateIdent,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASMODELLINGRULE),
+                                    UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add reference 'State'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
     return retval;
 }
 
@@ -14,6 +14,7 @@ extern UA_NodeId tankSystemTypeIdent;
 /*
  * Define the data type used by tank system objects. Nodes can be instantiated only
  * after defining these types first.
+ * Their State variable needs TankState to be defined before.
  */
 UA_StatusCode defineTankSystemObjectType(UA_Server *server);
 
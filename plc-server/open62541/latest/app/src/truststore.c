@@ -0,0 +1,712 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <open62541/plugin/log.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "truststore.h"
+#include "utils.h"
+
+#define TRUSTSTORE_INITIAL_BUCKETS 64
+#define TRUSTSTORE_EVENTS_SIZE 4096
+#define TRUSTSTORE_WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+
+static size_t hashThumbprint(const UA_Byte *thumbprint)
+{
+    /*
+     * The thumbprint is a SHA-1 hash already
+     */
+    size_t hash;
+    memcpy(&hash, thumbprint, sizeof(hash));
+    return hash;
+}
+
+
+static size_t hashPath(const char *path)
+{
+    size_t hash = 14695981039346656037ULL;
+    for(; *path; path++)
+    {
+        hash = (hash ^ (unsigned char)*path) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static void insertEntry(TrustStore *store, TrustEntry *entry)
+{
+    size_t mask = store->bucketsSize - 1;
+    size_t t = hashThumbprint(entry->thumbprint) & mask;
+    size_t s = entry->subjectHash & mask;
+    size_t p = hashPath(entry->path) & mask;
+    entry->nextByThumbprint = store->byThumbprint[t];
+    store->byThumbprint[t] = entry;
+    entry->nextBySubject = store->bySubject[s];
+    store->bySubject[s] = entry;
+    entry->nextByPath = store->byPath[p];
+    store->byPath[p] = entry;
+}
+
+
+static UA_StatusCode resizeBuckets(TrustStore *store, size_t bucketsSize)
+{
+    TrustEntry **byThumbprint = calloc(bucketsSize, sizeof(TrustEntry*));
+    TrustEntry **bySubject = calloc(bucketsSize, sizeof(TrustEntry*));
+    TrustEntry **byPath = calloc(bucketsSize, sizeof(TrustEntry*));
+    if(!byThumbprint || !bySubject || !byPath)
+    {
+        free(byThumbprint);
+        free(bySubject);
+        free(byPath);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    TrustEntry **oldByPath = store->byPath;
+    size_t oldBucketsSize = store->bucketsSize;
+    free(store->byThumbprint);
+    free(store->bySubject);
+    store->byThumbprint = byThumbprint;
+    store->bySubject = bySubject;
+    store->byPath = byPath;
+    store->bucketsSize = bucketsSize;
+
+    /*
+     * Every entry is in exactly one path chain
+     */
+    for(size_t i = 0; i < oldBucketsSize; i++)
+    {
+        TrustEntry *entry = oldByPath[i];
+        while(entry)
+        {
+            TrustEntry *next = entry->nextByPath;
+            insertEntry(store, entry);
+            entry = next;
+        }
+    }
+    free(oldByPath);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static void freeEntry(TrustEntry *entry)
+{
+    X509_free(entry->certificate);
+    X509_CRL_free(entry->crl);
+    free(entry->path);
+    free(entry);
+}
+
+
+static UA_Boolean removeEntry(TrustStore *store, const char *path)
+{
+    if(!store->bucketsSize)
+    {
+        return false;
+    }
+
+    size_t mask = store->bucketsSize - 1;
+    TrustEntry **link = &store->byPath[hashPath(path) & mask];
+    while(*link && strcmp((*link)->path, path) != 0)
+    {
+        link = &(*link)->nextByPath;
+    }
+    TrustEntry *entry = *link;
+    if(!entry)
+    {
+        return false;
+    }
+    *link = entry->nextByPath;
+
+    link = &store->byThumbprint[hashThumbprint(entry->thumbprint) & mask];
+    while(*link != entry)
+    {
+        link = &(*link)->nextByThumbprint;
+    }
+    *link = entry->nextByThumbprint;
+
+    link = &store->bySubject[entry->subjectHash & mask];
+    while(*link != entry)
+    {
+        link = &(*link)->nextBySubject;
+    }
+    *link = entry->nextBySubject;
+
+    store->entriesSize--;
+    if(entry->kind == TRUSTSTORE_TRUSTED)
+    {
+        store->trustedSize--;
+    }
+    freeEntry(entry);
+    return true;
+}
+
+
+/*
+ * Certificates are accepted in DER and PEM encoding, certificates sent
+ * by clients are always DER
+ */
+static X509 *parseCertificate(const UA_Byte *data, size_t length, UA_Boolean pem)
+{
+    if(!pem)
+    {
+        const unsigned char *p = data;
+        return d2i_X509(NULL, &p, (long)length);
+    }
+
+    X509 *certificate = NULL;
+    BIO *bio = BIO_new_mem_buf(data, (int)length);
+    if(bio)
+    {
+        certificate = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+        BIO_free(bio);
+    }
+    return certificate;
+}
+
+
+static X509_CRL *parseRevocationList(const UA_Byte *data, size_t length, UA_Boolean pem)
+{
+    if(!pem)
+    {
+        const unsigned char *p = data;
+        return d2i_X509_CRL(NULL, &p, (long)length);
+    }
+
+    X509_CRL *crl = NULL;
+    BIO *bio = BIO_new_mem_buf(data, (int)length);
+    if(bio)
+    {
+        crl = PEM_read_bio_X509_CRL(bio, NULL, NULL, NULL);
+        BIO_free(bio);
+    }
+    return crl;
+}
+
+
+static UA_Boolean isTimeValid(X509 *certificate)
+{
+    return X509_cmp_current_time(X509_get0_notBefore(certificate)) < 0 &&
+           X509_cmp_current_time(X509_get0_notAfter(certificate)) > 0;
+}
+
+
+void initTrustStore(TrustStore *store)
+{
+    memset(store, 0, sizeof(TrustStore));
+    store->inotifyFd = -1;
+    store->trustedWatch = -1;
+    store->issuersWatch = -1;
+    store->crlWatch = -1;
+}
+
+
+void clearTrustStore(TrustStore *store)
+{
+    for(size_t i = 0; i < store->bucketsSize; i++)
+    {
+        TrustEntry *entry = store->byPath[i];
+        while(entry)
+        {
+            TrustEntry *next = entry->nextByPath;
+            freeEntry(entry);
+            entry = next;
+        }
+    }
+    free(store->byThumbprint);
+    free(store->bySubject);
+    free(store->byPath);
+    free(store->trustedDirectory);
+    free(store->issuersDirectory);
+    free(store->crlDirectory);
+    if(store->inotifyFd >= 0)
+    {
+        close(store->inotifyFd);
+    }
+    initTrustStore(store);
+}
+
+
+UA_StatusCode addTrustStoreFile(TrustStore *store, const char *path, TrustEntryKind kind)
+{
+    if(!store->bucketsSize &&
+       resizeBuckets(store, TRUSTSTORE_INITIAL_BUCKETS) != UA_STATUSCODE_GOOD)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    removeEntry(store, path);
+
+    MappedFile file;
+    if(mapFile(path, &file) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to read certificate '%s'", path);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    X509 *certificate = NULL;
+    X509_CRL *crl = NULL;
+    if(kind == TRUSTSTORE_REVOCATION)
+    {
+        crl = parseRevocationList(file.contents.data, file.contents.length, file.pem);
+    }
+    else
+    {
+        certificate = parseCertificate(file.contents.data, file.contents.length, file.pem);
+    }
+    unmapFile(&file);
+    if(!certificate && !crl)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Ignoring '%s', not a DER or PEM %s", path,
+                       kind == TRUSTSTORE_REVOCATION ? "revocation list" : "certificate");
+        return UA_STATUSCODE_BADCERTIFICATEINVALID;
+    }
+
+    TrustEntry *entry = calloc(1, sizeof(TrustEntry));
+    char *entryPath = strdup(path);
+    unsigned int thumbprintSize = 0;
+    if(!entry || !entryPath ||
+       !(certificate ? X509_digest(certificate, EVP_sha1(), entry->thumbprint, &thumbprintSize)
+                     : X509_CRL_digest(crl, EVP_sha1(), entry->thumbprint, &thumbprintSize)))
+    {
+        free(entry);
+        free(entryPath);
+        X509_free(certificate);
+        X509_CRL_free(crl);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    entry->certificate = certificate;
+    entry->crl = crl;
+    entry->path = entryPath;
+    entry->kind = kind;
+    entry->subjectHash = X509_NAME_hash(certificate ? X509_get_subject_name(certificate)
+                                                    : X509_CRL_get_issuer(crl));
+
+    if(store->entriesSize >= store->bucketsSize &&
+       resizeBuckets(store, store->bucketsSize * 2) != UA_STATUSCODE_GOOD)
+    {
+        freeEntry(entry);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    insertEntry(store, entry);
+    store->entriesSize++;
+    if(kind == TRUSTSTORE_TRUSTED)
+    {
+        store->trustedSize++;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static size_t loadDirectory(TrustStore *store, const char *directory, TrustEntryKind kind)
+{
+    DIR *dir = opendir(directory);
+    if(!dir)
+    {
+        return 0;
+    }
+
+    size_t loaded = 0;
+    char path[PATH_MAX];
+    struct dirent *file;
+    while((file = readdir(dir)))
+    {
+        if(file->d_name[0] == '.' || (file->d_type != DT_REG && file->d_type != DT_UNKNOWN))
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", directory, file->d_name);
+        if(addTrustStoreFile(store, path, kind) == UA_STATUSCODE_GOOD)
+        {
+            loaded++;
+        }
+    }
+    closedir(dir);
+    return loaded;
+}
+
+
+/*
+ * Drop all entries loaded from a directory, used when the change events
+ * have been lost
+ */
+static void removeDirectoryEntries(TrustStore *store, const char *directory)
+{
+    size_t length = strlen(directory);
+    for(size_t i = 0; i < store->bucketsSize; i++)
+    {
+        TrustEntry *entry = store->byPath[i];
+        while(entry)
+        {
+            TrustEntry *next = entry->nextByPath;
+            if(strncmp(entry->path, directory, length) == 0 && entry->path[length] == '/')
+            {
+                removeEntry(store, entry->path);
+            }
+            entry = next;
+        }
+    }
+}
+
+
+UA_StatusCode watchTrustStoreDirectory(TrustStore *store, const char *directory)
+{
+    size_t length = strlen(directory) + sizeof("/trusted");
+    store->trustedDirectory = malloc(length);
+    store->issuersDirectory = malloc(length);
+    store->crlDirectory = malloc(length);
+    if(!store->trustedDirectory || !store->issuersDirectory || !store->crlDirectory)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    snprintf(store->trustedDirectory, length, "%s/trusted", directory);
+    snprintf(store->issuersDirectory, length, "%s/issuers", directory);
+    snprintf(store->crlDirectory, length, "%s/crl", directory);
+
+    /*
+     * Watch before loading, so no file added in between is missed
+     */
+    store->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(store->inotifyFd < 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to watch the PKI directory: %s", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    store->trustedWatch = inotify_add_watch(store->inotifyFd, store->trustedDirectory, TRUSTSTORE_WATCH_MASK);
+    store->issuersWatch = inotify_add_watch(store->inotifyFd, store->issuersDirectory, TRUSTSTORE_WATCH_MASK);
+    store->crlWatch = inotify_add_watch(store->inotifyFd, store->crlDirectory, TRUSTSTORE_WATCH_MASK);
+    if(store->trustedWatch < 0)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to watch '%s': %s", store->trustedDirectory, strerror(errno));
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+
+    size_t trusted = loadDirectory(store, store->trustedDirectory, TRUSTSTORE_TRUSTED);
+    size_t issuers = loadDirectory(store, store->issuersDirectory, TRUSTSTORE_ISSUER);
+    size_t crls = loadDirectory(store, store->crlDirectory, TRUSTSTORE_REVOCATION);
+    UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                "Loaded %zu trusted and %zu issuer certificates and %zu revocation lists from '%s'",
+                trusted, issuers, crls, directory);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static void applyChange(TrustStore *store, const struct inotify_event *event)
+{
+    const char *directory = NULL;
+    TrustEntryKind kind = TRUSTSTORE_TRUSTED;
+    if(event->wd == store->trustedWatch)
+    {
+        directory = store->trustedDirectory;
+    }
+    else if(event->wd == store->issuersWatch)
+    {
+        directory = store->issuersDirectory;
+        kind = TRUSTSTORE_ISSUER;
+    }
+    else if(event->wd == store->crlWatch)
+    {
+        directory = store->crlDirectory;
+        kind = TRUSTSTORE_REVOCATION;
+    }
+    if(!directory || event->len == 0 || event->name[0] == '.')
+    {
+        return;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", directory, event->name);
+    if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        if(removeEntry(store, path))
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Removed '%s' from the trust store", path);
+        }
+    }
+    else if(addTrustStoreFile(store, path, kind) == UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Added '%s' to the trust store", path);
+    }
+}
+
+
+void processTrustStoreChanges(TrustStore *store)
+{
+    if(store->inotifyFd < 0)
+    {
+        return;
+    }
+
+    char events[TRUSTSTORE_EVENTS_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for(;;)
+    {
+        ssize_t length = read(store->inotifyFd, events, sizeof(events));
+        if(length <= 0)
+        {
+            return;
+        }
+
+        for(char *p = events; p < events + length; )
+        {
+            const struct inotify_event *event = (const struct inotify_event*)p;
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                               "Trust store change events lost, reloading the PKI directory");
+                removeDirectoryEntries(store, store->trustedDirectory);
+                removeDirectoryEntries(store, store->issuersDirectory);
+                removeDirectoryEntries(store, store->crlDirectory);
+                loadDirectory(store, store->trustedDirectory, TRUSTSTORE_TRUSTED);
+                loadDirectory(store, store->issuersDirectory, TRUSTSTORE_ISSUER);
+                loadDirectory(store, store->crlDirectory, TRUSTSTORE_REVOCATION);
+            }
+            else
+            {
+                applyChange(store, event);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+
+static const TrustEntry *findTrusted(const TrustStore *store, const UA_Byte *thumbprint)
+{
+    if(!store->bucketsSize)
+    {
+        return NULL;
+    }
+    const TrustEntry *entry = store->byThumbprint[hashThumbprint(thumbprint) & (store->bucketsSize - 1)];
+    for(; entry; entry = entry->nextByThumbprint)
+    {
+        if(entry->kind == TRUSTSTORE_TRUSTED && memcmp(entry->thumbprint, thumbprint, TRUSTSTORE_THUMBPRINT_SIZE) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Collect the candidates for the chain above the issuer name through the
+ * subject index: trusted CA certificates as anchors, issuer CA certificates
+ * as untrusted intermediates, and the revocation lists of each issuer.
+ * Certificates that are not CAs allowed to sign certificates are never
+ * considered, even if they are trusted themselves.
+ */
+static void collectIssuers(const TrustStore *store, X509_NAME *issuer, size_t depth,
+                           X509_STORE *anchors, STACK_OF(X509) *intermediates)
+{
+    if(depth >= TRUSTSTORE_MAX_CHAIN)
+    {
+        return;
+    }
+
+    unsigned long hash = X509_NAME_hash(issuer);
+    const TrustEntry *entry = store->bySubject[hash & (store->bucketsSize - 1)];
+    for(; entry; entry = entry->nextBySubject)
+    {
+        if(entry->subjectHash != hash)
+        {
+            continue;
+        }
+        if(entry->crl)
+        {
+            if(X509_NAME_cmp(X509_CRL_get_issuer(entry->crl), issuer) == 0)
+            {
+                X509_STORE_add_crl(anchors, entry->crl);
+            }
+            continue;
+        }
+        X509 *certificate = entry->certificate;
+        if(X509_NAME_cmp(X509_get_subject_name(certificate), issuer) != 0 ||
+           X509_check_ca(certificate) == 0 ||
+           ((X509_get_extension_flags(certificate) & EXFLAG_KUSAGE) &&
+            !(X509_get_key_usage(certificate) & KU_KEY_CERT_SIGN)))
+        {
+            continue;
+        }
+        if(entry->kind == TRUSTSTORE_TRUSTED)
+        {
+            X509_STORE_add_cert(anchors, certificate);
+            continue;
+        }
+        sk_X509_push(intermediates, certificate);
+        X509_NAME *next = X509_get_issuer_name(certificate);
+        if(X509_NAME_cmp(next, issuer) != 0)
+        {
+            collectIssuers(store, next, depth + 1, anchors, intermediates);
+        }
+    }
+}
+
+
+static UA_StatusCode verifyStatus(int error, int depth)
+{
+    switch(error)
+    {
+        case X509_V_ERR_CERT_NOT_YET_VALID:
+        case X509_V_ERR_CERT_HAS_EXPIRED:
+            return depth == 0 ?
+                UA_STATUSCODE_BADCERTIFICATETIMEINVALID : UA_STATUSCODE_BADCERTIFICATEISSUERTIMEINVALID;
+        case X509_V_ERR_CERT_REVOKED:
+            return UA_STATUSCODE_BADCERTIFICATEREVOKED;
+        case X509_V_ERR_UNABLE_TO_GET_CRL:
+        case X509_V_ERR_CRL_NOT_YET_VALID:
+        case X509_V_ERR_CRL_HAS_EXPIRED:
+        case X509_V_ERR_CRL_SIGNATURE_FAILURE:
+        case X509_V_ERR_UNABLE_TO_DECRYPT_CRL_SIGNATURE:
+            return UA_STATUSCODE_BADCERTIFICATEREVOCATIONUNKNOWN;
+        default:
+            return UA_STATUSCODE_BADCERTIFICATEUNTRUSTED;
+    }
+}
+
+
+/*
+ * Verify the chain of a certificate that is not trusted itself. A partial
+ * chain is accepted, so a trusted CA does not have to be a root.
+ */
+static UA_StatusCode verifyChain(const TrustStore *store, X509 *certificate)
+{
+    if(!store->bucketsSize)
+    {
+        return UA_STATUSCODE_BADCERTIFICATEUNTRUSTED;
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    X509_STORE *anchors = X509_STORE_new();
+    STACK_OF(X509) *intermediates = sk_X509_new_null();
+    X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+    if(!anchors || !intermediates || !ctx)
+    {
+        goto cleanup;
+    }
+    collectIssuers(store, X509_get_issuer_name(certificate), 0, anchors, intermediates);
+    X509_STORE_set_flags(anchors, X509_V_FLAG_CRL_CHECK | X509_V_FLAG_PARTIAL_CHAIN);
+    if(X509_STORE_CTX_init(ctx, anchors, certificate, intermediates) != 1)
+    {
+        goto cleanup;
+    }
+
+    retval = UA_STATUSCODE_GOOD;
+    if(X509_verify_cert(ctx) != 1)
+    {
+        int error = X509_STORE_CTX_get_error(ctx);
+        retval = verifyStatus(error, X509_STORE_CTX_get_error_depth(ctx));
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Client certificate chain not verified: %s",
+                    X509_verify_cert_error_string(error));
+    }
+
+cleanup:
+    X509_STORE_CTX_free(ctx);
+    sk_X509_free(intermediates);
+    X509_STORE_free(anchors);
+    return retval;
+}
+
+
+static UA_StatusCode verifyCertificate(const UA_CertificateVerification *cv,
+                                       const UA_ByteString *certificate)
+{
+    const TrustStore *store = (const TrustStore*)cv->context;
+
+    UA_Byte thumbprint[TRUSTSTORE_THUMBPRINT_SIZE];
+    if(!EVP_Digest(certificate->data, certificate->length, thumbprint, NULL, EVP_sha1(), NULL))
+    {
+        return UA_STATUSCODE_BADCERTIFICATEINVALID;
+    }
+    const TrustEntry *entry = findTrusted(store, thumbprint);
+    if(entry)
+    {
+        return isTimeValid(entry->certificate) ?
+            UA_STATUSCODE_GOOD : UA_STATUSCODE_BADCERTIFICATETIMEINVALID;
+    }
+
+    X509 *x509 = parseCertificate(certificate->data, certificate->length, false);
+    if(!x509)
+    {
+        return UA_STATUSCODE_BADCERTIFICATEINVALID;
+    }
+    UA_StatusCode retval = verifyChain(store, x509);
+    X509_free(x509);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Rejected client certificate: %s", UA_StatusCode_name(retval));
+    }
+    return retval;
+}
+
+
+/*
+ * The application URI of the client has to be in the subject alternative
+ * names of its certificate
+ */
+static UA_StatusCode verifyApplicationUri(const UA_CertificateVerification *cv,
+                                          const UA_ByteString *certificate,
+                                          const UA_String *applicationURI)
+{
+    X509 *x509 = parseCertificate(certificate->data, certificate->length, false);
+    if(!x509)
+    {
+        return UA_STATUSCODE_BADCERTIFICATEINVALID;
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_BADCERTIFICATEURIINVALID;
+    GENERAL_NAMES *names = X509_get_ext_d2i(x509, NID_subject_alt_name, NULL, NULL);
+    for(int i = 0; names && i < sk_GENERAL_NAME_num(names); i++)
+    {
+        const GENERAL_NAME *name = sk_GENERAL_NAME_value(names, i);
+        if(name->type != GEN_URI)
+        {
+            continue;
+        }
+        const ASN1_IA5STRING *uri = name->d.uniformResourceIdentifier;
+        if((size_t)uri->length == applicationURI->length &&
+           memcmp(uri->data, applicationURI->data, applicationURI->length) == 0)
+        {
+            retval = UA_STATUSCODE_GOOD;
+            break;
+        }
+    }
+    GENERAL_NAMES_free(names);
+    X509_free(x509);
+    return retval;
+}
+
+
+static void clearTrustStoreVerification(UA_CertificateVerification *cv)
+{
+    /*
+     * The store is owned and cleared by its creator
+     */
+    cv->context = NULL;
+}
+
+
+void setTrustStoreVerification(UA_CertificateVerification *cv, TrustStore *store)
+{
+    if(cv->clear)
+    {
+        cv->clear(cv);
+    }
+    cv->context = store;
+    cv->verifyCertificate = verifyCertificate;
+    cv->verifyApplicationURI = verifyApplicationUri;
+    cv->clear = clearTrustStoreVerification;
+}
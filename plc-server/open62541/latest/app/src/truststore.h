@@ -0,0 +1,98 @@
+#ifndef TRUSTSTORE_H
+#define TRUSTSTORE_H
+
+#include <open62541/server.h>
+#include <openssl/x509.h>
+
+/*
+ * Trust store for client certificates, replacing the fixed-size trust and
+ * issuer lists. Certificates are indexed by their SHA-1 thumbprint, so a
+ * directly trusted certificate is found with a single hash lookup, and by
+ * subject name to find the issuers of a certificate signed by a CA.
+ * Revocation lists are indexed by the name of their issuer in the same
+ * subject index.
+ *
+ * A PKI directory contains the subdirectories 'trusted' and 'issuers',
+ * holding DER or PEM certificates, and 'crl' with the revocation lists.
+ * Issuer certificates are only used to build the chain to a trusted
+ * certificate, they are not trusted on their own. The directories are
+ * watched with inotify, each added, replaced or removed file updates only
+ * its own entry.
+ *
+ * A certificate that is not trusted itself is verified by OpenSSL against
+ * the CA certificates found for its chain. Every issuer has to be a CA
+ * allowed to sign certificates, and the CA that issued the client
+ * certificate has to provide a revocation list.
+ *
+ * The store is not thread-safe, it is used and updated from the server's
+ * event loop only.
+ */
+#define TRUSTSTORE_THUMBPRINT_SIZE 20
+#define TRUSTSTORE_MAX_CHAIN 8
+
+typedef enum {
+    TRUSTSTORE_TRUSTED,
+    TRUSTSTORE_ISSUER,
+    TRUSTSTORE_REVOCATION
+} TrustEntryKind;
+
+/*
+ * Either a certificate or, for TRUSTSTORE_REVOCATION, a revocation list.
+ * The subject hash of a revocation list is the hash of its issuer.
+ */
+typedef struct TrustEntry {
+    UA_Byte thumbprint[TRUSTSTORE_THUMBPRINT_SIZE];
+    unsigned long subjectHash;
+    char *path;
+    TrustEntryKind kind;
+    X509 *certificate;
+    X509_CRL *crl;
+    struct TrustEntry *nextByThumbprint;
+    struct TrustEntry *nextBySubject;
+    struct TrustEntry *nextByPath;
+} TrustEntry;
+
+typedef struct {
+    TrustEntry **byThumbprint;
+    TrustEntry **bySubject;
+    TrustEntry **byPath;
+    size_t bucketsSize;
+    size_t entriesSize;
+    size_t trustedSize;
+    char *trustedDirectory;
+    char *issuersDirectory;
+    char *crlDirectory;
+    int inotifyFd;
+    int trustedWatch;
+    int issuersWatch;
+    int crlWatch;
+} TrustStore;
+
+void initTrustStore(TrustStore *store);
+
+void clearTrustStore(TrustStore *store);
+
+/*
+ * Add a single certificate or revocation list file, e.g. given on the
+ * command line. Adding a path again replaces the entry.
+ */
+UA_StatusCode addTrustStoreFile(TrustStore *store, const char *path, TrustEntryKind kind);
+
+/*
+ * Load the certificates of a PKI directory and watch it for changes
+ */
+UA_StatusCode watchTrustStoreDirectory(TrustStore *store, const char *directory);
+
+/*
+ * Apply the pending changes of the watched directories, without blocking
+ */
+void processTrustStoreChanges(TrustStore *store);
+
+/*
+ * Verify client certificates against the store. Only the certificate and
+ * application URI checks are replaced, the other callbacks of the
+ * verification set up by the security policies are kept.
+ */
+void setTrustStoreVerification(UA_CertificateVerification *cv, TrustStore *store);
+
+#endif
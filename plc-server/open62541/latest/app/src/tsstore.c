@@ -0,0 +1,846 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <open62541/plugin/log_stdout.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "tsstore.h"
+
+#define TSSTORE_MAGIC "TSSEG001"
+#define TSSTORE_HEADER_SIZE 128
+
+/*
+ * Largest encoding of a sample: 4 + 64 bits of timestamp, 2 + 5 + 6 + 64
+ * bits of value
+ */
+#define TSSTORE_MAX_SAMPLE_BITS 145
+
+/*
+ * A writer that died while updating the header leaves the sequence counter
+ * odd until the next writer opens the segment
+ */
+#define TSSTORE_READ_RETRIES 10000
+
+typedef struct {
+    char magic[8];
+    uint32_t blockSamples;
+    uint32_t indexEntries;
+    uint64_t dataBits;
+    _Atomic uint64_t sequence;
+    _Atomic uint64_t samples;
+    _Atomic uint64_t bitLength;
+    _Atomic int64_t lastTime;
+    _Atomic uint64_t lastValue;
+    _Atomic uint32_t sealed;
+} SegmentHeader;
+
+_Static_assert(sizeof(SegmentHeader) <= TSSTORE_HEADER_SIZE, "segment header too large");
+
+/*
+ * Entry of the sparse time index, the first sample of a block
+ */
+typedef struct {
+    int64_t firstTime;
+    uint64_t firstValue;
+    uint64_t bitOffset;
+} IndexEntry;
+
+#define TSSTORE_DATA_OFFSET (TSSTORE_HEADER_SIZE + TSSTORE_INDEX_ENTRIES * sizeof(IndexEntry))
+
+/*
+ * Header fields written under the sequence counter
+ */
+typedef struct {
+    uint64_t samples;
+    uint64_t bitLength;
+    int64_t lastTime;
+    uint64_t lastValue;
+    uint32_t sealed;
+} SegmentState;
+
+
+static inline SegmentHeader *segmentHeader(UA_Byte *segment)
+{
+    return (SegmentHeader*)segment;
+}
+
+static inline IndexEntry *segmentIndex(UA_Byte *segment)
+{
+    return (IndexEntry*)(segment + TSSTORE_HEADER_SIZE);
+}
+
+static inline UA_Byte *segmentData(UA_Byte *segment)
+{
+    return segment + TSSTORE_DATA_OFFSET;
+}
+
+
+static inline int64_t toMilliseconds(UA_DateTime time)
+{
+    return (time - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_MSEC;
+}
+
+static inline UA_DateTime fromMilliseconds(int64_t time)
+{
+    return time * UA_DATETIME_MSEC + UA_DATETIME_UNIX_EPOCH;
+}
+
+static inline uint64_t doubleBits(UA_Double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline UA_Double bitsDouble(uint64_t bits)
+{
+    UA_Double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+static UA_Boolean readSegmentState(UA_Byte *segment, SegmentState *state)
+{
+    SegmentHeader *header = segmentHeader(segment);
+    for(int retry = 0; retry < TSSTORE_READ_RETRIES; retry++)
+    {
+        uint64_t before = atomic_load_explicit(&header->sequence, memory_order_acquire);
+        state->samples = atomic_load_explicit(&header->samples, memory_order_relaxed);
+        state->bitLength = atomic_load_explicit(&header->bitLength, memory_order_relaxed);
+        state->lastTime = atomic_load_explicit(&header->lastTime, memory_order_relaxed);
+        state->lastValue = atomic_load_explicit(&header->lastValue, memory_order_relaxed);
+        state->sealed = atomic_load_explicit(&header->sealed, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = atomic_load_explicit(&header->sequence, memory_order_relaxed);
+        if(before == after && (before & 1) == 0)
+        {
+            return true;
+        }
+    }
+    UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                   "Time series segment header is not consistent");
+    return false;
+}
+
+
+static void writeSegmentState(UA_Byte *segment, const SegmentState *state)
+{
+    SegmentHeader *header = segmentHeader(segment);
+    uint64_t sequence = atomic_load_explicit(&header->sequence, memory_order_relaxed);
+    atomic_store_explicit(&header->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&header->samples, state->samples, memory_order_relaxed);
+    atomic_store_explicit(&header->bitLength, state->bitLength, memory_order_relaxed);
+    atomic_store_explicit(&header->lastTime, state->lastTime, memory_order_relaxed);
+    atomic_store_explicit(&header->lastValue, state->lastValue, memory_order_relaxed);
+    atomic_store_explicit(&header->sealed, state->sealed, memory_order_relaxed);
+    atomic_store_explicit(&header->sequence, sequence + 2, memory_order_release);
+}
+
+
+/*
+ * Bit stream, most significant bit first. Written bits are ORed into the
+ * stream, which has to be zeroed beyond its end.
+ */
+static void writeBits(UA_Byte *data, uint64_t *position, uint64_t value, unsigned count)
+{
+    while(count > 0)
+    {
+        unsigned free = 8 - (unsigned)(*position & 7);
+        unsigned n = count < free ? count : free;
+        UA_Byte bits = (UA_Byte)((value >> (count - n)) & ((1u << n) - 1));
+        data[*position >> 3] |= (UA_Byte)(bits << (free - n));
+        *position += n;
+        count -= n;
+    }
+}
+
+
+static uint64_t readBits(const UA_Byte *data, uint64_t *position, unsigned count)
+{
+    uint64_t value = 0;
+    while(count > 0)
+    {
+        unsigned available = 8 - (unsigned)(*position & 7);
+        unsigned n = count < available ? count : available;
+        UA_Byte byte = data[*position >> 3];
+        value = (value << n) | ((byte >> (available - n)) & ((1u << n) - 1));
+        *position += n;
+        count -= n;
+    }
+    return value;
+}
+
+
+static void startCodec(TimeSeriesCodec *codec, int64_t time, uint64_t value)
+{
+    codec->time = time;
+    codec->delta = 0;
+    codec->value = value;
+    codec->leading = 64;    /* no window yet */
+    codec->trailing = 0;
+}
+
+
+/*
+ * Timestamps: '0' if the delta repeats, else '10', '110' or '1110' and the
+ * delta of delta in 7, 9 or 12 bits, '1111' and 64 bits for larger jumps.
+ * Values: '0' if repeated, else '10' and the XOR in the meaningful bits of
+ * the previous window, or '11', 5 bits leading zeros, 6 bits length and
+ * the XOR in a new window.
+ */
+static void encodeSample(UA_Byte *data, uint64_t *position, TimeSeriesCodec *codec,
+                         int64_t time, uint64_t value)
+{
+    int64_t delta = time - codec->time;
+    int64_t deltaOfDelta = delta - codec->delta;
+    if(deltaOfDelta == 0)
+    {
+        writeBits(data, position, 0x0, 1);
+    }
+    else if(deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        writeBits(data, position, 0x2, 2);
+        writeBits(data, position, (uint64_t)(deltaOfDelta + 63), 7);
+    }
+    else if(deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        writeBits(data, position, 0x6, 3);
+        writeBits(data, position, (uint64_t)(deltaOfDelta + 255), 9);
+    }
+    else if(deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        writeBits(data, position, 0xe, 4);
+        writeBits(data, position, (uint64_t)(deltaOfDelta + 2047), 12);
+    }
+    else
+    {
+        writeBits(data, position, 0xf, 4);
+        writeBits(data, position, (uint64_t)deltaOfDelta, 64);
+    }
+    codec->time = time;
+    codec->delta = delta;
+
+    uint64_t xor = value ^ codec->value;
+    if(xor == 0)
+    {
+        writeBits(data, position, 0x0, 1);
+        return;
+    }
+
+    uint8_t leading = (uint8_t)__builtin_clzll(xor);
+    uint8_t trailing = (uint8_t)__builtin_ctzll(xor);
+    if(leading > 31)
+    {
+        leading = 31;
+    }
+    if(leading >= codec->leading && trailing >= codec->trailing)
+    {
+        writeBits(data, position, 0x2, 2);
+        writeBits(data, position, xor >> codec->trailing,
+                  64u - codec->leading - codec->trailing);
+    }
+    else
+    {
+        unsigned meaningful = 64u - leading - trailing;
+        writeBits(data, position, 0x3, 2);
+        writeBits(data, position, leading, 5);
+        writeBits(data, position, meaningful - 1, 6);
+        writeBits(data, position, xor >> trailing, meaningful);
+        codec->leading = leading;
+        codec->trailing = trailing;
+    }
+    codec->value = value;
+}
+
+
+static void decodeSample(const UA_Byte *data, uint64_t *position, TimeSeriesCodec *codec)
+{
+    int64_t deltaOfDelta;
+    if(readBits(data, position, 1) == 0)
+    {
+        deltaOfDelta = 0;
+    }
+    else if(readBits(data, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)readBits(data, position, 7) - 63;
+    }
+    else if(readBits(data, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)readBits(data, position, 9) - 255;
+    }
+    else if(readBits(data, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)readBits(data, position, 12) - 2047;
+    }
+    else
+    {
+        deltaOfDelta = (int64_t)readBits(data, position, 64);
+    }
+    codec->delta += deltaOfDelta;
+    codec->time += codec->delta;
+
+    if(readBits(data, position, 1) == 0)
+    {
+        return;
+    }
+    if(readBits(data, position, 1) != 0)
+    {
+        codec->leading = (uint8_t)readBits(data, position, 5);
+        unsigned meaningful = (unsigned)readBits(data, position, 6) + 1;
+        codec->trailing = (uint8_t)(64u - codec->leading - meaningful);
+    }
+    unsigned meaningful = 64u - codec->leading - codec->trailing;
+    codec->value ^= readBits(data, position, meaningful) << codec->trailing;
+}
+
+
+static void segmentPath(const TimeSeries *series, UA_UInt32 number, char *path, size_t pathSize)
+{
+    snprintf(path, pathSize, "%s/%s.%08u.seg", series->dir, series->name, number);
+}
+
+
+static UA_Boolean parseSegmentName(const TimeSeries *series, const char *filename,
+                                   UA_UInt32 *number)
+{
+    size_t nameLength = strlen(series->name);
+    if(strncmp(filename, series->name, nameLength) != 0 || filename[nameLength] != '.')
+    {
+        return false;
+    }
+    const char *digits = filename + nameLength + 1;
+    char *end;
+    unsigned long parsed = strtoul(digits, &end, 10);
+    if(end == digits || strcmp(end, ".seg") != 0 || parsed == 0 || parsed > UINT32_MAX)
+    {
+        return false;
+    }
+    *number = (UA_UInt32)parsed;
+    return true;
+}
+
+
+static int compareNumbers(const void *a, const void *b)
+{
+    UA_UInt32 left = *(const UA_UInt32*)a;
+    UA_UInt32 right = *(const UA_UInt32*)b;
+    return (left > right) - (left < right);
+}
+
+
+/*
+ * Sorted numbers of the segments of the series, none if the directory does
+ * not exist yet
+ */
+static UA_StatusCode listSegments(const TimeSeries *series, UA_UInt32 **numbers,
+                                  size_t *numbersSize)
+{
+    *numbers = NULL;
+    *numbersSize = 0;
+
+    DIR *dir = opendir(series->dir);
+    if(!dir)
+    {
+        if(errno == ENOENT)
+        {
+            return UA_STATUSCODE_GOOD;
+        }
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to list time series directory %s: %s",
+                       series->dir, strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        UA_UInt32 number;
+        if(!parseSegmentName(series, entry->d_name, &number))
+        {
+            continue;
+        }
+        UA_UInt32 *grown = (UA_UInt32*)realloc(*numbers, (*numbersSize + 1) * sizeof(UA_UInt32));
+        if(!grown)
+        {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            break;
+        }
+        *numbers = grown;
+        (*numbers)[(*numbersSize)++] = number;
+    }
+    closedir(dir);
+
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        free(*numbers);
+        *numbers = NULL;
+        *numbersSize = 0;
+        return retval;
+    }
+    qsort(*numbers, *numbersSize, sizeof(UA_UInt32), compareNumbers);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static UA_UInt32 newestSegment(const TimeSeries *series)
+{
+    UA_UInt32 *numbers;
+    size_t numbersSize;
+    if(listSegments(series, &numbers, &numbersSize) != UA_STATUSCODE_GOOD || numbersSize == 0)
+    {
+        return 0;
+    }
+    UA_UInt32 newest = numbers[numbersSize - 1];
+    free(numbers);
+    return newest;
+}
+
+
+/*
+ * Map a segment read-only or for writing. A created segment must not exist
+ * yet and gets a fresh header.
+ */
+static UA_StatusCode mapSegment(const TimeSeries *series, UA_UInt32 number, UA_Boolean writable,
+                                UA_Boolean create, UA_Byte **segment)
+{
+    char path[PATH_MAX];
+    segmentPath(series, number, path, sizeof(path));
+
+    int flags = writable ? O_RDWR : O_RDONLY;
+    if(create)
+    {
+        flags |= O_CREAT | O_EXCL;
+    }
+    int fd = open(path, flags, 0644);
+    if(fd < 0)
+    {
+        if(errno != ENOENT)
+        {
+            UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                           "Unable to open time series segment %s: %s",
+                           path, strerror(errno));
+        }
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+
+    struct stat st;
+    UA_Boolean sized = create ? ftruncate(fd, TSSTORE_SEGMENT_SIZE) == 0
+                              : fstat(fd, &st) == 0 && st.st_size == TSSTORE_SEGMENT_SIZE;
+    if(!sized)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Time series segment %s has not the expected size", path);
+        close(fd);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    void *mapped = mmap(NULL, TSSTORE_SEGMENT_SIZE,
+                        writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to map time series segment %s: %s",
+                       path, strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    SegmentHeader *header = (SegmentHeader*)mapped;
+    if(create)
+    {
+        memcpy(header->magic, TSSTORE_MAGIC, sizeof(header->magic));
+        header->blockSamples = TSSTORE_BLOCK_SAMPLES;
+        header->indexEntries = TSSTORE_INDEX_ENTRIES;
+        header->dataBits = (uint64_t)(TSSTORE_SEGMENT_SIZE - TSSTORE_DATA_OFFSET) * 8;
+    }
+    else if(   memcmp(header->magic, TSSTORE_MAGIC, sizeof(header->magic)) != 0
+            || header->blockSamples != TSSTORE_BLOCK_SAMPLES
+            || header->indexEntries != TSSTORE_INDEX_ENTRIES)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "%s is not a time series segment of this format", path);
+        munmap(mapped, TSSTORE_SEGMENT_SIZE);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    *segment = (UA_Byte*)mapped;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+static void unmapSegment(TimeSeries *series)
+{
+    if(series->segment)
+    {
+        munmap(series->segment, TSSTORE_SEGMENT_SIZE);
+    }
+    series->segment = NULL;
+    series->segmentNumber = 0;
+}
+
+
+/*
+ * Seal the current segment of the writer and continue in a new one
+ */
+static UA_StatusCode startSegment(TimeSeries *series, UA_UInt32 number)
+{
+    if(series->segment)
+    {
+        SegmentState state;
+        readSegmentState(series->segment, &state);
+        state.sealed = 1;
+        writeSegmentState(series->segment, &state);
+        msync(series->segment, TSSTORE_SEGMENT_SIZE, MS_ASYNC);
+        unmapSegment(series);
+    }
+
+    UA_StatusCode retval = mapSegment(series, number, true, true, &series->segment);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to start segment %u of time series %s",
+                       number, series->name);
+        return retval;
+    }
+    series->segmentNumber = number;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Continue the last block of a segment after a restart. Bits behind the
+ * committed end may stem from a sample that was written when the previous
+ * writer died, they are cleared.
+ */
+static void restoreWriter(TimeSeries *series)
+{
+    SegmentHeader *header = segmentHeader(series->segment);
+    uint64_t sequence = atomic_load_explicit(&header->sequence, memory_order_relaxed);
+    if(sequence & 1)
+    {
+        atomic_store_explicit(&header->sequence, sequence + 1, memory_order_release);
+    }
+
+    SegmentState state;
+    readSegmentState(series->segment, &state);
+    if(state.samples == 0)
+    {
+        return;
+    }
+
+    UA_Byte *data = segmentData(series->segment);
+    uint64_t block = (state.samples - 1) / TSSTORE_BLOCK_SAMPLES;
+    const IndexEntry *entry = &segmentIndex(series->segment)[block];
+    startCodec(&series->codec, entry->firstTime, entry->firstValue);
+    uint64_t position = entry->bitOffset;
+    for(uint64_t i = block * TSSTORE_BLOCK_SAMPLES + 1; i < state.samples; i++)
+    {
+        decodeSample(data, &position, &series->codec);
+    }
+
+    uint64_t byte = state.bitLength >> 3;
+    unsigned used = (unsigned)(state.bitLength & 7);
+    if(used)
+    {
+        data[byte] &= (UA_Byte)(0xff << (8 - used));
+        byte++;
+    }
+    uint64_t dataBytes = header->dataBits / 8;
+    uint64_t dirty = TSSTORE_MAX_SAMPLE_BITS / 8 + 1;
+    if(byte < dataBytes)
+    {
+        memset(data + byte, 0, dataBytes - byte < dirty ? dataBytes - byte : dirty);
+    }
+}
+
+
+UA_StatusCode openTimeSeries(TimeSeries *series, const char *dir, const char *name,
+                             UA_Boolean writable)
+{
+    memset(series, 0, sizeof(TimeSeries));
+    series->dir = dir;
+    series->name = name;
+    series->writable = writable;
+
+    if(writable && mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        UA_LOG_WARNING(asyncLog, UA_LOGCATEGORY_USERLAND,
+                       "Unable to create time series directory %s: %s",
+                       dir, strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_UInt32 number = newestSegment(series);
+    if(number == 0)
+    {
+        return writable ? startSegment(series, 1) : UA_STATUSCODE_GOOD;
+    }
+
+    UA_StatusCode retval = mapSegment(series, number, writable, false, &series->segment);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    series->segmentNumber = number;
+    if(!writable)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    restoreWriter(series);
+    if(atomic_load_explicit(&segmentHeader(series->segment)->sealed, memory_order_relaxed))
+    {
+        return startSegment(series, number + 1);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void closeTimeSeries(TimeSeries *series)
+{
+    if(series->writable && series->segment)
+    {
+        msync(series->segment, TSSTORE_SEGMENT_SIZE, MS_ASYNC);
+    }
+    unmapSegment(series);
+}
+
+
+UA_StatusCode appendTimeSeries(TimeSeries *series, UA_DateTime time, UA_Double value)
+{
+    if(!series->writable || !series->segment)
+    {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    SegmentHeader *header = segmentHeader(series->segment);
+    uint64_t samples = atomic_load_explicit(&header->samples, memory_order_relaxed);
+    uint64_t bitLength = atomic_load_explicit(&header->bitLength, memory_order_relaxed);
+    if(   samples == (uint64_t)TSSTORE_BLOCK_SAMPLES * TSSTORE_INDEX_ENTRIES
+       || bitLength + TSSTORE_MAX_SAMPLE_BITS > header->dataBits)
+    {
+        UA_StatusCode retval = startSegment(series, series->segmentNumber + 1);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            return retval;
+        }
+        samples = 0;
+        bitLength = 0;
+    }
+
+    int64_t milliseconds = toMilliseconds(time);
+    uint64_t bits = doubleBits(value);
+    if(samples % TSSTORE_BLOCK_SAMPLES == 0)
+    {
+        IndexEntry *entry = &segmentIndex(series->segment)[samples / TSSTORE_BLOCK_SAMPLES];
+        entry->firstTime = milliseconds;
+        entry->firstValue = bits;
+        entry->bitOffset = bitLength;
+        startCodec(&series->codec, milliseconds, bits);
+    }
+    else
+    {
+        encodeSample(segmentData(series->segment), &bitLength, &series->codec,
+                     milliseconds, bits);
+    }
+
+    SegmentState state = {
+        .samples = samples + 1,
+        .bitLength = bitLength,
+        .lastTime = milliseconds,
+        .lastValue = bits,
+        .sealed = 0,
+    };
+    writeSegmentState(series->segment, &state);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_StatusCode readLatestTimeSeries(TimeSeries *series, UA_DateTime *time, UA_Double *value)
+{
+    if(!series->segment)
+    {
+        UA_UInt32 number = newestSegment(series);
+        if(number == 0 || mapSegment(series, number, false, false, &series->segment) != UA_STATUSCODE_GOOD)
+        {
+            return UA_STATUSCODE_BADNODATA;
+        }
+        series->segmentNumber = number;
+    }
+
+    SegmentState state;
+    if(!readSegmentState(series->segment, &state))
+    {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    /*
+     * A reader follows the writer to the next segment once it holds samples
+     */
+    UA_Byte *next;
+    if(   state.sealed && !series->writable
+       && mapSegment(series, series->segmentNumber + 1, false, false, &next) == UA_STATUSCODE_GOOD)
+    {
+        SegmentState nextState;
+        if(readSegmentState(next, &nextState) && nextState.samples > 0)
+        {
+            UA_UInt32 number = series->segmentNumber + 1;
+            unmapSegment(series);
+            series->segment = next;
+            series->segmentNumber = number;
+            state = nextState;
+        }
+        else
+        {
+            munmap(next, TSSTORE_SEGMENT_SIZE);
+        }
+    }
+
+    if(state.samples == 0)
+    {
+        return UA_STATUSCODE_BADNODATA;
+    }
+    *time = fromMilliseconds(state.lastTime);
+    *value = bitsDouble(state.lastValue);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Visit the samples of one segment in the range, returns false once a
+ * sample after the range was reached
+ */
+static UA_Boolean scanSegment(UA_Byte *segment, int64_t from, int64_t to,
+                              TimeSeriesVisitor visitor, void *context)
+{
+    SegmentState state;
+    if(!readSegmentState(segment, &state) || state.samples == 0 || state.lastTime < from)
+    {
+        return true;
+    }
+
+    const IndexEntry *index = segmentIndex(segment);
+    const UA_Byte *data = segmentData(segment);
+    uint64_t blocks = (state.samples + TSSTORE_BLOCK_SAMPLES - 1) / TSSTORE_BLOCK_SAMPLES;
+    if(index[0].firstTime > to)
+    {
+        return false;
+    }
+
+    /*
+     * Last block that starts before the range
+     */
+    uint64_t low = 0;
+    uint64_t high = blocks;
+    while(high - low > 1)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if(index[middle].firstTime <= from)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    for(uint64_t block = low; block < blocks; block++)
+    {
+        const IndexEntry *entry = &index[block];
+        uint64_t first = block * TSSTORE_BLOCK_SAMPLES;
+        uint64_t end = first + TSSTORE_BLOCK_SAMPLES < state.samples
+                     ? first + TSSTORE_BLOCK_SAMPLES : state.samples;
+        TimeSeriesCodec codec;
+        startCodec(&codec, entry->firstTime, entry->firstValue);
+        uint64_t position = entry->bitOffset;
+        for(uint64_t i = first; i < end; i++)
+        {
+            if(i > first)
+            {
+                decodeSample(data, &position, &codec);
+            }
+            if(codec.time > to)
+            {
+                return false;
+            }
+            if(codec.time >= from)
+            {
+                visitor(context, fromMilliseconds(codec.time), bitsDouble(codec.value));
+            }
+        }
+    }
+    return true;
+}
+
+
+UA_StatusCode scanTimeSeries(TimeSeries *series, UA_DateTime from, UA_DateTime to,
+                             TimeSeriesVisitor visitor, void *context)
+{
+    UA_UInt32 *numbers;
+    size_t numbersSize;
+    UA_StatusCode retval = listSegments(series, &numbers, &numbersSize);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+
+    int64_t fromTime = toMilliseconds(from);
+    int64_t toTime = toMilliseconds(to);
+    for(size_t i = 0; i < numbersSize; i++)
+    {
+        UA_Byte *segment;
+        if(mapSegment(series, numbers[i], false, false, &segment) != UA_STATUSCODE_GOOD)
+        {
+            continue;
+        }
+        UA_Boolean more = scanSegment(segment, fromTime, toTime, visitor, context);
+        munmap(segment, TSSTORE_SEGMENT_SIZE);
+        if(!more)
+        {
+            break;
+        }
+    }
+    free(numbers);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+UA_UInt64 timeSeriesBytesUsed(TimeSeries *series)
+{
+    UA_UInt32 *numbers;
+    size_t numbersSize;
+    if(listSegments(series, &numbers, &numbersSize) != UA_STATUSCODE_GOOD)
+    {
+        return 0;
+    }
+
+    UA_UInt64 bytes = 0;
+    for(size_t i = 0; i < numbersSize; i++)
+    {
+        UA_Byte *segment;
+        SegmentState state;
+        if(mapSegment(series, numbers[i], false, false, &segment) != UA_STATUSCODE_GOOD)
+        {
+            continue;
+        }
+        if(readSegmentState(segment, &state))
+        {
+            uint64_t blocks = (state.samples + TSSTORE_BLOCK_SAMPLES - 1) / TSSTORE_BLOCK_SAMPLES;
+            bytes += TSSTORE_HEADER_SIZE + blocks * sizeof(IndexEntry) + (state.bitLength + 7) / 8;
+        }
+        munmap(segment, TSSTORE_SEGMENT_SIZE);
+    }
+    free(numbers);
+    return bytes;
+}
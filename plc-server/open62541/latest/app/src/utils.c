@@ -2,44 +2,62 @@
 #include <open62541/config.h>
 #include <open62541/server.h>
 #include <open62541/types.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-UA_ByteString loadFile(const char *const path)
+UA_StatusCode mapFile(const char *path, MappedFile *file)
 {
-    UA_ByteString fileContents = UA_STRING_NULL;
+    memset(file, 0, sizeof(MappedFile));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
 
-    /* Open the file */
-    FILE *fp = fopen(path, "rb");
-    if(!fp)
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        /*
-         * This returns an empty UA_ByteString to check for
-         */
-        return fileContents;
+        close(fd);
+        return UA_STATUSCODE_BADNOTFOUND;
     }
 
     /*
-     * Get the file length, allocate the data and read
+     * The whole file is read right away, so populate the pages upfront
+     * instead of faulting them in one by one
      */
-    fseek(fp, 0, SEEK_END);
-    fileContents.length = (size_t)ftell(fp);
-    fileContents.data = (UA_Byte *)UA_malloc(fileContents.length * sizeof(UA_Byte));
-    if(fileContents.data)
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    file->contents.data = (UA_Byte*)data;
+    file->contents.length = (size_t)st.st_size;
+
+    size_t start = 0;
+    while(start < file->contents.length && isspace(file->contents.data[start]))
     {
-        fseek(fp, 0, SEEK_SET);
-        size_t read = fread(fileContents.data, sizeof(UA_Byte), fileContents.length, fp);
-        if(read != fileContents.length)
-        {
-            UA_ByteString_clear(&fileContents);
-        }
+        start++;
     }
-    else
+    file->pem = file->contents.length - start >= 10 &&
+        memcmp(file->contents.data + start, "-----BEGIN", 10) == 0;
+    return UA_STATUSCODE_GOOD;
+}
+
+
+void unmapFile(MappedFile *file)
+{
+    if(file->contents.data)
     {
-        fileContents.length = 0;
+        munmap(file->contents.data, file->contents.length);
     }
-    fclose(fp);
-    return fileContents;
+    memset(file, 0, sizeof(MappedFile));
 }
 
 
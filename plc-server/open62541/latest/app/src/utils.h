@@ -5,10 +5,19 @@
 
 
 /*
- * Parses the certificate and key file. Copied from example code
- * found on the open62541 github repository
+ * Certificate or key file mapped into memory. The contents point into the
+ * read-only mapping, they must not be modified or cleared, only released
+ * with unmapFile. PEM files are detected by their armor, everything else
+ * is assumed to be DER.
  */
-UA_ByteString loadFile(const char *const path);
+typedef struct {
+    UA_ByteString contents;
+    UA_Boolean pem;
+} MappedFile;
+
+UA_StatusCode mapFile(const char *path, MappedFile *file);
+
+void unmapFile(MappedFile *file);
 
 
 /*
@@ -3,16 +3,48 @@
 # treat undefined variables as an error
 set -u
 
-# wait until another process has setup the database
-# including creating the tables
+# plc-server creates the database or migrates it on start, so it does not
+# wait for plc-logic-client
 DB_NAME="${DB_NAME:-/database/process_database.sqlite3}"
-LOCKFILE="${DB_NAME:-/database/process_database.sqlite3}.lock"
-while [ ! -f "$LOCKFILE" ]; do
-  sleep 1
-done
 
 # generate the keys for encryption
 /pki/gen_kc_pair.sh
 
+# if METRICS_ADDRESS is set, serve Prometheus metrics on [ADDR:]PORT
+metrics_opt=""
+if [ -n "${METRICS_ADDRESS:-}" ]; then
+  metrics_opt="--metrics=${METRICS_ADDRESS}"
+fi
+
+# if TIMESERIES_DIR is set, read the samples from the time-series store of
+# plc-logic-client in that directory instead of the database
+timeseries_opt=""
+if [ -n "${TIMESERIES_DIR:-}" ]; then
+  timeseries_opt="--timeseries=${TIMESERIES_DIR}"
+fi
+
+# if ALARM_INTERVAL_MS or ALARM_HYSTERESIS are set, they override the
+# evaluation of the threshold alarm
+alarm_opt=""
+if [ -n "${ALARM_INTERVAL_MS:-}" ]; then
+  alarm_opt="--alarm-interval=${ALARM_INTERVAL_MS}"
+fi
+if [ -n "${ALARM_HYSTERESIS:-}" ]; then
+  alarm_opt="$alarm_opt --alarm-hysteresis=${ALARM_HYSTERESIS}"
+fi
+
+# if TANK_SYSTEMS is set, serve tankSystem1 to tankSystemN
+tanks_opt=""
+if [ -n "${TANK_SYSTEMS:-}" ]; then
+  tanks_opt="--tank-systems=${TANK_SYSTEMS}"
+fi
+
+# if NET_PROFILE is set, impair the connections of the clients, e.g. for
+# testing the control loop over a wifi or congested link
+net_profile_opt=""
+if [ -n "${NET_PROFILE:-}" ]; then
+  net_profile_opt="--net-profile=${NET_PROFILE}"
+fi
+
 # start the server
-/usr/local/bin/plc-server -d $DB_NAME
+/usr/local/bin/plc-server -d $DB_NAME $timeseries_opt $metrics_opt $alarm_opt $tanks_opt $net_profile_opt
@@ -0,0 +1,369 @@
+#include <math.h>
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include <stdlib.h>
+#include <string.h>
+#include "actuator.h"
+#include "asynclog.h"
+#include "diagnostics.h"
+#include "metrics.h"
+#include "utils.h"
+
+#define ACTUATOR_TICK (ACTUATOR_TICK_MS * UA_DATETIME_MSEC)
+
+static Metric *actuationMetric = NULL;
+
+
+UA_StatusCode initActuatorWheel(ActuatorWheel *wheel, size_t size,
+                                UA_UInt32 strokeTimeMs, UA_UInt32 deadTimeMs)
+{
+    memset(wheel, 0, sizeof(ActuatorWheel));
+    wheel->actuators = (ValveActuator*)calloc(size, sizeof(ValveActuator));
+    if(!wheel->actuators)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    wheel->actuatorsSize = size;
+    wheel->strokeTime = (UA_DateTime)strokeTimeMs * UA_DATETIME_MSEC;
+    wheel->deadTime = (UA_DateTime)deadTimeMs * UA_DATETIME_MSEC;
+    wheel->start = UA_DateTime_nowMonotonic();
+
+    actuationMetric = registerMetric(
+        "ValveActuationLatency", "Time from a write to 'Open' to the valve reaching its end position",
+        METRIC_LATENCY);
+    return UA_STATUSCODE_GOOD;
+}
+
+
+/*
+ * Put the actuator on the wheel at the first tick not before 'time', but
+ * never at a tick already processed
+ */
+static void scheduleActuator(ActuatorWheel *wheel, ValveActuator *actuator, UA_DateTime time)
+{
+    UA_UInt64 expiry = time > wheel->start
+        ? (UA_UInt64)((time - wheel->start + ACTUATOR_TICK - 1) / ACTUATOR_TICK)
+        : 0;
+    if(expiry <= wheel->tick)
+    {
+        expiry = wheel->tick + 1;
+    }
+    size_t slot = expiry % ACTUATOR_WHEEL_SLOTS;
+    actuator->expiry = expiry;
+    actuator->prev = NULL;
+    actuator->next = wheel->slots[slot];
+    if(actuator->next)
+    {
+        actuator->next->prev = actuator;
+    }
+    wheel->slots[slot] = actuator;
+    actuator->scheduled = true;
+}
+
+
+static void unscheduleActuator(ActuatorWheel *wheel, ValveActuator *actuator)
+{
+    if(!actuator->scheduled)
+    {
+        return;
+    }
+    if(actuator->prev)
+    {
+        actuator->prev->next = actuator->next;
+    }
+    else
+    {
+        wheel->slots[actuator->expiry % ACTUATOR_WHEEL_SLOTS] = actuator->next;
+    }
+    if(actuator->next)
+    {
+        actuator->next->prev = actuator->prev;
+    }
+    actuator->scheduled = false;
+}
+
+
+/*
+ * Time the moving valve reaches the end position of the active command
+ */
+static UA_DateTime getEndTime(const ActuatorWheel *wheel, const ValveActuator *actuator)
+{
+    UA_Double target = actuator->active.open ? 100. : 0.;
+    return actuator->positionTime
+        + (UA_DateTime)(fabs(target - actuator->position) / 100. * (UA_Double)wheel->strokeTime);
+}
+
+
+/*
+ * Move the valve towards the end position of the active command up to
+ * 'time'. The command is recorded at the exact time the end position is
+ * reached, independent of the tick it is noticed at.
+ */
+static void moveValve(ActuatorWheel *wheel, ValveActuator *actuator, UA_DateTime time)
+{
+    if(actuator->moving)
+    {
+        UA_DateTime end = getEndTime(wheel, actuator);
+        if(end <= time)
+        {
+            actuator->position = actuator->active.open ? 100. : 0.;
+            actuator->moving = false;
+            UA_Int64 latency = (end - actuator->active.received) / UA_DATETIME_USEC;
+            recordHistogramValue(&actuator->actuationLatency.histogram, latency);
+            recordLatency(actuationMetric, latency);
+        }
+        else
+        {
+            UA_Double travel = (UA_Double)(time - actuator->positionTime)
+                / (UA_Double)wheel->strokeTime * 100.;
+            actuator->position += actuator->active.open ? travel : -travel;
+        }
+    }
+    actuator->positionTime = time;
+}
+
+
+static void publishPosition(UA_Server *server, ValveActuator *actuator)
+{
+    if(actuator->position == actuator->published)
+    {
+        return;
+    }
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &actuator->position, &UA_TYPES[UA_TYPES_DOUBLE]);
+    if(UA_Server_writeValue(server, actuator->positionIdent, value) == UA_STATUSCODE_GOOD)
+    {
+        actuator->published = actuator->position;
+        recordValueChange(&actuator->positionIdent);
+    }
+}
+
+
+/*
+ * Called from the wheel once the actuator is due. Queued commands take
+ * effect in order, each one moving the valve from where the previous one
+ * left it, which reverses a valve mid-stroke.
+ */
+static void advanceActuator(UA_Server *server, ActuatorWheel *wheel, ValveActuator *actuator,
+                            UA_DateTime now)
+{
+    while(actuator->queueSize > 0)
+    {
+        ValveCommand *command = &actuator->queue[actuator->queueHead];
+        UA_DateTime effective = command->received + wheel->deadTime;
+        if(effective > now)
+        {
+            break;
+        }
+        moveValve(wheel, actuator, effective);
+        actuator->active = *command;
+        actuator->moving = true;
+        actuator->queueHead = (actuator->queueHead + 1) % ACTUATOR_QUEUE_SIZE;
+        actuator->queueSize--;
+    }
+    moveValve(wheel, actuator, now);
+    publishPosition(server, actuator);
+
+    /*
+     * Back on the wheel for the next position update, the end of the
+     * stroke or the next command, whichever comes first
+     */
+    UA_Boolean due = false;
+    UA_DateTime next = 0;
+    if(actuator->moving)
+    {
+        next = getEndTime(wheel, actuator);
+        if(next > now + ACTUATOR_UPDATE_MS * UA_DATETIME_MSEC)
+        {
+            next = now + ACTUATOR_UPDATE_MS * UA_DATETIME_MSEC;
+        }
+        due = true;
+    }
+    if(actuator->queueSize > 0)
+    {
+        UA_DateTime effective = actuator->queue[actuator->queueHead].received + wheel->deadTime;
+        next = due && next < effective ? next : effective;
+        due = true;
+    }
+    if(due)
+    {
+        scheduleActuator(wheel, actuator, next);
+    }
+}
+
+
+/*
+ * Advance the wheel to the current tick. If the callback was delayed by
+ * more than a revolution, every slot is visited once.
+ */
+static void wheelCallback(UA_Server *server, void *data)
+{
+    ActuatorWheel *wheel = (ActuatorWheel*)data;
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_UInt64 target = (UA_UInt64)((now - wheel->start) / ACTUATOR_TICK);
+    if(target > wheel->tick + ACTUATOR_WHEEL_SLOTS)
+    {
+        wheel->tick = target - ACTUATOR_WHEEL_SLOTS;
+    }
+    while(wheel->tick < target)
+    {
+        wheel->tick++;
+        size_t slot = wheel->tick % ACTUATOR_WHEEL_SLOTS;
+        ValveActuator *actuator = wheel->slots[slot];
+        wheel->slots[slot] = NULL;
+        while(actuator)
+        {
+            ValveActuator *next = actuator->next;
+            if(actuator->expiry <= wheel->tick)
+            {
+                actuator->scheduled = false;
+                advanceActuator(server, wheel, actuator, now);
+            }
+            else
+            {
+                actuator->prev = NULL;
+                actuator->next = wheel->slots[slot];
+                if(actuator->next)
+                {
+                    actuator->next->prev = actuator;
+                }
+                wheel->slots[slot] = actuator;
+            }
+            actuator = next;
+        }
+    }
+}
+
+
+/*
+ * Called after a write to 'Open' has been applied to the node, which
+ * holds the command. Also counts the notifications caused by the write.
+ */
+static void openWrittenCallback(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range, const UA_DataValue *data)
+{
+    recordValueChange(nodeId);
+    ValveActuator *actuator = (ValveActuator*)nodeContext;
+    if(!actuator)
+    {
+        return;
+    }
+    if(data->hasSourceTimestamp)
+    {
+        recordHistogramValue(&actuator->applyLatency.histogram,
+                             (UA_DateTime_now() - data->sourceTimestamp) / UA_DATETIME_USEC);
+    }
+    if(!data->hasValue || !UA_Variant_hasScalarType(&data->value, &UA_TYPES[UA_TYPES_BOOLEAN]))
+    {
+        return;
+    }
+
+    /*
+     * A full queue drops the oldest command, it would be superseded by
+     * the later ones anyway
+     */
+    if(actuator->queueSize == ACTUATOR_QUEUE_SIZE)
+    {
+        actuator->queueHead = (actuator->queueHead + 1) % ACTUATOR_QUEUE_SIZE;
+        actuator->queueSize--;
+    }
+    ValveCommand *command = &actuator->queue[(actuator->queueHead + actuator->queueSize) % ACTUATOR_QUEUE_SIZE];
+    command->open = *(UA_Boolean*)data->value.data;
+    command->received = UA_DateTime_nowMonotonic();
+    actuator->queueSize++;
+
+    /*
+     * Move the actuator up on the wheel if the command takes effect
+     * before it is due
+     */
+    ActuatorWheel *wheel = actuator->wheel;
+    UA_DateTime effective = command->received + wheel->deadTime;
+    if(!actuator->scheduled
+       || wheel->start + (UA_DateTime)actuator->expiry * ACTUATOR_TICK > effective)
+    {
+        unscheduleActuator(wheel, actuator);
+        scheduleActuator(wheel, actuator, effective);
+    }
+}
+
+
+UA_StatusCode addValveActuator(UA_Server *server, ActuatorWheel *wheel, size_t index,
+                               const UA_NodeId *valveIdent)
+{
+    ValveActuator *actuator = &wheel->actuators[index];
+    actuator->wheel = wheel;
+
+    UA_QualifiedName qn = UA_QUALIFIEDNAME(1, "Position");
+    UA_StatusCode retval = findAttributeNodeId(server, valveIdent, &qn, &actuator->positionIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'Position'");
+        return retval;
+    }
+
+    qn = UA_QUALIFIEDNAME(1, "Open");
+    UA_NodeId openIdent;
+    retval = findAttributeNodeId(server, valveIdent, &qn, &openIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'Open'");
+        return retval;
+    }
+    retval = UA_Server_setNodeContext(server, openIdent, actuator);
+    if(retval == UA_STATUSCODE_GOOD)
+    {
+        UA_ValueCallback callback = {NULL, openWrittenCallback};
+        retval = UA_Server_setVariableNode_valueCallback(server, openIdent, callback);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add write callback to 'Open'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+
+    retval = addLatencyHistogram(server, valveIdent, "ApplyLatency", &actuator->applyLatency);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        return retval;
+    }
+    return addLatencyHistogram(server, valveIdent, "ActuationLatency", &actuator->actuationLatency);
+}
+
+
+UA_StatusCode startActuatorWheel(UA_Server *server, ActuatorWheel *wheel)
+{
+    UA_StatusCode retval = UA_Server_addRepeatedCallback(server, wheelCallback, wheel,
+                                                         ACTUATOR_TICK_MS, &wheel->callbackId);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to schedule the valve actuators: %s",
+                    UA_StatusCode_name(retval));
+    }
+    return retval;
+}
+
+
+void stopActuatorWheel(UA_Server *server, ActuatorWheel *wheel)
+{
+    if(wheel->callbackId != 0)
+    {
+        UA_Server_removeRepeatedCallback(server, wheel->callbackId);
+        wheel->callbackId = 0;
+    }
+}
+
+
+void clearActuatorWheel(ActuatorWheel *wheel)
+{
+    free(wheel->actuators);
+    wheel->actuators = NULL;
+    wheel->actuatorsSize = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#include <open62541/server.h>
+#include "apply_latency.h"
+
+/*
+ * Travel model of the valves. A write to 'Open' is a command: it is
+ * queued, takes effect after the dead time of the actuator and then moves
+ * 'Position' towards 0 or 100 percent at the stroke speed. A command
+ * taking effect before the previous one reached its end position reverses
+ * the valve mid-stroke.
+ *
+ * All valves of the server share one hashed timer wheel, advanced by a
+ * single repeated callback every ACTUATOR_TICK_MS. A valve is only on the
+ * wheel while it has a command pending or is moving, and then only once,
+ * at the next time it needs attention: a queued command taking effect, a
+ * position update or the end of the stroke. Idle valves cost nothing.
+ *
+ * Every command is recorded in two histograms below its valve:
+ *
+ *   ApplyLatency      control decision to write, the writer sends the
+ *                     decision time as source timestamp of the value
+ *   ActuationLatency  write to end position reached, commands superseded
+ *                     by the next one before are not recorded
+ */
+#define ACTUATOR_TICK_MS 10
+#define ACTUATOR_WHEEL_SLOTS 256
+#define ACTUATOR_UPDATE_MS 100
+#define ACTUATOR_QUEUE_SIZE 16
+
+struct ActuatorWheel;
+
+typedef struct {
+    UA_Boolean open;
+    UA_DateTime received;       /* monotonic */
+} ValveCommand;
+
+typedef struct ValveActuator {
+    struct ActuatorWheel *wheel;
+    struct ValveActuator *next;
+    struct ValveActuator *prev;
+    UA_UInt64 expiry;           /* tick, valid while scheduled */
+    UA_Boolean scheduled;
+    UA_NodeId positionIdent;
+    ValveCommand queue[ACTUATOR_QUEUE_SIZE];
+    size_t queueHead;
+    size_t queueSize;
+    ValveCommand active;
+    UA_Boolean moving;          /* active command not completed yet */
+    UA_Double position;         /* percent open */
+    UA_DateTime positionTime;   /* monotonic time of the position */
+    UA_Double published;        /* last position written to the node */
+    LatencyHistogram applyLatency;
+    LatencyHistogram actuationLatency;
+} ValveActuator;
+
+typedef struct ActuatorWheel {
+    ValveActuator *slots[ACTUATOR_WHEEL_SLOTS];
+    UA_UInt64 tick;             /* last tick processed */
+    UA_DateTime start;          /* monotonic time of tick 0 */
+    UA_UInt64 callbackId;
+    UA_DateTime strokeTime;     /* full stroke, 0 moves instantly */
+    UA_DateTime deadTime;
+    ValveActuator *actuators;
+    size_t actuatorsSize;
+} ActuatorWheel;
+
+/*
+ * Allocate the actuators of 'size' valves
+ */
+UA_StatusCode initActuatorWheel(ActuatorWheel *wheel, size_t size,
+                                UA_UInt32 strokeTimeMs, UA_UInt32 deadTimeMs);
+
+/*
+ * Attach actuator 'index' to a valve instance: hook the writes to its
+ * 'Open' attribute and add the latency histograms below it
+ */
+UA_StatusCode addValveActuator(UA_Server *server, ActuatorWheel *wheel, size_t index,
+                               const UA_NodeId *valveIdent);
+
+/*
+ * Drive the wheel from the event loop of the running server
+ */
+UA_StatusCode startActuatorWheel(UA_Server *server, ActuatorWheel *wheel);
+
+void stopActuatorWheel(UA_Server *server, ActuatorWheel *wheel);
+
+void clearActuatorWheel(ActuatorWheel *wheel);
+
+#endif
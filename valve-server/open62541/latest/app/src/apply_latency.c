@@ -0,0 +1,89 @@
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/server.h>
+#include "apply_latency.h"
+#include "asynclog.h"
+
+
+typedef struct {
+    char *name;
+    UA_Double percentile;   /* negative for the sample count */
+} LatencyStatistic;
+
+static LatencyStatistic statistics[LATENCY_STATISTICS] = {
+    {"Count", -1.},
+    {"P50", 50.},
+    {"P90", 90.},
+    {"P99", 99.},
+    {"Max", 100.},
+};
+
+
+static UA_StatusCode readLatencyStatistic(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean includeSourceTimeStamp,
+    const UA_NumericRange *range, UA_DataValue *value)
+{
+    const LatencyStatisticNode *node = (const LatencyStatisticNode*)nodeContext;
+    const Histogram *histogram = &node->latency->histogram;
+    const LatencyStatistic *statistic = &statistics[node->statistic];
+    UA_UInt64 result = statistic->percentile < 0.
+        ? histogram->count
+        : getHistogramPercentile(histogram, statistic->percentile);
+
+    UA_StatusCode retval = UA_Variant_setScalarCopy(&value->value, &result, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+
+UA_StatusCode addLatencyHistogram(
+    UA_Server *server,
+    const UA_NodeId *parentIdent,
+    char *name,
+    LatencyHistogram *latency)
+{
+    initHistogram(&latency->histogram);
+
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    UA_NodeId latencyIdent;
+    UA_StatusCode retval = UA_Server_addObjectNode(server, UA_NODEID_NULL, *parentIdent,
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                                   UA_QUALIFIEDNAME(1, name),
+                                                   UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                                   oAttr, NULL, &latencyIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node '%s'. Exiting with code %u",
+                    name, retval);
+        return retval;
+    }
+
+    UA_DataSource dataSource = {readLatencyStatistic, NULL};
+    for(size_t i = 0; i < LATENCY_STATISTICS; i++)
+    {
+        latency->nodes[i].latency = latency;
+        latency->nodes[i].statistic = i;
+        UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+        vAttr.displayName = UA_LOCALIZEDTEXT("en-US", statistics[i].name);
+        vAttr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+        vAttr.valueRank = UA_VALUERANK_SCALAR;
+        vAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        retval = UA_Server_addDataSourceVariableNode(server, UA_NODEID_NULL, latencyIdent,
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                                     UA_QUALIFIEDNAME(1, statistics[i].name),
+                                                     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                                     vAttr, dataSource, &latency->nodes[i], NULL);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                        "Unable to add node '%s'. Exiting with code %u",
+                        statistics[i].name, retval);
+            return retval;
+        }
+    }
+    return retval;
+}
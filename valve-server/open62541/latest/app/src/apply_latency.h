@@ -0,0 +1,36 @@
+#ifndef APPLY_LATENCY_H
+#define APPLY_LATENCY_H
+
+#include <open62541/server.h>
+#include "histogram.h"
+
+/*
+ * Latency histogram exposed below a valve in an object whose variables
+ * (Count, P50, P90, P99, Max in microseconds) are computed when they are
+ * read. The valve actuators record one value per command, see actuator.h.
+ */
+#define LATENCY_STATISTICS 5
+
+struct LatencyHistogram;
+
+typedef struct {
+    const struct LatencyHistogram *latency;
+    size_t statistic;
+} LatencyStatisticNode;
+
+typedef struct LatencyHistogram {
+    Histogram histogram;
+    LatencyStatisticNode nodes[LATENCY_STATISTICS];
+} LatencyHistogram;
+
+/*
+ * Add the object 'name' with the statistics of the histogram below
+ * parentIdent. The histogram has to outlive the server.
+ */
+UA_StatusCode addLatencyHistogram(
+    UA_Server *server,
+    const UA_NodeId *parentIdent,
+    char *name,
+    LatencyHistogram *latency);
+
+#endif
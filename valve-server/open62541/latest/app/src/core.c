@@ -1,9 +1,19 @@
 #include <argp.h>
 #include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
+#include <open62541/server_config_default.h>
 #include <open62541/types.h>
+#include "actuator.h"
+#include "asynclog.h"
+#include "diagnostics.h"
+#include "discovery.h"
+#include "exporter.h"
+#include "netfault.h"
 #include "valve.h"
 #include "utils.h"
 
@@ -26,18 +36,88 @@ const char* argp_program_bug_address = "las3@oth-regensburg.de";
 static char doc[] = "OPC UA server -- simulates a valve actuator";
 static char args_doc[] = "";
 static struct argp_option options[] = {
+    {"metrics",         'm', "[ADDR:]PORT", 0, "Serve Prometheus metrics over HTTP" },
+    {"lds",             'l', "URL",         0, "Register with the local discovery server at URL" },
+    {"application-uri", 'u', "URI",         0, "Application URI [default: urn:sim-images:valve-server:<hostname>]" },
+    {"net-profile",     'n', "PROFILE",     0, "Impair the client connections, e.g. 'wifi' or 'latency=20,jitter=5,bandwidth=512,stall=5000/300'" },
+    {"valves",          'v', "COUNT",       0, "Number of valves, valve1 to valveCOUNT [default: 1]" },
+    {"stroke-time",     't', "MS",          0, "Time of a full stroke of a valve, 0 to move instantly [default: 2000]" },
+    {"dead-time",       'd', "MS",          0, "Delay from a command to the valve starting to move [default: 100]" },
     {0},
 };
 
 struct arguments
 {
+    char *metrics;
+    char *lds;
+    char *applicationUri;
+    char *netprofile;
+    UA_UInt32 valves;
+    UA_UInt32 strokeTime;
+    UA_UInt32 deadTime;
 };
 
+static UA_StatusCode parseUInt32(const char *arg, UA_UInt32 *value)
+{
+    char *end;
+    unsigned long number = strtoul(arg, &end, 10);
+    if(end == arg || *end != '\0' || *arg == '-' || number > UINT32_MAX)
+    {
+        return UA_STATUSCODE_BADSYNTAXERROR;
+    }
+    *value = (UA_UInt32)number;
+    return UA_STATUSCODE_GOOD;
+}
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
 {
     struct arguments *arguments = state->input;
     switch(key)
     {
+        case 'm':
+        {
+            arguments->metrics = arg;
+            break;
+        }
+        case 'l':
+        {
+            arguments->lds = arg;
+            break;
+        }
+        case 'u':
+        {
+            arguments->applicationUri = arg;
+            break;
+        }
+        case 'n':
+        {
+            arguments->netprofile = arg;
+            break;
+        }
+        case 'v':
+        {
+            if(parseUInt32(arg, &arguments->valves) != UA_STATUSCODE_GOOD || arguments->valves == 0)
+            {
+                argp_error(state, "invalid number of valves '%s'", arg);
+            }
+            break;
+        }
+        case 't':
+        {
+            if(parseUInt32(arg, &arguments->strokeTime) != UA_STATUSCODE_GOOD)
+            {
+                argp_error(state, "invalid stroke time '%s'", arg);
+            }
+            break;
+        }
+        case 'd':
+        {
+            if(parseUInt32(arg, &arguments->deadTime) != UA_STATUSCODE_GOOD)
+            {
+                argp_error(state, "invalid dead time '%s'", arg);
+            }
+            break;
+        }
          default: {
             return ARGP_ERR_UNKNOWN;
         }
@@ -48,6 +128,107 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
 
+/*
+ * Create a server, with its connections impaired if a network profile is
+ * given
+ */
+static UA_Server *newServer(const char *netprofile)
+{
+    if(!netprofile)
+    {
+        return UA_Server_new();
+    }
+
+    NetFaultProfile profile;
+    if(parseNetFaultProfile(netprofile, &profile) != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Invalid network profile '%s'", netprofile);
+        return NULL;
+    }
+
+    UA_ServerConfig config;
+    memset(&config, 0, sizeof(UA_ServerConfig));
+    config.eventLoop = newFaultyEventLoop(&profile, asyncLog);
+    if(!config.eventLoop)
+    {
+        return NULL;
+    }
+    UA_ServerConfig_setDefault(&config);
+    return UA_Server_newWithConfig(&config);
+}
+
+
+/*
+ * Add valve instance 'index' with initial values and its actuator
+ */
+static UA_StatusCode addValve(UA_Server *server, ActuatorWheel *wheel, UA_UInt32 index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "valve%u", index + 1);
+    UA_NodeId valveIdent;
+    UA_StatusCode retval = addValveObjectInstance(server, name, &valveIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add valve instance to server");
+        return retval;
+    }
+
+    UA_QualifiedName qn = UA_QUALIFIEDNAME(1, "DeviceID");
+    UA_NodeId deviceIdNode;
+    retval = findAttributeNodeId(server, &valveIdent, &qn, &deviceIdNode);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'DeviceID'");
+        return retval;
+    }
+    char deviceIdText[32];
+    snprintf(deviceIdText, sizeof(deviceIdText), "V%u", index + 1);
+    UA_String deviceId = UA_STRING(deviceIdText);
+    UA_Variant deviceIdValue;
+    UA_Variant_setScalar(&deviceIdValue, &deviceId, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_writeValue(server, deviceIdNode, deviceIdValue);
+
+    qn = UA_QUALIFIEDNAME(1, "Location");
+    UA_NodeId locationNode;
+    retval = findAttributeNodeId(server, &valveIdent, &qn, &locationNode);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'Location'");
+        return retval;
+    }
+    UA_String location = UA_STRING("P01B02R44"); // Plant 01 - Building 02 - Room 44
+    UA_Variant locationValue;
+    UA_Variant_setScalar(&locationValue, &location, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_writeValue(server, locationNode, locationValue);
+
+    qn = UA_QUALIFIEDNAME(1, "Open");
+    UA_NodeId openNode;
+    retval = findAttributeNodeId(server, &valveIdent, &qn, &openNode);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to find attribute 'Open'");
+        return retval;
+    }
+    UA_Boolean open = false;
+    UA_Variant openValue;
+    UA_Variant_setScalar(&openValue, &open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    UA_Server_writeValue(server, openNode, openValue);
+
+    retval = addValveActuator(server, wheel, index, &valveIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add the actuator of valve '%s'", name);
+    }
+    return retval;
+}
+
+
 int main(int argc, char **argv)
 {
     signal(SIGINT, stopHandler);
@@ -57,94 +238,143 @@ int main(int argc, char **argv)
      * Default arguments
      */
     struct arguments arguments = {
+        .metrics = NULL,
+        .lds = NULL,
+        .applicationUri = NULL,
+        .netprofile = NULL,
+        .valves = 1,
+        .strokeTime = 2000,
+        .deadTime = 100,
     };
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+    /*
+     * Write log messages from a background thread
+     */
+    startAsyncLogger();
+
     UA_StatusCode retval = 0;
 
+    /*
+     * All valves are driven by one actuator wheel
+     */
+    ActuatorWheel wheel;
+    retval = initActuatorWheel(&wheel, arguments.valves, arguments.strokeTime, arguments.deadTime);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to allocate the valve actuators");
+        goto cleanup;
+    }
+
     /*
      * Create and setup server
      */
-    UA_Server *server = UA_Server_new();
+    UA_Server *server = newServer(arguments.netprofile);
     if(!server)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to create actuator server");
         retval = UA_STATUSCODE_BAD;
-        goto cleanup;
+        goto cleanup_wheel;
     }
 
     /*
-     * Prepare the tank instance on the server with initial values
+     * Prepare the valve instances on the server with initial values
      */
-    UA_QualifiedName qn;
-    UA_NodeId valve1Ident;
     retval = defineValveObjectType(server);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to define valve object type");
         goto cleanup_server;
     }
-
-    retval = addValveObjectInstance(server, "valve1", &valve1Ident);
-    if(retval != UA_STATUSCODE_GOOD)
+    for(UA_UInt32 i = 0; i < arguments.valves; i++)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to add valve instance to server");
-        goto cleanup_server;
+        retval = addValve(server, &wheel, i);
+        if(retval != UA_STATUSCODE_GOOD)
+        {
+            goto cleanup_server;
+        }
     }
 
-    qn = UA_QUALIFIEDNAME(1, "DeviceID");
-    UA_NodeId deviceIdNode;
-    retval = findAttributeNodeId(server, &valve1Ident, &qn, &deviceIdNode);
+    /*
+     * The application URI identifies the server at the discovery server
+     */
+    retval = setServerApplication(server, arguments.applicationUri, "valve-server", NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to find attribute 'DeviceID'");
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to set the application description");
         goto cleanup_server;
     }
-    UA_String deviceId = UA_STRING("V1");
-    UA_Variant deviceIdValue;
-    UA_Variant_setScalar(&deviceIdValue, &deviceId, &UA_TYPES[UA_TYPES_STRING]);
-    UA_Server_writeValue(server, deviceIdNode, deviceIdValue);
 
-    qn = UA_QUALIFIEDNAME(1, "Location");
-    UA_NodeId locationNode;
-    retval = findAttributeNodeId(server, &valve1Ident, &qn, &locationNode);
+    /*
+     * Publish the runtime metrics
+     */
+    retval = addDiagnostics(server);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to find attribute 'Location'");
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add diagnostics to server");
         goto cleanup_server;
     }
-    UA_String location = UA_STRING("P01B02R44"); // Plant 01 - Building 02 - Room 44
-    UA_Variant locationValue;
-    UA_Variant_setScalar(&locationValue, &location, &UA_TYPES[UA_TYPES_STRING]);
-    UA_Server_writeValue(server, locationNode, locationValue);
 
-    qn = UA_QUALIFIEDNAME(1, "Open");
-    UA_NodeId openNode;
-    retval = findAttributeNodeId(server, &valve1Ident, &qn, &openNode);
-    if(retval != UA_STATUSCODE_GOOD)
+    /*
+     * The metrics endpoint is optional, the server runs without it
+     */
+    MetricsExporter exporter;
+    UA_Boolean exporting = false;
+    if(arguments.metrics)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                    "Unable to find attribute 'Open'");
-        goto cleanup_server;
+        exporting = startMetricsExporter(&exporter, arguments.metrics, "valve_server") == UA_STATUSCODE_GOOD;
     }
-    UA_Boolean open = false;
-    UA_Variant openValue;
-    UA_Variant_setScalar(&openValue, &open, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    UA_Server_writeValue(server, openNode, openValue);
 
     /*
      * Start event loop unless Ctrl-C has already been received
      */
-    if(!running) goto cleanup_server;
-    retval = UA_Server_run(server, &running);
+    if(running)
+    {
+        retval = UA_Server_run_startup(server);
+    }
+    if(running && retval == UA_STATUSCODE_GOOD)
+    {
+        startActuatorWheel(server, &wheel);
+
+        /*
+         * Registration with the discovery server is optional, a failed
+         * request is retried by the event loop
+         */
+        DiscoveryRegistration registration;
+        if(arguments.lds)
+        {
+            startDiscoveryRegistration(server, &registration, arguments.lds);
+        }
+
+        while(running)
+        {
+            iterateServerWithMetrics(server);
+        }
+
+        if(arguments.lds)
+        {
+            stopDiscoveryRegistration(server, &registration);
+            flushDiscoveryRequests(server);
+        }
+        stopActuatorWheel(server, &wheel);
+        retval = UA_Server_run_shutdown(server);
+    }
+
+    if(exporting)
+    {
+        stopMetricsExporter(&exporter);
+    }
 
 cleanup_server:
     UA_Server_delete(server);
+cleanup_wheel:
+    clearActuatorWheel(&wheel);
 cleanup:
+    stopAsyncLogger();
     return retval = UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "histogram.h"
+
+
+static size_t getBucketIndex(UA_UInt64 value)
+{
+    if(value < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    /*
+     * The shift keeps the four bits below the most significant one
+     */
+    size_t shift = (size_t)(63 - __builtin_clzll(value)) - 4;
+    size_t index = shift * HISTOGRAM_SUB_BUCKETS + (size_t)(value >> shift);
+    return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+
+static UA_UInt64 getBucketUpperBound(size_t index)
+{
+    if(index < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    size_t shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    UA_UInt64 lower = (UA_UInt64)(index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + ((UA_UInt64)1 << shift) - 1;
+}
+
+
+void initHistogram(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(Histogram));
+}
+
+
+void recordHistogramValue(Histogram *histogram, UA_Int64 value)
+{
+    UA_UInt64 v = value > 0 ? (UA_UInt64)value : 0;
+    histogram->buckets[getBucketIndex(v)]++;
+    histogram->count++;
+    histogram->sum += v;
+    if(v > histogram->max)
+    {
+        histogram->max = v;
+    }
+}
+
+
+UA_UInt64 getHistogramPercentile(const Histogram *histogram, UA_Double percentile)
+{
+    if(histogram->count == 0)
+    {
+        return 0;
+    }
+
+    UA_UInt64 target = (UA_UInt64)(percentile / 100. * (UA_Double)histogram->count + .5);
+    if(target < 1)
+    {
+        target = 1;
+    }
+
+    UA_UInt64 seen = 0;
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if(seen >= target)
+        {
+            UA_UInt64 bound = getBucketUpperBound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+
+void printHistogram(const Histogram *histogram, const char *name, FILE *fp)
+{
+    fprintf(fp, "%-20s count=%llu mean=%.1fus p50=%lluus p90=%lluus p99=%lluus p99.9=%lluus max=%lluus\n",
+            name,
+            (unsigned long long)histogram->count,
+            histogram->count ? (UA_Double)histogram->sum / (UA_Double)histogram->count : 0.,
+            (unsigned long long)getHistogramPercentile(histogram, 50.),
+            (unsigned long long)getHistogramPercentile(histogram, 90.),
+            (unsigned long long)getHistogramPercentile(histogram, 99.),
+            (unsigned long long)getHistogramPercentile(histogram, 99.9),
+            (unsigned long long)histogram->max);
+}
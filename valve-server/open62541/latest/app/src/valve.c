@@ -3,6 +3,7 @@
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
 #include <open62541/types.h>
+#include "asynclog.h"
 #include "valve.h"
 
 
@@ -25,7 +26,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                          UA_QUALIFIEDNAME(1, "EquipmentType"), eqAttr, NULL, &equipmentTypeIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'EquipmentType'. Exiting with code %u",
                     retval);
         return retval;
@@ -46,7 +47,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                        idAttr, NULL, &deviceIdIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'DeviceID'. Exiting with code %u",
                     retval);
         return retval;
@@ -56,7 +57,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'DeviceID'. Exiting with code %u",
                     retval);
         return retval;
@@ -74,7 +75,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                        locAttr, NULL, &locIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'Location'. Exiting with code %u",
                     retval);
         return retval;
@@ -84,7 +85,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'Location'. Exiting with code %u",
                     retval);
         return retval;
@@ -100,7 +101,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                          UA_QUALIFIEDNAME(1, "valveType"), vAttr, NULL, NULL);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'valveType'. Exiting with code %u",
                     retval);
         return retval;
@@ -122,7 +123,7 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                        openAttr, NULL, &openIdent);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add node 'Open'. Exiting with code %u",
                     retval);
         return retval;
@@ -132,11 +133,46 @@ UA_StatusCode defineValveObjectType(UA_Server *server)
                                     UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
     if(retval != UA_STATUSCODE_GOOD)
     {
-        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
                     "Unable to add reference 'Open'. Exiting with code %u",
                     retval);
         return retval;
     }
+
+    /*
+     * Stroke position in percent, 'Open' is the command and the position
+     * follows it at the travel speed of the valve
+     */
+    UA_VariableAttributes posAttr = UA_VariableAttributes_default;
+    posAttr.displayName = UA_LOCALIZEDTEXT("en-US", "Position");
+    posAttr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+    posAttr.valueRank = UA_VALUERANK_SCALAR;
+    posAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_Double closed = 0.;
+    UA_Variant_setScalar(&posAttr.value, &closed, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_NodeId posIdent;
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, valveTypeIdent,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                       UA_QUALIFIEDNAME(1, "Position"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       posAttr, NULL, &posIdent);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add node 'Position'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
+    retval = UA_Server_addReference(server, posIdent,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASMODELLINGRULE),
+                                    UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
+    if(retval != UA_STATUSCODE_GOOD)
+    {
+        UA_LOG_INFO(asyncLog, UA_LOGCATEGORY_USERLAND,
+                    "Unable to add reference 'Position'. Exiting with code %u",
+                    retval);
+        return retval;
+    }
     return retval;
 }
 
@@ -3,6 +3,49 @@
 # treat undefined variables as an error
 set -u
 
+# if METRICS_ADDRESS is set, serve Prometheus metrics on [ADDR:]PORT
+metrics_opt=""
+if [ -n "${METRICS_ADDRESS:-}" ]; then
+  metrics_opt="--metrics=${METRICS_ADDRESS}"
+fi
+
+# if LDS_URL is set, register with the local discovery server at that URL
+lds_opt=""
+if [ -n "${LDS_URL:-}" ]; then
+  lds_opt="--lds=${LDS_URL}"
+fi
+
+# if APPLICATION_URI is set, it replaces the default application URI
+uri_opt=""
+if [ -n "${APPLICATION_URI:-}" ]; then
+  uri_opt="--application-uri=${APPLICATION_URI}"
+fi
+
+# if NET_PROFILE is set, impair the connections of the clients, e.g. for
+# testing the control loop over a wifi or congested link
+net_profile_opt=""
+if [ -n "${NET_PROFILE:-}" ]; then
+  net_profile_opt="--net-profile=${NET_PROFILE}"
+fi
+
+# if VALVES is set, simulate that many valves, valve1 to valve<VALVES>
+valves_opt=""
+if [ -n "${VALVES:-}" ]; then
+  valves_opt="--valves=${VALVES}"
+fi
+
+# STROKE_TIME_MS and DEAD_TIME_MS replace the default travel model of the
+# valves, a stroke time of 0 switches them instantly
+stroke_opt=""
+if [ -n "${STROKE_TIME_MS:-}" ]; then
+  stroke_opt="--stroke-time=${STROKE_TIME_MS}"
+fi
+dead_opt=""
+if [ -n "${DEAD_TIME_MS:-}" ]; then
+  dead_opt="--dead-time=${DEAD_TIME_MS}"
+fi
+
 # if no ENV is set, the binary is started with defaults
-/usr/local/bin/valve-server
+/usr/local/bin/valve-server $metrics_opt $lds_opt $uri_opt $net_profile_opt \
+  $valves_opt $stroke_opt $dead_opt
 